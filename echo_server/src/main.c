@@ -8,23 +8,111 @@
 #include <zephyr/devicetree.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/gpio.h>
+#if CONFIG_WIFICONNECT
 #include "WifiConnect.h"
+#endif
 #include "EchoServer.h"
+#if CONFIG_NVPARMS
 #include "NvParms.h"
+#endif
+#if CONFIG_APP_ECHO_REACTOR
+#include "EchoReactor.h"
+#endif
+#include "BootSeq.h"
 
 /** @brief Initialize the logging module. */
 LOG_MODULE_REGISTER(app, LOG_LEVEL_DBG);
 
+#define STATS_PERIOD_MS     10000
 
+#if CONFIG_APP_ECHO_REACTOR
+K_THREAD_STACK_DEFINE(reactor_stack, CONFIG_APP_ECHO_REACTOR_STACK_SIZE);
+static EchoReactor reactor;
+
+static void
+log_reactor_stats(void)
+{
+    static EchoReactor_Stats last;
+    EchoReactor_Stats st;
+    uint32_t udp_msgs, udp_wakeups;
+
+    EchoReactor_getStats(&reactor, &st);
+    LOG_INF("rx %u tx %u bytes, tcp %u udp %u msgs, clients %u (peak %u)",
+        st.rx_bytes, st.tx_bytes, st.tcp_msgs, st.udp_msgs,
+        st.clients, st.peak_clients);
+    LOG_INF("pool stalls %u, send stalls %u, peak bufs %u, udp dropped %u",
+        st.pool_stalls, st.send_stalls, st.peak_bufs, st.udp_dropped);
+
+    udp_msgs = st.udp_msgs - last.udp_msgs;
+    udp_wakeups = st.udp_wakeups - last.udp_wakeups;
+    if (udp_wakeups > 0)
+    {
+        LOG_INF("udp %u pkt/s, %u.%02u pkts per wakeup",
+            udp_msgs * 1000 / STATS_PERIOD_MS,
+            udp_msgs / udp_wakeups,
+            (udp_msgs % udp_wakeups) * 100 / udp_wakeups);
+    }
+    last = st;
+}
+#else
 static EchoServer echo;
+#endif
+
+/** @brief Start-up phases. The server starts as soon as the network is up,
+    while main() goes on to its stats loop. */
+enum
+{
+    PH_NVPARMS = 0,
+    PH_WIFI,
+    PH_L4_CONNECTED,
+    PH_SERVER,
+    PH_FIRST_REQUEST,
+    PH_REPORT,
+    NUM_PHASES
+};
+
+static int init_nvparms(void *arg);
+static int init_wifi(void *arg);
+static int start_server(void *arg);
+static int boot_report(void *arg);
+
+static BootSeq boot;
+static BootSeq_Phase phases[NUM_PHASES] = {
+    [PH_NVPARMS] = { .name = "nvparms", .fn = init_nvparms },
+    [PH_WIFI] = { .name = "wifi", .fn = init_wifi, .deps = BIT(PH_NVPARMS) },
+    [PH_L4_CONNECTED] = { .name = "l4_connected" },
+    [PH_SERVER] = { .name = "server", .fn = start_server, .deps = BIT(PH_L4_CONNECTED) },
+    [PH_FIRST_REQUEST] = { .name = "first_request" },
+    [PH_REPORT] = { .name = "report", .fn = boot_report, .deps = BIT(PH_FIRST_REQUEST) },
+};
+
+static int
+init_nvparms(void *arg)
+{
+    int ret = 0;
+
+    ARG_UNUSED(arg);
+
+#if CONFIG_NVPARMS
+    ret = NvParms_init();
+    if (ret < 0)
+    {
+        LOG_ERR("NvParms module init error : %d", ret);
+    }
+#endif
+    return ret;
+}
 
 static int
-init_wifi(void)
+init_wifi(void *arg)
 {
+#if CONFIG_WIFICONNECT
     char ssid[32];
     char pass[32];
     int ret, pass_len;
 
+    ARG_UNUSED(arg);
+
     ret = NvParms_load("ssid", NVPARMS_TYPE_STRING, ssid, sizeof(ssid));
     if (ret <= 0)
     {
@@ -44,24 +132,41 @@ init_wifi(void)
 
     WifiConnect_init();
     WifiConnect_connect(ssid, pass);
+#else
+    ARG_UNUSED(arg);
+#endif
     return 0;
 }
 
-int main(void)
+#if CONFIG_APP_ECHO_REACTOR
+/** @brief The reactor echoed its first request. */
+static void
+first_request(void *arg)
 {
-    int ret;
+    ARG_UNUSED(arg);
 
-    LOG_INF("TCP Echo app.");
+    BootSeq_complete(&boot, PH_FIRST_REQUEST, 0);
+}
+#endif
 
-    ret = NvParms_init();
-    if (ret < 0)
-    {
-        LOG_ERR("NvParms module init error : %d", ret);
-        return 0;
-    }
+static int
+start_server(void *arg)
+{
+    int ret;
 
-    init_wifi();
+    ARG_UNUSED(arg);
 
+#if CONFIG_APP_ECHO_REACTOR
+    EchoReactor_onFirstRequest(&reactor, first_request, NULL);
+    ret = EchoReactor_init(
+        &reactor,
+        12001,
+        reactor_stack,
+        K_THREAD_STACK_SIZEOF(reactor_stack),
+        "Echo Reactor",
+        20);
+    if (ret < 0) LOG_ERR("Error initializing Echo reactor: %d",  ret);
+#else
     ret = EchoServer_init(
         &echo,
         12001,
@@ -71,10 +176,47 @@ int main(void)
         "Echo Server",
         20);
     if (ret < 0) LOG_ERR("Error initializing Echo server: %d",  ret);
+#endif
+    return ret;
+}
+
+/** @brief Log the start-up timeline once the first request has been served. */
+static int
+boot_report(void *arg)
+{
+    ARG_UNUSED(arg);
+
+    BootSeq_log(&boot);
+    return 0;
+}
+
+int main(void)
+{
+    int ret;
+
+    LOG_INF("TCP Echo app.");
+
+    ret = BootSeq_init(&boot, phases, NUM_PHASES);
+    if (ret < 0)
+    {
+        return 0;
+    }
+    BootSeq_watchL4(&boot, PH_L4_CONNECTED);
+#if !CONFIG_APP_ECHO_REACTOR
+    /* EchoServer has no hook for its first request; a ping stands in. */
+    BootSeq_watchPing(&boot, PH_FIRST_REQUEST);
+#endif
+    BootSeq_start(&boot);
 
     while (1)
     {
-        k_msleep(1000);
+        k_msleep(STATS_PERIOD_MS);
+#if CONFIG_APP_ECHO_REACTOR
+        if (BootSeq_wait(&boot, PH_SERVER, K_NO_WAIT) == 0)
+        {
+            log_reactor_stats();
+        }
+#endif
     }
 
     return 0;
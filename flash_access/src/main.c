@@ -12,18 +12,30 @@
 #include <zephyr/storage/flash_map.h>
 
 #include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
 
+#if defined(CONFIG_SOC_FAMILY_ESPRESSIF_ESP32)
 #include <spi_flash_mmap.h>
 #include <soc.h>
+#endif
 #include <errno.h>
+#include <string.h>
 
 #include "SwTimer.h"
+#if CONFIG_APP_FLASHWRITER_DEMO
+#include "FlashWriter.h"
+#endif
+#if CONFIG_SETTINGSPROF
+#include "SettingsProf.h"
+#endif
 
 /** @brief Initialize the logging module. */
 LOG_MODULE_REGISTER(app, CONFIG_LOG_DEFAULT_LEVEL);
 
 /* The devicetree node identifier for the "led0" alias. */
 #define LED0_NODE DT_ALIAS(led0)
+
+#if DT_NODE_EXISTS(LED0_NODE)
 static const struct gpio_dt_spec led = GPIO_DT_SPEC_GET(LED0_NODE, gpios);
 
 /** @brief Demonstration thread for blinking LED. */
@@ -58,9 +70,151 @@ static void led_flash(void *arg0, void *arg1, void *arg2)
 }
 
 K_THREAD_DEFINE(led_thread, 1024, led_flash, NULL, NULL, NULL, 10, 0, 0);
+#endif
 
 #define FLASH_PARTITION scratch_partition
 
+#if CONFIG_APP_FLASHWRITER_DEMO
+K_THREAD_STACK_DEFINE(fw_stack, CONFIG_FLASHWRITER_STACK_SIZE);
+static FlashWriter fw;
+
+/** @brief Deterministic test pattern so the image CRC can be computed up
+    front, as a sender would. */
+static void
+fill_pattern(uint32_t *state, uint8_t *buf, uint32_t len)
+{
+    uint32_t x = *state;
+    uint32_t k;
+
+    for (k = 0; k < len; k++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[k] = (uint8_t)x;
+    }
+
+    *state = x;
+}
+
+static uint32_t
+kbps(uint32_t bytes, uint32_t us)
+{
+    return (us > 0) ? (uint32_t)(((uint64_t)bytes * 1000000 / 1024) / us) : 0;
+}
+
+/** @brief Baseline: erase, program and read back one sector at a time. */
+static int
+serial_write(const struct flash_area *fa, uint32_t total, uint32_t sector)
+{
+    static uint8_t sbuf[CONFIG_APP_FLASHWRITER_CHUNK_SIZE];
+    uint32_t state = 0x12345678;
+    uint32_t off, k;
+    int rc;
+
+    for (off = 0; off < total; off += sector)
+    {
+        rc = flash_area_erase(fa, off, sector);
+        if (rc < 0)
+        {
+            return rc;
+        }
+
+        for (k = 0; k < sector; k += sizeof(sbuf))
+        {
+            uint8_t rbuf[32];
+            uint32_t j;
+
+            fill_pattern(&state, sbuf, sizeof(sbuf));
+            rc = flash_area_write(fa, off + k, sbuf, sizeof(sbuf));
+            if (rc < 0)
+            {
+                return rc;
+            }
+
+            for (j = 0; j < sizeof(sbuf); j += sizeof(rbuf))
+            {
+                rc = flash_area_read(fa, off + k + j, rbuf, sizeof(rbuf));
+                if (rc < 0 || memcmp(rbuf, &sbuf[j], sizeof(rbuf)) != 0)
+                {
+                    return -EIO;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/** @brief Stream a test image into the scratch partition in transport sized
+    chunks and compare against the serial erase/program/read-back loop. */
+static void
+flashwriter_demo(void)
+{
+    static uint8_t chunk[CONFIG_APP_FLASHWRITER_CHUNK_SIZE];
+    const FlashWriter_Stats *st;
+    uint32_t total, state, expected, crc, t0, us;
+    uint32_t k;
+    int rc;
+
+    rc = FlashWriter_init(
+        &fw,
+        FIXED_PARTITION_ID(FLASH_PARTITION),
+        fw_stack,
+        K_THREAD_STACK_SIZEOF(fw_stack));
+    if (rc < 0)
+    {
+        LOG_ERR("FlashWriter init error: %d", rc);
+        return;
+    }
+
+    /* Whole sectors of whole chunks, so both paths write the same image. */
+    total = ROUND_DOWN(FIXED_PARTITION_SIZE(FLASH_PARTITION),
+        MAX(fw.sector_size, sizeof(chunk)));
+
+    t0 = k_cycle_get_32();
+    rc = serial_write(fw.fa, total, fw.sector_size);
+    us = k_cyc_to_us_floor32(k_cycle_get_32() - t0);
+    if (rc < 0)
+    {
+        LOG_ERR("Serial write error: %d", rc);
+        return;
+    }
+    LOG_INF("serial     : %u bytes in %u us (%u KiB/s)", total, us, kbps(total, us));
+
+    /* The sender knows the image CRC before sending it. */
+    state = 0x12345678;
+    expected = 0;
+    for (k = 0; k < total; k += sizeof(chunk))
+    {
+        fill_pattern(&state, chunk, sizeof(chunk));
+        expected = crc32_ieee_update(expected, chunk, sizeof(chunk));
+    }
+
+    FlashWriter_open(&fw, total);
+    state = 0x12345678;
+    for (k = 0; k < total; k += sizeof(chunk))
+    {
+        fill_pattern(&state, chunk, sizeof(chunk));
+        rc = FlashWriter_write(&fw, chunk, sizeof(chunk));
+        if (rc < 0)
+        {
+            LOG_ERR("FlashWriter_write error: %d", rc);
+            FlashWriter_abort(&fw);
+            return;
+        }
+    }
+
+    rc = FlashWriter_finish(&fw, &expected, &crc);
+    st = FlashWriter_getStats(&fw);
+    LOG_INF("flashwriter: %u bytes in %u us (%u KiB/s) crc=0x%08x rc=%d",
+        st->bytes, st->elapsed_us, kbps(st->bytes, st->elapsed_us), crc, rc);
+    LOG_INF("  erase %u us, program %u us, caller stalled %u us, %u sectors",
+        st->erase_us, st->program_us, st->stall_us, st->sectors_erased);
+    LOG_INF("  raw program bandwidth: %u KiB/s", kbps(st->bytes, st->program_us));
+}
+#endif
+
 static void timer_cb(struct k_timer *t)
 {
     static unsigned int count = 0;
@@ -75,10 +229,7 @@ static SwTimer swt = {
 
 int main(void)
 {
-    uint8_t buffer[32];
     const struct device *flash_device;
-    const void *mem_ptr;
-    spi_flash_mmap_handle_t handle;
     off_t address = FIXED_PARTITION_OFFSET(FLASH_PARTITION);
     size_t size = FIXED_PARTITION_SIZE(FLASH_PARTITION);
     int rc;
@@ -95,19 +246,35 @@ int main(void)
     printf("address = 0x%08x\n", address);
     printf("size = 0x%08x\n", size);
 
-#if 1
+#if defined(CONFIG_SOC_FAMILY_ESPRESSIF_ESP32)
+    const void *mem_ptr;
+    spi_flash_mmap_handle_t handle;
+
     /* map selected region */
     spi_flash_mmap(address, size, SPI_FLASH_MMAP_DATA, &mem_ptr, &handle);
     LOG_INF("memory-mapped pointer address: %p", mem_ptr);
     LOG_HEXDUMP_INF(mem_ptr, 32, "flash read using memory-mapped pointer");
 #endif
 
+#if CONFIG_APP_FLASHWRITER_DEMO
+    flashwriter_demo();
+#endif
+
     rc = settings_subsys_init();
     if (rc)
     {
         LOG_ERR("Settings error : %d", rc);
     }
 
+#if CONFIG_SETTINGSPROF
+    static SettingsProf_Report rpt;
+
+    if (SettingsProf_run(&rpt) == 0)
+    {
+        SettingsProf_log(&rpt);
+    }
+#endif
+
     SwTimer_create(&swt);
     SwTimer_start_ms(&swt, 5000);
 
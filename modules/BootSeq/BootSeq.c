@@ -0,0 +1,458 @@
+/*******************************************************************************
+ *  @file: BootSeq.c
+ *
+ *  @brief: Start-up orchestrator with per-phase timestamps.
+*******************************************************************************/
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include "BootSeq.h"
+
+#if CONFIG_NET_CONNECTION_MANAGER
+#include <zephyr/net/net_event.h>
+#include <zephyr/net/conn_mgr_monitor.h>
+#endif
+
+#if CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(BootSeq, CONFIG_BOOTSEQ_LOG_LEVEL);
+
+K_THREAD_STACK_ARRAY_DEFINE(worker_stacks, CONFIG_BOOTSEQ_WORKERS, CONFIG_BOOTSEQ_STACK_SIZE);
+static struct k_thread workers[CONFIG_BOOTSEQ_WORKERS];
+
+/** @brief The running sequence, for the shell. */
+static BootSeq *active;
+
+static const char *const state_names[] = {
+    [BOOTSEQ_PENDING] = "pending",
+    [BOOTSEQ_RUNNING] = "running",
+    [BOOTSEQ_DONE] = "done",
+    [BOOTSEQ_FAILED] = "failed",
+    [BOOTSEQ_SKIPPED] = "skipped",
+};
+
+#define TIMELINE_HDR    "phase               state   ready ms     end ms    took ms"
+#define TIMELINE_LINE   80
+
+static int64_t
+now_us(void)
+{
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+/** @brief One timeline row, aligned with TIMELINE_HDR. Used by both the log
+    and the shell command. */
+static void
+format_phase(const BootSeq_Phase *ph, char *buf, size_t size)
+{
+    int64_t took = (ph->end_us && ph->ready_us) ? ph->end_us - ph->ready_us : 0;
+
+    snprintk(buf, size, "%-16s %8s %6u.%03u %6u.%03u %6u.%03u",
+        ph->name, state_names[ph->state],
+        (uint32_t)(ph->ready_us / 1000), (uint32_t)(ph->ready_us % 1000),
+        (uint32_t)(ph->end_us / 1000), (uint32_t)(ph->end_us % 1000),
+        (uint32_t)(took / 1000), (uint32_t)(took % 1000));
+}
+
+/** @brief Mark runnable phases and skip those behind a failure. Called with
+    the lock held after any phase finishes. */
+static void
+update_locked(BootSeq *seq)
+{
+    bool changed = true;
+    int k;
+
+    while (changed)
+    {
+        changed = false;
+        for (k = 0; k < seq->num_phases; k++)
+        {
+            BootSeq_Phase *ph = &seq->phases[k];
+
+            if (ph->state != BOOTSEQ_PENDING)
+            {
+                continue;
+            }
+
+            if ((ph->deps & seq->finished & ~seq->done) != 0 && ph->fn)
+            {
+                ph->state = BOOTSEQ_SKIPPED;
+                ph->ret = -ECANCELED;
+                ph->end_us = now_us();
+                seq->finished |= BIT(k);
+                changed = true;
+                LOG_WRN("%s skipped.", ph->name);
+            }
+            else if (ph->ready_us == 0 && (ph->deps & ~seq->done) == 0)
+            {
+                ph->ready_us = now_us();
+            }
+        }
+    }
+
+    k_condvar_broadcast(&seq->cond);
+}
+
+static void
+finish_locked(BootSeq *seq, int id, int ret)
+{
+    BootSeq_Phase *ph = &seq->phases[id];
+
+    ph->ret = ret;
+    ph->end_us = now_us();
+    ph->state = (ret < 0) ? BOOTSEQ_FAILED : BOOTSEQ_DONE;
+    seq->finished |= BIT(id);
+    if (ret >= 0)
+    {
+        seq->done |= BIT(id);
+    }
+
+    LOG_INF("%s %s at %u ms (%d).", ph->name, state_names[ph->state],
+        (uint32_t)(ph->end_us / 1000), ret);
+
+    update_locked(seq);
+}
+
+/** @brief Next runnable function phase, or -1. Sets *more if function
+    phases remain that are not runnable yet. */
+static int
+next_locked(BootSeq *seq, bool *more)
+{
+    int k;
+
+    *more = false;
+    for (k = 0; k < seq->num_phases; k++)
+    {
+        BootSeq_Phase *ph = &seq->phases[k];
+
+        if (!ph->fn || ph->state != BOOTSEQ_PENDING)
+        {
+            continue;
+        }
+        if ((ph->deps & ~seq->done) == 0)
+        {
+            return k;
+        }
+        *more = true;
+    }
+
+    return -1;
+}
+
+static void
+worker_fn(void *p1, void *p2, void *p3)
+{
+    BootSeq *seq = (BootSeq *)p1;
+
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    k_mutex_lock(&seq->lock, K_FOREVER);
+
+    while (1)
+    {
+        BootSeq_Phase *ph;
+        bool more;
+        int id;
+        int ret;
+
+        id = next_locked(seq, &more);
+        if (id < 0)
+        {
+            if (!more)
+            {
+                break;
+            }
+            /* Wait for a dependency (possibly an event) to finish. */
+            k_condvar_wait(&seq->cond, &seq->lock, K_FOREVER);
+            continue;
+        }
+
+        ph = &seq->phases[id];
+        ph->state = BOOTSEQ_RUNNING;
+        k_mutex_unlock(&seq->lock);
+
+        LOG_DBG("%s started on %s.", ph->name, k_thread_name_get(k_current_get()));
+        ret = ph->fn(ph->arg);
+
+        k_mutex_lock(&seq->lock, K_FOREVER);
+        finish_locked(seq, id, ret);
+    }
+
+    k_mutex_unlock(&seq->lock);
+}
+
+/** @brief Set up a sequence over a phase table (up to BOOTSEQ_MAX_PHASES).
+    Dependencies must point to phases in the table. */
+int
+BootSeq_init(BootSeq *seq, BootSeq_Phase *phases, int num_phases)
+{
+    int k;
+
+    if (num_phases <= 0 || num_phases > BOOTSEQ_MAX_PHASES)
+    {
+        LOG_ERR("Bad number of phases: %d", num_phases);
+        return -EINVAL;
+    }
+
+    for (k = 0; k < num_phases; k++)
+    {
+        if ((phases[k].deps & ~BIT_MASK(num_phases)) != 0 || (phases[k].deps & BIT(k)) != 0)
+        {
+            LOG_ERR("Bad dependencies for %s: 0x%08x", phases[k].name, phases[k].deps);
+            return -EINVAL;
+        }
+        phases[k].state = BOOTSEQ_PENDING;
+        phases[k].ret = 0;
+        phases[k].ready_us = 0;
+        phases[k].end_us = 0;
+    }
+
+    seq->phases = phases;
+    seq->num_phases = num_phases;
+    seq->finished = 0;
+    seq->done = 0;
+    k_mutex_init(&seq->lock);
+    k_condvar_init(&seq->cond);
+#if CONFIG_NET_MGMT_EVENT
+    seq->l4_phase = -1;
+#endif
+#if CONFIG_NET_IPV4
+    seq->ping_phase = -1;
+    atomic_set(&seq->ping_seen, 0);
+#endif
+
+    return 0;
+}
+
+/** @brief Start the worker threads. Returns immediately. Only one sequence
+    can run at a time. */
+int
+BootSeq_start(BootSeq *seq)
+{
+    int k;
+
+    if (active)
+    {
+        LOG_ERR("A sequence is already running.");
+        return -EBUSY;
+    }
+    active = seq;
+
+    k_mutex_lock(&seq->lock, K_FOREVER);
+    seq->start_us = now_us();
+    update_locked(seq);
+    k_mutex_unlock(&seq->lock);
+
+    LOG_INF("Start-up sequence: %u phases, %u workers, at %u ms.",
+        seq->num_phases, CONFIG_BOOTSEQ_WORKERS, (uint32_t)(seq->start_us / 1000));
+
+    for (k = 0; k < CONFIG_BOOTSEQ_WORKERS; k++)
+    {
+        char name[16];
+
+        k_thread_create(
+            &workers[k],
+            worker_stacks[k],
+            K_THREAD_STACK_SIZEOF(worker_stacks[k]),
+            worker_fn,
+            seq, NULL, NULL,
+            CONFIG_BOOTSEQ_THREAD_PRIO,
+            0,
+            K_NO_WAIT);
+        snprintk(name, sizeof(name), "bootseq%d", k);
+        k_thread_name_set(&workers[k], name);
+    }
+
+    return 0;
+}
+
+/** @brief Complete an event phase (ret < 0 fails it). Callable from any
+    thread. */
+void
+BootSeq_complete(BootSeq *seq, int id, int ret)
+{
+    BootSeq_Phase *ph;
+
+    if (id < 0 || id >= seq->num_phases)
+    {
+        return;
+    }
+
+    ph = &seq->phases[id];
+
+    k_mutex_lock(&seq->lock, K_FOREVER);
+    if (ph->fn == NULL && ph->state == BOOTSEQ_PENDING)
+    {
+        if (ph->ready_us == 0)
+        {
+            ph->ready_us = seq->start_us;
+        }
+        finish_locked(seq, id, ret);
+    }
+    k_mutex_unlock(&seq->lock);
+}
+
+/** @brief Wait for a phase to finish. Returns its result, -ECANCELED if it
+    was skipped, or -EAGAIN on timeout. */
+int
+BootSeq_wait(BootSeq *seq, int id, k_timeout_t timeout)
+{
+    k_timepoint_t end = sys_timepoint_calc(timeout);
+    int ret = -EAGAIN;
+
+    if (id < 0 || id >= seq->num_phases)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&seq->lock, K_FOREVER);
+    while (!(seq->finished & BIT(id)))
+    {
+        if (k_condvar_wait(&seq->cond, &seq->lock, sys_timepoint_timeout(end)) < 0)
+        {
+            break;
+        }
+    }
+    if (seq->finished & BIT(id))
+    {
+        ret = seq->phases[id].ret;
+    }
+    k_mutex_unlock(&seq->lock);
+
+    return ret;
+}
+
+#if CONFIG_NET_CONNECTION_MANAGER
+static void
+l4_handler(struct net_mgmt_event_callback *cb, uint32_t mgmt_event, struct net_if *iface)
+{
+    BootSeq *seq = CONTAINER_OF(cb, BootSeq, l4_cb);
+
+    ARG_UNUSED(iface);
+
+    if (mgmt_event == NET_EVENT_L4_CONNECTED)
+    {
+        BootSeq_complete(seq, seq->l4_phase, 0);
+    }
+}
+
+/** @brief Complete event phase id on the first NET_EVENT_L4_CONNECTED
+    (including one that has already happened). */
+int
+BootSeq_watchL4(BootSeq *seq, int id)
+{
+    if (id < 0 || id >= seq->num_phases || seq->phases[id].fn)
+    {
+        return -EINVAL;
+    }
+
+    seq->l4_phase = id;
+    net_mgmt_init_event_callback(&seq->l4_cb, l4_handler, NET_EVENT_L4_CONNECTED);
+    net_mgmt_add_event_callback(&seq->l4_cb);
+    conn_mgr_mon_resend_status();
+
+    return 0;
+}
+#endif
+
+#if CONFIG_NET_IPV4
+static int
+ping_handler(struct net_icmp_ctx *ctx, struct net_pkt *pkt,
+    struct net_icmp_ip_hdr *ip_hdr, struct net_icmp_hdr *icmp_hdr, void *user_data)
+{
+    BootSeq *seq = CONTAINER_OF(ctx, BootSeq, icmp);
+
+    ARG_UNUSED(user_data);
+    ARG_UNUSED(pkt);
+    ARG_UNUSED(ip_hdr);
+    ARG_UNUSED(icmp_hdr);
+
+    /* Stays registered for good, so every later echo request only costs
+       this check. The stack's own handler sends the reply. */
+    if (atomic_cas(&seq->ping_seen, 0, 1))
+    {
+        BootSeq_complete(seq, seq->ping_phase, 0);
+    }
+    return 0;
+}
+
+/** @brief Complete event phase id on the first ICMPv4 echo request
+    received (a ping is the first request an app without other services
+    serves). */
+int
+BootSeq_watchPing(BootSeq *seq, int id)
+{
+    int ret;
+
+    if (id < 0 || id >= seq->num_phases || seq->phases[id].fn)
+    {
+        return -EINVAL;
+    }
+
+    seq->ping_phase = id;
+    ret = net_icmp_init_ctx(&seq->icmp, NET_ICMPV4_ECHO_REQUEST, 0, ping_handler);
+    if (ret < 0)
+    {
+        LOG_ERR("Unable to watch ICMP echo requests: %d", ret);
+        return ret;
+    }
+
+    return 0;
+}
+#endif
+
+/** @brief Log the timeline of every phase. */
+void
+BootSeq_log(BootSeq *seq)
+{
+    int k;
+
+    k_mutex_lock(&seq->lock, K_FOREVER);
+    LOG_INF(TIMELINE_HDR);
+    for (k = 0; k < seq->num_phases; k++)
+    {
+        char line[TIMELINE_LINE];
+
+        format_phase(&seq->phases[k], line, sizeof(line));
+        LOG_INF("%s", line);
+    }
+    k_mutex_unlock(&seq->lock);
+}
+
+#if CONFIG_SHELL
+static int
+cmd_bootseq(const struct shell *sh, size_t argc, char **argv)
+{
+    BootSeq *seq = active;
+    int k;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    if (!seq)
+    {
+        shell_print(sh, "No start-up sequence.");
+        return 0;
+    }
+
+    k_mutex_lock(&seq->lock, K_FOREVER);
+    shell_print(sh, "started at %u.%03u ms", (uint32_t)(seq->start_us / 1000),
+        (uint32_t)(seq->start_us % 1000));
+    shell_print(sh, TIMELINE_HDR);
+    for (k = 0; k < seq->num_phases; k++)
+    {
+        char line[TIMELINE_LINE];
+
+        format_phase(&seq->phases[k], line, sizeof(line));
+        shell_print(sh, "%s", line);
+    }
+    k_mutex_unlock(&seq->lock);
+
+    return 0;
+}
+
+SHELL_CMD_REGISTER(bootseq, NULL, "Start-up phase timeline", cmd_bootseq);
+#endif
@@ -0,0 +1,129 @@
+/*******************************************************************************
+ *  @file: BootSeq.h
+ *
+ *  @brief: Start-up orchestrator with per-phase timestamps.
+ *
+ *  An app describes its start-up as a table of phases. A phase either runs a
+ *  function (NvParms init, WiFi connect, server start) or is an event that
+ *  something else completes (the L4 connected event, the first request
+ *  served). Each phase lists the phases it depends on. A small pool of worker
+ *  threads runs every phase whose dependencies are done, so independent
+ *  stages overlap. main() does not block on any of it.
+ *
+ *  Every phase records when it became runnable and when it finished, in
+ *  microseconds since boot. BootSeq_log() (or the "bootseq" shell command)
+ *  prints the timeline, which shows the time to the first served request.
+ *
+ *  A phase that fails skips every phase that depends on it.
+*******************************************************************************/
+#ifndef BOOTSEQ_H
+#define BOOTSEQ_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#if CONFIG_NET_MGMT_EVENT
+#include <zephyr/net/net_mgmt.h>
+#endif
+#if CONFIG_NET_IPV4
+#include <zephyr/net/icmp.h>
+#endif
+
+#define BOOTSEQ_MAX_PHASES      24
+
+typedef int (*BootSeq_Fn)(void *arg);
+
+typedef enum BootSeq_State
+{
+    BOOTSEQ_PENDING = 0,
+    BOOTSEQ_RUNNING,
+    BOOTSEQ_DONE,
+    BOOTSEQ_FAILED,
+    BOOTSEQ_SKIPPED
+} BootSeq_State;
+
+typedef struct BootSeq_Phase
+{
+    const char *name;
+    /** @brief Work to run on a worker thread, or NULL for an event phase
+        (completed with BootSeq_complete()). A negative return fails the
+        phase. */
+    BootSeq_Fn fn;
+    void *arg;
+    /** @brief Phases that must be done first, as BIT(index). Event phases
+        may complete before their dependencies; they are then timed from
+        the start of the sequence. */
+    uint32_t deps;
+
+    /* Filled in by BootSeq. */
+    BootSeq_State state;
+    int ret;
+    /** @brief When the phase became runnable and when it finished (us since
+        boot, 0 if not yet). */
+    int64_t ready_us;
+    int64_t end_us;
+} BootSeq_Phase;
+
+typedef struct BootSeq
+{
+    BootSeq_Phase *phases;
+    uint8_t num_phases;
+    /** @brief Finished phases (done, failed or skipped), as BIT(index). */
+    uint32_t finished;
+    uint32_t done;
+    int64_t start_us;
+
+    struct k_mutex lock;
+    struct k_condvar cond;
+
+#if CONFIG_NET_MGMT_EVENT
+    struct net_mgmt_event_callback l4_cb;
+    int8_t l4_phase;
+#endif
+#if CONFIG_NET_IPV4
+    struct net_icmp_ctx icmp;
+    int8_t ping_phase;
+    /** @brief Set by the first echo request, so later ones skip the lock. */
+    atomic_t ping_seen;
+#endif
+} BootSeq;
+
+/** @brief Set up a sequence over a phase table (up to BOOTSEQ_MAX_PHASES).
+    Dependencies must point to phases in the table. */
+int
+BootSeq_init(BootSeq *seq, BootSeq_Phase *phases, int num_phases);
+
+/** @brief Start the worker threads. Returns immediately. Only one sequence
+    can run at a time. */
+int
+BootSeq_start(BootSeq *seq);
+
+/** @brief Complete an event phase (ret < 0 fails it). Callable from any
+    thread. */
+void
+BootSeq_complete(BootSeq *seq, int id, int ret);
+
+/** @brief Wait for a phase to finish. Returns its result, -ECANCELED if it
+    was skipped, or -EAGAIN on timeout. */
+int
+BootSeq_wait(BootSeq *seq, int id, k_timeout_t timeout);
+
+#if CONFIG_NET_CONNECTION_MANAGER
+/** @brief Complete event phase id on the first NET_EVENT_L4_CONNECTED
+    (including one that has already happened). */
+int
+BootSeq_watchL4(BootSeq *seq, int id);
+#endif
+
+#if CONFIG_NET_IPV4
+/** @brief Complete event phase id on the first ICMPv4 echo request
+    received (a ping is the first request an app without other services
+    serves). */
+int
+BootSeq_watchPing(BootSeq *seq, int id);
+#endif
+
+/** @brief Log the timeline of every phase. */
+void
+BootSeq_log(BootSeq *seq);
+
+#endif
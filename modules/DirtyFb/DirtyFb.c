@@ -0,0 +1,418 @@
+/*******************************************************************************
+ *  @file: DirtyFb.c
+ *
+ *  @brief: Monochrome framebuffer that sends the display only what changed.
+*******************************************************************************/
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/display.h>
+#include "DirtyFb.h"
+
+#if CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(DirtyFb, CONFIG_DIRTYFB_LOG_LEVEL);
+
+#if CONFIG_SHELL
+static DirtyFb *shell_fb;
+#endif
+
+int
+DirtyFb_init(DirtyFb *fb, const struct device *dev)
+{
+    struct display_capabilities caps;
+
+    display_get_capabilities(dev, &caps);
+
+    if (!(caps.screen_info & SCREEN_INFO_MONO_VTILED) ||
+        caps.x_resolution > CONFIG_DIRTYFB_MAX_WIDTH ||
+        caps.y_resolution > CONFIG_DIRTYFB_MAX_HEIGHT)
+    {
+        LOG_ERR("Display %ux%u is not supported.", caps.x_resolution, caps.y_resolution);
+        return -ENOTSUP;
+    }
+
+    fb->dev = dev;
+    fb->width = caps.x_resolution;
+    fb->pages = caps.y_resolution / 8;
+    fb->invert = (caps.current_pixel_format == PIXEL_FORMAT_MONO10);
+    fb->shadow_ok = false;
+    memset(&fb->stats, 0, sizeof(fb->stats));
+#if CONFIG_DIRTYFB_TEXT_CACHE > 0
+    memset(fb->text, 0, sizeof(fb->text));
+    fb->text_clock = 0;
+#endif
+    DirtyFb_clear(fb);
+
+#if CONFIG_SHELL
+    /* The shell reports on the first framebuffer set up. */
+    if (!shell_fb)
+    {
+        shell_fb = fb;
+    }
+#endif
+
+    LOG_INF("%ux%u, %u pages.", fb->width, fb->pages * 8, fb->pages);
+    return 0;
+}
+
+void
+DirtyFb_clear(DirtyFb *fb)
+{
+    memset(fb->buf, 0, (size_t)fb->width * fb->pages);
+}
+
+static inline uint8_t
+glyph_index(const DirtyFb_Font *font, char ch)
+{
+    uint8_t c = (uint8_t)ch;
+
+    if (c < font->first || c > font->last)
+    {
+        c = ' ';
+    }
+    return c - font->first;
+}
+
+/** @brief Draw str into row (width columns) from column x, a glyph at a
+    time, each followed by blank columns to fill its cell. Returns the
+    column after the last cell. */
+static uint16_t
+render_bytes(const DirtyFb_Font *font, const char *str, uint8_t *row,
+    uint16_t x, uint16_t width)
+{
+    const uint8_t cell = MAX(font->cell, font->width);
+
+    for (; *str && x < width; str++)
+    {
+        const uint8_t *glyph = &font->glyphs[glyph_index(font, *str) * font->width];
+        uint16_t n = MIN(font->width, width - x);
+        uint16_t pad = MIN(cell - font->width, width - x - n);
+
+        memcpy(&row[x], glyph, n);
+        memset(&row[x + n], 0, pad);
+        x += n + pad;
+    }
+
+    return x;
+}
+
+/** @brief As render_bytes(), from the packed words: each glyph is one
+    8-byte store, and the next glyph overwrites what is past its cell. The
+    last glyph (and one at the right edge) stores only its cell. */
+static uint16_t
+render_words(const DirtyFb_Font *font, const char *str, uint8_t *row,
+    uint16_t x, uint16_t width)
+{
+    const uint8_t cell = font->cell;
+
+    for (; *str && x < width; str++)
+    {
+        uint64_t word = font->words[glyph_index(font, *str)];
+        uint8_t *dst = &row[x];
+
+        if ((cell == 8 || str[1]) && width - x >= 8)
+        {
+            if (((uintptr_t)dst & 3) == 0)
+            {
+                /* Two word stores. */
+                memcpy(__builtin_assume_aligned(dst, 4), &word, sizeof(word));
+            }
+            else
+            {
+                memcpy(dst, &word, sizeof(word));
+            }
+            x += cell;
+        }
+        else
+        {
+            uint16_t n = MIN(cell, width - x);
+
+            memcpy(dst, &word, n);
+            x += n;
+        }
+    }
+
+    return x;
+}
+
+static inline uint16_t
+render(const DirtyFb_Font *font, const char *str, uint8_t *row, uint16_t x, uint16_t width)
+{
+    return font->words ? render_words(font, str, row, x, width) :
+        render_bytes(font, str, row, x, width);
+}
+
+int
+DirtyFb_print(DirtyFb *fb, const DirtyFb_Font *font, const char *str,
+    uint16_t x, uint16_t y)
+{
+    uint8_t page = y / 8;
+
+    if (page >= fb->pages)
+    {
+        return x;
+    }
+
+    return render(font, str, &fb->buf[page * fb->width], x, fb->width);
+}
+
+#if CONFIG_DIRTYFB_TEXT_CACHE > 0
+/** @brief The cache entry for str in font, rendered into the least
+    recently used entry on a miss. */
+static const DirtyFb_Text *
+text_lookup(DirtyFb *fb, const DirtyFb_Font *font, const char *str, size_t len)
+{
+    DirtyFb_Text *lru = &fb->text[0];
+    k_spinlock_key_t key;
+    bool hit = false;
+    int k;
+
+    for (k = 0; k < CONFIG_DIRTYFB_TEXT_CACHE; k++)
+    {
+        DirtyFb_Text *t = &fb->text[k];
+
+        if (t->font == font && memcmp(t->str, str, len + 1) == 0)
+        {
+            lru = t;
+            hit = true;
+            break;
+        }
+        if (t->used < lru->used)
+        {
+            lru = t;
+        }
+    }
+
+    if (!hit)
+    {
+        memcpy(lru->str, str, len + 1);
+        lru->font = font;
+        lru->width = render(font, str, lru->cols, 0, sizeof(lru->cols));
+    }
+    lru->used = ++fb->text_clock;
+
+    key = k_spin_lock(&fb->stats_lock);
+    if (hit)
+    {
+        fb->stats.text_hits++;
+    }
+    else
+    {
+        fb->stats.text_misses++;
+    }
+    k_spin_unlock(&fb->stats_lock, key);
+
+    return lru;
+}
+#endif
+
+int
+DirtyFb_printCached(DirtyFb *fb, const DirtyFb_Font *font, const char *str,
+    uint16_t x, uint16_t y)
+{
+#if CONFIG_DIRTYFB_TEXT_CACHE > 0
+    uint8_t page = y / 8;
+    size_t len = strlen(str);
+    const DirtyFb_Text *t;
+    uint16_t n;
+
+    if (len > CONFIG_DIRTYFB_TEXT_CACHE_LEN || page >= fb->pages || x >= fb->width)
+    {
+        return DirtyFb_print(fb, font, str, x, y);
+    }
+
+    t = text_lookup(fb, font, str, len);
+    n = MIN(t->width, fb->width - x);
+    memcpy(&fb->buf[page * fb->width + x], t->cols, n);
+    return x + n;
+#else
+    return DirtyFb_print(fb, font, str, x, y);
+#endif
+}
+
+/** @brief Write columns [first, last] of page from the buffer, and record
+    them as shown. */
+static int
+write_span(DirtyFb *fb, uint8_t page, uint16_t first, uint16_t last)
+{
+    uint16_t len = last - first + 1;
+    const uint8_t *src = &fb->buf[page * fb->width + first];
+    struct display_buffer_descriptor desc = {
+        .buf_size = len,
+        .width = len,
+        .height = 8,
+        .pitch = len,
+    };
+    int ret;
+
+    if (fb->invert)
+    {
+        uint16_t k;
+
+        for (k = 0; k < len; k++)
+        {
+            fb->tx[k] = ~src[k];
+        }
+        src = fb->tx;
+    }
+
+    ret = display_write(fb->dev, first, page * 8, &desc, src);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    memcpy(&fb->shadow[page * fb->width + first], &fb->buf[page * fb->width + first], len);
+    return len;
+}
+
+int
+DirtyFb_flush(DirtyFb *fb)
+{
+    uint32_t bytes = 0;
+    uint32_t writes = 0;
+    k_spinlock_key_t key;
+    uint8_t page;
+    int ret = 0;
+
+    for (page = 0; page < fb->pages; page++)
+    {
+        const uint8_t *cur = &fb->buf[page * fb->width];
+        const uint8_t *old = &fb->shadow[page * fb->width];
+        int first = 0;
+        int last = fb->width - 1;
+
+        if (fb->shadow_ok)
+        {
+            while (first < fb->width && cur[first] == old[first])
+            {
+                first++;
+            }
+            if (first == fb->width)
+            {
+                continue;
+            }
+            while (cur[last] == old[last])
+            {
+                last--;
+            }
+        }
+
+        ret = write_span(fb, page, first, last);
+        if (ret < 0)
+        {
+            LOG_ERR("Write of page %u failed: %d", page, ret);
+            /* The display may show part of the span: resend it all next time. */
+            fb->shadow_ok = false;
+            break;
+        }
+        bytes += ret;
+        writes++;
+    }
+
+    if (ret >= 0)
+    {
+        fb->shadow_ok = true;
+    }
+
+    key = k_spin_lock(&fb->stats_lock);
+    fb->stats.flushes++;
+    fb->stats.clean += (writes == 0);
+    fb->stats.writes += writes;
+    fb->stats.bytes += bytes;
+    fb->stats.full_bytes += (uint32_t)fb->width * fb->pages;
+    k_spin_unlock(&fb->stats_lock, key);
+
+    return (ret < 0) ? ret : (int)bytes;
+}
+
+void
+DirtyFb_invalidate(DirtyFb *fb)
+{
+    fb->shadow_ok = false;
+}
+
+void
+DirtyFb_getStats(DirtyFb *fb, DirtyFb_Stats *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&fb->stats_lock);
+
+    *stats = fb->stats;
+    k_spin_unlock(&fb->stats_lock, key);
+}
+
+void
+DirtyFb_resetStats(DirtyFb *fb)
+{
+    k_spinlock_key_t key = k_spin_lock(&fb->stats_lock);
+
+    memset(&fb->stats, 0, sizeof(fb->stats));
+    k_spin_unlock(&fb->stats_lock, key);
+}
+
+#if CONFIG_SHELL
+static int
+cmd_show(const struct shell *sh, size_t argc, char **argv)
+{
+    DirtyFb_Stats st;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    if (!shell_fb)
+    {
+        shell_print(sh, "No framebuffer.");
+        return 0;
+    }
+
+    DirtyFb_getStats(shell_fb, &st);
+    shell_print(sh, "%ux%u, %s", shell_fb->width, shell_fb->pages * 8,
+        shell_fb->invert ? "inverted" : "normal");
+    shell_print(sh, "flushes %u (clean %u), writes %u", st.flushes, st.clean, st.writes);
+    shell_print(sh, "bytes %u of %u full frame (%u per flush)", st.bytes, st.full_bytes,
+        st.flushes ? st.bytes / st.flushes : 0);
+    shell_print(sh, "text cache hits %u misses %u", st.text_hits, st.text_misses);
+    return 0;
+}
+
+static int
+cmd_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    if (shell_fb)
+    {
+        DirtyFb_resetStats(shell_fb);
+    }
+    shell_print(sh, "Statistics cleared.");
+    return 0;
+}
+
+static int
+cmd_full(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    if (shell_fb)
+    {
+        DirtyFb_invalidate(shell_fb);
+    }
+    shell_print(sh, "Next flush sends the whole frame.");
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(dirtyfb_cmds,
+    SHELL_CMD(show, NULL, "Show flush statistics.", cmd_show),
+    SHELL_CMD(reset, NULL, "Clear flush statistics.", cmd_reset),
+    SHELL_CMD(full, NULL, "Send the whole frame on the next flush.", cmd_full),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(dirtyfb, &dirtyfb_cmds, "Dirty-page framebuffer", NULL);
+#endif
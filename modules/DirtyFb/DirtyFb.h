@@ -0,0 +1,166 @@
+/*******************************************************************************
+ *  @file: DirtyFb.h
+ *
+ *  @brief: Monochrome framebuffer that sends the display only what changed.
+ *
+ *  The buffer uses the SSD1306 RAM layout: the display is divided into
+ *  pages of 8 rows, and each byte is one column of a page, with the top row
+ *  in bit 0. Drawing only touches the buffer. DirtyFb_flush() compares it
+ *  with a copy of the last frame sent, and for each page that changed
+ *  writes the span from the first to the last changed column, with one
+ *  display_write(). The SSD1306 driver sets the column and page address
+ *  window for the write, so only that span goes over the bus. A page that
+ *  did not change costs nothing.
+ *
+ *  The first flush (and the one after DirtyFb_invalidate()) sends the whole
+ *  frame.
+ *
+ *  Text is drawn from fonts whose glyphs are packed one per 64-bit word, in
+ *  the same column layout (DIRTYFB_GLYPH() builds the table at compile time
+ *  from a font's column list). A glyph is copied with one 8-byte store, and
+ *  the next glyph overwrites the padding past its cell. Strings drawn with
+ *  DirtyFb_printCached() are kept rendered (CONFIG_DIRTYFB_TEXT_CACHE
+ *  entries, least recently used replaced), so labels that repeat on every
+ *  frame are a single copy.
+*******************************************************************************/
+#ifndef DIRTYFB_H
+#define DIRTYFB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+
+#define DIRTYFB_MAX_PAGES   (CONFIG_DIRTYFB_MAX_HEIGHT / 8)
+#define DIRTYFB_MAX_BYTES   (CONFIG_DIRTYFB_MAX_WIDTH * DIRTYFB_MAX_PAGES)
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define DIRTYFB_COL(c, n)   ((uint64_t)(c) << (56 - 8 * (n)))
+#else
+#define DIRTYFB_COL(c, n)   ((uint64_t)(c) << (8 * (n)))
+#endif
+
+#define DIRTYFB_GLYPH_(c0, c1, c2, c3, c4, c5, c6, c7, ...)                 \
+    (DIRTYFB_COL(c0, 0) | DIRTYFB_COL(c1, 1) | DIRTYFB_COL(c2, 2) |        \
+     DIRTYFB_COL(c3, 3) | DIRTYFB_COL(c4, 4) | DIRTYFB_COL(c5, 5) |        \
+     DIRTYFB_COL(c6, 6) | DIRTYFB_COL(c7, 7)),
+
+/** @brief One glyph's columns (up to 8) as a word whose bytes are the
+    columns in memory order, followed by a comma. For a words table built
+    from a font's column list, e.g. { FONT_GLYPHS(DIRTYFB_GLYPH) }. */
+#define DIRTYFB_GLYPH(...)  DIRTYFB_GLYPH_(__VA_ARGS__, 0, 0, 0, 0, 0, 0, 0, 0)
+
+/** @brief A font 8 rows high, as columns: width bytes per glyph, top row
+    in bit 0 (CFB_FONT_MONO_VPACKED). */
+typedef struct DirtyFb_Font
+{
+    const uint8_t *glyphs;
+    uint8_t width;
+    uint8_t first;
+    uint8_t last;
+    /** @brief The glyphs packed by DIRTYFB_GLYPH(), or NULL to copy from
+        glyphs a byte at a time. */
+    const uint64_t *words;
+    /** @brief Columns per character: the glyph and its spacing, up to 8.
+        Drawn the same with or without words. */
+    uint8_t cell;
+} DirtyFb_Font;
+
+/** @brief A rendered string. */
+typedef struct DirtyFb_Text
+{
+    const DirtyFb_Font *font;
+    char str[CONFIG_DIRTYFB_TEXT_CACHE_LEN + 1];
+    uint16_t width;
+    uint32_t used;
+    uint8_t __aligned(4) cols[CONFIG_DIRTYFB_TEXT_CACHE_LEN * 8];
+} DirtyFb_Text;
+
+typedef struct DirtyFb_Stats
+{
+    uint32_t flushes;
+    /** @brief Flushes with nothing to send. */
+    uint32_t clean;
+    /** @brief display_write() calls, one per changed page. */
+    uint32_t writes;
+    /** @brief Pixel data bytes written. */
+    uint32_t bytes;
+    /** @brief Bytes the flushes would have written as full frames. */
+    uint32_t full_bytes;
+    uint32_t text_hits;
+    uint32_t text_misses;
+} DirtyFb_Stats;
+
+typedef struct DirtyFb
+{
+    const struct device *dev;
+    uint16_t width;
+    uint8_t pages;
+    /** @brief The display's pixel format is MONO10 (1 is off): bytes are
+        inverted on the way out. */
+    bool invert;
+
+    /** @brief Word aligned, so 8-column glyphs at a column that is a
+        multiple of 4 are copied with word stores. */
+    uint8_t __aligned(4) buf[DIRTYFB_MAX_BYTES];
+    /** @brief What the display shows, valid if shadow_ok. */
+    uint8_t shadow[DIRTYFB_MAX_BYTES];
+    bool shadow_ok;
+    uint8_t tx[CONFIG_DIRTYFB_MAX_WIDTH];
+
+#if CONFIG_DIRTYFB_TEXT_CACHE > 0
+    DirtyFb_Text text[CONFIG_DIRTYFB_TEXT_CACHE];
+    uint32_t text_clock;
+#endif
+
+    struct k_spinlock stats_lock;
+    DirtyFb_Stats stats;
+} DirtyFb;
+
+/** @brief Set up the framebuffer for dev, cleared. Set the display's pixel
+    format first.
+    @return 0 on success, -ENOTSUP if the display is larger than
+    CONFIG_DIRTYFB_MAX_WIDTH x CONFIG_DIRTYFB_MAX_HEIGHT or not a
+    monochrome vertically tiled one.
+*/
+int
+DirtyFb_init(DirtyFb *fb, const struct device *dev);
+
+/** @brief Clear the buffer. The display is not touched until the flush. */
+void
+DirtyFb_clear(DirtyFb *fb);
+
+/** @brief Draw str at column x of the page holding row y (a multiple of 8),
+    clipped at the right edge.
+    @return The column after the last glyph drawn.
+*/
+int
+DirtyFb_print(DirtyFb *fb, const DirtyFb_Font *font, const char *str,
+    uint16_t x, uint16_t y);
+
+/** @brief Draw str as DirtyFb_print() does, from the text cache when it
+    was drawn recently in the same font. Meant for labels and other
+    strings that repeat. Strings longer than CONFIG_DIRTYFB_TEXT_CACHE_LEN
+    are drawn directly.
+*/
+int
+DirtyFb_printCached(DirtyFb *fb, const DirtyFb_Font *font, const char *str,
+    uint16_t x, uint16_t y);
+
+/** @brief Write the changed spans to the display.
+    @return The number of bytes written, or the display_write() error.
+*/
+int
+DirtyFb_flush(DirtyFb *fb);
+
+/** @brief Forget what the display shows, so the next flush sends it all. */
+void
+DirtyFb_invalidate(DirtyFb *fb);
+
+void
+DirtyFb_getStats(DirtyFb *fb, DirtyFb_Stats *stats);
+
+void
+DirtyFb_resetStats(DirtyFb *fb);
+
+#endif
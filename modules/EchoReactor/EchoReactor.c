@@ -0,0 +1,469 @@
+/*******************************************************************************
+ *  @file: EchoReactor.c
+ *
+ *  @brief: Event-driven echo server for many TCP and UDP clients.
+*******************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/posix/fcntl.h>
+#include "EchoReactor.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(EchoReactor, CONFIG_ECHOREACTOR_LOG_LEVEL);
+
+/** @brief Buffer pool shared by every client of every reactor. */
+K_MEM_SLAB_DEFINE_STATIC(
+    echo_bufs,
+    CONFIG_ECHOREACTOR_BUF_SIZE,
+    CONFIG_ECHOREACTOR_NUM_BUFS,
+    4);
+
+static uint8_t *
+buf_alloc(EchoReactor *r)
+{
+    void *buf;
+    uint32_t used;
+
+    if (k_mem_slab_alloc(&echo_bufs, &buf, K_NO_WAIT) != 0)
+    {
+        r->stats.pool_stalls++;
+        return NULL;
+    }
+
+    used = k_mem_slab_num_used_get(&echo_bufs);
+    if (used > r->stats.peak_bufs)
+    {
+        r->stats.peak_bufs = used;
+    }
+
+    return (uint8_t *)buf;
+}
+
+/** @brief Return a buffer and resume polling anything that was starved. */
+static void
+buf_free(EchoReactor *r, uint8_t *buf)
+{
+    uint32_t k;
+
+    k_mem_slab_free(&echo_bufs, buf);
+
+    if (r->num_starved == 0)
+    {
+        return;
+    }
+
+    for (k = ECHOREACTOR_FD_UDP; k < ECHOREACTOR_NUM_FDS; k++)
+    {
+        struct zsock_pollfd *pfd = &r->fds[k];
+        if (pfd->fd >= 0 && pfd->events == 0)
+        {
+            pfd->events = ZSOCK_POLLIN;
+        }
+    }
+    r->num_starved = 0;
+}
+
+static inline void
+starve(EchoReactor *r, struct zsock_pollfd *pfd)
+{
+    pfd->events = 0;
+    r->num_starved++;
+}
+
+static int
+open_socket(uint16_t port, int type, int proto)
+{
+    struct sockaddr_in addr;
+    int opt = 1;
+    int fd;
+
+    fd = zsock_socket(AF_INET, type, proto);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+
+    zsock_setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+
+    if (zsock_bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        int ret = -errno;
+        zsock_close(fd);
+        return ret;
+    }
+
+    zsock_fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+static void
+close_client(EchoReactor *r, uint32_t slot)
+{
+    EchoReactor_Conn *conn = &r->conns[slot - ECHOREACTOR_FD_CLIENT0];
+    struct zsock_pollfd *pfd = &r->fds[slot];
+
+    zsock_close(pfd->fd);
+    pfd->fd = -1;
+    pfd->events = 0;
+    pfd->revents = 0;
+
+    if (conn->buf)
+    {
+        buf_free(r, conn->buf);
+        conn->buf = NULL;
+    }
+
+    r->stats.clients--;
+
+    /* A slot is free again. */
+    r->fds[ECHOREACTOR_FD_LISTEN].events = ZSOCK_POLLIN;
+}
+
+/** @brief A request was echoed: report the first one. */
+static void
+served(EchoReactor *r)
+{
+    if (!r->served)
+    {
+        r->served = true;
+        if (r->on_first)
+        {
+            r->on_first(r->on_first_arg);
+        }
+    }
+}
+
+static void
+handle_accept(EchoReactor *r)
+{
+    uint32_t slot;
+
+    for (slot = ECHOREACTOR_FD_CLIENT0; slot < ECHOREACTOR_NUM_FDS; slot++)
+    {
+        if (r->fds[slot].fd < 0)
+        {
+            break;
+        }
+    }
+
+    if (slot == ECHOREACTOR_NUM_FDS)
+    {
+        /* Leave further clients in the listen backlog. */
+        r->fds[ECHOREACTOR_FD_LISTEN].events = 0;
+        return;
+    }
+
+    int fd = zsock_accept(r->fds[ECHOREACTOR_FD_LISTEN].fd, NULL, NULL);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    zsock_fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    r->fds[slot].fd = fd;
+    r->fds[slot].events = ZSOCK_POLLIN;
+    memset(&r->conns[slot - ECHOREACTOR_FD_CLIENT0], 0, sizeof(EchoReactor_Conn));
+
+    r->stats.accepts++;
+    r->stats.clients++;
+    if (r->stats.clients > r->stats.peak_clients)
+    {
+        r->stats.peak_clients = r->stats.clients;
+    }
+
+    LOG_DBG("[%s] client %d in slot %u", r->name, fd, slot);
+}
+
+/** @brief Send pending data. Returns false if the connection was closed. */
+static bool
+flush_client(EchoReactor *r, uint32_t slot)
+{
+    EchoReactor_Conn *conn = &r->conns[slot - ECHOREACTOR_FD_CLIENT0];
+    struct zsock_pollfd *pfd = &r->fds[slot];
+
+    while (conn->sent < conn->len)
+    {
+        ssize_t n = zsock_send(pfd->fd, &conn->buf[conn->sent],
+            conn->len - conn->sent, ZSOCK_MSG_DONTWAIT);
+        if (n < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                /* Backpressure: stop reading until the echo drains. */
+                pfd->events = ZSOCK_POLLOUT;
+                r->stats.send_stalls++;
+                return true;
+            }
+            close_client(r, slot);
+            return false;
+        }
+        conn->sent += n;
+        r->stats.tx_bytes += n;
+    }
+
+    buf_free(r, conn->buf);
+    conn->buf = NULL;
+    pfd->events = ZSOCK_POLLIN;
+    return true;
+}
+
+static void
+handle_client(EchoReactor *r, uint32_t slot)
+{
+    EchoReactor_Conn *conn = &r->conns[slot - ECHOREACTOR_FD_CLIENT0];
+    struct zsock_pollfd *pfd = &r->fds[slot];
+    short revents = pfd->revents;
+    ssize_t n;
+
+    if (revents & (ZSOCK_POLLERR | ZSOCK_POLLNVAL))
+    {
+        close_client(r, slot);
+        return;
+    }
+
+    if (conn->buf)
+    {
+        if (revents & (ZSOCK_POLLOUT | ZSOCK_POLLHUP))
+        {
+            flush_client(r, slot);
+        }
+        return;
+    }
+
+    if (!(revents & (ZSOCK_POLLIN | ZSOCK_POLLHUP)))
+    {
+        return;
+    }
+
+    conn->buf = buf_alloc(r);
+    if (!conn->buf)
+    {
+        starve(r, pfd);
+        return;
+    }
+
+    n = zsock_recv(pfd->fd, conn->buf, CONFIG_ECHOREACTOR_BUF_SIZE, ZSOCK_MSG_DONTWAIT);
+    if (n <= 0)
+    {
+        if (n < 0 && errno == EAGAIN)
+        {
+            buf_free(r, conn->buf);
+            conn->buf = NULL;
+            return;
+        }
+        close_client(r, slot);
+        return;
+    }
+
+    conn->len = n;
+    conn->sent = 0;
+    r->stats.rx_bytes += n;
+    r->stats.tcp_msgs++;
+
+    if (flush_client(r, slot))
+    {
+        served(r);
+    }
+}
+
+#if CONFIG_ECHOREACTOR_UDP_BATCH
+static void
+handle_udp(EchoReactor *r)
+{
+    UdpBatch_Stats *bs = &r->udp.stats;
+    uint32_t rx_bytes = bs->rx_bytes;
+    uint32_t tx_bytes = bs->tx_bytes;
+    uint32_t truncated = bs->rx_truncated;
+    int n;
+
+    r->stats.udp_wakeups++;
+
+    /* poll() has already reported the socket readable. */
+    n = UdpBatch_recv(&r->udp, 0);
+    r->stats.udp_dropped += bs->rx_truncated - truncated;
+    if (n <= 0)
+    {
+        return;
+    }
+
+    UdpBatch_reply(&r->udp, n);
+    served(r);
+
+    r->stats.udp_msgs += n;
+    r->stats.rx_bytes += bs->rx_bytes - rx_bytes;
+    r->stats.tx_bytes += bs->tx_bytes - tx_bytes;
+}
+#else
+static void
+handle_udp(EchoReactor *r)
+{
+    struct zsock_pollfd *pfd = &r->fds[ECHOREACTOR_FD_UDP];
+    struct sockaddr_storage src;
+    socklen_t src_len = sizeof(src);
+    uint8_t *buf;
+    ssize_t n;
+
+    r->stats.udp_wakeups++;
+
+    buf = buf_alloc(r);
+    if (!buf)
+    {
+        starve(r, pfd);
+        return;
+    }
+
+    n = zsock_recvfrom(pfd->fd, buf, CONFIG_ECHOREACTOR_BUF_SIZE,
+        ZSOCK_MSG_DONTWAIT, (struct sockaddr *)&src, &src_len);
+    if (n > 0)
+    {
+        r->stats.rx_bytes += n;
+        r->stats.udp_msgs++;
+        if (zsock_sendto(pfd->fd, buf, n, 0, (struct sockaddr *)&src, src_len) == n)
+        {
+            r->stats.tx_bytes += n;
+            served(r);
+        }
+    }
+
+    buf_free(r, buf);
+}
+#endif
+
+static void
+reactor_thread(void *p1, void *p2, void *p3)
+{
+    EchoReactor *r = (EchoReactor *)p1;
+    uint32_t k;
+
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    LOG_INF("[%s] serving TCP and UDP on port %u (%u clients, %u x %u byte pool)",
+        r->name,
+        r->port,
+        CONFIG_ECHOREACTOR_MAX_CLIENTS,
+        CONFIG_ECHOREACTOR_NUM_BUFS,
+        CONFIG_ECHOREACTOR_BUF_SIZE);
+
+    while (1)
+    {
+        int ready = zsock_poll(r->fds, ECHOREACTOR_NUM_FDS, -1);
+        if (ready < 0)
+        {
+            LOG_ERR("[%s] poll error: %d", r->name, errno);
+            k_msleep(100);
+            continue;
+        }
+
+        for (k = ECHOREACTOR_FD_CLIENT0; k < ECHOREACTOR_NUM_FDS; k++)
+        {
+            if (r->fds[k].fd >= 0 && r->fds[k].revents)
+            {
+                handle_client(r, k);
+            }
+        }
+
+        if (r->fds[ECHOREACTOR_FD_UDP].revents & ZSOCK_POLLIN)
+        {
+            handle_udp(r);
+        }
+
+        if (r->fds[ECHOREACTOR_FD_LISTEN].revents & ZSOCK_POLLIN)
+        {
+            handle_accept(r);
+        }
+    }
+}
+
+/** @brief Open the sockets and start the reactor thread. */
+int
+EchoReactor_init(
+    EchoReactor *r,
+    uint16_t port,
+    k_thread_stack_t *stack,
+    size_t stack_size,
+    const char *name,
+    int prio)
+{
+    EchoReactor_Fn on_first = r->on_first;
+    void *on_first_arg = r->on_first_arg;
+    int fd;
+    uint32_t k;
+
+    memset(r, 0, sizeof(*r));
+    r->on_first = on_first;
+    r->on_first_arg = on_first_arg;
+    r->name = name;
+    r->port = port;
+
+    for (k = 0; k < ECHOREACTOR_NUM_FDS; k++)
+    {
+        r->fds[k].fd = -1;
+    }
+
+    fd = open_socket(port, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0)
+    {
+        LOG_ERR("[%s] TCP socket error: %d", name, fd);
+        return fd;
+    }
+
+    if (zsock_listen(fd, CONFIG_ECHOREACTOR_MAX_CLIENTS) < 0)
+    {
+        LOG_ERR("[%s] listen error: %d", name, errno);
+        zsock_close(fd);
+        return -errno;
+    }
+
+    r->fds[ECHOREACTOR_FD_LISTEN].fd = fd;
+    r->fds[ECHOREACTOR_FD_LISTEN].events = ZSOCK_POLLIN;
+
+    fd = open_socket(port, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0)
+    {
+        LOG_ERR("[%s] UDP socket error: %d", name, fd);
+        zsock_close(r->fds[ECHOREACTOR_FD_LISTEN].fd);
+        return fd;
+    }
+
+    r->fds[ECHOREACTOR_FD_UDP].fd = fd;
+    r->fds[ECHOREACTOR_FD_UDP].events = ZSOCK_POLLIN;
+#if CONFIG_ECHOREACTOR_UDP_BATCH
+    UdpBatch_init(&r->udp, fd);
+#endif
+
+    r->tid = k_thread_create(
+        &r->thread,
+        stack,
+        stack_size,
+        reactor_thread,
+        r, NULL, NULL,
+        prio,
+        0,
+        K_NO_WAIT);
+    k_thread_name_set(r->tid, name);
+
+    return 0;
+}
+
+/** @brief Report the first served request. */
+void
+EchoReactor_onFirstRequest(EchoReactor *r, EchoReactor_Fn fn, void *arg)
+{
+    r->on_first = fn;
+    r->on_first_arg = arg;
+}
+
+/** @brief Copy the current statistics. */
+void
+EchoReactor_getStats(EchoReactor *r, EchoReactor_Stats *stats)
+{
+    *stats = r->stats;
+}
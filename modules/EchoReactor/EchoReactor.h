@@ -0,0 +1,119 @@
+/*******************************************************************************
+ *  @file: EchoReactor.h
+ *
+ *  @brief: Event-driven echo server for many TCP and UDP clients.
+ *
+ *  One thread multiplexes the TCP listener, the UDP socket and every TCP
+ *  client with zsock_poll(). Data is echoed from a small pool of buffers
+ *  shared by all clients. Each client costs one pollfd and one
+ *  EchoReactor_Conn (16 bytes in total on 32-bit targets) rather than a
+ *  thread stack and a private buffer.
+ *
+ *  Backpressure is per connection: a client whose echo is blocked on its send
+ *  window is polled for POLLOUT only, and is not read from until the pending
+ *  data has been sent.
+*******************************************************************************/
+#ifndef ECHOREACTOR_H
+#define ECHOREACTOR_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#if CONFIG_ECHOREACTOR_UDP_BATCH
+#include "UdpBatch.h"
+#endif
+
+/** @brief Fixed pollfd slots ahead of the client slots. */
+#define ECHOREACTOR_FD_LISTEN   0
+#define ECHOREACTOR_FD_UDP      1
+#define ECHOREACTOR_FD_CLIENT0  2
+
+#define ECHOREACTOR_NUM_FDS     (ECHOREACTOR_FD_CLIENT0 + CONFIG_ECHOREACTOR_MAX_CLIENTS)
+
+/** @brief Called on the reactor thread once the first request has been
+    served. */
+typedef void (*EchoReactor_Fn)(void *arg);
+
+/** @brief Per-client state. The socket lives in the matching pollfd. */
+typedef struct EchoReactor_Conn
+{
+    /** @brief Pool buffer holding unsent data, or NULL. */
+    uint8_t *buf;
+    uint16_t len;
+    uint16_t sent;
+} EchoReactor_Conn;
+
+typedef struct EchoReactor_Stats
+{
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t tcp_msgs;
+    uint32_t udp_msgs;
+    /** @brief Times the UDP socket was serviced (udp_msgs / udp_wakeups is
+        the mean batch size). */
+    uint32_t udp_wakeups;
+    /** @brief UDP datagrams too long for a batch slot, dropped. */
+    uint32_t udp_dropped;
+    uint32_t accepts;
+    uint32_t clients;
+    uint32_t peak_clients;
+    /** @brief Reads deferred because the buffer pool was empty. */
+    uint32_t pool_stalls;
+    /** @brief Sends which did not complete and were resumed on POLLOUT. */
+    uint32_t send_stalls;
+    uint32_t peak_bufs;
+} EchoReactor_Stats;
+
+typedef struct EchoReactor
+{
+    const char *name;
+    uint16_t port;
+
+    struct zsock_pollfd fds[ECHOREACTOR_NUM_FDS];
+    EchoReactor_Conn conns[CONFIG_ECHOREACTOR_MAX_CLIENTS];
+    /** @brief Clients (and the UDP socket) waiting on a pool buffer. */
+    uint32_t num_starved;
+
+#if CONFIG_ECHOREACTOR_UDP_BATCH
+    UdpBatch udp;
+#endif
+
+    struct k_thread thread;
+    k_tid_t tid;
+
+    EchoReactor_Fn on_first;
+    void *on_first_arg;
+    bool served;
+
+    EchoReactor_Stats stats;
+} EchoReactor;
+
+/** @brief Open TCP and UDP sockets on the port and start the reactor thread.
+    @param r          Reactor object.
+    @param port       Port for both TCP and UDP.
+    @param stack      Stack for the reactor thread.
+    @param stack_size Size of stack.
+    @param name       Thread name.
+    @param prio       Thread priority.
+    @return 0 on success, negative errno on error.
+*/
+int
+EchoReactor_init(
+    EchoReactor *r,
+    uint16_t port,
+    k_thread_stack_t *stack,
+    size_t stack_size,
+    const char *name,
+    int prio);
+
+/** @brief Have fn called (on the reactor thread) when the first TCP message
+    or UDP datagram has been echoed, e.g. to time the first served request.
+    Call before EchoReactor_init(), which keeps it. */
+void
+EchoReactor_onFirstRequest(EchoReactor *r, EchoReactor_Fn fn, void *arg);
+
+/** @brief Copy the current statistics. */
+void
+EchoReactor_getStats(EchoReactor *r, EchoReactor_Stats *stats);
+
+#endif
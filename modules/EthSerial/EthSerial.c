@@ -0,0 +1,1358 @@
+/*******************************************************************************
+ *  @file: EthSerial.c
+ *
+ *  @brief: Ethernet over a UART.
+*******************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/net/net_pkt.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/ethernet.h>
+#include "SerFrame.h"
+#include "EthSerial.h"
+
+#if CONFIG_ETHSERIAL_LINKCTL
+#include <zephyr/sys/crc.h>
+#endif
+
+#if CONFIG_ETHSERIAL_HDRCOMP
+#include "HdrComp.h"
+#endif
+
+#if CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(EthSerial, CONFIG_ETHSERIAL_LOG_LEVEL);
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_ETHSERIAL_RX_RING_SIZE),
+    "CONFIG_ETHSERIAL_RX_RING_SIZE must be a power of 2");
+
+#define RING_MASK       (CONFIG_ETHSERIAL_RX_RING_SIZE - 1)
+#define FRAME_MAX       (NET_ETH_MTU + sizeof(struct net_eth_hdr))
+#define CRC_LEN         2
+/* Longest frame on the wire: header compression prefix and CRC included. */
+#define WIRE_MAX        (FRAME_MAX + 2 + CRC_LEN)
+#define TX_BUF_SIZE     SERFRAME_MAX_ENCODED(WIRE_MAX)
+#define NUM_TX_BUFS     2
+
+/* Link control frames start with a magic that is neither a frame type
+   byte nor a plausible destination MAC (it has the group bit set). They are
+   "ESLC", op, op-specific payload, CRC-16, whether or not data frames carry
+   a CRC. */
+#define LINKCTL_MAGIC       "ESLC"
+#define LINKCTL_MAGIC_LEN   4
+#define LINKCTL_HDR_LEN     (LINKCTL_MAGIC_LEN + 1)
+#define LINKCTL_VERSION     1
+/* version, options, header compression slots */
+#define LINKCTL_REQ         0x01
+#define LINKCTL_ACK         0x02
+/* baud rate (32 bits, little-endian; 0 in an ack declines) */
+#define LINKCTL_BAUD_REQ    0x03
+#define LINKCTL_BAUD_ACK    0x04
+/* sequence (16 bits) and a fixed pattern; echoed by the host */
+#define LINKCTL_PROBE       0x05
+/* baud rate; commits a switch, echoed by the host */
+#define LINKCTL_BAUD_OK     0x06
+
+#define LINKCTL_OPT_HDRCOMP     0x01
+#define LINKCTL_OPT_CRC         0x02
+#define LINKCTL_OPT_AUTOBAUD    0x04
+
+#define PROBE_LEN           64
+#define LINKCTL_MAX_LEN     (LINKCTL_HDR_LEN + PROBE_LEN + CRC_LEN)
+
+#define LOCAL_OPTS  ( \
+    (IS_ENABLED(CONFIG_ETHSERIAL_HDRCOMP) ? LINKCTL_OPT_HDRCOMP : 0) | \
+    (IS_ENABLED(CONFIG_ETHSERIAL_CRC) ? LINKCTL_OPT_CRC : 0) | \
+    (IS_ENABLED(CONFIG_ETHSERIAL_AUTOBAUD) ? LINKCTL_OPT_AUTOBAUD : 0))
+
+#if CONFIG_ETHSERIAL_HDRCOMP
+#define LOCAL_SLOTS         HDRCOMP_SLOTS
+#define RX_HEAD_SIZE        MAX(HDRCOMP_MAX_HDR + 2, LINKCTL_MAX_LEN)
+#else
+#define LOCAL_SLOTS         0
+#define RX_HEAD_SIZE        LINKCTL_MAX_LEN
+#endif
+
+#if CONFIG_ETHSERIAL_AUTOBAUD
+/* Protocol timing, shared with the host. After acking a baud request the
+   host switches, and goes back to its previous rate unless the switch is
+   committed with BAUD_OK within BAUD_REVERT_MS. */
+#define BAUD_REVERT_MS      1500
+#define BAUD_SETTLE_MS      20
+#define REPLY_TIMEOUT_MS    200
+#define REPLY_TRIES         3
+#define PROBE_WAIT_MS       500
+#define KEEPALIVE_MS        2000
+#define KEEPALIVE_MISSES    3
+/* The host goes back to the base rate after this long without a valid
+   frame, which is when the device gives up on keepalives and does too. */
+#define IDLE_RESET_MS       (KEEPALIVE_MS * KEEPALIVE_MISSES)
+
+static const uint32_t baud_rates[] = {
+    115200, 230400, 460800, 921600, 1000000, 1500000, 2000000, 3000000
+};
+#define NUM_RATES           ARRAY_SIZE(baud_rates)
+
+typedef enum LinkEvent_Type
+{
+    LINK_EV_START = 0,
+    LINK_EV_BAUD_ACK,
+    LINK_EV_BAUD_OK,
+    LINK_EV_BURST
+} LinkEvent_Type;
+
+typedef struct LinkEvent
+{
+    uint8_t type;
+    uint32_t rate;
+} LinkEvent;
+#endif
+
+#if CONFIG_ETHSERIAL_COBS
+#define FRAMING         SERFRAME_COBS
+#define DELIM           COBS_DELIM
+#else
+#define FRAMING         SERFRAME_SLIP
+#define DELIM           SLIP_END
+#endif
+
+typedef struct EthSerial_Data
+{
+    const struct device *uart;
+    struct net_if *iface;
+    uint8_t mac[6];
+
+    /** @brief RX ring: head is written only by the ISR, tail only by the
+        decode thread. Both run freely and are masked on access. */
+    uint8_t ring[CONFIG_ETHSERIAL_RX_RING_SIZE];
+    atomic_t head;
+    atomic_t tail;
+    struct k_sem rx_sem;
+
+    SerFrame_Decoder dec;
+    struct net_pkt *rx_pkt;
+    uint16_t rx_len;
+    bool rx_drop;
+
+#if CONFIG_ETHSERIAL_LINKCTL
+    /** @brief Start of the current frame, gathered so link control frames
+        and compressed headers can be parsed linearly. */
+    uint8_t rx_head[RX_HEAD_SIZE];
+    uint16_t rx_head_len;
+    bool rx_head_done;
+    bool rx_ctl;
+    /** @brief Running CRC of the current frame; 0 at the end of a frame
+        whose CRC is good. */
+    uint16_t rx_crc;
+    atomic_t crc_on;
+    struct k_work_delayable neg_work;
+    uint8_t neg_tries;
+#endif
+#if CONFIG_ETHSERIAL_AUTOBAUD
+    struct k_msgq link_q;
+    char link_q_buf[8 * sizeof(LinkEvent)];
+    atomic_t probe_rx;
+    uint32_t base_baud;
+    /** @brief Index of the fastest rate still allowed. Lowered on each
+        fallback so the link does not keep stepping back into a bad rate. */
+    int ceiling;
+    uint32_t burst_start;
+    uint16_t burst_errs;
+    EthSerial_BaudStep steps[NUM_RATES];
+#endif
+#if CONFIG_ETHSERIAL_HDRCOMP
+    /** @brief TX contexts are used under tx_lock, RX contexts by the
+        decode thread. */
+    HdrComp hc;
+    atomic_t hc_on;
+#endif
+
+    /** @brief TX double buffer. The ISR owns tx_active while it is
+        non-negative; tx_next is queued behind it. */
+    uint8_t tx_bufs[NUM_TX_BUFS][TX_BUF_SIZE];
+    uint16_t tx_len[NUM_TX_BUFS];
+    uint8_t tx_fill;
+    int8_t tx_active;
+    int8_t tx_next;
+    uint16_t tx_pos;
+    struct k_sem tx_free;
+    struct k_mutex tx_lock;
+    struct k_spinlock tx_spin;
+
+    EthSerial_Stats stats;
+} EthSerial_Data;
+
+static EthSerial_Data eth_data;
+
+#if CONFIG_ETHSERIAL_LINKCTL
+static void
+linkctl_rx(EthSerial_Data *d, const uint8_t *f, size_t len);
+#endif
+
+K_THREAD_STACK_DEFINE(rx_stack, CONFIG_ETHSERIAL_RX_STACK_SIZE);
+static struct k_thread rx_thread;
+
+/** @brief Move FIFO bytes into the ring. Wakes the decode thread on a frame
+    delimiter or when the ring is half full. */
+static void
+isr_rx(EthSerial_Data *d)
+{
+    uint32_t head = atomic_get(&d->head);
+    uint32_t tail = atomic_get(&d->tail);
+    bool wake = false;
+
+    while (uart_irq_rx_ready(d->uart))
+    {
+        uint32_t space = CONFIG_ETHSERIAL_RX_RING_SIZE - (head - tail);
+        uint32_t chunk = MIN(space, CONFIG_ETHSERIAL_RX_RING_SIZE - (head & RING_MASK));
+        int n;
+
+        if (chunk == 0)
+        {
+            uint8_t discard[16];
+
+            n = uart_fifo_read(d->uart, discard, sizeof(discard));
+            if (n <= 0)
+            {
+                break;
+            }
+            d->stats.rx_overrun += n;
+            wake = true;
+            continue;
+        }
+
+        n = uart_fifo_read(d->uart, &d->ring[head & RING_MASK], chunk);
+        if (n <= 0)
+        {
+            break;
+        }
+
+        if (memchr(&d->ring[head & RING_MASK], DELIM, n))
+        {
+            wake = true;
+        }
+        head += n;
+    }
+
+    atomic_set(&d->head, head);
+
+    if (wake || (head - tail) > CONFIG_ETHSERIAL_RX_RING_SIZE / 2)
+    {
+        k_sem_give(&d->rx_sem);
+    }
+}
+
+static void
+isr_tx(EthSerial_Data *d)
+{
+    k_spinlock_key_t key = k_spin_lock(&d->tx_spin);
+
+    while (d->tx_active >= 0 && uart_irq_tx_ready(d->uart))
+    {
+        int idx = d->tx_active;
+        int n = uart_fifo_fill(d->uart, &d->tx_bufs[idx][d->tx_pos],
+            d->tx_len[idx] - d->tx_pos);
+        if (n <= 0)
+        {
+            break;
+        }
+
+        d->tx_pos += n;
+        if (d->tx_pos == d->tx_len[idx])
+        {
+            d->tx_active = d->tx_next;
+            d->tx_next = -1;
+            d->tx_pos = 0;
+            k_sem_give(&d->tx_free);
+        }
+    }
+
+    if (d->tx_active < 0)
+    {
+        uart_irq_tx_disable(d->uart);
+    }
+
+    k_spin_unlock(&d->tx_spin, key);
+}
+
+static void
+uart_isr(const struct device *dev, void *user_data)
+{
+    EthSerial_Data *d = (EthSerial_Data *)user_data;
+
+    ARG_UNUSED(dev);
+
+    while (uart_irq_update(d->uart) && uart_irq_is_pending(d->uart))
+    {
+        if (uart_irq_rx_ready(d->uart))
+        {
+            isr_rx(d);
+        }
+        if (uart_irq_tx_ready(d->uart))
+        {
+            isr_tx(d);
+        }
+    }
+}
+
+/** @brief Write frame bytes into the rx packet. */
+static void
+rx_write(EthSerial_Data *d, const uint8_t *data, size_t len)
+{
+    if (d->rx_drop || len == 0)
+    {
+        return;
+    }
+
+    if (!d->rx_pkt)
+    {
+        d->rx_pkt = net_pkt_rx_alloc_with_buffer(
+            d->iface, FRAME_MAX + CRC_LEN, AF_UNSPEC, 0, K_NO_WAIT);
+        if (!d->rx_pkt)
+        {
+            d->stats.rx_nobuf++;
+            d->rx_drop = true;
+            return;
+        }
+    }
+
+    if (d->rx_len + len > FRAME_MAX + CRC_LEN ||
+        net_pkt_write(d->rx_pkt, data, len) < 0)
+    {
+        d->stats.rx_oversize++;
+        d->rx_drop = true;
+        return;
+    }
+    d->rx_len += len;
+}
+
+#if CONFIG_ETHSERIAL_LINKCTL
+/** @brief Parse the gathered start of a frame and pass it on. */
+static void
+rx_head_flush(EthSerial_Data *d)
+{
+    const uint8_t *h = d->rx_head;
+    size_t n = d->rx_head_len;
+
+    d->rx_head_done = true;
+
+    if (n >= LINKCTL_MAGIC_LEN && memcmp(h, LINKCTL_MAGIC, LINKCTL_MAGIC_LEN) == 0)
+    {
+        d->rx_ctl = true;
+        return;
+    }
+
+#if CONFIG_ETHSERIAL_HDRCOMP
+    if (atomic_get(&d->hc_on))
+    {
+        uint8_t hdr[HDRCOMP_MAX_HDR];
+        size_t used;
+        int hlen;
+
+        hlen = HdrComp_decompress(&d->hc, h, n, hdr, &used);
+        if (hlen < 0)
+        {
+            d->rx_drop = true;
+            return;
+        }
+
+        rx_write(d, hdr, hlen);
+        h += used;
+        n -= used;
+    }
+#endif
+
+    rx_write(d, h, n);
+}
+#endif
+
+/** @brief Decoder sink: write a run of frame bytes into the rx packet. */
+static void
+rx_sink(void *arg, const uint8_t *data, size_t len)
+{
+    EthSerial_Data *d = (EthSerial_Data *)arg;
+
+#if CONFIG_ETHSERIAL_LINKCTL
+    d->rx_crc = crc16_ccitt(d->rx_crc, data, len);
+
+    if (!d->rx_head_done)
+    {
+        size_t n = MIN(len, sizeof(d->rx_head) - d->rx_head_len);
+
+        memcpy(&d->rx_head[d->rx_head_len], data, n);
+        d->rx_head_len += n;
+        if (d->rx_head_len < sizeof(d->rx_head))
+        {
+            return;
+        }
+
+        rx_head_flush(d);
+        data += n;
+        len -= n;
+    }
+#endif
+
+    rx_write(d, data, len);
+}
+
+#if CONFIG_ETHSERIAL_HDRCOMP
+/** @brief Fill in the IP length and checksum of a decompressed frame. */
+static void
+rx_hdrcomp_end(EthSerial_Data *d, struct net_pkt *pkt)
+{
+    NET_PKT_DATA_ACCESS_CONTIGUOUS_DEFINE(ip_access, struct net_ipv4_hdr);
+    struct net_ipv4_hdr *ip;
+
+    if (d->hc.rx_slot < 0)
+    {
+        return;
+    }
+
+    net_pkt_cursor_init(pkt);
+    if (net_pkt_skip(pkt, sizeof(struct net_eth_hdr)) < 0)
+    {
+        return;
+    }
+
+    ip = (struct net_ipv4_hdr *)net_pkt_get_data(pkt, &ip_access);
+    if (ip && HdrComp_rxEnd(&d->hc, d->rx_len, (uint8_t *)ip))
+    {
+        net_pkt_set_data(pkt, &ip_access);
+    }
+}
+#endif
+
+/** @brief Count a damaged frame. With auto-baud, a burst of them makes the
+    link fall back to a slower rate. */
+static void
+line_error(EthSerial_Data *d)
+{
+#if CONFIG_ETHSERIAL_AUTOBAUD
+    uint32_t now = k_uptime_get_32();
+
+    if (now - d->burst_start > CONFIG_ETHSERIAL_AUTOBAUD_BURST_MS)
+    {
+        d->burst_start = now;
+        d->burst_errs = 0;
+    }
+
+    if (++d->burst_errs == CONFIG_ETHSERIAL_AUTOBAUD_BURST_ERRORS)
+    {
+        LinkEvent ev = { .type = LINK_EV_BURST };
+        k_msgq_put(&d->link_q, &ev, K_NO_WAIT);
+    }
+#else
+    ARG_UNUSED(d);
+#endif
+}
+
+static void
+rx_frame_end(EthSerial_Data *d)
+{
+    struct net_pkt *pkt;
+    bool lost = false;
+#if CONFIG_ETHSERIAL_LINKCTL
+    bool crc_ok = (d->rx_crc == 0 && d->dec.len > CRC_LEN);
+
+    if (d->dec.len > 0 && !d->dec.bad && !d->rx_head_done)
+    {
+        rx_head_flush(d);
+    }
+#endif
+
+    pkt = d->rx_pkt;
+    d->rx_pkt = NULL;
+
+    if (d->dec.len == 0)
+    {
+        /* Back to back delimiters. */
+    }
+    else if (d->dec.bad)
+    {
+        d->stats.rx_bad++;
+        line_error(d);
+        lost = true;
+    }
+#if CONFIG_ETHSERIAL_LINKCTL
+    else if (d->rx_ctl)
+    {
+        if (crc_ok && d->rx_head_len == d->dec.len)
+        {
+            linkctl_rx(d, d->rx_head, d->rx_head_len - CRC_LEN);
+        }
+        else
+        {
+            d->stats.rx_crc_err++;
+            line_error(d);
+        }
+    }
+    else if (atomic_get(&d->crc_on) && !crc_ok)
+    {
+        d->stats.rx_crc_err++;
+        line_error(d);
+        lost = true;
+    }
+#endif
+    else if (pkt && !d->rx_drop)
+    {
+        d->stats.rx_frames++;
+        d->stats.rx_bytes += d->dec.len;
+
+#if CONFIG_ETHSERIAL_LINKCTL
+        if (atomic_get(&d->crc_on))
+        {
+            d->rx_len -= CRC_LEN;
+            net_pkt_update_length(pkt, d->rx_len);
+        }
+#endif
+#if CONFIG_ETHSERIAL_HDRCOMP
+        rx_hdrcomp_end(d, pkt);
+#endif
+
+        net_pkt_cursor_init(pkt);
+        if (net_recv_data(d->iface, pkt) == 0)
+        {
+            pkt = NULL;
+        }
+    }
+
+    if (pkt)
+    {
+        net_pkt_unref(pkt);
+    }
+
+#if CONFIG_ETHSERIAL_HDRCOMP
+    /* A lost frame leaves the peer's compressor ahead of our contexts. */
+    if (lost || (d->rx_drop && d->hc.rx_slot >= 0))
+    {
+        HdrComp_rxToss(&d->hc);
+    }
+#else
+    ARG_UNUSED(lost);
+#endif
+
+#if CONFIG_ETHSERIAL_LINKCTL
+    d->rx_head_len = 0;
+    d->rx_head_done = false;
+    d->rx_ctl = false;
+    d->rx_crc = 0xFFFF;
+#endif
+    d->rx_len = 0;
+    d->rx_drop = false;
+    SerFrame_decodeNext(&d->dec);
+}
+
+static void
+rx_thread_fn(void *p1, void *p2, void *p3)
+{
+    EthSerial_Data *d = (EthSerial_Data *)p1;
+
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1)
+    {
+        uint32_t head, tail;
+
+        k_sem_take(&d->rx_sem, K_FOREVER);
+        d->stats.rx_wakeups++;
+
+        head = atomic_get(&d->head);
+        tail = atomic_get(&d->tail);
+
+        /* Drain everything that has arrived, frame by frame. */
+        while (tail != head)
+        {
+            uint32_t chunk = MIN(head - tail,
+                CONFIG_ETHSERIAL_RX_RING_SIZE - (tail & RING_MASK));
+            bool frame_end;
+            size_t n;
+
+            n = SerFrame_decode(&d->dec, &d->ring[tail & RING_MASK], chunk,
+                rx_sink, d, &frame_end);
+            tail += n;
+            atomic_set(&d->tail, tail);
+
+            if (frame_end)
+            {
+                rx_frame_end(d);
+            }
+
+            if (tail == head)
+            {
+                head = atomic_get(&d->head);
+            }
+        }
+    }
+}
+
+/** @brief Encode a frame into the next free TX buffer and queue it. The
+    frame is pre followed by frags, less its first skip bytes, and a CRC if
+    crc is set. Called with tx_lock held. */
+static void
+tx_frame_locked(
+    EthSerial_Data *d,
+    const uint8_t *pre,
+    size_t pre_len,
+    struct net_buf *frags,
+    size_t skip,
+    bool crc)
+{
+    SerFrame_Encoder enc;
+    struct net_buf *frag;
+    k_spinlock_key_t key;
+    uint16_t fcs = 0xFFFF;
+    size_t len;
+    int idx;
+
+    k_sem_take(&d->tx_free, K_FOREVER);
+
+    /* Buffers are released in order, so they free up round-robin. */
+    idx = d->tx_fill;
+    d->tx_fill = (d->tx_fill + 1) % NUM_TX_BUFS;
+
+    SerFrame_encodeBegin(&enc, FRAMING, d->tx_bufs[idx]);
+    if (pre_len > 0)
+    {
+        SerFrame_encodeFeed(&enc, pre, pre_len);
+#if CONFIG_ETHSERIAL_LINKCTL
+        if (crc)
+        {
+            fcs = crc16_ccitt(fcs, pre, pre_len);
+        }
+#endif
+    }
+    for (frag = frags; frag; frag = frag->frags)
+    {
+        if (skip >= frag->len)
+        {
+            skip -= frag->len;
+            continue;
+        }
+        SerFrame_encodeFeed(&enc, frag->data + skip, frag->len - skip);
+#if CONFIG_ETHSERIAL_LINKCTL
+        if (crc)
+        {
+            fcs = crc16_ccitt(fcs, frag->data + skip, frag->len - skip);
+        }
+#endif
+        skip = 0;
+    }
+#if CONFIG_ETHSERIAL_LINKCTL
+    if (crc)
+    {
+        uint8_t tail[CRC_LEN];
+
+        sys_put_le16(fcs, tail);
+        SerFrame_encodeFeed(&enc, tail, sizeof(tail));
+    }
+#else
+    ARG_UNUSED(crc);
+    ARG_UNUSED(fcs);
+#endif
+    len = SerFrame_encodeEnd(&enc);
+    d->tx_len[idx] = len;
+
+    d->stats.tx_frames++;
+    d->stats.tx_wire_bytes += len;
+
+    key = k_spin_lock(&d->tx_spin);
+    if (d->tx_active < 0)
+    {
+        d->tx_active = idx;
+        d->tx_pos = 0;
+    }
+    else
+    {
+        d->tx_next = idx;
+    }
+    k_spin_unlock(&d->tx_spin, key);
+
+    uart_irq_tx_enable(d->uart);
+}
+
+static int
+eth_send(const struct device *dev, struct net_pkt *pkt)
+{
+    EthSerial_Data *d = dev->data;
+    size_t pkt_len = net_pkt_get_len(pkt);
+#if CONFIG_ETHSERIAL_HDRCOMP
+    uint8_t pre[HDRCOMP_MAX_PREFIX];
+#else
+    const uint8_t *pre = NULL;
+#endif
+    size_t pre_len = 0;
+    size_t skip = 0;
+
+    k_mutex_lock(&d->tx_lock, K_FOREVER);
+
+#if CONFIG_ETHSERIAL_HDRCOMP
+    if (atomic_get(&d->hc_on))
+    {
+        uint8_t hdr[HDRCOMP_MAX_HDR];
+        size_t n = MIN(pkt_len, sizeof(hdr));
+
+        net_pkt_cursor_init(pkt);
+        if (net_pkt_read(pkt, hdr, n) == 0)
+        {
+            pre_len = HdrComp_compress(&d->hc, hdr, n, pkt_len, pre, &skip);
+        }
+        else
+        {
+            pre[0] = HDRCOMP_T_ETH;
+            pre_len = 1;
+        }
+    }
+#endif
+
+#if CONFIG_ETHSERIAL_LINKCTL
+    tx_frame_locked(d, pre, pre_len, pkt->buffer, skip, atomic_get(&d->crc_on));
+#else
+    tx_frame_locked(d, pre, pre_len, pkt->buffer, skip, false);
+#endif
+    d->stats.tx_bytes += pkt_len;
+
+    k_mutex_unlock(&d->tx_lock);
+
+    return 0;
+}
+
+#if CONFIG_ETHSERIAL_LINKCTL
+static void
+linkctl_send(EthSerial_Data *d, uint8_t op, const uint8_t *payload, size_t len)
+{
+    uint8_t f[LINKCTL_MAX_LEN];
+
+    memcpy(f, LINKCTL_MAGIC, LINKCTL_MAGIC_LEN);
+    f[LINKCTL_MAGIC_LEN] = op;
+    memcpy(&f[LINKCTL_HDR_LEN], payload, len);
+    len += LINKCTL_HDR_LEN;
+    sys_put_le16(crc16_ccitt(0xFFFF, f, len), &f[len]);
+
+    k_mutex_lock(&d->tx_lock, K_FOREVER);
+    tx_frame_locked(d, f, len + CRC_LEN, NULL, 0, false);
+    k_mutex_unlock(&d->tx_lock);
+}
+
+static void
+linkctl_send_config(EthSerial_Data *d, uint8_t op, uint8_t opts, uint8_t slots)
+{
+    uint8_t p[3] = { LINKCTL_VERSION, opts, slots };
+
+    linkctl_send(d, op, p, sizeof(p));
+}
+
+/** @brief Apply negotiated options. Runs in the decode thread. */
+static void
+link_configure(EthSerial_Data *d, uint8_t opts, uint8_t slots)
+{
+    k_mutex_lock(&d->tx_lock, K_FOREVER);
+#if CONFIG_ETHSERIAL_HDRCOMP
+    /* Both ends start over with empty contexts. */
+    if (!(opts & LINKCTL_OPT_HDRCOMP))
+    {
+        slots = 0;
+    }
+    HdrComp_reset(&d->hc, slots);
+    atomic_set(&d->hc_on, slots > 0);
+#else
+    ARG_UNUSED(slots);
+#endif
+    atomic_set(&d->crc_on, (opts & LINKCTL_OPT_CRC) != 0);
+    k_mutex_unlock(&d->tx_lock);
+
+    LOG_INF("Link options: header compression %s (%u slots), crc %s, auto-baud %s.",
+        (opts & LINKCTL_OPT_HDRCOMP) ? "on" : "off", slots,
+        (opts & LINKCTL_OPT_CRC) ? "on" : "off",
+        (opts & LINKCTL_OPT_AUTOBAUD) ? "on" : "off");
+
+#if CONFIG_ETHSERIAL_AUTOBAUD
+    if (opts & LINKCTL_OPT_AUTOBAUD)
+    {
+        LinkEvent ev = { .type = LINK_EV_START };
+        k_msgq_put(&d->link_q, &ev, K_NO_WAIT);
+    }
+#endif
+}
+
+static void
+linkctl_rx(EthSerial_Data *d, const uint8_t *f, size_t len)
+{
+    const uint8_t *p = &f[LINKCTL_HDR_LEN];
+    uint8_t op = f[LINKCTL_MAGIC_LEN];
+    uint8_t opts;
+    uint8_t slots;
+
+    len -= MIN(len, LINKCTL_HDR_LEN);
+
+    switch (op)
+    {
+    case LINKCTL_REQ:
+    case LINKCTL_ACK:
+        if (len < 3 || p[0] != LINKCTL_VERSION)
+        {
+            LOG_WRN("Ignoring link config (len %u, version %u).",
+                (unsigned int)len, (len > 0) ? p[0] : 0);
+            return;
+        }
+
+        opts = p[1] & LOCAL_OPTS;
+        slots = MIN(p[2], LOCAL_SLOTS);
+        k_work_cancel_delayable(&d->neg_work);
+
+        if (op == LINKCTL_REQ)
+        {
+            /* The host (re)started: answer with what both ends support. */
+            linkctl_send_config(d, LINKCTL_ACK, opts, slots);
+        }
+        link_configure(d, opts, slots);
+        break;
+
+#if CONFIG_ETHSERIAL_AUTOBAUD
+    case LINKCTL_BAUD_ACK:
+    case LINKCTL_BAUD_OK:
+        if (len >= 4)
+        {
+            LinkEvent ev = {
+                .type = (op == LINKCTL_BAUD_ACK) ? LINK_EV_BAUD_ACK : LINK_EV_BAUD_OK,
+                .rate = sys_get_le32(p)
+            };
+            k_msgq_put(&d->link_q, &ev, K_NO_WAIT);
+        }
+        break;
+
+    case LINKCTL_PROBE:
+        if (len == PROBE_LEN)
+        {
+            atomic_inc(&d->probe_rx);
+        }
+        break;
+#endif
+
+    default:
+        LOG_WRN("Unknown link control op %u.", op);
+        break;
+    }
+}
+
+/** @brief Offer our options until the host answers or we give up (an older
+    host drops the frame, and the link stays raw). */
+static void
+neg_work_fn(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    EthSerial_Data *d = CONTAINER_OF(dwork, EthSerial_Data, neg_work);
+
+    linkctl_send_config(d, LINKCTL_REQ, LOCAL_OPTS, LOCAL_SLOTS);
+
+    if (++d->neg_tries < CONFIG_ETHSERIAL_LINKCTL_REQ_TRIES)
+    {
+        k_work_reschedule(dwork, K_MSEC(CONFIG_ETHSERIAL_LINKCTL_REQ_INTERVAL_MS));
+    }
+}
+#endif
+
+#if CONFIG_ETHSERIAL_AUTOBAUD
+K_THREAD_STACK_DEFINE(link_stack, CONFIG_ETHSERIAL_AUTOBAUD_STACK_SIZE);
+static struct k_thread link_thread;
+
+/** @brief Wait until everything queued has left the UART. Called with
+    tx_lock held. */
+static void
+tx_drain_locked(EthSerial_Data *d)
+{
+    int k;
+
+    for (k = 0; k < NUM_TX_BUFS; k++)
+    {
+        k_sem_take(&d->tx_free, K_FOREVER);
+    }
+    for (k = 0; k < NUM_TX_BUFS; k++)
+    {
+        k_sem_give(&d->tx_free);
+    }
+
+    /* Then the FIFO and shift register. */
+    for (k = 0; k < 20 && uart_irq_tx_complete(d->uart) == 0; k++)
+    {
+        k_msleep(1);
+    }
+}
+
+static int
+set_baud(EthSerial_Data *d, uint32_t rate)
+{
+    struct uart_config cfg;
+    int ret;
+
+    k_mutex_lock(&d->tx_lock, K_FOREVER);
+    tx_drain_locked(d);
+    ret = uart_config_get(d->uart, &cfg);
+    if (ret == 0)
+    {
+        cfg.baudrate = rate;
+        ret = uart_configure(d->uart, &cfg);
+    }
+    k_mutex_unlock(&d->tx_lock);
+
+    if (ret < 0)
+    {
+        LOG_ERR("Unable to set %u baud: %d", rate, ret);
+        return ret;
+    }
+
+    d->stats.baud = rate;
+    return 0;
+}
+
+static int
+rate_index(uint32_t rate)
+{
+    int k;
+
+    for (k = NUM_RATES - 1; k > 0; k--)
+    {
+        if (baud_rates[k] <= rate)
+        {
+            break;
+        }
+    }
+    return k;
+}
+
+/** @brief Send op with a rate and wait for the host's reply carrying the
+    same rate. */
+static bool
+link_request(EthSerial_Data *d, uint8_t op, uint32_t rate, uint8_t reply)
+{
+    uint8_t p[4];
+    LinkEvent ev;
+    int k;
+
+    sys_put_le32(rate, p);
+
+    for (k = 0; k < REPLY_TRIES; k++)
+    {
+        int64_t end = k_uptime_get() + REPLY_TIMEOUT_MS;
+
+        linkctl_send(d, op, p, sizeof(p));
+
+        while (k_msgq_get(&d->link_q, &ev, K_MSEC(MAX(end - k_uptime_get(), 0))) == 0)
+        {
+            if (ev.type == reply)
+            {
+                return ev.rate == rate;
+            }
+            /* Error bursts are expected while trying a rate; anything
+               else is stale. */
+        }
+    }
+
+    return false;
+}
+
+static void
+probe_send(EthSerial_Data *d, uint16_t seq)
+{
+    uint8_t p[PROBE_LEN];
+    int k;
+
+    /* Include the bytes the framing has to escape. */
+    sys_put_le16(seq, p);
+    p[2] = SLIP_END;
+    p[3] = SLIP_ESC;
+    p[4] = COBS_DELIM;
+    for (k = 5; k < PROBE_LEN; k++)
+    {
+        p[k] = (k & 1) ? 0x55 : (uint8_t)(k * 37);
+    }
+
+    linkctl_send(d, LINKCTL_PROBE, p, sizeof(p));
+}
+
+/** @brief Send num probes and count the echoes that come back intact. */
+static uint32_t
+probe_run(EthSerial_Data *d, uint16_t num)
+{
+    int64_t end;
+    uint16_t k;
+
+    atomic_set(&d->probe_rx, 0);
+    for (k = 0; k < num; k++)
+    {
+        probe_send(d, k);
+    }
+
+    end = k_uptime_get() + PROBE_WAIT_MS;
+    while (atomic_get(&d->probe_rx) < num && k_uptime_get() < end)
+    {
+        k_msleep(10);
+    }
+
+    return atomic_get(&d->probe_rx);
+}
+
+/** @brief Switch both ends to baud_rates[idx] and check the link. */
+static bool
+baud_try(EthSerial_Data *d, int idx, bool probe)
+{
+    EthSerial_BaudStep *st = &d->steps[idx];
+    uint32_t rate = baud_rates[idx];
+    uint32_t prev = d->stats.baud;
+    uint32_t crc_errs = d->stats.rx_crc_err + d->stats.rx_bad;
+
+    /* The host switches right after its ack. */
+    if (!link_request(d, LINKCTL_BAUD_REQ, rate, LINK_EV_BAUD_ACK))
+    {
+        LOG_INF("Host declined %u baud.", rate);
+        return false;
+    }
+
+    if (set_baud(d, rate) < 0)
+    {
+        /* The host goes back by itself. */
+        k_msleep(BAUD_REVERT_MS);
+        return false;
+    }
+    k_msleep(BAUD_SETTLE_MS);
+
+    st->tries++;
+    if (probe)
+    {
+        st->probes = CONFIG_ETHSERIAL_AUTOBAUD_PROBES;
+        st->echoed = probe_run(d, CONFIG_ETHSERIAL_AUTOBAUD_PROBES);
+        st->errors = d->stats.rx_crc_err + d->stats.rx_bad - crc_errs;
+        st->clean = (st->echoed == st->probes && st->errors == 0);
+
+        LOG_INF("%u baud: %u/%u probes echoed, %u line errors.",
+            rate, st->echoed, st->probes, st->errors);
+    }
+
+    if ((!probe || st->clean) && link_request(d, LINKCTL_BAUD_OK, rate, LINK_EV_BAUD_OK))
+    {
+        return true;
+    }
+
+    /* Wait out the host's revert timer at the old rate. */
+    set_baud(d, prev);
+    k_msleep(BAUD_REVERT_MS);
+    return false;
+}
+
+static void
+baud_step_up(EthSerial_Data *d)
+{
+    int idx = rate_index(d->stats.baud);
+
+    while (idx < d->ceiling && baud_try(d, idx + 1, true))
+    {
+        idx++;
+    }
+
+    LOG_INF("Link running at %u baud.", d->stats.baud);
+}
+
+/** @brief Renegotiate from scratch at the base rate. The host also returns
+    to the base rate when it hears nothing valid for a while. */
+static void
+link_restart(EthSerial_Data *d)
+{
+    LOG_WRN("Lost the host, restarting at %u baud.", d->base_baud);
+
+    set_baud(d, d->base_baud);
+    k_msleep(BAUD_REVERT_MS);
+
+    d->neg_tries = 0;
+    k_work_reschedule(&d->neg_work, K_NO_WAIT);
+}
+
+static void
+baud_fall_back(EthSerial_Data *d)
+{
+    int idx = rate_index(d->stats.baud);
+
+    if (d->stats.baud == d->base_baud)
+    {
+        return;
+    }
+
+    d->stats.baud_fallbacks++;
+    d->ceiling = MAX(idx - 1, rate_index(d->base_baud));
+    LOG_WRN("Line errors at %u baud, falling back.", d->stats.baud);
+
+    /* No probing on the way down: the lower rate was clean before. */
+    if (!baud_try(d, idx - 1, false))
+    {
+        link_restart(d);
+    }
+}
+
+/** @brief Above the base rate, check that the host is still there. */
+static void
+keepalive(EthSerial_Data *d, int *misses)
+{
+    if (d->stats.baud == d->base_baud)
+    {
+        return;
+    }
+
+    if (probe_run(d, 1) == 1)
+    {
+        *misses = 0;
+    }
+    else if (++(*misses) >= KEEPALIVE_MISSES)
+    {
+        *misses = 0;
+        link_restart(d);
+    }
+}
+
+static void
+link_thread_fn(void *p1, void *p2, void *p3)
+{
+    EthSerial_Data *d = (EthSerial_Data *)p1;
+    int misses = 0;
+    LinkEvent ev;
+
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1)
+    {
+        if (k_msgq_get(&d->link_q, &ev, K_MSEC(KEEPALIVE_MS)) < 0)
+        {
+            keepalive(d, &misses);
+            continue;
+        }
+
+        switch (ev.type)
+        {
+        case LINK_EV_START:
+            baud_step_up(d);
+            break;
+        case LINK_EV_BURST:
+            baud_fall_back(d);
+            break;
+        default:
+            /* Late replies. */
+            break;
+        }
+    }
+}
+#endif
+
+static void
+eth_iface_init(struct net_if *iface)
+{
+    const struct device *dev = net_if_get_device(iface);
+    EthSerial_Data *d = dev->data;
+
+    d->iface = iface;
+    ethernet_init(iface);
+    net_if_set_link_addr(iface, d->mac, sizeof(d->mac), NET_LINK_ETHERNET);
+}
+
+static enum ethernet_hw_caps
+eth_caps(const struct device *dev)
+{
+    ARG_UNUSED(dev);
+    return 0;
+}
+
+static const struct ethernet_api eth_api = {
+    .iface_api.init = eth_iface_init,
+    .get_capabilities = eth_caps,
+    .send = eth_send,
+};
+
+static int
+eth_init(const struct device *dev)
+{
+    EthSerial_Data *d = dev->data;
+    uint8_t c;
+
+    d->uart = DEVICE_DT_GET(DT_CHOSEN(zephyr_uart_pipe));
+    if (!device_is_ready(d->uart))
+    {
+        LOG_ERR("UART not ready.");
+        return -ENODEV;
+    }
+
+    if (net_bytes_from_str(d->mac, sizeof(d->mac), CONFIG_ETHSERIAL_MAC_ADDR) < 0)
+    {
+        LOG_ERR("Invalid MAC address: %s", CONFIG_ETHSERIAL_MAC_ADDR);
+        return -EINVAL;
+    }
+
+    SerFrame_decodeInit(&d->dec, FRAMING);
+    k_sem_init(&d->rx_sem, 0, 1);
+    k_sem_init(&d->tx_free, NUM_TX_BUFS, NUM_TX_BUFS);
+    k_mutex_init(&d->tx_lock);
+    d->tx_fill = 0;
+    d->tx_active = -1;
+    d->tx_next = -1;
+
+    k_thread_create(
+        &rx_thread,
+        rx_stack,
+        K_THREAD_STACK_SIZEOF(rx_stack),
+        rx_thread_fn,
+        d, NULL, NULL,
+        CONFIG_ETHSERIAL_RX_THREAD_PRIO,
+        0,
+        K_NO_WAIT);
+    k_thread_name_set(&rx_thread, "eth_serial_rx");
+
+    uart_irq_rx_disable(d->uart);
+    uart_irq_tx_disable(d->uart);
+    while (uart_fifo_read(d->uart, &c, 1) > 0)
+    {
+    }
+    uart_irq_callback_user_data_set(d->uart, uart_isr, d);
+    uart_irq_rx_enable(d->uart);
+
+#if CONFIG_ETHSERIAL_HDRCOMP
+    HdrComp_reset(&d->hc, 0);
+#endif
+#if CONFIG_ETHSERIAL_LINKCTL
+    d->rx_crc = 0xFFFF;
+#endif
+#if CONFIG_ETHSERIAL_AUTOBAUD
+    {
+        struct uart_config cfg;
+        int k;
+
+        if (uart_config_get(d->uart, &cfg) < 0)
+        {
+            LOG_ERR("UART does not support runtime configuration.");
+            return -ENOTSUP;
+        }
+        d->base_baud = cfg.baudrate;
+        d->stats.baud = cfg.baudrate;
+        d->ceiling = rate_index(MIN(CONFIG_ETHSERIAL_AUTOBAUD_MAX, baud_rates[NUM_RATES - 1]));
+        for (k = 0; k < NUM_RATES; k++)
+        {
+            d->steps[k].baud = baud_rates[k];
+        }
+    }
+
+    k_msgq_init(&d->link_q, d->link_q_buf, sizeof(LinkEvent),
+        sizeof(d->link_q_buf) / sizeof(LinkEvent));
+    k_thread_create(
+        &link_thread,
+        link_stack,
+        K_THREAD_STACK_SIZEOF(link_stack),
+        link_thread_fn,
+        d, NULL, NULL,
+        K_LOWEST_APPLICATION_THREAD_PRIO,
+        0,
+        K_NO_WAIT);
+    k_thread_name_set(&link_thread, "eth_serial_link");
+#endif
+#if CONFIG_ETHSERIAL_LINKCTL
+    k_work_init_delayable(&d->neg_work, neg_work_fn);
+    k_work_schedule(&d->neg_work, K_NO_WAIT);
+#endif
+
+    LOG_INF("%s framing on %s, %u byte rx ring",
+        (FRAMING == SERFRAME_SLIP) ? "SLIP" : "COBS",
+        d->uart->name,
+        CONFIG_ETHSERIAL_RX_RING_SIZE);
+
+    return 0;
+}
+
+ETH_NET_DEVICE_INIT(
+    eth_serial,
+    "eth_serial",
+    eth_init,
+    NULL,
+    &eth_data,
+    NULL,
+    CONFIG_ETHSERIAL_INIT_PRIORITY,
+    &eth_api,
+    NET_ETH_MTU);
+
+/** @brief Copy the driver statistics. */
+void
+EthSerial_getStats(EthSerial_Stats *stats)
+{
+    *stats = eth_data.stats;
+}
+
+#if CONFIG_ETHSERIAL_AUTOBAUD
+/** @brief Copy the auto-baud results, one entry per candidate rate.
+    Returns the number of entries. */
+int
+EthSerial_getBaudSteps(EthSerial_BaudStep *steps, int max)
+{
+    int n = MIN(max, (int)NUM_RATES);
+
+    memcpy(steps, eth_data.steps, n * sizeof(*steps));
+    return n;
+}
+#endif
+
+#if CONFIG_SHELL
+static int
+cmd_ethserial(const struct shell *sh, size_t argc, char **argv)
+{
+    EthSerial_Stats st;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    EthSerial_getStats(&st);
+    shell_print(sh, "rx: %u frames %u bytes, %u wakeups", st.rx_frames, st.rx_bytes, st.rx_wakeups);
+    shell_print(sh, "    bad %u nobuf %u oversize %u overrun %u bytes",
+        st.rx_bad, st.rx_nobuf, st.rx_oversize, st.rx_overrun);
+#if CONFIG_ETHSERIAL_LINKCTL
+    shell_print(sh, "    crc errors %u (crc %s)",
+        st.rx_crc_err, atomic_get(&eth_data.crc_on) ? "on" : "off");
+#endif
+    shell_print(sh, "tx: %u frames %u bytes (%u on the wire)",
+        st.tx_frames, st.tx_bytes, st.tx_wire_bytes);
+
+#if CONFIG_ETHSERIAL_HDRCOMP
+    {
+        const HdrComp_Stats *hs = &eth_data.hc.stats;
+
+        shell_print(sh, "hdrcomp: %s, %u slots",
+            atomic_get(&eth_data.hc_on) ? "on" : "off", eth_data.hc.num_slots);
+        shell_print(sh, "    tx comp %u uncomp %u raw %u, %u header bytes saved",
+            hs->tx_comp, hs->tx_uncomp, hs->tx_raw, hs->tx_saved);
+        shell_print(sh, "    rx comp %u uncomp %u dropped %u",
+            hs->rx_comp, hs->rx_uncomp, hs->rx_err);
+    }
+#endif
+#if CONFIG_ETHSERIAL_AUTOBAUD
+    {
+        EthSerial_BaudStep steps[NUM_RATES];
+        int n = EthSerial_getBaudSteps(steps, ARRAY_SIZE(steps));
+        int k;
+
+        shell_print(sh, "baud: %u (%u fallbacks)", st.baud, st.baud_fallbacks);
+        shell_print(sh, "    %8s %6s %8s %7s", "rate", "tries", "echoed", "errors");
+        for (k = 0; k < n; k++)
+        {
+            if (steps[k].tries == 0)
+            {
+                continue;
+            }
+            shell_print(sh, "    %8u %6u %3u/%-4u %7u%s",
+                steps[k].baud, steps[k].tries, steps[k].echoed, steps[k].probes,
+                steps[k].errors, steps[k].clean ? "" : " (rejected)");
+        }
+    }
+#endif
+    return 0;
+}
+
+SHELL_CMD_REGISTER(ethserial, NULL, "eth_serial driver statistics", cmd_ethserial);
+#endif
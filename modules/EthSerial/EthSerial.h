@@ -0,0 +1,81 @@
+/*******************************************************************************
+ *  @file: EthSerial.h
+ *
+ *  @brief: Ethernet over a UART.
+ *
+ *  Receive path: the UART ISR copies bytes from the FIFO straight into a
+ *  single-producer/single-consumer ring. It only wakes the decode thread when
+ *  it sees a frame delimiter or the ring passes half full. The decode thread
+ *  then drains every complete frame in the ring in one pass. Decoded runs are
+ *  written directly into the fragments of a preallocated net_pkt, which is
+ *  handed to the stack at the end of the frame.
+ *
+ *  Transmit path: each packet's fragment chain is encoded into one of two
+ *  frame buffers. The TX ISR drains the other buffer into the UART FIFO.
+ *
+ *  Optionally (CONFIG_ETHSERIAL_HDRCOMP) TCP/IPv4 headers are compressed on
+ *  the link (HdrComp.h), once the host has agreed to it in a link control
+ *  exchange.
+ *
+ *  Optionally (CONFIG_ETHSERIAL_AUTOBAUD) frames carry a CRC-16 and the link
+ *  steps up through faster baud rates once negotiated. Each rate is checked
+ *  with probe frames echoed by the host and kept only if every probe comes
+ *  back clean. A burst of line errors later steps the link back down.
+*******************************************************************************/
+#ifndef ETHSERIAL_H
+#define ETHSERIAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct EthSerial_Stats
+{
+    uint32_t rx_frames;
+    uint32_t rx_bytes;
+    /** @brief Frames with a framing error. */
+    uint32_t rx_bad;
+    /** @brief Frames dropped because no net_pkt was available. */
+    uint32_t rx_nobuf;
+    /** @brief Frames longer than the MTU. */
+    uint32_t rx_oversize;
+    /** @brief Bytes lost because the ring was full. */
+    uint32_t rx_overrun;
+    /** @brief Decode thread wakeups (rx_frames / rx_wakeups is the mean
+        batch). */
+    uint32_t rx_wakeups;
+    /** @brief Frames with a bad CRC (CONFIG_ETHSERIAL_LINKCTL). */
+    uint32_t rx_crc_err;
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    /** @brief Encoded bytes sent, framing overhead included. */
+    uint32_t tx_wire_bytes;
+    /** @brief Current UART rate (CONFIG_ETHSERIAL_AUTOBAUD). */
+    uint32_t baud;
+    /** @brief Rate reductions after error bursts. */
+    uint32_t baud_fallbacks;
+} EthSerial_Stats;
+
+/** @brief Result of the last probe run at one candidate rate. */
+typedef struct EthSerial_BaudStep
+{
+    uint32_t baud;
+    /** @brief Times the link switched to this rate. */
+    uint16_t tries;
+    uint16_t probes;
+    /** @brief Probes echoed back intact. */
+    uint16_t echoed;
+    /** @brief Bad or damaged frames received during the probe run. */
+    uint16_t errors;
+    bool clean;
+} EthSerial_BaudStep;
+
+/** @brief Copy the driver statistics. */
+void
+EthSerial_getStats(EthSerial_Stats *stats);
+
+/** @brief Copy the auto-baud results, one entry per candidate rate.
+    Returns the number of entries. */
+int
+EthSerial_getBaudSteps(EthSerial_BaudStep *steps, int max);
+
+#endif
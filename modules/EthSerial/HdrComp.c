@@ -0,0 +1,577 @@
+/*******************************************************************************
+ *  @file: HdrComp.c
+ *
+ *  @brief: TCP/IPv4 header compression for eth_serial.
+*******************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include "HdrComp.h"
+
+#define ETH_HLEN        14
+#define IP_OFF          ETH_HLEN
+#define TCP_OFF         (ETH_HLEN + 20)
+
+/* Offsets within the frame. */
+#define ETH_TYPE        12
+#define IP_VHL          (IP_OFF + 0)
+#define IP_TOS          (IP_OFF + 1)
+#define IP_LEN          (IP_OFF + 2)
+#define IP_ID           (IP_OFF + 4)
+#define IP_FRAG         (IP_OFF + 6)
+#define IP_PROTO        (IP_OFF + 9)
+#define IP_CSUM         (IP_OFF + 10)
+#define IP_ADDRS        (IP_OFF + 12)
+#define TCP_PORTS       (TCP_OFF + 0)
+#define TCP_SEQ         (TCP_OFF + 4)
+#define TCP_ACK         (TCP_OFF + 8)
+#define TCP_DOFF        (TCP_OFF + 12)
+#define TCP_FLAGS       (TCP_OFF + 13)
+#define TCP_WIN         (TCP_OFF + 14)
+#define TCP_CSUM        (TCP_OFF + 16)
+#define TCP_URG         (TCP_OFF + 18)
+#define TCP_OPTS        (TCP_OFF + 20)
+
+#define TH_FIN          0x01
+#define TH_SYN          0x02
+#define TH_RST          0x04
+#define TH_PSH          0x08
+#define TH_ACK          0x10
+#define TH_URG          0x20
+
+/* NOP, NOP, timestamp: the option layout Linux and Zephyr use on
+   established connections. */
+#define TS_OPTS_LEN     12
+#define TS_VAL          (TCP_OPTS + 4)
+#define TS_ECR          (TCP_OPTS + 8)
+
+static inline uint16_t
+get16(const uint8_t *p)
+{
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t
+get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void
+put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static inline void
+put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint16_t
+ip_csum(const uint8_t *ip)
+{
+    uint32_t sum = 0;
+    int k;
+
+    for (k = 0; k < 20; k += 2)
+    {
+        if (k != 10)
+        {
+            sum += get16(&ip[k]);
+        }
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+/** @brief Header length of a compressible TCP/IPv4 frame, or 0.
+    frame_len of 0 skips the IP length check (receive side). */
+static size_t
+tcp_hdr_len(const uint8_t *f, size_t avail, size_t frame_len)
+{
+    size_t hlen;
+
+    if (avail < TCP_OPTS ||
+        get16(&f[ETH_TYPE]) != 0x0800 ||
+        f[IP_VHL] != 0x45 ||
+        f[IP_PROTO] != 6 ||
+        (get16(&f[IP_FRAG]) & 0x3FFF) != 0)
+    {
+        return 0;
+    }
+
+    hlen = TCP_OFF + (f[TCP_DOFF] >> 4) * 4;
+    if (hlen < TCP_OPTS || hlen > avail)
+    {
+        return 0;
+    }
+
+    if (frame_len > 0 && (frame_len < hlen || get16(&f[IP_LEN]) != frame_len - ETH_HLEN))
+    {
+        /* Padded or truncated: the decompressor could not rebuild the
+           IP length. */
+        return 0;
+    }
+
+    return hlen;
+}
+
+static inline bool
+ts_layout(const uint8_t *f, size_t hlen)
+{
+    return hlen == TCP_OPTS + TS_OPTS_LEN &&
+        f[TCP_OPTS] == 1 && f[TCP_OPTS + 1] == 1 &&
+        f[TCP_OPTS + 2] == 8 && f[TCP_OPTS + 3] == 10;
+}
+
+/** @brief Whether everything not carried by a compressed frame matches the
+    context. */
+static bool
+same_flow_fields(const HdrComp_Ctx *ctx, const uint8_t *f, size_t hlen)
+{
+    const uint8_t *h = ctx->hdr;
+
+    if (hlen != ctx->hdr_len ||
+        memcmp(h, f, ETH_HLEN) != 0 ||
+        h[IP_TOS] != f[IP_TOS] ||
+        memcmp(&h[IP_FRAG], &f[IP_FRAG], 4) != 0 ||
+        memcmp(&h[IP_ADDRS], &f[IP_ADDRS], 12) != 0 ||
+        h[TCP_DOFF] != f[TCP_DOFF] ||
+        (h[TCP_FLAGS] & ~TH_PSH) != (f[TCP_FLAGS] & ~TH_PSH) ||
+        get16(&h[TCP_URG]) != get16(&f[TCP_URG]))
+    {
+        return false;
+    }
+
+    if (ts_layout(f, hlen))
+    {
+        return ts_layout(h, hlen);
+    }
+
+    return memcmp(&h[TCP_OPTS], &f[TCP_OPTS], hlen - TCP_OPTS) == 0;
+}
+
+/** @brief Append a delta: 1 byte for 1-255, else 0 and 16 bits. */
+static inline size_t
+put_delta(uint8_t *out, uint16_t v)
+{
+    if (v >= 1 && v <= 255)
+    {
+        out[0] = v;
+        return 1;
+    }
+    out[0] = 0;
+    put16(&out[1], v);
+    return 3;
+}
+
+static inline bool
+get_delta(const uint8_t *in, size_t len, size_t *pos, uint16_t *v)
+{
+    if (*pos >= len)
+    {
+        return false;
+    }
+    if (in[*pos] != 0)
+    {
+        *v = in[(*pos)++];
+        return true;
+    }
+    if (*pos + 3 > len)
+    {
+        return false;
+    }
+    *v = get16(&in[*pos + 1]);
+    *pos += 3;
+    return true;
+}
+
+/** @brief Clear all contexts. */
+void
+HdrComp_reset(HdrComp *c, uint8_t num_slots)
+{
+    memset(c->tx, 0, sizeof(c->tx));
+    memset(c->rx, 0, sizeof(c->rx));
+    c->clock = 0;
+    c->num_slots = (num_slots < HDRCOMP_SLOTS) ? num_slots : HDRCOMP_SLOTS;
+    c->rx_slot = -1;
+}
+
+/** @brief Find the TX context of the frame's flow, or the least recently
+    used one to replace. */
+static int
+tx_lookup(HdrComp *c, const uint8_t *f, bool *found)
+{
+    int victim = 0;
+    int k;
+
+    for (k = 0; k < c->num_slots; k++)
+    {
+        const HdrComp_Ctx *ctx = &c->tx[k];
+
+        if (ctx->valid &&
+            memcmp(&ctx->hdr[IP_ADDRS], &f[IP_ADDRS], 8) == 0 &&
+            memcmp(&ctx->hdr[TCP_PORTS], &f[TCP_PORTS], 4) == 0)
+        {
+            *found = true;
+            return k;
+        }
+
+        if (!ctx->valid)
+        {
+            victim = k;
+        }
+        else if (c->tx[victim].valid && ctx->used < c->tx[victim].used)
+        {
+            victim = k;
+        }
+    }
+
+    *found = false;
+    return victim;
+}
+
+/** @brief Compress the header of an outgoing frame. */
+size_t
+HdrComp_compress(
+    HdrComp *c,
+    const uint8_t *frame,
+    size_t avail,
+    size_t frame_len,
+    uint8_t *out,
+    size_t *skip)
+{
+    const uint8_t *f = frame;
+    HdrComp_Ctx *ctx;
+    size_t hlen;
+    size_t payload;
+    size_t pos;
+    uint32_t seq_d, ack_d;
+    uint16_t win_d, id_d;
+    uint32_t tv_d = 0, te_d = 0;
+    uint8_t mask = 0;
+    bool found;
+    int slot;
+
+    *skip = 0;
+
+    hlen = tcp_hdr_len(f, avail, frame_len);
+    if (c->num_slots == 0 || hlen == 0 ||
+        (f[TCP_FLAGS] & (TH_SYN | TH_FIN | TH_RST | TH_URG)) ||
+        !(f[TCP_FLAGS] & TH_ACK))
+    {
+        c->stats.tx_raw++;
+        out[0] = HDRCOMP_T_ETH;
+        return 1;
+    }
+
+    slot = tx_lookup(c, f, &found);
+    ctx = &c->tx[slot];
+    ctx->used = ++c->clock;
+    payload = frame_len - hlen;
+
+    if (!found || !same_flow_fields(ctx, f, hlen))
+    {
+        goto uncompressed;
+    }
+
+    seq_d = get32(&f[TCP_SEQ]) - get32(&ctx->hdr[TCP_SEQ]);
+    ack_d = get32(&f[TCP_ACK]) - get32(&ctx->hdr[TCP_ACK]);
+    win_d = get16(&f[TCP_WIN]) - get16(&ctx->hdr[TCP_WIN]);
+    id_d = get16(&f[IP_ID]) - get16(&ctx->hdr[IP_ID]);
+
+    /* Backwards or big jumps, retransmissions and duplicate ACKs. The
+       last two also let a receiver that lost sync recover. */
+    if (seq_d > 0xFFFF || ack_d > 0xFFFF ||
+        (payload > 0 && seq_d == 0) ||
+        (payload == 0 && seq_d == 0 && ack_d == 0 && win_d == 0))
+    {
+        goto uncompressed;
+    }
+
+    if (ts_layout(f, hlen))
+    {
+        tv_d = get32(&f[TS_VAL]) - get32(&ctx->hdr[TS_VAL]);
+        te_d = get32(&f[TS_ECR]) - get32(&ctx->hdr[TS_ECR]);
+        if (tv_d > 0xFFFF || te_d > 0xFFFF)
+        {
+            goto uncompressed;
+        }
+    }
+
+    pos = 5;
+    if (seq_d != 0)
+    {
+        if (seq_d == ctx->last_len)
+        {
+            mask |= HDRCOMP_D;
+        }
+        else
+        {
+            mask |= HDRCOMP_S;
+            pos += put_delta(&out[pos], seq_d);
+        }
+    }
+    if (ack_d != 0)
+    {
+        mask |= HDRCOMP_A;
+        pos += put_delta(&out[pos], ack_d);
+    }
+    if (win_d != 0)
+    {
+        mask |= HDRCOMP_W;
+        pos += put_delta(&out[pos], win_d);
+    }
+    if (id_d != 1)
+    {
+        mask |= HDRCOMP_I;
+        pos += put_delta(&out[pos], id_d);
+    }
+    if (f[TCP_FLAGS] & TH_PSH)
+    {
+        mask |= HDRCOMP_P;
+    }
+    if (tv_d != 0)
+    {
+        mask |= HDRCOMP_TV;
+        pos += put_delta(&out[pos], tv_d);
+    }
+    if (te_d != 0)
+    {
+        mask |= HDRCOMP_TE;
+        pos += put_delta(&out[pos], te_d);
+    }
+
+    out[0] = HDRCOMP_T_COMP;
+    out[1] = slot;
+    out[2] = mask;
+    out[3] = f[TCP_CSUM];
+    out[4] = f[TCP_CSUM + 1];
+
+    memcpy(ctx->hdr, f, hlen);
+    ctx->last_len = payload;
+
+    c->stats.tx_comp++;
+    c->stats.tx_saved += hlen - pos;
+    *skip = hlen;
+    return pos;
+
+uncompressed:
+    memcpy(ctx->hdr, f, hlen);
+    ctx->hdr_len = hlen;
+    ctx->valid = true;
+    ctx->last_len = payload;
+
+    c->stats.tx_uncomp++;
+    out[0] = HDRCOMP_T_UNCOMP;
+    out[1] = slot;
+    return 2;
+}
+
+static int
+rx_compressed(HdrComp *c, const uint8_t *in, size_t len, uint8_t *out, size_t *consumed)
+{
+    HdrComp_Ctx *ctx;
+    uint8_t *h = out;
+    size_t pos = 5;
+    uint8_t mask;
+    uint16_t v;
+    uint8_t slot;
+
+    if (len < 5)
+    {
+        return -EINVAL;
+    }
+
+    slot = in[1];
+    mask = in[2];
+    if (slot >= c->num_slots || !c->rx[slot].valid || c->rx[slot].toss)
+    {
+        return -EINVAL;
+    }
+    ctx = &c->rx[slot];
+
+    memcpy(h, ctx->hdr, ctx->hdr_len);
+    h[TCP_CSUM] = in[3];
+    h[TCP_CSUM + 1] = in[4];
+
+    if (mask & HDRCOMP_D)
+    {
+        put32(&h[TCP_SEQ], get32(&h[TCP_SEQ]) + ctx->last_len);
+    }
+    if (mask & HDRCOMP_S)
+    {
+        if (!get_delta(in, len, &pos, &v))
+        {
+            return -EINVAL;
+        }
+        put32(&h[TCP_SEQ], get32(&h[TCP_SEQ]) + v);
+    }
+    if (mask & HDRCOMP_A)
+    {
+        if (!get_delta(in, len, &pos, &v))
+        {
+            return -EINVAL;
+        }
+        put32(&h[TCP_ACK], get32(&h[TCP_ACK]) + v);
+    }
+    if (mask & HDRCOMP_W)
+    {
+        if (!get_delta(in, len, &pos, &v))
+        {
+            return -EINVAL;
+        }
+        put16(&h[TCP_WIN], get16(&h[TCP_WIN]) + v);
+    }
+    v = 1;
+    if ((mask & HDRCOMP_I) && !get_delta(in, len, &pos, &v))
+    {
+        return -EINVAL;
+    }
+    put16(&h[IP_ID], get16(&h[IP_ID]) + v);
+
+    h[TCP_FLAGS] = (mask & HDRCOMP_P) ?
+        (h[TCP_FLAGS] | TH_PSH) : (h[TCP_FLAGS] & ~TH_PSH);
+
+    if (mask & (HDRCOMP_TV | HDRCOMP_TE))
+    {
+        if (!ts_layout(h, ctx->hdr_len))
+        {
+            return -EINVAL;
+        }
+        if (mask & HDRCOMP_TV)
+        {
+            if (!get_delta(in, len, &pos, &v))
+            {
+                return -EINVAL;
+            }
+            put32(&h[TS_VAL], get32(&h[TS_VAL]) + v);
+        }
+        if (mask & HDRCOMP_TE)
+        {
+            if (!get_delta(in, len, &pos, &v))
+            {
+                return -EINVAL;
+            }
+            put32(&h[TS_ECR], get32(&h[TS_ECR]) + v);
+        }
+    }
+
+    /* Length and checksum are filled in by HdrComp_rxEnd(). */
+    memcpy(ctx->hdr, h, ctx->hdr_len);
+    c->rx_slot = slot;
+    c->rx_comp = true;
+    *consumed = pos;
+    return ctx->hdr_len;
+}
+
+/** @brief Expand the prefix of a received frame. */
+int
+HdrComp_decompress(
+    HdrComp *c,
+    const uint8_t *in,
+    size_t len,
+    uint8_t *out,
+    size_t *consumed)
+{
+    HdrComp_Ctx *ctx;
+    size_t hlen;
+    int ret;
+
+    c->rx_slot = -1;
+
+    if (len < 1)
+    {
+        return -EINVAL;
+    }
+
+    switch (in[0])
+    {
+    case HDRCOMP_T_ETH:
+        *consumed = 1;
+        return 0;
+
+    case HDRCOMP_T_UNCOMP:
+        if (len < 2 || in[1] >= c->num_slots)
+        {
+            break;
+        }
+        hlen = tcp_hdr_len(&in[2], len - 2, 0);
+        if (hlen == 0)
+        {
+            break;
+        }
+        ctx = &c->rx[in[1]];
+        memcpy(ctx->hdr, &in[2], hlen);
+        ctx->hdr_len = hlen;
+        ctx->valid = true;
+        ctx->toss = false;
+        c->rx_slot = in[1];
+        c->rx_comp = false;
+        c->stats.rx_uncomp++;
+        *consumed = 2;
+        return 0;
+
+    case HDRCOMP_T_COMP:
+        ret = rx_compressed(c, in, len, out, consumed);
+        if (ret < 0)
+        {
+            break;
+        }
+        c->stats.rx_comp++;
+        return ret;
+
+    default:
+        break;
+    }
+
+    c->stats.rx_err++;
+    return -EINVAL;
+}
+
+/** @brief Finish a received frame once its length is known. */
+bool
+HdrComp_rxEnd(HdrComp *c, size_t frame_len, uint8_t *ip)
+{
+    HdrComp_Ctx *ctx;
+
+    if (c->rx_slot < 0)
+    {
+        return false;
+    }
+
+    ctx = &c->rx[c->rx_slot];
+    c->rx_slot = -1;
+    ctx->last_len = (frame_len > ctx->hdr_len) ? frame_len - ctx->hdr_len : 0;
+
+    if (!c->rx_comp)
+    {
+        return false;
+    }
+
+    put16(&ip[2], frame_len - ETH_HLEN);
+    put16(&ip[10], ip_csum(ip));
+    memcpy(&ctx->hdr[IP_OFF], ip, 20);
+    return true;
+}
+
+/** @brief A received frame was lost or damaged. */
+void
+HdrComp_rxToss(HdrComp *c)
+{
+    int k;
+
+    for (k = 0; k < HDRCOMP_SLOTS; k++)
+    {
+        c->rx[k].toss = true;
+    }
+    c->rx_slot = -1;
+}
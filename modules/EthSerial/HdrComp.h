@@ -0,0 +1,157 @@
+/*******************************************************************************
+ *  @file: HdrComp.h
+ *
+ *  @brief: TCP/IPv4 header compression for eth_serial (Van Jacobson style,
+ *  RFC 1144, extended for the TCP timestamp option).
+ *
+ *  Each direction keeps a context (the previous Ethernet + IPv4 + TCP
+ *  header) per flow, in a small table indexed by a slot number chosen by the
+ *  compressor. Every frame on the link starts with a type byte:
+ *
+ *  HDRCOMP_T_ETH:     raw Ethernet frame follows.
+ *  HDRCOMP_T_UNCOMP:  slot, then the raw frame. Loads the slot's context.
+ *  HDRCOMP_T_COMP:    slot, change mask, TCP checksum (2), then the deltas
+ *                     selected by the mask, then the TCP payload.
+ *
+ *  Deltas are sent in mask bit order as 1 byte (1-255) or as 0 followed by
+ *  a big-endian 16-bit value. The Ethernet header, addresses, ports, TTL,
+ *  TOS and TCP options other than timestamps come from the context. The IP
+ *  length and checksum are recomputed by the decompressor. The IP ID is
+ *  assumed to advance by 1 unless HDRCOMP_I is set. HDRCOMP_D means the
+ *  sequence number advanced by the previous segment's payload length.
+ *
+ *  Only ACK segments with no SYN, FIN, RST or URG, no IP options and no
+ *  fragmentation are compressed. Anything unusual (retransmissions, large
+ *  jumps, changed options) is sent uncompressed, which also resynchronizes
+ *  the receiver. After a lost or damaged frame the receiver drops
+ *  compressed frames until each context is reloaded; TCP retransmission
+ *  does the rest, as in RFC 1144.
+*******************************************************************************/
+#ifndef HDRCOMP_H
+#define HDRCOMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef HDRCOMP_SLOTS
+#define HDRCOMP_SLOTS   CONFIG_ETHSERIAL_HDRCOMP_SLOTS
+#endif
+
+#define HDRCOMP_T_ETH       0x00
+#define HDRCOMP_T_UNCOMP    0x01
+#define HDRCOMP_T_COMP      0x02
+
+/** @brief Change mask bits. */
+#define HDRCOMP_S           0x01    /* seq delta */
+#define HDRCOMP_A           0x02    /* ack delta */
+#define HDRCOMP_W           0x04    /* window delta (signed 16-bit) */
+#define HDRCOMP_I           0x08    /* IP ID delta, if not 1 */
+#define HDRCOMP_P           0x10    /* PSH set */
+#define HDRCOMP_TV          0x20    /* TSval delta */
+#define HDRCOMP_TE          0x40    /* TSecr delta */
+#define HDRCOMP_D           0x80    /* seq += previous payload length */
+
+/** @brief Ethernet + IPv4 + TCP with the longest TCP options. */
+#define HDRCOMP_MAX_HDR     (14 + 20 + 60)
+
+/** @brief Longest prefix the compressor emits: type, slot, mask, checksum
+    and six 3-byte deltas. */
+#define HDRCOMP_MAX_PREFIX  (5 + 6 * 3)
+
+typedef struct HdrComp_Ctx
+{
+    uint8_t hdr[HDRCOMP_MAX_HDR];
+    uint8_t hdr_len;
+    bool valid;
+    /** @brief RX: lost sync, drop compressed frames until reloaded. */
+    bool toss;
+    uint16_t last_len;
+    /** @brief TX: last use, for replacement. */
+    uint32_t used;
+} HdrComp_Ctx;
+
+typedef struct HdrComp_Stats
+{
+    uint32_t tx_raw;
+    uint32_t tx_uncomp;
+    uint32_t tx_comp;
+    /** @brief Header bytes not sent thanks to compression. */
+    uint32_t tx_saved;
+    uint32_t rx_uncomp;
+    uint32_t rx_comp;
+    /** @brief Compressed frames dropped (bad slot, lost sync, truncated). */
+    uint32_t rx_err;
+} HdrComp_Stats;
+
+typedef struct HdrComp
+{
+    uint8_t num_slots;
+    uint32_t clock;
+    HdrComp_Ctx tx[HDRCOMP_SLOTS];
+    HdrComp_Ctx rx[HDRCOMP_SLOTS];
+    /** @brief RX slot awaiting HdrComp_rxEnd(), or -1. */
+    int8_t rx_slot;
+    bool rx_comp;
+    HdrComp_Stats stats;
+} HdrComp;
+
+/** @brief Clear all contexts (statistics are kept). num_slots is the
+    negotiated slot count, at most HDRCOMP_SLOTS; 0 sends every frame raw. */
+void
+HdrComp_reset(HdrComp *c, uint8_t num_slots);
+
+/** @brief Compress the header of an outgoing frame.
+    @param c          Compressor.
+    @param frame      Start of the frame.
+    @param avail      Bytes available at frame (the frame or at least
+                      HDRCOMP_MAX_HDR of it).
+    @param frame_len  Full frame length.
+    @param out        Receives the prefix (HDRCOMP_MAX_PREFIX bytes).
+    @param skip       Set to the number of frame bytes the prefix replaces.
+    @return Prefix length. Send the prefix, then frame[*skip..].
+*/
+size_t
+HdrComp_compress(
+    HdrComp *c,
+    const uint8_t *frame,
+    size_t avail,
+    size_t frame_len,
+    uint8_t *out,
+    size_t *skip);
+
+/** @brief Expand the prefix of a received frame.
+    @param c         Decompressor.
+    @param in        Start of the received frame.
+    @param len       Bytes available (HDRCOMP_MAX_HDR + 2, or the whole
+                     frame if shorter).
+    @param out       Receives the reconstructed header (HDRCOMP_MAX_HDR).
+    @param consumed  Set to the number of input bytes used.
+    @return Bytes written to out (0 for raw and uncompressed frames: the
+            frame follows the prefix as is), or a negative errno if the
+            frame must be dropped.
+*/
+int
+HdrComp_decompress(
+    HdrComp *c,
+    const uint8_t *in,
+    size_t len,
+    uint8_t *out,
+    size_t *consumed);
+
+/** @brief Finish a received frame once its length is known.
+    @param c          Decompressor.
+    @param frame_len  Length of the delivered Ethernet frame.
+    @param ip         The frame's IPv4 header (20 bytes).
+    @return true if ip was updated (length and checksum) and must be
+            written back.
+*/
+bool
+HdrComp_rxEnd(HdrComp *c, size_t frame_len, uint8_t *ip);
+
+/** @brief A received frame was lost or damaged: drop compressed frames
+    until each context is reloaded. */
+void
+HdrComp_rxToss(HdrComp *c);
+
+#endif
@@ -0,0 +1,431 @@
+/*******************************************************************************
+ *  @file: SerFrame.c
+ *
+ *  @brief: Streaming SLIP and COBS framing for eth_serial.
+*******************************************************************************/
+#include <string.h>
+#include "SerFrame.h"
+
+#define MIN_SIZE(a, b)  ((a) < (b) ? (a) : (b))
+
+#define ONES            0x01010101u
+#define HIGHS           0x80808080u
+
+/* Runs are scanned a 32-bit word at a time (SWAR): a word has a byte equal
+   to b iff has_zero(v ^ ONES * b) is non-zero. Loads go through memcpy so
+   unaligned input is fine on cores without unaligned access. */
+static inline uint32_t
+load32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t
+has_zero(uint32_t v)
+{
+    return (v - ONES) & ~v & HIGHS;
+}
+
+static inline uint32_t
+slip_special(uint32_t v)
+{
+    return has_zero(v ^ (ONES * SLIP_END)) | has_zero(v ^ (ONES * SLIP_ESC));
+}
+
+/** @brief Length of the run at p that needs no SLIP escaping. */
+static inline size_t
+slip_run(const uint8_t *p, size_t len)
+{
+    size_t k = 0;
+
+    while (k + 4 <= len)
+    {
+        if (slip_special(load32(&p[k])))
+        {
+            break;
+        }
+        k += 4;
+    }
+
+    for (; k < len; k++)
+    {
+        if (p[k] == SLIP_END || p[k] == SLIP_ESC)
+        {
+            break;
+        }
+    }
+    return k;
+}
+
+/** @brief Length of the run at p that contains no zero byte. */
+static inline size_t
+zero_run(const uint8_t *p, size_t len)
+{
+    size_t k = 0;
+
+    while (k + 4 <= len && !has_zero(load32(&p[k])))
+    {
+        k += 4;
+    }
+
+    for (; k < len; k++)
+    {
+        if (p[k] == 0)
+        {
+            break;
+        }
+    }
+    return k;
+}
+
+/** @brief Start encoding a frame into out. */
+void
+SerFrame_encodeBegin(SerFrame_Encoder *enc, SerFrame_Type type, uint8_t *out)
+{
+    enc->type = type;
+    enc->out = out;
+
+    if (type == SERFRAME_SLIP)
+    {
+        out[0] = SLIP_END;
+        enc->pos = 1;
+    }
+    else
+    {
+        out[0] = COBS_DELIM;
+        enc->code_pos = 1;
+        enc->code = 1;
+        enc->pos = 2;
+    }
+}
+
+static inline size_t
+slip_put(uint8_t *out, size_t pos, uint8_t b)
+{
+    if (b == SLIP_END || b == SLIP_ESC)
+    {
+        out[pos++] = SLIP_ESC;
+        out[pos++] = (b == SLIP_END) ? SLIP_ESC_END : SLIP_ESC_ESC;
+    }
+    else
+    {
+        out[pos++] = b;
+    }
+    return pos;
+}
+
+static void
+slip_feed(SerFrame_Encoder *enc, const uint8_t *data, size_t len)
+{
+    uint8_t *out = enc->out;
+    size_t pos = enc->pos;
+    size_t k = 0;
+
+    /* Clean words are copied whole; a word holding a byte to escape is
+       done bytewise, so heavily escaped data costs no more than a plain
+       byte loop. */
+    while (k + 4 <= len)
+    {
+        uint32_t v = load32(&data[k]);
+
+        if (!slip_special(v))
+        {
+            memcpy(&out[pos], &v, sizeof(v));
+            pos += 4;
+            k += 4;
+            continue;
+        }
+
+        pos = slip_put(out, pos, data[k]);
+        pos = slip_put(out, pos, data[k + 1]);
+        pos = slip_put(out, pos, data[k + 2]);
+        pos = slip_put(out, pos, data[k + 3]);
+        k += 4;
+    }
+
+    for (; k < len; k++)
+    {
+        pos = slip_put(out, pos, data[k]);
+    }
+
+    enc->pos = pos;
+}
+
+static inline void
+cobs_close_block(SerFrame_Encoder *enc, size_t *pos)
+{
+    enc->out[enc->code_pos] = enc->code;
+    enc->code_pos = (*pos)++;
+    enc->code = 1;
+}
+
+static void
+cobs_feed(SerFrame_Encoder *enc, const uint8_t *data, size_t len)
+{
+    uint8_t *out = enc->out;
+    size_t pos = enc->pos;
+
+    while (len > 0)
+    {
+        size_t n;
+
+        if (*data == 0)
+        {
+            /* The zero is implied by the block's code. */
+            cobs_close_block(enc, &pos);
+            data++;
+            len--;
+            continue;
+        }
+
+        /* Copy up to the next zero or the end of the 254 byte block. */
+        n = zero_run(data, MIN_SIZE(len, 0xFFu - enc->code));
+        memcpy(&out[pos], data, n);
+        pos += n;
+        data += n;
+        len -= n;
+        enc->code += n;
+
+        if (enc->code == 0xFF)
+        {
+            /* Full block: no zero implied. */
+            cobs_close_block(enc, &pos);
+        }
+    }
+
+    enc->pos = pos;
+}
+
+/** @brief Append frame data. */
+void
+SerFrame_encodeFeed(SerFrame_Encoder *enc, const uint8_t *data, size_t len)
+{
+    if (enc->type == SERFRAME_SLIP)
+    {
+        slip_feed(enc, data, len);
+    }
+    else
+    {
+        cobs_feed(enc, data, len);
+    }
+}
+
+/** @brief Terminate the frame. */
+size_t
+SerFrame_encodeEnd(SerFrame_Encoder *enc)
+{
+    if (enc->type == SERFRAME_SLIP)
+    {
+        enc->out[enc->pos++] = SLIP_END;
+    }
+    else
+    {
+        enc->out[enc->code_pos] = enc->code;
+        enc->out[enc->pos++] = COBS_DELIM;
+    }
+
+    return enc->pos;
+}
+
+void
+SerFrame_decodeInit(SerFrame_Decoder *dec, SerFrame_Type type)
+{
+    dec->type = type;
+    SerFrame_decodeNext(dec);
+}
+
+/** @brief Decoder output. Short runs (escaped bytes, COBS zeros, short
+    plain runs) are gathered in the stage so that heavily escaped frames don't
+    cost a sink call per byte; long runs go straight to the sink. Held in a
+    local while decoding so byte stores into the stage don't force the
+    decoder state to be reloaded from memory. */
+typedef struct Output
+{
+    SerFrame_Sink sink;
+    void *arg;
+    uint8_t *stage;
+    size_t staged;
+    uint32_t len;
+} Output;
+
+static inline void
+out_flush(Output *o)
+{
+    if (o->staged > 0)
+    {
+        o->sink(o->arg, o->stage, o->staged);
+        o->staged = 0;
+    }
+}
+
+static inline void
+out_byte(Output *o, uint8_t b)
+{
+    if (o->staged == SERFRAME_STAGE_SIZE)
+    {
+        out_flush(o);
+    }
+    o->stage[o->staged++] = b;
+    o->len++;
+}
+
+static inline void
+out_run(Output *o, const uint8_t *p, size_t n)
+{
+    o->len += n;
+
+    if (n < SERFRAME_STAGE_DIRECT)
+    {
+        if (o->staged + n > SERFRAME_STAGE_SIZE)
+        {
+            out_flush(o);
+        }
+        memcpy(&o->stage[o->staged], p, n);
+        o->staged += n;
+        return;
+    }
+
+    out_flush(o);
+    o->sink(o->arg, p, n);
+}
+
+static size_t
+slip_decode(SerFrame_Decoder *dec, Output *o, const uint8_t *in, size_t len, bool *frame_end)
+{
+    bool esc = dec->esc;
+    size_t k = 0;
+
+    while (k < len)
+    {
+        uint8_t b = in[k++];
+
+        if (esc)
+        {
+            esc = false;
+            if (b == SLIP_ESC_END)
+            {
+                out_byte(o, SLIP_END);
+            }
+            else if (b == SLIP_ESC_ESC)
+            {
+                out_byte(o, SLIP_ESC);
+            }
+            else
+            {
+                dec->bad = true;
+                if (b == SLIP_END)
+                {
+                    *frame_end = true;
+                    break;
+                }
+            }
+        }
+        else if (b == SLIP_END)
+        {
+            *frame_end = true;
+            break;
+        }
+        else if (b == SLIP_ESC)
+        {
+            esc = true;
+        }
+        else
+        {
+            size_t n = 1 + slip_run(&in[k], len - k);
+            out_run(o, &in[k - 1], n);
+            k += n - 1;
+        }
+    }
+
+    dec->esc = esc;
+    return k;
+}
+
+static size_t
+cobs_decode(SerFrame_Decoder *dec, Output *o, const uint8_t *in, size_t len, bool *frame_end)
+{
+    size_t left = dec->left;
+    bool zero_pending = dec->zero_pending;
+    size_t k = 0;
+
+    while (k < len)
+    {
+        uint8_t b;
+
+        if (left > 0)
+        {
+            size_t n = zero_run(&in[k], MIN_SIZE(len - k, left));
+            if (n > 0)
+            {
+                out_run(o, &in[k], n);
+                left -= n;
+                k += n;
+            }
+            if (k < len && left > 0)
+            {
+                /* Delimiter inside a block: truncated frame. */
+                dec->bad = true;
+                *frame_end = true;
+                k++;
+                break;
+            }
+            continue;
+        }
+
+        b = in[k++];
+        if (b == COBS_DELIM)
+        {
+            /* The zero owed by the final block is dropped. */
+            *frame_end = true;
+            break;
+        }
+
+        if (zero_pending)
+        {
+            out_byte(o, 0);
+        }
+        left = b - 1;
+        zero_pending = (b != 0xFF);
+    }
+
+    dec->left = left;
+    dec->zero_pending = zero_pending;
+    return k;
+}
+
+/** @brief Decode input until the end of a frame or of the input. */
+size_t
+SerFrame_decode(
+    SerFrame_Decoder *dec,
+    const uint8_t *in,
+    size_t len,
+    SerFrame_Sink sink,
+    void *arg,
+    bool *frame_end)
+{
+    Output o = {
+        .sink = sink,
+        .arg = arg,
+        .stage = dec->stage,
+        .staged = 0,
+        .len = 0
+    };
+    size_t n;
+
+    *frame_end = false;
+
+    if (dec->type == SERFRAME_SLIP)
+    {
+        n = slip_decode(dec, &o, in, len, frame_end);
+    }
+    else
+    {
+        n = cobs_decode(dec, &o, in, len, frame_end);
+    }
+
+    out_flush(&o);
+    dec->len += o.len;
+    return n;
+}
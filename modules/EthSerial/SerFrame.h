@@ -0,0 +1,122 @@
+/*******************************************************************************
+ *  @file: SerFrame.h
+ *
+ *  @brief: Streaming SLIP and COBS framing for eth_serial.
+ *
+ *  Encoders run incrementally over the fragments of a packet into one
+ *  linear output buffer, so a net_buf chain is framed without first being
+ *  linearized. Decoders run incrementally over whatever bytes the UART has
+ *  delivered. Decoded data is passed to a sink callback in contiguous runs
+ *  (everything between escapes or COBS code bytes), so the sink can write
+ *  straight into packet buffers; short runs are gathered into one call.
+ *  Runs are found by scanning a 32-bit word at a time.
+ *
+ *  SLIP: RFC 1055, END-delimited at both ends of a frame.
+ *  COBS: 0x00-delimited, with a leading delimiter as well.
+*******************************************************************************/
+#ifndef SERFRAME_H
+#define SERFRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SLIP_END        0xC0
+#define SLIP_ESC        0xDB
+#define SLIP_ESC_END    0xDC
+#define SLIP_ESC_ESC    0xDD
+
+#define COBS_DELIM      0x00
+
+typedef enum SerFrame_Type
+{
+    SERFRAME_SLIP = 0,
+    SERFRAME_COBS
+} SerFrame_Type;
+
+/** @brief Decoder staging buffer size, and the run length from which runs
+    bypass it and go straight to the sink. */
+#define SERFRAME_STAGE_SIZE     32
+#define SERFRAME_STAGE_DIRECT   8
+
+/** @brief Worst-case encoded size of a len byte frame, delimiters included. */
+#define SERFRAME_MAX_ENCODED(len)   (2 * (len) + 3)
+
+typedef struct SerFrame_Encoder
+{
+    SerFrame_Type type;
+    uint8_t *out;
+    size_t pos;
+    /** @brief COBS: position of the pending code byte and its count. */
+    size_t code_pos;
+    uint8_t code;
+} SerFrame_Encoder;
+
+/** @brief Called with each run of decoded bytes. */
+typedef void (*SerFrame_Sink)(void *arg, const uint8_t *data, size_t len);
+
+typedef struct SerFrame_Decoder
+{
+    SerFrame_Type type;
+    /** @brief SLIP: previous byte was ESC. */
+    bool esc;
+    /** @brief COBS: data bytes left in the current block, and whether a
+        zero is owed before the next block. */
+    uint8_t left;
+    bool zero_pending;
+    /** @brief Set on a protocol error; cleared at the next delimiter. */
+    bool bad;
+    uint32_t len;
+    /** @brief Gathers short runs for the sink. Always flushed before
+        SerFrame_decode() returns. */
+    uint8_t stage[SERFRAME_STAGE_SIZE];
+} SerFrame_Decoder;
+
+/** @brief Start encoding a frame into out. out must have room for
+    SERFRAME_MAX_ENCODED() of the frame length. */
+void
+SerFrame_encodeBegin(SerFrame_Encoder *enc, SerFrame_Type type, uint8_t *out);
+
+/** @brief Append frame data. */
+void
+SerFrame_encodeFeed(SerFrame_Encoder *enc, const uint8_t *data, size_t len);
+
+/** @brief Terminate the frame. Returns the encoded length. */
+size_t
+SerFrame_encodeEnd(SerFrame_Encoder *enc);
+
+void
+SerFrame_decodeInit(SerFrame_Decoder *dec, SerFrame_Type type);
+
+/** @brief Decode input until the end of a frame or of the input.
+    @param dec        Decoder.
+    @param in         Received bytes.
+    @param len        Number of bytes.
+    @param sink       Receives decoded runs of the current frame.
+    @param arg        Sink argument.
+    @param frame_end  Set true if a frame delimiter was consumed. The frame
+                      is complete and valid if dec->len > 0 and !dec->bad;
+                      call SerFrame_decodeNext() before decoding further.
+    @return Number of input bytes consumed.
+*/
+size_t
+SerFrame_decode(
+    SerFrame_Decoder *dec,
+    const uint8_t *in,
+    size_t len,
+    SerFrame_Sink sink,
+    void *arg,
+    bool *frame_end);
+
+/** @brief Reset per-frame state after a frame end. */
+static inline void
+SerFrame_decodeNext(SerFrame_Decoder *dec)
+{
+    dec->esc = false;
+    dec->left = 0;
+    dec->zero_pending = false;
+    dec->bad = false;
+    dec->len = 0;
+}
+
+#endif
@@ -0,0 +1,243 @@
+/*******************************************************************************
+ *  @file: FixedJson.c
+ *
+ *  @brief: Single-pass JSON object encoder for fixed-point values.
+*******************************************************************************/
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include "FixedJson.h"
+
+/** @brief Output cursor. end leaves room for the NUL. */
+typedef struct Writer
+{
+    char *p;
+    char *end;
+    bool full;
+} Writer;
+
+static const uint32_t pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+static inline void
+put_char(Writer *w, char c)
+{
+    if (w->p < w->end)
+    {
+        *w->p++ = c;
+    }
+    else
+    {
+        w->full = true;
+    }
+}
+
+static void
+put_mem(Writer *w, const char *s, size_t len)
+{
+    if ((size_t)(w->end - w->p) < len)
+    {
+        w->full = true;
+        return;
+    }
+    memcpy(w->p, s, len);
+    w->p += len;
+}
+
+/** @brief Decimal digits of v, at least min_digits (zero padded). */
+static void
+put_uint(Writer *w, uint32_t v, uint8_t min_digits)
+{
+    char tmp[10];
+    int n = 0;
+
+    do
+    {
+        tmp[n++] = '0' + (v % 10);
+        v /= 10;
+    } while (v);
+
+    while (n < min_digits)
+    {
+        tmp[n++] = '0';
+    }
+
+    while (n)
+    {
+        put_char(w, tmp[--n]);
+    }
+}
+
+static void
+put_int(Writer *w, int32_t v)
+{
+    if (v < 0)
+    {
+        put_char(w, '-');
+        put_uint(w, 0u - (uint32_t)v, 1);
+    }
+    else
+    {
+        put_uint(w, v, 1);
+    }
+}
+
+static void
+put_sensor_value(Writer *w, const struct sensor_value *val, uint8_t decimals)
+{
+    /* val2 is in millionths, with the sign of val1 (or its own sign when
+       val1 is 0). */
+    bool neg = (val->val1 < 0) || (val->val2 < 0);
+    uint32_t ip = (val->val1 < 0) ? 0u - (uint32_t)val->val1 : (uint32_t)val->val1;
+    uint32_t fp = (val->val2 < 0) ? 0u - (uint32_t)val->val2 : (uint32_t)val->val2;
+    uint32_t scale = pow10[6 - decimals];
+
+    /* Round half away from zero to decimals digits. */
+    fp = (fp + scale / 2) / scale;
+    if (fp >= pow10[decimals])
+    {
+        fp -= pow10[decimals];
+        ip++;
+    }
+
+    if (neg && (ip || fp))
+    {
+        put_char(w, '-');
+    }
+    put_uint(w, ip, 1);
+    if (decimals)
+    {
+        put_char(w, '.');
+        put_uint(w, fp, decimals);
+    }
+}
+
+static void
+put_string(Writer *w, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    if (!s)
+    {
+        put_mem(w, "null", 4);
+        return;
+    }
+
+    put_char(w, '"');
+    for (; *s; s++)
+    {
+        char c = *s;
+
+        if (c == '"' || c == '\\')
+        {
+            put_char(w, '\\');
+            put_char(w, c);
+        }
+        else if ((uint8_t)c < 0x20)
+        {
+            put_mem(w, "\\u00", 4);
+            put_char(w, hex[(c >> 4) & 0xf]);
+            put_char(w, hex[c & 0xf]);
+        }
+        else
+        {
+            put_char(w, c);
+        }
+    }
+    put_char(w, '"');
+}
+
+int
+FixedJson_encode(
+    const FixedJson_Field *fields,
+    size_t num_fields,
+    const void *obj,
+    char *buf,
+    size_t size)
+{
+    Writer w;
+    size_t k;
+
+    if (size == 0)
+    {
+        return -ENOMEM;
+    }
+
+    w.p = buf;
+    w.end = buf + size - 1;
+    w.full = false;
+
+    put_char(&w, '{');
+    for (k = 0; k < num_fields; k++)
+    {
+        const FixedJson_Field *f = &fields[k];
+        const uint8_t *member = (const uint8_t *)obj + f->offset;
+
+        if (k)
+        {
+            put_char(&w, ',');
+        }
+        put_char(&w, '"');
+        put_mem(&w, f->name, f->name_len);
+        put_mem(&w, "\":", 2);
+
+        switch (f->type)
+        {
+        case FIXEDJSON_SENSOR_VALUE:
+            if (f->decimals > 6)
+            {
+                return -EINVAL;
+            }
+            put_sensor_value(&w, (const struct sensor_value *)member, f->decimals);
+            break;
+        case FIXEDJSON_INT32:
+            put_int(&w, *(const int32_t *)member);
+            break;
+        case FIXEDJSON_UINT32:
+            put_uint(&w, *(const uint32_t *)member, 1);
+            break;
+        case FIXEDJSON_BOOL:
+            if (*(const bool *)member)
+            {
+                put_mem(&w, "true", 4);
+            }
+            else
+            {
+                put_mem(&w, "false", 5);
+            }
+            break;
+        case FIXEDJSON_STRING:
+            put_string(&w, *(const char *const *)member);
+            break;
+        default:
+            return -EINVAL;
+        }
+
+        if (w.full)
+        {
+            return -ENOMEM;
+        }
+    }
+    put_char(&w, '}');
+
+    if (w.full)
+    {
+        return -ENOMEM;
+    }
+
+    *w.p = '\0';
+    return w.p - buf;
+}
+
+int
+FixedJson_putSensorValue(const struct sensor_value *val, uint8_t decimals, char *buf, size_t size)
+{
+    Writer w = { .p = buf, .end = buf + size, .full = false };
+
+    if (decimals > 6)
+    {
+        return -EINVAL;
+    }
+
+    put_sensor_value(&w, val, decimals);
+    return w.full ? -ENOMEM : (w.p - buf);
+}
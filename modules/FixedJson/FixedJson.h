@@ -0,0 +1,85 @@
+/*******************************************************************************
+ *  @file: FixedJson.h
+ *
+ *  @brief: Single-pass JSON object encoder for fixed-point values.
+ *
+ *  Encodes a struct into a flat JSON object, driven by a table of fields.
+ *  A struct sensor_value is written straight from its integer and
+ *  millionths parts, rounded to the field's number of decimals, so no
+ *  float or double math is needed (the ESP32-C3 has no FPU). Output goes
+ *  straight into the caller's buffer in one pass. There is no length
+ *  pre-pass: if the buffer runs out, the encode fails.
+ *
+ *  Example:
+ *    struct reading { struct sensor_value temp; uint32_t seq; };
+ *    static const FixedJson_Field reading_fields[] = {
+ *        FIXEDJSON_FIELD(struct reading, temp, FIXEDJSON_SENSOR_VALUE, 2),
+ *        FIXEDJSON_FIELD(struct reading, seq, FIXEDJSON_UINT32, 0),
+ *    };
+ *    len = FixedJson_encode(reading_fields, ARRAY_SIZE(reading_fields),
+ *        &r, buf, sizeof(buf));
+ *  gives {"temp":21.57,"seq":12}.
+ *
+ *  Needs only struct sensor_value from Zephyr, so it can be tested on the
+ *  host (tools/fixedjson_test).
+*******************************************************************************/
+#ifndef FIXEDJSON_H
+#define FIXEDJSON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <zephyr/drivers/sensor.h>
+
+typedef enum FixedJson_Type
+{
+    /** @brief struct sensor_value, with decimals (0 to 6) digits. */
+    FIXEDJSON_SENSOR_VALUE = 0,
+    FIXEDJSON_INT32,
+    FIXEDJSON_UINT32,
+    FIXEDJSON_BOOL,
+    /** @brief const char *, escaped. NULL is written as null. */
+    FIXEDJSON_STRING
+} FixedJson_Type;
+
+typedef struct FixedJson_Field
+{
+    const char *name;
+    uint8_t name_len;
+    uint8_t type;
+    uint8_t decimals;
+    uint16_t offset;
+} FixedJson_Field;
+
+/** @brief A field for member of struct_, named after the member. */
+#define FIXEDJSON_FIELD(struct_, member, type_, decimals_) \
+    FIXEDJSON_FIELD_NAMED(struct_, member, #member, type_, decimals_)
+
+/** @brief A field for member of struct_, with its own JSON name. */
+#define FIXEDJSON_FIELD_NAMED(struct_, member, name_, type_, decimals_) \
+    {                                                                  \
+        .name = name_,                                                 \
+        .name_len = sizeof(name_) - 1,                                 \
+        .type = type_,                                                 \
+        .decimals = decimals_,                                         \
+        .offset = offsetof(struct_, member),                           \
+    }
+
+/** @brief Encode obj as a JSON object into buf, NUL terminated.
+    @return The length (without the NUL), -ENOMEM if buf is too small, or
+    -EINVAL for a bad field.
+*/
+int
+FixedJson_encode(
+    const FixedJson_Field *fields,
+    size_t num_fields,
+    const void *obj,
+    char *buf,
+    size_t size);
+
+/** @brief Write a sensor_value as a JSON number with decimals digits.
+    @return The length, or -ENOMEM. Not NUL terminated.
+*/
+int
+FixedJson_putSensorValue(const struct sensor_value *val, uint8_t decimals, char *buf, size_t size);
+
+#endif
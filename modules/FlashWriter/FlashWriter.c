@@ -0,0 +1,438 @@
+/*******************************************************************************
+ *  @file: FlashWriter.c
+ *
+ *  @brief: Pipelined streaming writer for flash partitions.
+*******************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/sys/crc.h>
+#include "FlashWriter.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(FlashWriter, CONFIG_FLASHWRITER_LOG_LEVEL);
+
+#define READBACK_CHUNK  64
+
+static inline uint32_t
+cyc_since_us(uint32_t start)
+{
+    return k_cyc_to_us_floor32(k_cycle_get_32() - start);
+}
+
+static int
+erase_next_sector(FlashWriter *fw)
+{
+    uint32_t t0 = k_cycle_get_32();
+    int ret;
+
+    ret = flash_area_erase(fw->fa, fw->erased_to, fw->sector_size);
+    if (ret < 0)
+    {
+        LOG_ERR("Erase failed at 0x%08x: %d", (unsigned int)fw->erased_to, ret);
+        return ret;
+    }
+
+    fw->erased_to += fw->sector_size;
+    fw->stats.sectors_erased++;
+    fw->stats.erase_us += cyc_since_us(t0);
+    return 0;
+}
+
+#if CONFIG_FLASHWRITER_READBACK_CRC
+static int
+readback_crc(FlashWriter *fw, off_t off, uint32_t len)
+{
+    uint8_t chunk[READBACK_CHUNK];
+    int ret;
+
+    while (len > 0)
+    {
+        uint32_t n = MIN(len, sizeof(chunk));
+
+        ret = flash_area_read(fw->fa, off, chunk, n);
+        if (ret < 0)
+        {
+            LOG_ERR("Read back failed at 0x%08x: %d", (unsigned int)off, ret);
+            return ret;
+        }
+
+        fw->flash_crc = crc32_ieee_update(fw->flash_crc, chunk, n);
+        off += n;
+        len -= n;
+    }
+
+    return 0;
+}
+#endif
+
+/** @brief Program one buffer, then erase ahead for the next one. Runs in the
+    program thread. */
+static int
+program_block(FlashWriter *fw, const FlashWriter_Block *blk)
+{
+    uint8_t *buf = fw->bufs[blk->idx];
+    uint32_t padded = ROUND_UP(blk->len, fw->write_block_size);
+    uint32_t t0;
+    int ret;
+
+    /* Only the final block of a stream can be short. Pad it out to the
+       program granularity with the erase value. */
+    if (padded > blk->len)
+    {
+        memset(&buf[blk->len], fw->erase_value, padded - blk->len);
+    }
+
+    /* Normally already erased ahead, except for the first block. */
+    while (fw->erased_to < fw->prog_off + (off_t)padded)
+    {
+        ret = erase_next_sector(fw);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+
+    t0 = k_cycle_get_32();
+    ret = flash_area_write(fw->fa, fw->prog_off, buf, padded);
+    if (ret < 0)
+    {
+        LOG_ERR("Write failed at 0x%08x: %d", (unsigned int)fw->prog_off, ret);
+        return ret;
+    }
+    fw->stats.program_us += cyc_since_us(t0);
+
+#if CONFIG_FLASHWRITER_READBACK_CRC
+    ret = readback_crc(fw, fw->prog_off, blk->len);
+    if (ret < 0)
+    {
+        return ret;
+    }
+#endif
+
+    fw->prog_off += padded;
+    fw->stats.blocks++;
+
+    /* Erase ahead while the caller is filling the other buffer. */
+    if (fw->erased_to < fw->end &&
+        fw->erased_to < fw->prog_off + (off_t)fw->sector_size)
+    {
+        return erase_next_sector(fw);
+    }
+
+    return 0;
+}
+
+static void
+program_thread(void *p1, void *p2, void *p3)
+{
+    FlashWriter *fw = (FlashWriter *)p1;
+    FlashWriter_Block blk;
+
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1)
+    {
+        k_msgq_get(&fw->blockq, &blk, K_FOREVER);
+
+        if (atomic_get(&fw->status) == 0)
+        {
+            int ret = program_block(fw, &blk);
+            if (ret < 0)
+            {
+                atomic_cas(&fw->status, 0, ret);
+            }
+        }
+
+        k_sem_give(&fw->free_bufs);
+    }
+}
+
+static int
+take_buf(FlashWriter *fw)
+{
+    uint32_t t0 = k_cycle_get_32();
+
+    k_sem_take(&fw->free_bufs, K_FOREVER);
+    fw->stats.stall_us += cyc_since_us(t0);
+
+    /* Blocks are programmed in order, so buffers free up round-robin. */
+    fw->fill_idx = (fw->fill_idx + 1) % FLASHWRITER_NUM_BUFS;
+    fw->fill_len = 0;
+    fw->have_buf = true;
+    return (int)atomic_get(&fw->status);
+}
+
+static void
+submit_buf(FlashWriter *fw)
+{
+    FlashWriter_Block blk = {
+        .idx = fw->fill_idx,
+        .len = fw->fill_len
+    };
+
+    /* Never blocks: at most NUM_BUFS blocks are outstanding. */
+    k_msgq_put(&fw->blockq, &blk, K_FOREVER);
+    fw->have_buf = false;
+}
+
+/** @brief Wait until the program thread has released every buffer. */
+static void
+drain(FlashWriter *fw)
+{
+    int k;
+
+    if (fw->have_buf)
+    {
+        k_sem_give(&fw->free_bufs);
+        fw->have_buf = false;
+    }
+
+    for (k = 0; k < FLASHWRITER_NUM_BUFS; k++)
+    {
+        k_sem_take(&fw->free_bufs, K_FOREVER);
+    }
+    for (k = 0; k < FLASHWRITER_NUM_BUFS; k++)
+    {
+        k_sem_give(&fw->free_bufs);
+    }
+
+    fw->active = false;
+    fw->stats.elapsed_us = cyc_since_us(fw->start_cyc);
+}
+
+/** @brief Initialize the writer for a fixed partition. */
+int
+FlashWriter_init(
+    FlashWriter *fw,
+    uint8_t area_id,
+    k_thread_stack_t *stack,
+    size_t stack_size)
+{
+    const struct flash_parameters *params;
+    struct flash_pages_info info;
+    int ret;
+    int k;
+
+    memset(fw, 0, sizeof(*fw));
+    fw->area_id = area_id;
+
+    ret = flash_area_open(area_id, &fw->fa);
+    if (ret < 0)
+    {
+        LOG_ERR("Unable to open flash area %u: %d", area_id, ret);
+        return ret;
+    }
+
+    ret = flash_get_page_info_by_offs(fw->fa->fa_dev, fw->fa->fa_off, &info);
+    if (ret < 0)
+    {
+        LOG_ERR("Unable to get sector size: %d", ret);
+        goto error;
+    }
+
+    params = flash_get_parameters(fw->fa->fa_dev);
+
+    fw->sector_size = info.size;
+    fw->write_block_size = flash_get_write_block_size(fw->fa->fa_dev);
+    fw->erase_value = params->erase_value;
+
+    for (k = 0; k < FLASHWRITER_NUM_BUFS; k++)
+    {
+        fw->bufs[k] = k_malloc(fw->sector_size);
+        if (!fw->bufs[k])
+        {
+            LOG_ERR("Error allocating %u byte buffer.", fw->sector_size);
+            ret = -ENOMEM;
+            goto error;
+        }
+    }
+
+    k_sem_init(&fw->free_bufs, FLASHWRITER_NUM_BUFS, FLASHWRITER_NUM_BUFS);
+    k_msgq_init(
+        &fw->blockq,
+        fw->blockq_buf,
+        sizeof(FlashWriter_Block),
+        FLASHWRITER_NUM_BUFS);
+
+    fw->tid = k_thread_create(
+        &fw->thread,
+        stack,
+        stack_size,
+        program_thread,
+        fw, NULL, NULL,
+        CONFIG_FLASHWRITER_THREAD_PRIO,
+        0,
+        K_NO_WAIT);
+    k_thread_name_set(fw->tid, "flashwriter");
+
+    LOG_INF("Area %u: off=0x%08x size=0x%08x sector=%u write_block=%u",
+        area_id,
+        (unsigned int)fw->fa->fa_off,
+        (unsigned int)fw->fa->fa_size,
+        fw->sector_size,
+        fw->write_block_size);
+
+    return 0;
+
+error:
+    for (k = 0; k < FLASHWRITER_NUM_BUFS; k++)
+    {
+        k_free(fw->bufs[k]);
+        fw->bufs[k] = NULL;
+    }
+    flash_area_close(fw->fa);
+    fw->fa = NULL;
+    return ret;
+}
+
+/** @brief Begin a new stream at the start of the partition. */
+int
+FlashWriter_open(FlashWriter *fw, uint32_t total_len)
+{
+    if (fw->active)
+    {
+        return -EBUSY;
+    }
+
+    if (total_len > fw->fa->fa_size)
+    {
+        LOG_ERR("Image too large: %u > %u", total_len, (unsigned int)fw->fa->fa_size);
+        return -ENOSPC;
+    }
+
+    fw->end = (total_len > 0) ?
+        ROUND_UP(total_len, fw->sector_size) : fw->fa->fa_size;
+    fw->prog_off = 0;
+    fw->erased_to = 0;
+    fw->crc = 0;
+    fw->flash_crc = 0;
+    atomic_set(&fw->status, 0);
+    fw->fill_idx = FLASHWRITER_NUM_BUFS - 1;
+    fw->fill_len = 0;
+    fw->have_buf = false;
+    memset(&fw->stats, 0, sizeof(fw->stats));
+    fw->start_cyc = k_cycle_get_32();
+    fw->active = true;
+
+    return 0;
+}
+
+/** @brief Append a chunk to the stream. */
+int
+FlashWriter_write(FlashWriter *fw, const void *data, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    int ret;
+
+    if (!fw->active)
+    {
+        return -EINVAL;
+    }
+
+    ret = (int)atomic_get(&fw->status);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    if (fw->stats.bytes + len > (uint32_t)fw->end)
+    {
+        LOG_ERR("Stream overruns partition.");
+        return -ENOSPC;
+    }
+
+    fw->crc = crc32_ieee_update(fw->crc, p, len);
+    fw->stats.bytes += len;
+
+    while (len > 0)
+    {
+        uint32_t n;
+
+        if (!fw->have_buf)
+        {
+            ret = take_buf(fw);
+            if (ret < 0)
+            {
+                return ret;
+            }
+        }
+
+        n = MIN(len, fw->sector_size - fw->fill_len);
+        memcpy(&fw->bufs[fw->fill_idx][fw->fill_len], p, n);
+        fw->fill_len += n;
+        p += n;
+        len -= n;
+
+        if (fw->fill_len == fw->sector_size)
+        {
+            submit_buf(fw);
+        }
+    }
+
+    return 0;
+}
+
+/** @brief Flush the final partial buffer and check the CRCs. */
+int
+FlashWriter_finish(FlashWriter *fw, const uint32_t *expected_crc, uint32_t *crc)
+{
+    if (!fw->active)
+    {
+        return -EINVAL;
+    }
+
+    if (fw->have_buf && fw->fill_len > 0)
+    {
+        submit_buf(fw);
+    }
+
+    drain(fw);
+
+    if (crc)
+    {
+        *crc = fw->crc;
+    }
+
+    if (atomic_get(&fw->status) < 0)
+    {
+        return -EIO;
+    }
+
+    if (expected_crc && *expected_crc != fw->crc)
+    {
+        LOG_ERR("Stream CRC mismatch: expected 0x%08x, got 0x%08x",
+            *expected_crc, fw->crc);
+        return -EIO;
+    }
+
+#if CONFIG_FLASHWRITER_READBACK_CRC
+    if (fw->flash_crc != fw->crc)
+    {
+        LOG_ERR("Flash CRC mismatch: stream 0x%08x, flash 0x%08x",
+            fw->crc, fw->flash_crc);
+        return -EIO;
+    }
+#endif
+
+    LOG_INF("Wrote %u bytes in %u us (crc=0x%08x).",
+        fw->stats.bytes, fw->stats.elapsed_us, fw->crc);
+
+    return 0;
+}
+
+/** @brief Abandon the stream in progress. */
+void
+FlashWriter_abort(FlashWriter *fw)
+{
+    if (!fw->active)
+    {
+        return;
+    }
+
+    atomic_cas(&fw->status, 0, -ECANCELED);
+
+    drain(fw);
+}
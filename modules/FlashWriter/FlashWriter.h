@@ -0,0 +1,143 @@
+/*******************************************************************************
+ *  @file: FlashWriter.h
+ *
+ *  @brief: Pipelined streaming writer for flash partitions.
+ *
+ *  Data arrives in arbitrary sized chunks from any transport (TCP, RPC, UART)
+ *  via FlashWriter_write(). Chunks are collected into one of two buffers, each
+ *  one erase sector in size. A full buffer is handed to the program thread
+ *  while the caller fills the other one. After programming sector N, the
+ *  program thread erases sector N+1 so that the erase is off the critical
+ *  path of the next buffer.
+ *
+ *  Integrity is checked with a running CRC32 of the incoming stream, which is
+ *  compared at FlashWriter_finish() against an expected value (if supplied).
+ *  With CONFIG_FLASHWRITER_READBACK_CRC (a debug option) each block is also
+ *  read back after it is programmed and its CRC compared as well.
+*******************************************************************************/
+#ifndef FLASHWRITER_H
+#define FLASHWRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/storage/flash_map.h>
+
+#define FLASHWRITER_NUM_BUFS    2
+
+/** @brief A buffer that has been filled and is queued for programming. */
+typedef struct FlashWriter_Block
+{
+    uint8_t idx;
+    uint32_t len;
+} FlashWriter_Block;
+
+/** @brief Statistics from a completed (or in-progress) stream. */
+typedef struct FlashWriter_Stats
+{
+    uint32_t bytes;
+    uint32_t blocks;
+    uint32_t sectors_erased;
+    /** @brief Time (us) the caller was blocked waiting on a free buffer. */
+    uint32_t stall_us;
+    /** @brief Time (us) spent in erase and program by the program thread. */
+    uint32_t erase_us;
+    uint32_t program_us;
+    uint32_t elapsed_us;
+} FlashWriter_Stats;
+
+typedef struct FlashWriter
+{
+    const struct flash_area *fa;
+    uint8_t area_id;
+
+    /** @brief Erase sector size and program block granularity. */
+    uint32_t sector_size;
+    uint32_t write_block_size;
+    uint8_t erase_value;
+
+    /** @brief Double buffer, each sector_size bytes. */
+    uint8_t *bufs[FLASHWRITER_NUM_BUFS];
+    uint8_t fill_idx;
+    uint32_t fill_len;
+    bool have_buf;
+
+    /** @brief Next offset to program, end of the erased region and end of
+        the region the stream may occupy. */
+    off_t prog_off;
+    off_t erased_to;
+    off_t end;
+
+    /** @brief Running CRC of the input stream, and of the data read back
+        (CONFIG_FLASHWRITER_READBACK_CRC). */
+    uint32_t crc;
+    uint32_t flash_crc;
+
+    /** @brief First error reported by the program thread. Set by the
+        program thread and read by the caller, so it is atomic. */
+    atomic_t status;
+    bool active;
+
+    struct k_sem free_bufs;
+    struct k_msgq blockq;
+    char blockq_buf[FLASHWRITER_NUM_BUFS * sizeof(FlashWriter_Block)];
+
+    struct k_thread thread;
+    k_tid_t tid;
+
+    uint32_t start_cyc;
+    FlashWriter_Stats stats;
+} FlashWriter;
+
+/** @brief Initialize the writer for a fixed partition.
+    @param fw         Writer object.
+    @param area_id    Partition id (i.e. FIXED_PARTITION_ID(scratch_partition)).
+    @param stack      Stack for the program thread.
+    @param stack_size Size of stack.
+    @return 0 on success, negative errno on error.
+*/
+int
+FlashWriter_init(
+    FlashWriter *fw,
+    uint8_t area_id,
+    k_thread_stack_t *stack,
+    size_t stack_size);
+
+/** @brief Begin a new stream at the start of the partition.
+    @param fw         Writer object.
+    @param total_len  Length of the image (0 if unknown). Used to bounds-check
+                      the stream against the partition size up front.
+*/
+int
+FlashWriter_open(FlashWriter *fw, uint32_t total_len);
+
+/** @brief Append a chunk to the stream. Blocks only when both buffers are
+    waiting to be programmed.
+*/
+int
+FlashWriter_write(FlashWriter *fw, const void *data, uint32_t len);
+
+/** @brief Flush the final partial buffer, wait for the program thread and
+    check the CRCs.
+    @param fw            Writer object.
+    @param expected_crc  CRC32 (IEEE) of the full image, or NULL to skip.
+    @param crc           Optional output of the computed stream CRC.
+    @return 0 on success, -EIO on CRC mismatch or flash error.
+*/
+int
+FlashWriter_finish(FlashWriter *fw, const uint32_t *expected_crc, uint32_t *crc);
+
+/** @brief Abandon the stream in progress. */
+void
+FlashWriter_abort(FlashWriter *fw);
+
+/** @brief Get the statistics of the last stream. */
+static inline const FlashWriter_Stats *
+FlashWriter_getStats(FlashWriter *fw)
+{
+    return &fw->stats;
+}
+
+#endif
@@ -0,0 +1,1057 @@
+/*******************************************************************************
+ *  @file: MqttQueue.c
+ *
+ *  @brief: MQTT publisher with a bounded queue and its own thread.
+*******************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/mqtt.h>
+#include "MqttQueue.h"
+
+#if CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#endif
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(MqttQueue, CONFIG_MQTTQUEUE_LOG_LEVEL);
+
+#define FD_SOCK     0
+#define FD_WAKE     1
+
+/** @brief The queue used by the shell command. */
+static MqttQueue *shell_queue;
+
+static void
+record_latency(MqttQueue *q, uint32_t queued_ms)
+{
+    uint32_t lat = k_uptime_get_32() - queued_ms;
+    k_spinlock_key_t key = k_spin_lock(&q->stats_lock);
+
+    q->stats.latency_last = lat;
+    q->stats.latency_max = MAX(q->stats.latency_max, lat);
+    q->stats.latency_sum += lat;
+    q->stats.latency_count++;
+    k_spin_unlock(&q->stats_lock, key);
+}
+
+static inline MqttQueue_Inflight *
+inflight_at(MqttQueue *q, uint32_t k)
+{
+    return &q->inflight[(q->if_head + k) % CONFIG_MQTTQUEUE_INFLIGHT];
+}
+
+#if CONFIG_MQTTQUEUE_SPOOL
+/** @brief Saved spool_acked, so a reboot resumes the replay. */
+#define SPOOL_OFF_PATH      CONFIG_MQTTQUEUE_SPOOL_PATH ".off"
+
+/** @brief Spool record header. The payload follows. */
+typedef struct SpoolRec
+{
+    uint8_t topic;
+    uint8_t qos;
+    uint16_t len;
+} SpoolRec;
+
+BUILD_ASSERT(CONFIG_MQTTQUEUE_SPOOL_CHUNK >= sizeof(SpoolRec) + CONFIG_MQTTQUEUE_MAX_PAYLOAD,
+    "A spool chunk must hold the largest record.");
+
+static inline bool
+spool_pending(MqttQueue *q)
+{
+    return q->spool_ok && q->spool_rd < q->spool_size;
+}
+
+static void
+spool_update_stats(MqttQueue *q)
+{
+    k_spinlock_key_t key = k_spin_lock(&q->stats_lock);
+
+    q->stats.spool_bytes = q->spool_size - q->spool_acked;
+    k_spin_unlock(&q->stats_lock, key);
+}
+
+static void
+spool_save_acked(MqttQueue *q)
+{
+    struct fs_file_t fp;
+    int ret;
+
+    fs_file_t_init(&fp);
+    ret = fs_open(&fp, SPOOL_OFF_PATH, FS_O_WRITE | FS_O_CREATE);
+    if (ret < 0)
+    {
+        LOG_ERR("[%s] Failed to open %s: %d", q->name, SPOOL_OFF_PATH, ret);
+        return;
+    }
+    fs_write(&fp, &q->spool_acked, sizeof(q->spool_acked));
+    fs_close(&fp);
+}
+
+static void
+spool_init(MqttQueue *q)
+{
+    struct fs_file_t fp;
+    off_t size;
+    int ret;
+
+    fs_file_t_init(&q->spool);
+    ret = fs_open(&q->spool, CONFIG_MQTTQUEUE_SPOOL_PATH, FS_O_RDWR | FS_O_CREATE);
+    if (ret < 0)
+    {
+        LOG_ERR("[%s] No spool (%s: %d), messages are kept in RAM only.",
+            q->name, CONFIG_MQTTQUEUE_SPOOL_PATH, ret);
+        return;
+    }
+
+    fs_seek(&q->spool, 0, FS_SEEK_END);
+    size = fs_tell(&q->spool);
+    q->spool_size = (size > 0) ? size : 0;
+
+    fs_file_t_init(&fp);
+    if (fs_open(&fp, SPOOL_OFF_PATH, FS_O_READ) == 0)
+    {
+        if (fs_read(&fp, &q->spool_acked, sizeof(q->spool_acked)) != sizeof(q->spool_acked) ||
+            q->spool_acked > q->spool_size)
+        {
+            q->spool_acked = 0;
+        }
+        fs_close(&fp);
+    }
+
+    q->spool_rd = q->spool_acked;
+    q->spool_ok = true;
+    spool_update_stats(q);
+
+    if (q->spool_rd < q->spool_size)
+    {
+        LOG_INF("[%s] %u spooled bytes to replay.", q->name, q->spool_size - q->spool_rd);
+    }
+}
+
+/** @brief Empty the spool once everything in it is acknowledged. */
+static void
+spool_reset(MqttQueue *q)
+{
+    k_spinlock_key_t key;
+    int ret;
+
+    ret = fs_truncate(&q->spool, 0);
+    if (ret < 0)
+    {
+        LOG_ERR("[%s] Spool truncate error: %d", q->name, ret);
+        return;
+    }
+    fs_unlink(SPOOL_OFF_PATH);
+
+    q->spool_size = 0;
+    q->spool_rd = 0;
+    q->spool_acked = 0;
+    q->spool_buf_len = 0;
+
+    key = k_spin_lock(&q->stats_lock);
+    q->stats.spool_bytes = 0;
+    if (q->replay_start_ms)
+    {
+        q->stats.replay_last_msgs = q->replay_msgs;
+        q->stats.replay_last_ms = k_uptime_get_32() - q->replay_start_ms;
+    }
+    k_spin_unlock(&q->stats_lock, key);
+
+    if (q->replay_start_ms)
+    {
+        LOG_INF("[%s] Replayed %u spooled messages in %u ms.", q->name,
+            q->replay_msgs, k_uptime_get_32() - q->replay_start_ms);
+    }
+    q->replay_start_ms = 0;
+    q->replay_msgs = 0;
+}
+
+/** @brief Everything before offset has been sent and, for QoS 1,
+    acknowledged. */
+static void
+spool_ack(MqttQueue *q, uint32_t offset)
+{
+    if (!q->spool_ok || offset <= q->spool_acked)
+    {
+        return;
+    }
+
+    q->spool_acked = offset;
+    if (q->spool_acked == q->spool_size)
+    {
+        spool_reset(q);
+        return;
+    }
+    spool_update_stats(q);
+}
+
+static int
+spool_append(MqttQueue *q, const MqttQueue_Msg *msg)
+{
+    uint8_t rec[sizeof(SpoolRec) + CONFIG_MQTTQUEUE_MAX_PAYLOAD];
+    SpoolRec hdr = { .topic = msg->topic, .qos = msg->qos, .len = msg->len };
+    size_t len = sizeof(hdr) + msg->len;
+    k_spinlock_key_t key;
+    ssize_t ret;
+
+    if (q->spool_size + len > CONFIG_MQTTQUEUE_SPOOL_MAX_SIZE)
+    {
+        key = k_spin_lock(&q->stats_lock);
+        q->stats.spool_dropped++;
+        k_spin_unlock(&q->stats_lock, key);
+        return -ENOSPC;
+    }
+
+    memcpy(rec, &hdr, sizeof(hdr));
+    memcpy(&rec[sizeof(hdr)], msg->data, msg->len);
+
+    fs_seek(&q->spool, q->spool_size, FS_SEEK_SET);
+    ret = fs_write(&q->spool, rec, len);
+    if (ret != (ssize_t)len)
+    {
+        LOG_ERR("[%s] Spool write error: %d", q->name, (int)ret);
+        /* Drop a partial record; replay stops at a short one anyway. */
+        fs_truncate(&q->spool, q->spool_size);
+        return (ret < 0) ? ret : -EIO;
+    }
+    q->spool_size += len;
+
+    key = k_spin_lock(&q->stats_lock);
+    q->stats.spooled++;
+    k_spin_unlock(&q->stats_lock, key);
+    return 0;
+}
+
+/** @brief Move everything queued to the spool, in order. */
+static void
+spool_queue(MqttQueue *q)
+{
+    uint32_t count = 0;
+
+    while (k_msgq_get(&q->msgq, &q->spool_msg, K_NO_WAIT) == 0)
+    {
+        spool_append(q, &q->spool_msg);
+        count++;
+    }
+
+    if (count > 0)
+    {
+        fs_sync(&q->spool);
+        spool_update_stats(q);
+    }
+}
+
+/** @brief Read the next chunk, from spool_rd. */
+static int
+spool_fill(MqttQueue *q)
+{
+    ssize_t ret;
+
+    fs_seek(&q->spool, q->spool_rd, FS_SEEK_SET);
+    ret = fs_read(&q->spool, q->spool_buf, MIN(sizeof(q->spool_buf), q->spool_size - q->spool_rd));
+    if (ret < 0)
+    {
+        q->spool_buf_len = 0;
+        return ret;
+    }
+    q->spool_buf_off = q->spool_rd;
+    q->spool_buf_len = ret;
+
+    /* Once per chunk, not per message. */
+    spool_save_acked(q);
+    return 0;
+}
+
+/** @brief Read the next spooled message into msg.
+    @return 0, -ENODATA at the end, or an error (the rest is skipped).
+*/
+static int
+spool_next(MqttQueue *q, MqttQueue_Msg *msg)
+{
+    SpoolRec hdr;
+    uint32_t pos = q->spool_rd - q->spool_buf_off;
+    k_spinlock_key_t key;
+    int ret;
+
+    if (q->spool_rd >= q->spool_size)
+    {
+        return -ENODATA;
+    }
+
+    if (q->spool_rd < q->spool_buf_off || pos + sizeof(hdr) > q->spool_buf_len)
+    {
+        ret = spool_fill(q);
+        if (ret < 0)
+        {
+            goto bad;
+        }
+        pos = 0;
+    }
+
+    memcpy(&hdr, &q->spool_buf[pos], sizeof(hdr));
+    if (hdr.len > CONFIG_MQTTQUEUE_MAX_PAYLOAD || hdr.topic >= CONFIG_MQTTQUEUE_MAX_TOPICS)
+    {
+        ret = -EBADMSG;
+        goto bad;
+    }
+
+    if (pos + sizeof(hdr) + hdr.len > q->spool_buf_len)
+    {
+        ret = spool_fill(q);
+        if (ret < 0)
+        {
+            goto bad;
+        }
+        pos = 0;
+        if (sizeof(hdr) + hdr.len > q->spool_buf_len)
+        {
+            ret = -EBADMSG;
+            goto bad;
+        }
+    }
+
+    if (hdr.topic >= q->num_topics)
+    {
+        LOG_WRN("[%s] Spooled message for unregistered topic %u dropped.", q->name, hdr.topic);
+        q->spool_rd += sizeof(hdr) + hdr.len;
+
+        key = k_spin_lock(&q->stats_lock);
+        q->stats.spool_dropped++;
+        k_spin_unlock(&q->stats_lock, key);
+        return -ENOENT;
+    }
+
+    msg->topic = hdr.topic;
+    msg->qos = hdr.qos;
+    msg->len = hdr.len;
+    msg->queued_ms = k_uptime_get_32();
+    memcpy(msg->data, &q->spool_buf[pos + sizeof(hdr)], hdr.len);
+    q->spool_rd += sizeof(hdr) + hdr.len;
+
+    if (q->replay_start_ms == 0)
+    {
+        q->replay_start_ms = k_uptime_get_32() | 1;
+    }
+    q->replay_msgs++;
+
+    key = k_spin_lock(&q->stats_lock);
+    q->stats.replayed++;
+    k_spin_unlock(&q->stats_lock, key);
+    return 0;
+
+bad:
+    LOG_ERR("[%s] Spool read error at %u: %d, skipping %u bytes.", q->name,
+        q->spool_rd, ret, q->spool_size - q->spool_rd);
+    q->spool_rd = q->spool_size;
+    return ret;
+}
+#endif
+
+/** @brief The next message to send: spooled ones first, then the queue. */
+static int
+next_msg(MqttQueue *q, MqttQueue_Msg *msg, uint32_t *spool_end)
+{
+    *spool_end = 0;
+
+#if CONFIG_MQTTQUEUE_SPOOL
+    while (spool_pending(q))
+    {
+        if (spool_next(q, msg) == 0)
+        {
+            *spool_end = q->spool_rd;
+            return 0;
+        }
+    }
+#endif
+
+    return k_msgq_get(&q->msgq, msg, K_NO_WAIT);
+}
+
+static void
+on_puback(MqttQueue *q, uint16_t msg_id)
+{
+    k_spinlock_key_t key;
+    uint32_t k;
+
+    for (k = 0; k < q->if_count; k++)
+    {
+        MqttQueue_Inflight *e = inflight_at(q, k);
+
+        if (!e->acked && e->msg_id == msg_id)
+        {
+            e->acked = true;
+            record_latency(q, e->msg.queued_ms);
+            break;
+        }
+    }
+
+    /* The window opens from the oldest message. */
+    while (q->if_count > 0 && inflight_at(q, 0)->acked)
+    {
+#if CONFIG_MQTTQUEUE_SPOOL
+        spool_ack(q, inflight_at(q, 0)->spool_end);
+#endif
+        q->if_head = (q->if_head + 1) % CONFIG_MQTTQUEUE_INFLIGHT;
+        q->if_count--;
+    }
+
+#if CONFIG_MQTTQUEUE_SPOOL
+    /* With nothing in flight, every spooled message read so far is done,
+       including QoS 0 ones sent behind a QoS 1 message. */
+    if (q->if_count == 0)
+    {
+        spool_ack(q, q->spool_rd);
+    }
+#endif
+
+    key = k_spin_lock(&q->stats_lock);
+    q->stats.acked++;
+    q->stats.inflight = q->if_count;
+    k_spin_unlock(&q->stats_lock, key);
+}
+
+static void
+mqtt_evt_handler(struct mqtt_client *client, const struct mqtt_evt *evt)
+{
+    MqttQueue *q = CONTAINER_OF(client, MqttQueue, client);
+
+    switch (evt->type)
+    {
+    case MQTT_EVT_CONNACK:
+        q->connack = evt->result;
+        atomic_set(&q->connected, evt->result == 0);
+#if CONFIG_MQTT_VERSION_5_0
+        q->alias_max = evt->param.connack.prop.topic_alias_maximum;
+#endif
+        break;
+    case MQTT_EVT_DISCONNECT:
+        atomic_set(&q->connected, 0);
+        break;
+    case MQTT_EVT_PUBACK:
+        if (evt->result == 0)
+        {
+            on_puback(q, evt->param.puback.message_id);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static uint16_t
+next_msg_id(MqttQueue *q)
+{
+    if (++q->next_msg_id == 0)
+    {
+        q->next_msg_id = 1;
+    }
+    return q->next_msg_id;
+}
+
+static int
+send_msg(MqttQueue *q, MqttQueue_Msg *msg, uint16_t msg_id, bool dup)
+{
+    MqttQueue_Topic *t = &q->topics[msg->topic];
+    struct mqtt_publish_param param = { 0 };
+    int ret;
+
+    param.message.topic.topic.utf8 = (const uint8_t *)t->name;
+    param.message.topic.topic.size = strlen(t->name);
+    param.message.topic.qos = msg->qos;
+    param.message.payload.data = msg->data;
+    param.message.payload.len = msg->len;
+    param.message_id = msg_id;
+    param.dup_flag = dup;
+
+#if CONFIG_MQTT_VERSION_5_0
+    /* Aliases are numbered from 1, in topic order. Once the broker has seen
+       an alias with its name, the name is left out. */
+    if (msg->topic < q->alias_max)
+    {
+        param.prop.topic_alias = msg->topic + 1;
+        if (t->alias_set)
+        {
+            param.message.topic.topic.utf8 = (const uint8_t *)"";
+            param.message.topic.topic.size = 0;
+        }
+    }
+#endif
+
+    ret = mqtt_publish(&q->client, &param);
+    if (ret == 0)
+    {
+        k_spinlock_key_t key = k_spin_lock(&q->stats_lock);
+
+        q->stats.sent++;
+        k_spin_unlock(&q->stats_lock, key);
+#if CONFIG_MQTT_VERSION_5_0
+        t->alias_set = (msg->topic < q->alias_max);
+#endif
+    }
+    return ret;
+}
+
+/** @brief Send what the window allows: unsent in-flight messages (after a
+    reconnect) first, then the queue in order. Stops at the first QoS 1
+    message that does not fit, so QoS 0 messages do not overtake it. */
+static int
+pump(MqttQueue *q)
+{
+    k_spinlock_key_t key;
+    uint32_t spool_end;
+    uint32_t k;
+    int ret;
+
+    for (k = 0; k < q->if_count; k++)
+    {
+        MqttQueue_Inflight *e = inflight_at(q, k);
+
+        if (e->acked || e->sent)
+        {
+            continue;
+        }
+
+        ret = send_msg(q, &e->msg, e->msg_id, true);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        e->sent = true;
+
+        key = k_spin_lock(&q->stats_lock);
+        q->stats.resent++;
+        k_spin_unlock(&q->stats_lock, key);
+    }
+
+#if CONFIG_MQTTQUEUE_SPOOL
+    /* While the spool is replaying, anything queued goes behind it. */
+    if (spool_pending(q))
+    {
+        spool_queue(q);
+    }
+#endif
+
+    while (q->if_count < CONFIG_MQTTQUEUE_INFLIGHT)
+    {
+        /* Read straight into the next in-flight slot. It is only committed
+           for QoS 1. */
+        MqttQueue_Inflight *e = inflight_at(q, q->if_count);
+
+        if (next_msg(q, &e->msg, &spool_end) != 0)
+        {
+            break;
+        }
+
+        if (e->msg.qos == MQTT_QOS_0_AT_MOST_ONCE)
+        {
+            ret = send_msg(q, &e->msg, 0, false);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            record_latency(q, e->msg.queued_ms);
+#if CONFIG_MQTTQUEUE_SPOOL
+            if (q->if_count == 0)
+            {
+                spool_ack(q, spool_end);
+            }
+#endif
+            continue;
+        }
+
+        e->msg_id = next_msg_id(q);
+        e->acked = false;
+        e->sent = false;
+#if CONFIG_MQTTQUEUE_SPOOL
+        e->spool_end = spool_end;
+#endif
+        q->if_count++;
+
+        key = k_spin_lock(&q->stats_lock);
+        q->stats.inflight = q->if_count;
+        q->stats.peak_inflight = MAX(q->stats.peak_inflight, q->if_count);
+        k_spin_unlock(&q->stats_lock, key);
+
+        ret = send_msg(q, &e->msg, e->msg_id, false);
+        if (ret < 0)
+        {
+            /* Kept in flight, and sent again after the reconnect. */
+            return ret;
+        }
+        e->sent = true;
+    }
+
+    return 0;
+}
+
+static void
+drop_connection(MqttQueue *q, int err)
+{
+    LOG_WRN("[%s] Connection lost: %d", q->name, err);
+    mqtt_abort(&q->client);
+    atomic_set(&q->connected, 0);
+}
+
+static int
+do_connect(MqttQueue *q)
+{
+    struct zsock_pollfd pfd;
+    const char *client_id = (const char *)q->client.client_id.utf8;
+    uint32_t k;
+    int ret;
+
+    mqtt_client_init(&q->client);
+    q->client.broker = &q->broker;
+    q->client.evt_cb = mqtt_evt_handler;
+    q->client.client_id.utf8 = (const uint8_t *)client_id;
+    q->client.client_id.size = strlen(client_id);
+#if CONFIG_MQTT_VERSION_5_0
+    q->client.protocol_version = MQTT_VERSION_5_0;
+#else
+    q->client.protocol_version = MQTT_VERSION_3_1_1;
+#endif
+    q->client.rx_buf = q->rx_buf;
+    q->client.rx_buf_size = sizeof(q->rx_buf);
+    q->client.tx_buf = q->tx_buf;
+    q->client.tx_buf_size = sizeof(q->tx_buf);
+    q->client.transport.type = MQTT_TRANSPORT_NON_SECURE;
+    q->connack = -EINPROGRESS;
+
+    ret = mqtt_connect(&q->client);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    pfd.fd = q->client.transport.tcp.sock;
+    pfd.events = ZSOCK_POLLIN;
+    ret = zsock_poll(&pfd, 1, CONFIG_MQTTQUEUE_CONNECT_TIMEOUT_MS);
+    if (ret > 0)
+    {
+        mqtt_input(&q->client);
+    }
+
+    if (!atomic_get(&q->connected))
+    {
+        mqtt_abort(&q->client);
+        return (ret > 0) ? -ECONNREFUSED : -ETIMEDOUT;
+    }
+
+    /* A new session: resend everything unacknowledged, and send each
+       topic name again with its alias. */
+    for (k = 0; k < q->if_count; k++)
+    {
+        inflight_at(q, k)->sent = false;
+    }
+    for (k = 0; k < q->num_topics; k++)
+    {
+        q->topics[k].alias_set = false;
+    }
+
+    return 0;
+}
+
+/** @brief Wait before the next connect attempt. With a spool, anything
+    queued meanwhile is moved to it, so the queue does not overflow. */
+static void
+wait_offline(MqttQueue *q, uint32_t ms)
+{
+#if CONFIG_MQTTQUEUE_SPOOL
+    int64_t end = k_uptime_get() + ms;
+    int64_t left;
+
+    if (!q->spool_ok)
+    {
+        k_msleep(ms);
+        return;
+    }
+
+    while ((left = end - k_uptime_get()) > 0)
+    {
+        struct zsock_pollfd pfd = { .fd = q->wake_fd[0], .events = ZSOCK_POLLIN };
+        uint8_t drain[16];
+
+        zsock_poll(&pfd, 1, (int)left);
+        while (zsock_recv(q->wake_fd[0], drain, sizeof(drain), ZSOCK_MSG_DONTWAIT) > 0)
+        {
+        }
+        spool_queue(q);
+    }
+#else
+    k_msleep(ms);
+#endif
+}
+
+static void
+queue_thread(void *p1, void *p2, void *p3)
+{
+    MqttQueue *q = (MqttQueue *)p1;
+    uint32_t backoff = CONFIG_MQTTQUEUE_RECONNECT_MIN_MS;
+
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1)
+    {
+        struct zsock_pollfd fds[2];
+        k_spinlock_key_t key;
+        int ret;
+
+        if (!atomic_get(&q->connected))
+        {
+#if CONFIG_MQTTQUEUE_SPOOL
+            if (q->spool_ok)
+            {
+                spool_queue(q);
+            }
+#endif
+            ret = do_connect(q);
+
+            key = k_spin_lock(&q->stats_lock);
+            if (ret == 0)
+            {
+                q->stats.connects++;
+            }
+            else
+            {
+                q->stats.connect_fails++;
+            }
+            k_spin_unlock(&q->stats_lock, key);
+
+            if (ret < 0)
+            {
+                LOG_WRN("[%s] Connect failed (%d), retry in %u ms.", q->name, ret, backoff);
+                wait_offline(q, backoff);
+                backoff = MIN(backoff * 2, CONFIG_MQTTQUEUE_RECONNECT_MAX_MS);
+                continue;
+            }
+
+            LOG_INF("[%s] Connected, %u queued, %u in flight.", q->name,
+                k_msgq_num_used_get(&q->msgq), q->if_count);
+#if CONFIG_MQTTQUEUE_SPOOL
+            if (spool_pending(q))
+            {
+                LOG_INF("[%s] Replaying %u spooled bytes.", q->name, q->spool_size - q->spool_rd);
+            }
+#endif
+            backoff = CONFIG_MQTTQUEUE_RECONNECT_MIN_MS;
+        }
+
+        ret = pump(q);
+        if (ret < 0)
+        {
+            drop_connection(q, ret);
+            continue;
+        }
+
+        /* Anything still queued waits on the window: sleep until a PUBACK,
+           a new publish, or the keepalive. */
+        fds[FD_SOCK].fd = q->client.transport.tcp.sock;
+        fds[FD_SOCK].events = ZSOCK_POLLIN;
+        fds[FD_WAKE].fd = q->wake_fd[0];
+        fds[FD_WAKE].events = ZSOCK_POLLIN;
+
+        ret = zsock_poll(fds, 2, mqtt_keepalive_time_left(&q->client));
+        if (ret < 0)
+        {
+            drop_connection(q, -errno);
+            continue;
+        }
+
+        if (fds[FD_WAKE].revents & ZSOCK_POLLIN)
+        {
+            uint8_t drain[16];
+
+            while (zsock_recv(q->wake_fd[0], drain, sizeof(drain), ZSOCK_MSG_DONTWAIT) > 0)
+            {
+            }
+        }
+
+        if (fds[FD_SOCK].revents & ZSOCK_POLLIN)
+        {
+            ret = mqtt_input(&q->client);
+            if (ret < 0)
+            {
+                drop_connection(q, ret);
+                continue;
+            }
+        }
+
+        if (fds[FD_SOCK].revents & (ZSOCK_POLLERR | ZSOCK_POLLHUP | ZSOCK_POLLNVAL))
+        {
+            drop_connection(q, -ECONNRESET);
+            continue;
+        }
+
+        ret = mqtt_live(&q->client);
+        if (ret < 0 && ret != -EAGAIN)
+        {
+            drop_connection(q, ret);
+        }
+    }
+}
+
+/** @brief Set up the queue and start its thread, which connects to
+    CONFIG_MQTTQUEUE_SERVER_ADDR. Register topics before publishing. */
+int
+MqttQueue_init(
+    MqttQueue *q,
+    const char *client_id,
+    k_thread_stack_t *stack,
+    size_t stack_size,
+    int prio)
+{
+    struct sockaddr_in *broker = (struct sockaddr_in *)&q->broker;
+    int ret;
+
+    memset(q, 0, sizeof(*q));
+    q->name = client_id;
+    q->client.client_id.utf8 = (const uint8_t *)client_id;
+
+    broker->sin_family = AF_INET;
+    broker->sin_port = htons(CONFIG_MQTTQUEUE_SERVER_PORT);
+    ret = zsock_inet_pton(AF_INET, CONFIG_MQTTQUEUE_SERVER_ADDR, &broker->sin_addr);
+    if (ret != 1)
+    {
+        LOG_ERR("Bad broker address: %s", CONFIG_MQTTQUEUE_SERVER_ADDR);
+        return -EINVAL;
+    }
+
+    ret = zsock_socketpair(AF_UNIX, SOCK_STREAM, 0, q->wake_fd);
+    if (ret < 0)
+    {
+        LOG_ERR("[%s] socketpair error: %d", q->name, errno);
+        return -errno;
+    }
+
+    k_msgq_init(&q->msgq, q->msgq_buf, sizeof(MqttQueue_Msg), CONFIG_MQTTQUEUE_DEPTH);
+    k_mutex_init(&q->put_lock);
+#if CONFIG_MQTTQUEUE_SPOOL
+    spool_init(q);
+#endif
+
+    q->tid = k_thread_create(
+        &q->thread,
+        stack,
+        stack_size,
+        queue_thread,
+        q, NULL, NULL,
+        prio,
+        0,
+        K_NO_WAIT);
+    k_thread_name_set(q->tid, client_id);
+
+    shell_queue = q;
+    return 0;
+}
+
+/** @brief Register a topic. Returns its index for MqttQueue_publish(), or
+    a negative errno. */
+int
+MqttQueue_addTopic(MqttQueue *q, const char *name, uint8_t qos)
+{
+    if (q->num_topics == CONFIG_MQTTQUEUE_MAX_TOPICS || qos > MQTT_QOS_1_AT_LEAST_ONCE)
+    {
+        return -EINVAL;
+    }
+
+    q->topics[q->num_topics].name = name;
+    q->topics[q->num_topics].qos = qos;
+    return q->num_topics++;
+}
+
+/** @brief Queue a message. Waits up to timeout for room; after that the
+    drop policy applies. */
+int
+MqttQueue_publish(MqttQueue *q, int topic, const void *data, size_t len,
+    k_timeout_t timeout)
+{
+    MqttQueue_Msg *msg = &q->put_msg;
+    k_spinlock_key_t key;
+    bool evicted = false;
+    uint32_t depth;
+    int ret;
+
+    if (topic < 0 || topic >= q->num_topics)
+    {
+        return -EINVAL;
+    }
+    if (len > CONFIG_MQTTQUEUE_MAX_PAYLOAD)
+    {
+        return -EMSGSIZE;
+    }
+
+    k_mutex_lock(&q->put_lock, K_FOREVER);
+
+    msg->topic = topic;
+    msg->qos = q->topics[topic].qos;
+    msg->len = len;
+    msg->queued_ms = k_uptime_get_32();
+    memcpy(msg->data, data, len);
+
+    ret = k_msgq_put(&q->msgq, msg, timeout);
+#if CONFIG_MQTTQUEUE_DROP_OLDEST
+    if (ret != 0 && k_msgq_get(&q->msgq, &q->drop_msg, K_NO_WAIT) == 0)
+    {
+        /* Only put_lock holders add messages, so this fits. */
+        ret = k_msgq_put(&q->msgq, msg, K_NO_WAIT);
+        evicted = true;
+    }
+#endif
+    depth = k_msgq_num_used_get(&q->msgq);
+
+    k_mutex_unlock(&q->put_lock);
+
+    key = k_spin_lock(&q->stats_lock);
+    if (ret == 0)
+    {
+        q->stats.queued++;
+    }
+    /* One message is lost either way: the evicted one or this one. */
+    if (ret != 0 || evicted)
+    {
+        q->stats.dropped++;
+    }
+    q->stats.depth = depth;
+    q->stats.peak_depth = MAX(q->stats.peak_depth, depth);
+    k_spin_unlock(&q->stats_lock, key);
+
+    if (ret != 0)
+    {
+        return -ENOBUFS;
+    }
+
+    /* Wake the thread if it is waiting in poll. A full pair means a wakeup
+       is already pending. */
+    zsock_send(q->wake_fd[1], "", 1, ZSOCK_MSG_DONTWAIT);
+    return 0;
+}
+
+/** @brief True while connected to the broker. */
+bool
+MqttQueue_isConnected(MqttQueue *q)
+{
+    return atomic_get(&q->connected) != 0;
+}
+
+void
+MqttQueue_getStats(MqttQueue *q, MqttQueue_Stats *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&q->stats_lock);
+
+    *stats = q->stats;
+    stats->depth = k_msgq_num_used_get(&q->msgq);
+    k_spin_unlock(&q->stats_lock, key);
+}
+
+void
+MqttQueue_resetStats(MqttQueue *q)
+{
+    k_spinlock_key_t key = k_spin_lock(&q->stats_lock);
+
+    memset(&q->stats, 0, sizeof(q->stats));
+    q->stats.inflight = q->if_count;
+#if CONFIG_MQTTQUEUE_SPOOL
+    q->stats.spool_bytes = q->spool_size - q->spool_acked;
+#endif
+    k_spin_unlock(&q->stats_lock, key);
+}
+
+#if CONFIG_SHELL
+static int
+cmd_show(const struct shell *sh, size_t argc, char **argv)
+{
+    MqttQueue_Stats st;
+    uint32_t avg;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    if (!shell_queue)
+    {
+        shell_print(sh, "No queue.");
+        return 0;
+    }
+
+    MqttQueue_getStats(shell_queue, &st);
+    avg = st.latency_count ? (uint32_t)(st.latency_sum / st.latency_count) : 0;
+
+    shell_print(sh, "%s, broker %s:%u",
+        atomic_get(&shell_queue->connected) ? "connected" : "disconnected",
+        CONFIG_MQTTQUEUE_SERVER_ADDR, CONFIG_MQTTQUEUE_SERVER_PORT);
+    shell_print(sh, "queued %u sent %u acked %u dropped %u resent %u",
+        st.queued, st.sent, st.acked, st.dropped, st.resent);
+    shell_print(sh, "depth %u (peak %u of %u), in flight %u (peak %u of %u)",
+        st.depth, st.peak_depth, CONFIG_MQTTQUEUE_DEPTH,
+        st.inflight, st.peak_inflight, CONFIG_MQTTQUEUE_INFLIGHT);
+    shell_print(sh, "latency ms: last %u avg %u max %u (%u msgs)",
+        st.latency_last, avg, st.latency_max, st.latency_count);
+    shell_print(sh, "connects %u, failed %u", st.connects, st.connect_fails);
+#if CONFIG_MQTTQUEUE_SPOOL
+    shell_print(sh, "spool %s: %u bytes of %u, spooled %u replayed %u dropped %u",
+        shell_queue->spool_ok ? CONFIG_MQTTQUEUE_SPOOL_PATH : "(off)",
+        st.spool_bytes, CONFIG_MQTTQUEUE_SPOOL_MAX_SIZE,
+        st.spooled, st.replayed, st.spool_dropped);
+    if (st.replay_last_msgs)
+    {
+        shell_print(sh, "last replay: %u msgs in %u ms", st.replay_last_msgs, st.replay_last_ms);
+    }
+#endif
+    return 0;
+}
+
+static int
+cmd_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    if (shell_queue)
+    {
+        MqttQueue_resetStats(shell_queue);
+    }
+    shell_print(sh, "Statistics cleared.");
+    return 0;
+}
+
+/** @brief Queue count numbered messages on topic 0, as fast as the queue
+    takes them, for load tests against a broker. The payload is the bare
+    sequence number, so 10k messages fit a small spool. */
+static int
+cmd_flood(const struct shell *sh, size_t argc, char **argv)
+{
+    uint32_t count = strtoul(argv[1], NULL, 0);
+    uint32_t start = k_uptime_get_32();
+    uint32_t k;
+
+    if (!shell_queue)
+    {
+        shell_print(sh, "No queue.");
+        return 0;
+    }
+
+    for (k = 0; k < count; k++)
+    {
+        char buf[12];
+        int len = snprintk(buf, sizeof(buf), "%u", k);
+
+        MqttQueue_publish(shell_queue, 0, buf, len, K_FOREVER);
+    }
+
+    shell_print(sh, "%u messages queued in %u ms.", count, k_uptime_get_32() - start);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(mqttq_cmds,
+    SHELL_CMD(show, NULL, "Show queue statistics.", cmd_show),
+    SHELL_CMD(reset, NULL, "Clear queue statistics.", cmd_reset),
+    SHELL_CMD_ARG(flood, NULL, "Queue <count> numbered messages on the first topic.",
+        cmd_flood, 2, 0),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(mqttq, &mqttq_cmds, "MQTT publish queue", NULL);
+#endif
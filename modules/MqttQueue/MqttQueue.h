@@ -0,0 +1,218 @@
+/*******************************************************************************
+ *  @file: MqttQueue.h
+ *
+ *  @brief: MQTT publisher with a bounded queue and its own thread.
+ *
+ *  MqttQueue_publish() copies the message into a queue and returns. It does
+ *  not wait on the broker, so a slow broker or link does not stall the
+ *  caller. The MqttQueue thread owns the broker connection. It sends queued
+ *  messages in order, reconnects with backoff, and keeps the connection
+ *  alive.
+ *
+ *  QoS 1 messages are kept until their PUBACK arrives. Up to
+ *  CONFIG_MQTTQUEUE_INFLIGHT of them can be unacknowledged at once, so the
+ *  link is not idle for a broker round trip per message. After a reconnect,
+ *  unacknowledged messages are sent again (with DUP set) ahead of the
+ *  queue, so ordering is kept.
+ *
+ *  Topics are registered once and referred to by index. On an MQTT 5
+ *  connection (CONFIG_MQTT_VERSION_5_0) each topic is given a topic alias,
+ *  so only its first publish per connection carries the topic name.
+ *
+ *  When the queue is full, CONFIG_MQTTQUEUE_DROP_OLDEST drops the oldest
+ *  queued message and CONFIG_MQTTQUEUE_DROP_NEWEST refuses the new one.
+ *  Either way the drop is counted.
+ *
+ *  With CONFIG_MQTTQUEUE_SPOOL, messages are not held in RAM while the
+ *  broker is unreachable. The thread appends them to a spool file
+ *  (CONFIG_MQTTQUEUE_SPOOL_PATH, on a mounted LittleFS) as they are
+ *  queued. After the reconnect, the spool is replayed in order through the
+ *  in-flight window, ahead of anything queued since, and is read in
+ *  CONFIG_MQTTQUEUE_SPOOL_CHUNK reads. Once every spooled message is
+ *  acknowledged, the file is truncated. The acknowledged offset is saved
+ *  with each chunk read, so after a reboot only the last chunk can be sent
+ *  twice. The spool holds CONFIG_MQTTQUEUE_SPOOL_MAX_SIZE bytes; messages
+ *  that do not fit are dropped and counted. Topic indexes are stored in the
+ *  spool, so register topics in the same order on every boot.
+*******************************************************************************/
+#ifndef MQTTQUEUE_H
+#define MQTTQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/mqtt.h>
+#if CONFIG_MQTTQUEUE_SPOOL
+#include <zephyr/fs/fs.h>
+#endif
+
+typedef struct MqttQueue_Msg
+{
+    uint8_t topic;
+    uint8_t qos;
+    uint16_t len;
+    /** @brief k_uptime_get_32() when queued, for the publish latency. */
+    uint32_t queued_ms;
+    uint8_t data[CONFIG_MQTTQUEUE_MAX_PAYLOAD];
+} MqttQueue_Msg;
+
+/** @brief A QoS 1 message sent and not yet acknowledged. */
+typedef struct MqttQueue_Inflight
+{
+    MqttQueue_Msg msg;
+    uint16_t msg_id;
+    bool acked;
+    /** @brief Sent on the current connection. */
+    bool sent;
+#if CONFIG_MQTTQUEUE_SPOOL
+    /** @brief Spool offset past this message, 0 if it was not spooled. */
+    uint32_t spool_end;
+#endif
+} MqttQueue_Inflight;
+
+typedef struct MqttQueue_Topic
+{
+    const char *name;
+    uint8_t qos;
+    /** @brief The alias has been sent with the name on this connection. */
+    bool alias_set;
+} MqttQueue_Topic;
+
+typedef struct MqttQueue_Stats
+{
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t acked;
+    uint32_t dropped;
+    /** @brief QoS 1 messages sent again after a reconnect. */
+    uint32_t resent;
+    uint32_t connects;
+    uint32_t connect_fails;
+    uint32_t depth;
+    uint32_t peak_depth;
+    uint32_t inflight;
+    uint32_t peak_inflight;
+    /** @brief Queued to acknowledged (QoS 1) or sent (QoS 0), in ms. */
+    uint32_t latency_last;
+    uint32_t latency_max;
+    uint64_t latency_sum;
+    uint32_t latency_count;
+#if CONFIG_MQTTQUEUE_SPOOL
+    uint32_t spooled;
+    uint32_t replayed;
+    /** @brief Messages that did not fit in the spool. */
+    uint32_t spool_dropped;
+    /** @brief Bytes in the spool not yet acknowledged. */
+    uint32_t spool_bytes;
+    /** @brief The last full replay: messages, and ms from the first read
+        to the last acknowledgement. */
+    uint32_t replay_last_msgs;
+    uint32_t replay_last_ms;
+#endif
+} MqttQueue_Stats;
+
+typedef struct MqttQueue
+{
+    const char *name;
+
+    struct mqtt_client client;
+    struct sockaddr_storage broker;
+    uint8_t rx_buf[CONFIG_MQTTQUEUE_BUF_SIZE];
+    uint8_t tx_buf[CONFIG_MQTTQUEUE_BUF_SIZE];
+    /** @brief Set by the queue thread, read from any thread. */
+    atomic_t connected;
+    /** @brief Set by the CONNACK handler: 0, or the broker's refusal. */
+    int connack;
+    uint16_t next_msg_id;
+#if CONFIG_MQTT_VERSION_5_0
+    uint16_t alias_max;
+#endif
+
+    MqttQueue_Topic topics[CONFIG_MQTTQUEUE_MAX_TOPICS];
+    uint8_t num_topics;
+
+    struct k_msgq msgq;
+    char __aligned(4) msgq_buf[CONFIG_MQTTQUEUE_DEPTH * sizeof(MqttQueue_Msg)];
+    /** @brief Serializes producers, which build messages in put_msg. */
+    struct k_mutex put_lock;
+    MqttQueue_Msg put_msg;
+    MqttQueue_Msg drop_msg;
+
+#if CONFIG_MQTTQUEUE_SPOOL
+    /** @brief Append-only spool file. Records follow each other from
+        offset 0: spooled (acknowledged) up to spool_acked, read (replay
+        in flight) up to spool_rd, and waiting up to spool_size. */
+    struct fs_file_t spool;
+    bool spool_ok;
+    uint32_t spool_size;
+    uint32_t spool_rd;
+    uint32_t spool_acked;
+    /** @brief Chunk read from spool_buf_off. */
+    uint8_t spool_buf[CONFIG_MQTTQUEUE_SPOOL_CHUNK];
+    uint32_t spool_buf_off;
+    uint32_t spool_buf_len;
+    MqttQueue_Msg spool_msg;
+    uint32_t replay_start_ms;
+    uint32_t replay_msgs;
+#endif
+
+    /** @brief Ring of unacknowledged QoS 1 messages, oldest first. */
+    MqttQueue_Inflight inflight[CONFIG_MQTTQUEUE_INFLIGHT];
+    uint8_t if_head;
+    uint8_t if_count;
+
+    /** @brief Socket pair used to wake the thread out of poll on a publish. */
+    int wake_fd[2];
+
+    struct k_thread thread;
+    k_tid_t tid;
+
+    struct k_spinlock stats_lock;
+    MqttQueue_Stats stats;
+} MqttQueue;
+
+/** @brief Set up the queue and start its thread, which connects to
+    CONFIG_MQTTQUEUE_SERVER_ADDR. Register topics before publishing. With
+    the spool, its file system must be mounted first, and topics registered
+    right away (spooled messages for unknown topics are dropped).
+    @param q          Queue object.
+    @param client_id  MQTT client id.
+    @param stack      Stack for the thread.
+    @param stack_size Size of stack.
+    @param prio       Thread priority.
+    @return 0 on success, negative errno on error.
+*/
+int
+MqttQueue_init(
+    MqttQueue *q,
+    const char *client_id,
+    k_thread_stack_t *stack,
+    size_t stack_size,
+    int prio);
+
+/** @brief Register a topic. Returns its index for MqttQueue_publish(), or
+    a negative errno. */
+int
+MqttQueue_addTopic(MqttQueue *q, const char *name, uint8_t qos);
+
+/** @brief Queue a message. Waits up to timeout for room; after that the
+    drop policy applies.
+    @return 0 if queued (possibly after dropping the oldest), -ENOBUFS if
+    dropped, -EMSGSIZE or -EINVAL for bad arguments.
+*/
+int
+MqttQueue_publish(MqttQueue *q, int topic, const void *data, size_t len,
+    k_timeout_t timeout);
+
+/** @brief True while connected to the broker. */
+bool
+MqttQueue_isConnected(MqttQueue *q);
+
+void
+MqttQueue_getStats(MqttQueue *q, MqttQueue_Stats *stats);
+
+void
+MqttQueue_resetStats(MqttQueue *q);
+
+#endif
@@ -0,0 +1,205 @@
+/*******************************************************************************
+ *  @file: NetBufStats.c
+ *
+ *  @brief: Network buffer pool usage and high-water marks.
+*******************************************************************************/
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net_buf.h>
+#include <zephyr/net/net_pkt.h>
+#include <zephyr/net/net_stats.h>
+#include <zephyr/sys/iterable_sections.h>
+#include "NetBufStats.h"
+
+#if CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(NetBufStats, CONFIG_NETBUFSTATS_LOG_LEVEL);
+
+static uint32_t
+slab_fails(struct k_mem_slab *slab)
+{
+#if CONFIG_NET_PKT_ALLOC_STATS
+    STRUCT_SECTION_FOREACH(net_pkt_alloc_stats_slab, st)
+    {
+        if (st->slab == slab)
+        {
+            return st->fail.count;
+        }
+    }
+#else
+    ARG_UNUSED(slab);
+#endif
+    return 0;
+}
+
+static void
+add_slab(NetBufStats *stats, const char *name, struct k_mem_slab *slab)
+{
+    NetBufStats_Pool *p;
+
+    if (stats->num_pools == ARRAY_SIZE(stats->pools))
+    {
+        return;
+    }
+
+    p = &stats->pools[stats->num_pools++];
+    p->name = name;
+    p->type = NETBUFSTATS_PKT_SLAB;
+    p->count = slab->info.num_blocks;
+    p->used = k_mem_slab_num_used_get(slab);
+    p->peak = k_mem_slab_max_used_get(slab);
+    p->bytes = slab->info.num_blocks * slab->info.block_size;
+    p->fails = slab_fails(slab);
+}
+
+static void
+add_pool(NetBufStats *stats, struct net_buf_pool *pool)
+{
+    NetBufStats_Pool *p;
+
+    if (stats->num_pools == ARRAY_SIZE(stats->pools))
+    {
+        return;
+    }
+
+    p = &stats->pools[stats->num_pools++];
+    p->name = pool->name;
+    p->type = NETBUFSTATS_BUF_POOL;
+    p->count = pool->buf_count;
+    p->used = pool->buf_count - atomic_get(&pool->avail_count);
+    p->peak = pool->max_used;
+    p->bytes = pool->pool_size;
+    p->fails = 0;
+}
+
+static void
+get_tcp(NetBufStats_Tcp *tcp)
+{
+#if CONFIG_NET_STATISTICS_TCP && CONFIG_NET_STATISTICS_USER_API
+    struct net_stats_tcp st;
+
+    if (net_mgmt(NET_REQUEST_STATS_GET_TCP, NULL, &st, sizeof(st)) == 0)
+    {
+        tcp->sent = st.sent;
+        tcp->recv = st.recv;
+        tcp->rexmit = st.rexmit;
+        tcp->drop = st.drop;
+        tcp->conndrop = st.conndrop;
+        return;
+    }
+#endif
+    memset(tcp, 0, sizeof(*tcp));
+}
+
+/** @brief Take a snapshot of every pool and the TCP counters. */
+int
+NetBufStats_get(NetBufStats *stats)
+{
+    struct k_mem_slab *rx, *tx;
+    struct net_buf_pool *rx_data, *tx_data;
+
+    memset(stats, 0, sizeof(*stats));
+
+    net_pkt_get_info(&rx, &tx, &rx_data, &tx_data);
+    add_slab(stats, "RX pkt", rx);
+    add_slab(stats, "TX pkt", tx);
+
+    STRUCT_SECTION_FOREACH(net_buf_pool, pool)
+    {
+        add_pool(stats, pool);
+    }
+
+    get_tcp(&stats->tcp);
+    return 0;
+}
+
+/** @brief Restart peak tracking from the current usage. */
+void
+NetBufStats_resetPeaks(void)
+{
+    struct k_mem_slab *rx, *tx;
+    struct net_buf_pool *rx_data, *tx_data;
+
+    net_pkt_get_info(&rx, &tx, &rx_data, &tx_data);
+    k_mem_slab_runtime_stats_reset_max(rx);
+    k_mem_slab_runtime_stats_reset_max(tx);
+
+    STRUCT_SECTION_FOREACH(net_buf_pool, pool)
+    {
+        k_spinlock_key_t key = k_spin_lock(&pool->lock);
+        pool->max_used = pool->buf_count - atomic_get(&pool->avail_count);
+        k_spin_unlock(&pool->lock, key);
+    }
+}
+
+/** @brief Log a snapshot. */
+void
+NetBufStats_log(void)
+{
+    static NetBufStats stats;
+    uint32_t k;
+
+    NetBufStats_get(&stats);
+
+    for (k = 0; k < stats.num_pools; k++)
+    {
+        const NetBufStats_Pool *p = &stats.pools[k];
+        LOG_INF("%-16s used %3u peak %3u of %3u (%u bytes) fails %u",
+            p->name, p->used, p->peak, p->count, p->bytes, p->fails);
+    }
+
+    LOG_INF("tcp sent %u recv %u rexmit %u drop %u conndrop %u",
+        stats.tcp.sent, stats.tcp.recv, stats.tcp.rexmit,
+        stats.tcp.drop, stats.tcp.conndrop);
+}
+
+#if CONFIG_SHELL
+static int
+cmd_show(const struct shell *sh, size_t argc, char **argv)
+{
+    static NetBufStats stats;
+    uint32_t k;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    NetBufStats_get(&stats);
+
+    shell_print(sh, "%-16s %5s %5s %5s %7s %6s",
+        "pool", "used", "peak", "count", "bytes", "fails");
+    for (k = 0; k < stats.num_pools; k++)
+    {
+        const NetBufStats_Pool *p = &stats.pools[k];
+        shell_print(sh, "%-16s %5u %5u %5u %7u %6u",
+            p->name, p->used, p->peak, p->count, p->bytes, p->fails);
+    }
+
+    shell_print(sh, "tcp: sent %u recv %u rexmit %u drop %u conndrop %u",
+        stats.tcp.sent, stats.tcp.recv, stats.tcp.rexmit,
+        stats.tcp.drop, stats.tcp.conndrop);
+
+    return 0;
+}
+
+static int
+cmd_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    NetBufStats_resetPeaks();
+    shell_print(sh, "Peaks reset.");
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_netbuf,
+    SHELL_CMD(show, NULL, "Current and peak use of each buffer pool.", cmd_show),
+    SHELL_CMD(reset, NULL, "Restart peak tracking.", cmd_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(netbuf, &sub_netbuf, "Network buffer pool statistics", cmd_show);
+#endif
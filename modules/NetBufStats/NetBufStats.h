@@ -0,0 +1,72 @@
+/*******************************************************************************
+ *  @file: NetBufStats.h
+ *
+ *  @brief: Network buffer pool usage and high-water marks.
+ *
+ *  Collects, for the rx/tx net_pkt slabs and every net_buf pool in the image
+ *  (rx/tx data, TCP, driver pools), the configured size, current use and the
+ *  peak use since boot or the last reset. Pools can then be sized to the
+ *  measured peak rather than by trial and error.
+ *
+ *  Peaks come from the kernel (CONFIG_MEM_SLAB_TRACE_MAX_UTILIZATION and
+ *  CONFIG_NET_BUF_POOL_USAGE) so that short bursts between samples are not
+ *  missed.
+*******************************************************************************/
+#ifndef NETBUFSTATS_H
+#define NETBUFSTATS_H
+
+#include <stdint.h>
+
+typedef enum NetBufStats_Type
+{
+    NETBUFSTATS_PKT_SLAB = 0,
+    NETBUFSTATS_BUF_POOL
+} NetBufStats_Type;
+
+typedef struct NetBufStats_Pool
+{
+    const char *name;
+    NetBufStats_Type type;
+    uint16_t count;
+    uint16_t used;
+    uint16_t peak;
+    /** @brief RAM reserved for buffer data (or packet structs). */
+    uint32_t bytes;
+    /** @brief Failed allocations (net_pkt slabs with
+        CONFIG_NET_PKT_ALLOC_STATS only). */
+    uint32_t fails;
+} NetBufStats_Pool;
+
+typedef struct NetBufStats_Tcp
+{
+    uint32_t sent;
+    uint32_t recv;
+    /** @brief Retransmitted segments: the usual sign of a stalled window or
+        dropped buffers. */
+    uint32_t rexmit;
+    uint32_t drop;
+    uint32_t conndrop;
+} NetBufStats_Tcp;
+
+typedef struct NetBufStats
+{
+    NetBufStats_Pool pools[CONFIG_NETBUFSTATS_MAX_POOLS];
+    uint32_t num_pools;
+    NetBufStats_Tcp tcp;
+} NetBufStats;
+
+/** @brief Take a snapshot of every pool and the TCP counters.
+    @return 0 on success.
+*/
+int
+NetBufStats_get(NetBufStats *stats);
+
+/** @brief Restart peak tracking from the current usage. */
+void
+NetBufStats_resetPeaks(void);
+
+/** @brief Log a snapshot. */
+void
+NetBufStats_log(void);
+
+#endif
@@ -0,0 +1,768 @@
+/*******************************************************************************
+ *  @file: SettingsIdx.c
+ *
+ *  @brief: Indexed NVS settings backend.
+*******************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/settings/settings.h>
+#include "SettingsIdx.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(SettingsIdx, CONFIG_SETTINGSIDX_LOG_LEVEL);
+
+#if DT_HAS_CHOSEN(zephyr_settings_partition)
+#define SETTINGSIDX_PARTITION \
+    DT_FIXED_PARTITION_ID(DT_CHOSEN(zephyr_settings_partition))
+#else
+#define SETTINGSIDX_PARTITION   FIXED_PARTITION_ID(storage_partition)
+#endif
+
+#define SETTINGSIDX_MAGIC       0x58444953  /* "SIDX" */
+
+#define ALLOC_ID                0x0001
+#define INDEX_ID                0x0002
+#define BANK_BASE(b)            ((b) ? 0x0080 : 0x0010)
+#define BANK_CHUNKS             0x0070
+#define KEY_ID_MIN              0x0100
+#define KEY_ID_MAX              0x3fff
+
+#define MAX_RECORD \
+    (1 + SETTINGS_MAX_NAME_LEN + SETTINGS_MAX_VAL_LEN)
+
+/** @brief Persisted allocator state: ids are reserved in blocks of
+    CONFIG_SETTINGSIDX_ID_BLOCK, and no id at or above reserved_upto has been
+    used. */
+typedef struct AllocHdr
+{
+    uint32_t magic;
+    uint16_t reserved_upto;
+    uint16_t pad;
+} AllocHdr;
+
+/** @brief Persisted index header. All keys with id < indexed_upto are in the
+    index chunks of the active bank. */
+typedef struct IndexHdr
+{
+    uint32_t magic;
+    uint8_t bank;
+    uint8_t pad;
+    uint16_t chunks;
+    uint16_t indexed_upto;
+    uint16_t pad2;
+} IndexHdr;
+
+typedef struct Entry
+{
+    uint16_t id;
+    uint16_t name_off;
+    uint8_t name_len;
+} Entry;
+
+typedef struct ValueReader
+{
+    const uint8_t *val;
+    size_t len;
+} ValueReader;
+
+static struct nvs_fs fs;
+static struct settings_store store;
+static K_MUTEX_DEFINE(lock);
+
+static Entry entries[CONFIG_SETTINGSIDX_MAX_KEYS];
+static uint32_t num_entries;
+static char name_pool[CONFIG_SETTINGSIDX_NAME_POOL_SIZE];
+static uint32_t pool_used;
+
+BUILD_ASSERT(CONFIG_SETTINGSIDX_NAME_POOL_SIZE <= UINT16_MAX + 1,
+    "Entry.name_off is 16 bits");
+
+static AllocHdr alloc_hdr;
+static IndexHdr index_hdr;
+/** @brief Next id to hand out, below alloc_hdr.reserved_upto. */
+static uint32_t next_id;
+
+/* Shared record and chunk buffers. Only used with the lock held. */
+static uint8_t rec_buf[MAX_RECORD];
+static uint8_t chunk_buf[CONFIG_SETTINGSIDX_CHUNK_SIZE];
+
+/* Copy of the record handed to a settings handler by idx_load, which runs
+   the handler without the lock held. */
+static K_MUTEX_DEFINE(load_lock);
+static uint8_t load_buf[MAX_RECORD];
+
+static SettingsIdx_Stats stats;
+
+static void flush_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(flush_work, flush_work_handler);
+
+/** @brief Compare an index entry to a name. */
+static int
+entry_cmp(const Entry *e, const char *name, size_t len)
+{
+    size_t n = MIN(e->name_len, len);
+    int c = memcmp(&name_pool[e->name_off], name, n);
+
+    if (c != 0)
+    {
+        return c;
+    }
+
+    return (int)e->name_len - (int)len;
+}
+
+/** @brief First entry whose name is >= name. */
+static uint32_t
+lower_bound(const char *name, size_t len)
+{
+    uint32_t lo = 0;
+    uint32_t hi = num_entries;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (entry_cmp(&entries[mid], name, len) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static int
+find(const char *name, size_t len)
+{
+    uint32_t i = lower_bound(name, len);
+
+    if (i < num_entries && entry_cmp(&entries[i], name, len) == 0)
+    {
+        return (int)i;
+    }
+
+    return -ENOENT;
+}
+
+static int
+insert(const char *name, size_t len, uint16_t id)
+{
+    uint32_t i;
+
+    if (num_entries == ARRAY_SIZE(entries) ||
+        pool_used + len > sizeof(name_pool))
+    {
+        LOG_ERR("Index full (%u keys, %u name bytes).", num_entries, pool_used);
+        return -ENOMEM;
+    }
+
+    i = lower_bound(name, len);
+    memmove(&entries[i + 1], &entries[i], (num_entries - i) * sizeof(Entry));
+    memcpy(&name_pool[pool_used], name, len);
+
+    entries[i].id = id;
+    entries[i].name_off = pool_used;
+    entries[i].name_len = len;
+
+    pool_used += len;
+    num_entries++;
+    return 0;
+}
+
+static void
+remove_at(uint32_t i)
+{
+    uint16_t off = entries[i].name_off;
+    uint8_t len = entries[i].name_len;
+    uint32_t k;
+
+    /* Keep the name pool packed. */
+    memmove(&name_pool[off], &name_pool[off + len], pool_used - off - len);
+    pool_used -= len;
+
+    memmove(&entries[i], &entries[i + 1], (num_entries - i - 1) * sizeof(Entry));
+    num_entries--;
+
+    for (k = 0; k < num_entries; k++)
+    {
+        if (entries[k].name_off > off)
+        {
+            entries[k].name_off -= len;
+        }
+    }
+}
+
+/** @brief Read a key record. Returns the value length, or negative errno. */
+static int
+read_record(uint16_t id, const char **name, size_t *name_len, const uint8_t **val)
+{
+    ssize_t len = nvs_read(&fs, id, rec_buf, sizeof(rec_buf));
+
+    if (len < 0)
+    {
+        return (int)len;
+    }
+
+    if (len < 1 || len > (ssize_t)sizeof(rec_buf) || rec_buf[0] + 1 > len)
+    {
+        LOG_ERR("Corrupt record 0x%04x (len %d).", id, (int)len);
+        return -EIO;
+    }
+
+    *name = (const char *)&rec_buf[1];
+    *name_len = rec_buf[0];
+    *val = &rec_buf[1 + rec_buf[0]];
+    return (int)(len - 1 - rec_buf[0]);
+}
+
+static ssize_t
+value_read_cb(void *cb_arg, void *data, size_t len)
+{
+    ValueReader *rd = (ValueReader *)cb_arg;
+    size_t n = MIN(len, rd->len);
+
+    memcpy(data, rd->val, n);
+    return n;
+}
+
+/** @brief Write the index into the inactive bank, then commit it by writing
+    the index header. */
+static int
+flush_locked(void)
+{
+    uint8_t bank = !index_hdr.bank;
+    uint16_t old_chunks = index_hdr.chunks;
+    uint8_t old_bank = index_hdr.bank;
+    uint16_t chunk = 0;
+    uint32_t used = 0;
+    uint32_t k;
+    ssize_t rc;
+
+    for (k = 0; k < num_entries; k++)
+    {
+        const Entry *e = &entries[k];
+        uint32_t need = 3 + e->name_len;
+
+        if (used + need > sizeof(chunk_buf))
+        {
+            rc = nvs_write(&fs, BANK_BASE(bank) + chunk, chunk_buf, used);
+            if (rc < 0)
+            {
+                return (int)rc;
+            }
+            used = 0;
+            if (++chunk == BANK_CHUNKS)
+            {
+                LOG_ERR("Index exceeds %u chunks.", BANK_CHUNKS);
+                return -ENOSPC;
+            }
+        }
+
+        sys_put_le16(e->id, &chunk_buf[used]);
+        chunk_buf[used + 2] = e->name_len;
+        memcpy(&chunk_buf[used + 3], &name_pool[e->name_off], e->name_len);
+        used += need;
+    }
+
+    if (used > 0)
+    {
+        rc = nvs_write(&fs, BANK_BASE(bank) + chunk, chunk_buf, used);
+        if (rc < 0)
+        {
+            return (int)rc;
+        }
+        chunk++;
+    }
+
+    index_hdr.magic = SETTINGSIDX_MAGIC;
+    index_hdr.bank = bank;
+    index_hdr.chunks = chunk;
+    index_hdr.indexed_upto = next_id;
+    rc = nvs_write(&fs, INDEX_ID, &index_hdr, sizeof(index_hdr));
+    if (rc < 0)
+    {
+        return (int)rc;
+    }
+
+    for (k = 0; k < old_chunks; k++)
+    {
+        nvs_delete(&fs, BANK_BASE(old_bank) + k);
+    }
+
+    stats.chunks = chunk;
+    stats.flushes++;
+    return 0;
+}
+
+static void
+flush_work_handler(struct k_work *work)
+{
+    int ret;
+
+    ARG_UNUSED(work);
+
+    k_mutex_lock(&lock, K_FOREVER);
+    ret = flush_locked();
+    k_mutex_unlock(&lock);
+
+    if (ret < 0)
+    {
+        LOG_ERR("Index flush failed: %d", ret);
+    }
+}
+
+static inline void
+schedule_flush(void)
+{
+    k_work_reschedule(&flush_work, K_MSEC(CONFIG_SETTINGSIDX_FLUSH_DELAY_MS));
+}
+
+/** @brief Allocate a key record id. Ids are handed out in increasing order so
+    that keys created after the last flush can be found at boot. They are
+    reserved CONFIG_SETTINGSIDX_ID_BLOCK at a time, so only one key in a block
+    costs an allocator write. Once the range is exhausted, freed ids are
+    reused, and the caller must index a reused id before writing its record. */
+static int
+alloc_id(uint16_t *id, bool *reused)
+{
+    static uint8_t used_map[(KEY_ID_MAX - KEY_ID_MIN + 8) / 8];
+    uint32_t k;
+    ssize_t rc;
+
+    if (next_id <= KEY_ID_MAX)
+    {
+        if (next_id >= alloc_hdr.reserved_upto)
+        {
+            alloc_hdr.reserved_upto =
+                MIN(next_id + CONFIG_SETTINGSIDX_ID_BLOCK, KEY_ID_MAX + 1);
+            rc = nvs_write(&fs, ALLOC_ID, &alloc_hdr, sizeof(alloc_hdr));
+            if (rc < 0)
+            {
+                return (int)rc;
+            }
+        }
+
+        *id = next_id++;
+        *reused = false;
+        return 0;
+    }
+
+    memset(used_map, 0, sizeof(used_map));
+    for (k = 0; k < num_entries; k++)
+    {
+        uint32_t bit = entries[k].id - KEY_ID_MIN;
+        used_map[bit / 8] |= BIT(bit % 8);
+    }
+
+    for (k = 0; k <= KEY_ID_MAX - KEY_ID_MIN; k++)
+    {
+        if (!(used_map[k / 8] & BIT(k % 8)))
+        {
+            *id = KEY_ID_MIN + k;
+            *reused = true;
+            return 0;
+        }
+    }
+
+    return -ENOSPC;
+}
+
+/** @brief Load every key in a subtree. A handler may save or delete keys,
+    which changes the index, so each record is copied out and the handler is
+    called without the lock held. The walk then resumes after the name just
+    loaded. */
+static int
+idx_load(struct settings_store *cs, const struct settings_load_arg *arg)
+{
+    const char *subtree = (arg && arg->subtree) ? arg->subtree : "";
+    size_t sub_len = strlen(subtree);
+    char name[SETTINGS_MAX_NAME_LEN + 1];
+    uint32_t i;
+
+    ARG_UNUSED(cs);
+
+    k_mutex_lock(&load_lock, K_FOREVER);
+    k_mutex_lock(&lock, K_FOREVER);
+
+    /* All keys under a subtree share its name as a prefix, so they are
+       contiguous in the sorted index. */
+    i = lower_bound(subtree, sub_len);
+    while (i < num_entries)
+    {
+        Entry *e = &entries[i];
+        const char *rec_name;
+        size_t rec_name_len;
+        const uint8_t *val;
+        ValueReader rd;
+        int len;
+
+        if (e->name_len < sub_len ||
+            memcmp(&name_pool[e->name_off], subtree, sub_len) != 0)
+        {
+            break;
+        }
+
+        /* Skip siblings such as "abc" when loading "ab". */
+        if (sub_len > 0 && e->name_len > sub_len &&
+            name_pool[e->name_off + sub_len] != SETTINGS_NAME_SEPARATOR)
+        {
+            i++;
+            continue;
+        }
+
+        len = read_record(e->id, &rec_name, &rec_name_len, &val);
+        if (len == -ENOENT ||
+            (len >= 0 && entry_cmp(e, rec_name, rec_name_len) != 0))
+        {
+            /* Deleted after the last index flush, or the id was reused for
+               another key before the flush. */
+            remove_at(i);
+            schedule_flush();
+            continue;
+        }
+        else if (len < 0)
+        {
+            i++;
+            continue;
+        }
+
+        memcpy(name, rec_name, rec_name_len);
+        name[rec_name_len] = '\0';
+        memcpy(load_buf, val, len);
+        rd.val = load_buf;
+        rd.len = len;
+
+        k_mutex_unlock(&lock);
+        settings_call_set_handler(name, len, value_read_cb, &rd, arg);
+        k_mutex_lock(&lock, K_FOREVER);
+
+        i = lower_bound(name, rec_name_len);
+        if (i < num_entries && entry_cmp(&entries[i], name, rec_name_len) == 0)
+        {
+            i++;
+        }
+    }
+
+    k_mutex_unlock(&lock);
+    k_mutex_unlock(&load_lock);
+    return 0;
+}
+
+static int
+idx_save(struct settings_store *cs, const char *name, const char *value, size_t val_len)
+{
+    size_t name_len = strlen(name);
+    bool reused = false;
+    uint16_t id;
+    ssize_t rc;
+    int i;
+    int ret = 0;
+
+    ARG_UNUSED(cs);
+
+    if (name_len == 0 || name_len > SETTINGS_MAX_NAME_LEN ||
+        val_len > SETTINGS_MAX_VAL_LEN)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&lock, K_FOREVER);
+
+    i = find(name, name_len);
+
+    if (!value || val_len == 0)
+    {
+        if (i >= 0)
+        {
+            nvs_delete(&fs, entries[i].id);
+            remove_at(i);
+            schedule_flush();
+        }
+        goto out;
+    }
+
+    if (i >= 0)
+    {
+        id = entries[i].id;
+    }
+    else
+    {
+        ret = alloc_id(&id, &reused);
+        if (ret < 0)
+        {
+            goto out;
+        }
+    }
+
+    if (i < 0)
+    {
+        ret = insert(name, name_len, id);
+        if (ret < 0)
+        {
+            goto out;
+        }
+
+        /* A reused id is below indexed_upto, where the boot replay does not
+           look, so it is indexed before its record is written. If the write
+           then fails (or never happens), the load drops the entry. */
+        if (reused)
+        {
+            ret = flush_locked();
+            if (ret < 0)
+            {
+                remove_at(find(name, name_len));
+                goto out;
+            }
+        }
+    }
+
+    rec_buf[0] = name_len;
+    memcpy(&rec_buf[1], name, name_len);
+    memcpy(&rec_buf[1 + name_len], value, val_len);
+
+    rc = nvs_write(&fs, id, rec_buf, 1 + name_len + val_len);
+    if (rc < 0)
+    {
+        ret = (int)rc;
+        if (i < 0)
+        {
+            remove_at(find(name, name_len));
+            schedule_flush();
+        }
+        goto out;
+    }
+
+    if (i < 0 && !reused)
+    {
+        schedule_flush();
+    }
+
+out:
+    k_mutex_unlock(&lock);
+    return ret;
+}
+
+static void *
+idx_storage_get(struct settings_store *cs)
+{
+    ARG_UNUSED(cs);
+    return &fs;
+}
+
+static const struct settings_store_itf idx_itf = {
+    .csi_load = idx_load,
+    .csi_save = idx_save,
+    .csi_storage_get = idx_storage_get,
+};
+
+/** @brief Read the persisted index chunks into RAM. */
+static int
+load_index(void)
+{
+    uint32_t c;
+
+    if (nvs_read(&fs, INDEX_ID, &index_hdr, sizeof(index_hdr)) != sizeof(index_hdr) ||
+        index_hdr.magic != SETTINGSIDX_MAGIC)
+    {
+        memset(&index_hdr, 0, sizeof(index_hdr));
+        index_hdr.indexed_upto = KEY_ID_MIN;
+        return 0;
+    }
+
+    for (c = 0; c < index_hdr.chunks; c++)
+    {
+        ssize_t len = nvs_read(&fs, BANK_BASE(index_hdr.bank) + c,
+            chunk_buf, sizeof(chunk_buf));
+        uint32_t pos = 0;
+
+        if (len < 0 || len > (ssize_t)sizeof(chunk_buf))
+        {
+            LOG_ERR("Index chunk %u unreadable: %d", c, (int)len);
+            return -EIO;
+        }
+
+        while (pos + 3 <= (uint32_t)len)
+        {
+            uint16_t id = sys_get_le16(&chunk_buf[pos]);
+            uint8_t nlen = chunk_buf[pos + 2];
+
+            if (pos + 3 + nlen > (uint32_t)len ||
+                num_entries == ARRAY_SIZE(entries) ||
+                pool_used + nlen > sizeof(name_pool))
+            {
+                LOG_ERR("Index chunk %u does not fit.", c);
+                return -ENOMEM;
+            }
+
+            /* Chunks are written in name order, so append. */
+            memcpy(&name_pool[pool_used], &chunk_buf[pos + 3], nlen);
+            entries[num_entries].id = id;
+            entries[num_entries].name_off = pool_used;
+            entries[num_entries].name_len = nlen;
+            num_entries++;
+            pool_used += nlen;
+            pos += 3 + nlen;
+        }
+    }
+
+    stats.chunks = index_hdr.chunks;
+    return 0;
+}
+
+/** @brief Add keys created after the last index flush. They have ids from
+    indexed_upto up to the end of the reserved block. Allocation resumes after
+    the last one found. */
+static int
+replay_tail(void)
+{
+    uint32_t id;
+    bool added = false;
+
+    next_id = MAX(index_hdr.indexed_upto, KEY_ID_MIN);
+
+    for (id = index_hdr.indexed_upto; id < alloc_hdr.reserved_upto; id++)
+    {
+        const char *name;
+        size_t name_len;
+        const uint8_t *val;
+        int i;
+
+        if (read_record(id, &name, &name_len, &val) < 0)
+        {
+            continue;
+        }
+
+        i = find(name, name_len);
+        if (i >= 0)
+        {
+            entries[i].id = id;
+        }
+        else if (insert(name, name_len, id) < 0)
+        {
+            return -ENOMEM;
+        }
+
+        stats.tail_replayed++;
+        added = true;
+        next_id = id + 1;
+    }
+
+    if (added)
+    {
+        return flush_locked();
+    }
+
+    return 0;
+}
+
+static int
+mount_nvs(void)
+{
+    const struct flash_area *fa;
+    struct flash_pages_info info;
+    int ret;
+
+    ret = flash_area_open(SETTINGSIDX_PARTITION, &fa);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    fs.flash_device = fa->fa_dev;
+    fs.offset = fa->fa_off;
+
+    ret = flash_get_page_info_by_offs(fa->fa_dev, fa->fa_off, &info);
+    if (ret < 0)
+    {
+        flash_area_close(fa);
+        return ret;
+    }
+
+    fs.sector_size = info.size;
+    fs.sector_count = fa->fa_size / info.size;
+    flash_area_close(fa);
+
+    return nvs_mount(&fs);
+}
+
+/** @brief Entry point called by the settings subsystem for
+    CONFIG_SETTINGS_CUSTOM. */
+int
+settings_backend_init(void)
+{
+    uint32_t t0 = k_cycle_get_32();
+    int ret;
+
+    ret = mount_nvs();
+    if (ret < 0)
+    {
+        LOG_ERR("NVS mount failed: %d", ret);
+        return ret;
+    }
+
+    if (nvs_read(&fs, ALLOC_ID, &alloc_hdr, sizeof(alloc_hdr)) != sizeof(alloc_hdr) ||
+        alloc_hdr.magic != SETTINGSIDX_MAGIC)
+    {
+        alloc_hdr.magic = SETTINGSIDX_MAGIC;
+        alloc_hdr.reserved_upto = KEY_ID_MIN;
+    }
+
+    k_mutex_lock(&lock, K_FOREVER);
+    ret = load_index();
+    if (ret == 0)
+    {
+        ret = replay_tail();
+    }
+    k_mutex_unlock(&lock);
+
+    if (ret < 0)
+    {
+        LOG_ERR("Index load failed: %d", ret);
+        return ret;
+    }
+
+    store.cs_itf = &idx_itf;
+    settings_src_register(&store);
+    settings_dst_register(&store);
+
+    stats.init_us = k_cyc_to_us_floor32(k_cycle_get_32() - t0);
+    LOG_INF("%u keys indexed (%u replayed) in %u us.",
+        num_entries, stats.tail_replayed, stats.init_us);
+
+    return 0;
+}
+
+/** @brief Persist the index now. */
+int
+SettingsIdx_flush(void)
+{
+    int ret;
+
+    k_work_cancel_delayable(&flush_work);
+
+    k_mutex_lock(&lock, K_FOREVER);
+    ret = flush_locked();
+    k_mutex_unlock(&lock);
+
+    return ret;
+}
+
+/** @brief Get backend statistics. */
+void
+SettingsIdx_getStats(SettingsIdx_Stats *out)
+{
+    k_mutex_lock(&lock, K_FOREVER);
+    stats.keys = num_entries;
+    stats.name_pool_used = pool_used;
+    *out = stats;
+    k_mutex_unlock(&lock);
+}
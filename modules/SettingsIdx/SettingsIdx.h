@@ -0,0 +1,44 @@
+/*******************************************************************************
+ *  @file: SettingsIdx.h
+ *
+ *  @brief: Indexed NVS settings backend.
+ *
+ *  Provides settings_backend_init() for CONFIG_SETTINGS_CUSTOM. Each key is a
+ *  single NVS record holding its name and value. A RAM index of key names,
+ *  sorted by name, maps each key to its record id. The index is persisted in
+ *  compact chunks, double-banked so that a flush is committed by a single
+ *  header write.
+ *
+ *  Record id layout:
+ *    0x0001          id allocator state
+ *    0x0002          index header (active bank, chunk count, indexed ids)
+ *    0x0010-0x007f   index chunks, bank 0
+ *    0x0080-0x00ef   index chunks, bank 1
+ *    0x0100-0x3fff   key records
+*******************************************************************************/
+#ifndef SETTINGSIDX_H
+#define SETTINGSIDX_H
+
+#include <stdint.h>
+
+typedef struct SettingsIdx_Stats
+{
+    uint32_t keys;
+    uint32_t name_pool_used;
+    uint32_t chunks;
+    uint32_t flushes;
+    /** @brief Keys recovered at boot from after the last index flush. */
+    uint32_t tail_replayed;
+    /** @brief Time (us) to mount and load the index at boot. */
+    uint32_t init_us;
+} SettingsIdx_Stats;
+
+/** @brief Persist the index now, rather than after the flush delay. */
+int
+SettingsIdx_flush(void);
+
+/** @brief Get backend statistics. */
+void
+SettingsIdx_getStats(SettingsIdx_Stats *stats);
+
+#endif
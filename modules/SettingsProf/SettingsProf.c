@@ -0,0 +1,274 @@
+/*******************************************************************************
+ *  @file: SettingsProf.c
+ *
+ *  @brief: Load-time profiling for the settings subsystem.
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include "SettingsProf.h"
+
+#if CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(SettingsProf, CONFIG_SETTINGSPROF_LOG_LEVEL);
+
+static inline uint32_t
+cyc_since_us(uint32_t start)
+{
+    return k_cyc_to_us_floor32(k_cycle_get_32() - start);
+}
+
+/** @brief Direct load callback: bucket each record by its top-level name. */
+static int
+count_cb(
+    const char *key,
+    size_t len,
+    settings_read_cb read_cb,
+    void *cb_arg,
+    void *param)
+{
+    SettingsProf_Report *rpt = (SettingsProf_Report *)param;
+    const char *next;
+    size_t name_len;
+    uint32_t k;
+
+    ARG_UNUSED(read_cb);
+    ARG_UNUSED(cb_arg);
+
+    rpt->records++;
+    rpt->bytes += len;
+
+    name_len = settings_name_next(key, &next);
+    if (name_len == 0)
+    {
+        name_len = strlen(key);
+    }
+    name_len = MIN(name_len, sizeof(rpt->subtrees[0].name) - 1);
+
+    for (k = 0; k < rpt->num_subtrees; k++)
+    {
+        SettingsProf_Subtree *st = &rpt->subtrees[k];
+        if (strncmp(st->name, key, name_len) == 0 && st->name[name_len] == '\0')
+        {
+            st->records++;
+            st->bytes += len;
+            return 0;
+        }
+    }
+
+    if (rpt->num_subtrees == ARRAY_SIZE(rpt->subtrees))
+    {
+        rpt->untracked++;
+        return 0;
+    }
+
+    SettingsProf_Subtree *st = &rpt->subtrees[rpt->num_subtrees++];
+    memcpy(st->name, key, name_len);
+    st->name[name_len] = '\0';
+    st->records = 1;
+    st->bytes = len;
+    return 0;
+}
+
+/** @brief Profile the current contents of the settings store. */
+int
+SettingsProf_run(SettingsProf_Report *rpt)
+{
+    uint32_t t0;
+    uint32_t k;
+    int ret;
+
+    memset(rpt, 0, sizeof(*rpt));
+
+    t0 = k_cycle_get_32();
+    ret = settings_load_subtree_direct(NULL, count_cb, rpt);
+    rpt->replay_us = cyc_since_us(t0);
+    if (ret < 0)
+    {
+        LOG_ERR("Direct load failed: %d", ret);
+        return ret;
+    }
+
+    for (k = 0; k < rpt->num_subtrees; k++)
+    {
+        t0 = k_cycle_get_32();
+        settings_load_subtree(rpt->subtrees[k].name);
+        rpt->subtrees[k].load_us = cyc_since_us(t0);
+    }
+
+    t0 = k_cycle_get_32();
+    ret = settings_load();
+    rpt->load_us = cyc_since_us(t0);
+
+    return ret;
+}
+
+/** @brief Log a report. */
+void
+SettingsProf_log(const SettingsProf_Report *rpt)
+{
+    uint32_t k;
+
+    LOG_INF("%u records (%u bytes), replay %u us, settings_load %u us",
+        rpt->records, rpt->bytes, rpt->replay_us, rpt->load_us);
+
+    for (k = 0; k < rpt->num_subtrees; k++)
+    {
+        const SettingsProf_Subtree *st = &rpt->subtrees[k];
+        LOG_INF("  %-15s %5u records %6u bytes %8u us",
+            st->name, st->records, st->bytes, st->load_us);
+    }
+
+    if (rpt->untracked > 0)
+    {
+        LOG_WRN("  %u records in untracked subtrees", rpt->untracked);
+    }
+}
+
+#if CONFIG_SETTINGSPROF_BENCH
+static uint32_t bench_set_count;
+
+static int
+bench_set(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+    uint32_t val;
+
+    ARG_UNUSED(key);
+
+    if (len == sizeof(val) && read_cb(cb_arg, &val, sizeof(val)) == sizeof(val))
+    {
+        bench_set_count++;
+    }
+
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(settingsprof_bench, "bench", NULL, bench_set, NULL, NULL);
+
+/** @brief Populate "bench/" with num_keys keys and time full and single key
+    loads. */
+int
+SettingsProf_bench(uint32_t num_keys, SettingsProf_BenchResult *res)
+{
+    char name[24];
+    uint32_t t0;
+    uint32_t k;
+    int ret = 0;
+
+    memset(res, 0, sizeof(*res));
+    res->num_keys = num_keys;
+
+    t0 = k_cycle_get_32();
+    for (k = 0; k < num_keys; k++)
+    {
+        snprintf(name, sizeof(name), "bench/k%04u", k);
+        ret = settings_save_one(name, &k, sizeof(k));
+        if (ret < 0)
+        {
+            LOG_ERR("Save of %s failed: %d", name, ret);
+            goto cleanup;
+        }
+    }
+    res->write_us = cyc_since_us(t0);
+
+    bench_set_count = 0;
+    t0 = k_cycle_get_32();
+    settings_load();
+    res->load_all_us = cyc_since_us(t0);
+
+    /* Load the key in the middle of the name order. */
+    snprintf(name, sizeof(name), "bench/k%04u", num_keys / 2);
+    bench_set_count = 0;
+    t0 = k_cycle_get_32();
+    settings_load_subtree(name);
+    res->load_one_us = cyc_since_us(t0);
+
+    if (bench_set_count != 1)
+    {
+        LOG_WRN("Single key load delivered %u values.", bench_set_count);
+    }
+
+cleanup:
+    for (k = 0; k < num_keys; k++)
+    {
+        snprintf(name, sizeof(name), "bench/k%04u", k);
+        settings_delete(name);
+    }
+
+    return ret;
+}
+#endif
+
+#if CONFIG_SHELL
+static int
+cmd_report(const struct shell *sh, size_t argc, char **argv)
+{
+    static SettingsProf_Report rpt;
+    uint32_t k;
+    int ret;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    ret = SettingsProf_run(&rpt);
+    if (ret < 0)
+    {
+        shell_error(sh, "Profiling failed: %d", ret);
+        return ret;
+    }
+
+    shell_print(sh, "%u records (%u bytes), replay %u us, settings_load %u us",
+        rpt.records, rpt.bytes, rpt.replay_us, rpt.load_us);
+    shell_print(sh, "%-15s %7s %7s %9s", "subtree", "records", "bytes", "load_us");
+    for (k = 0; k < rpt.num_subtrees; k++)
+    {
+        const SettingsProf_Subtree *st = &rpt.subtrees[k];
+        shell_print(sh, "%-15s %7u %7u %9u",
+            st->name, st->records, st->bytes, st->load_us);
+    }
+
+    return 0;
+}
+
+#if CONFIG_SETTINGSPROF_BENCH
+static int
+cmd_bench(const struct shell *sh, size_t argc, char **argv)
+{
+    static const uint32_t defaults[] = { 10, 50, 100, 250, 500, 1000 };
+    SettingsProf_BenchResult res;
+    uint32_t num = (argc > 1) ? argc - 1 : ARRAY_SIZE(defaults);
+    uint32_t k;
+
+    shell_print(sh, "%6s %10s %12s %12s", "keys", "write_us", "load_all_us", "load_one_us");
+    for (k = 0; k < num; k++)
+    {
+        uint32_t n = (argc > 1) ? strtoul(argv[k + 1], NULL, 0) : defaults[k];
+        int ret = SettingsProf_bench(n, &res);
+        if (ret < 0)
+        {
+            shell_error(sh, "Bench with %u keys failed: %d", n, ret);
+            return ret;
+        }
+        shell_print(sh, "%6u %10u %12u %12u",
+            res.num_keys, res.write_us, res.load_all_us, res.load_one_us);
+    }
+
+    return 0;
+}
+#endif
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_settings_prof,
+    SHELL_CMD(report, NULL, "Per-subtree record counts and load times.", cmd_report),
+#if CONFIG_SETTINGSPROF_BENCH
+    SHELL_CMD(bench, NULL, "Load time vs key count: bench [n1 n2 ...]", cmd_bench),
+#endif
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(settings_prof, &sub_settings_prof, "Settings profiling", NULL);
+#endif
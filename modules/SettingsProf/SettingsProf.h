@@ -0,0 +1,67 @@
+/*******************************************************************************
+ *  @file: SettingsProf.h
+ *
+ *  @brief: Load-time profiling for the settings subsystem.
+ *
+ *  Works with any settings backend. A direct load pass groups the stored
+ *  records by top-level name (i.e. the handler they are routed to) and counts
+ *  them. Each subtree is then loaded through its handler and timed.
+*******************************************************************************/
+#ifndef SETTINGSPROF_H
+#define SETTINGSPROF_H
+
+#include <stdint.h>
+
+typedef struct SettingsProf_Subtree
+{
+    char name[16];
+    uint32_t records;
+    uint32_t bytes;
+    /** @brief Time (us) of settings_load_subtree() for this subtree. */
+    uint32_t load_us;
+} SettingsProf_Subtree;
+
+typedef struct SettingsProf_Report
+{
+    SettingsProf_Subtree subtrees[CONFIG_SETTINGSPROF_MAX_SUBTREES];
+    uint32_t num_subtrees;
+    uint32_t records;
+    uint32_t bytes;
+    /** @brief Records whose subtree did not fit in subtrees[]. */
+    uint32_t untracked;
+    /** @brief Time (us) of a full backend replay with no handlers called. */
+    uint32_t replay_us;
+    /** @brief Time (us) of a full settings_load(). */
+    uint32_t load_us;
+} SettingsProf_Report;
+
+/** @brief Profile the current contents of the settings store.
+    @return 0 on success, negative errno otherwise.
+*/
+int
+SettingsProf_run(SettingsProf_Report *rpt);
+
+/** @brief Log a report. */
+void
+SettingsProf_log(const SettingsProf_Report *rpt);
+
+#if CONFIG_SETTINGSPROF_BENCH
+typedef struct SettingsProf_BenchResult
+{
+    uint32_t num_keys;
+    /** @brief Time (us) to write num_keys keys. */
+    uint32_t write_us;
+    /** @brief Time (us) of a full settings_load(). */
+    uint32_t load_all_us;
+    /** @brief Time (us) to load a single key via its full name. */
+    uint32_t load_one_us;
+} SettingsProf_BenchResult;
+
+/** @brief Populate "bench/" with num_keys keys and time full and single key
+    loads. Keys are deleted again afterwards.
+*/
+int
+SettingsProf_bench(uint32_t num_keys, SettingsProf_BenchResult *res);
+#endif
+
+#endif
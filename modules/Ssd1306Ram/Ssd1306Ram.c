@@ -0,0 +1,666 @@
+/*******************************************************************************
+ *  @file: Ssd1306Ram.c
+ *
+ *  @brief: SSD1306 display emulated in RAM (vnd,ssd1306-ram).
+*******************************************************************************/
+#define DT_DRV_COMPAT vnd_ssd1306_ram
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/display.h>
+#include "Ssd1306Ram.h"
+
+#if CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(Ssd1306Ram, CONFIG_SSD1306RAM_LOG_LEVEL);
+
+/* Display RAM of the controller. */
+#define RAM_COLS            128
+#define RAM_PAGES           8
+
+/* SSD1306 commands the model acts on. */
+#define CMD_SET_CONTRAST    0x81
+#define CMD_MEM_MODE        0x20
+#define CMD_COLUMN_ADDR     0x21
+#define CMD_PAGE_ADDR       0x22
+#define CMD_SEG_REMAP       0xA0
+#define CMD_SEG_REMAP_REV   0xA1
+#define CMD_ENTIRE_RESUME   0xA4
+#define CMD_ENTIRE_ON       0xA5
+#define CMD_NORMAL          0xA6
+#define CMD_INVERSE         0xA7
+#define CMD_DISPLAY_OFF     0xAE
+#define CMD_DISPLAY_ON      0xAF
+#define CMD_COM_SCAN_INC    0xC0
+#define CMD_COM_SCAN_DEC    0xC8
+
+#define MODE_HORIZONTAL     0
+#define MODE_VERTICAL       1
+#define MODE_PAGE           2
+
+/* An I2C write: the address byte and the control byte, before the payload. */
+#define XFER_OVERHEAD       2
+
+struct ssd1306ram_config {
+    uint16_t width;
+    uint16_t height;
+    uint8_t segment_offset;
+    uint8_t page_offset;
+};
+
+struct ssd1306ram_data {
+    uint8_t ram[RAM_PAGES][RAM_COLS];
+
+    /* Controller state. */
+    uint8_t mode;
+    uint8_t col_start;
+    uint8_t col_end;
+    uint8_t page_start;
+    uint8_t page_end;
+    uint8_t col;
+    uint8_t page;
+    uint8_t contrast;
+    bool on;
+    bool inverse;
+    bool entire_on;
+    bool seg_remap;
+    bool com_dec;
+
+    /* Command being parsed, waiting for want arguments. */
+    uint8_t cmd;
+    uint8_t args[6];
+    uint8_t nargs;
+    uint8_t want;
+
+    enum display_pixel_format pf;
+
+    /* Serializes display calls, and guards the stats. */
+    struct k_mutex lock;
+    Ssd1306Ram_Stats stats;
+    /** @brief The totals when the current frame started. */
+    Ssd1306Ram_Stats mark;
+};
+
+#if CONFIG_SHELL
+static const struct device *shell_dev;
+#endif
+
+static uint8_t
+cmd_arg_count(uint8_t cmd)
+{
+    switch (cmd)
+    {
+        case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+        case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+            return 1;
+        case 0x21: case 0x22: case 0xA3:
+            return 2;
+        case 0x29: case 0x2A:
+            return 5;
+        case 0x26: case 0x27:
+            return 6;
+        default:
+            return 0;
+    }
+}
+
+static void
+apply_cmd(struct ssd1306ram_data *d, uint8_t cmd, const uint8_t *args)
+{
+    if (cmd <= 0x0F)
+    {
+        /* Page mode: lower column nibble. */
+        d->col = (d->col & 0xF0) | cmd;
+        return;
+    }
+    if (cmd <= 0x1F)
+    {
+        d->col = ((cmd & 0x07) << 4) | (d->col & 0x0F);
+        return;
+    }
+    if (cmd >= 0xB0 && cmd <= 0xB7)
+    {
+        d->page = cmd & 0x07;
+        return;
+    }
+
+    switch (cmd)
+    {
+        case CMD_SET_CONTRAST:
+            d->contrast = args[0];
+            break;
+        case CMD_MEM_MODE:
+            if ((args[0] & 0x03) != 0x03)
+            {
+                d->mode = args[0] & 0x03;
+            }
+            break;
+        case CMD_COLUMN_ADDR:
+            d->col_start = args[0] & 0x7F;
+            d->col_end = args[1] & 0x7F;
+            d->col = d->col_start;
+            break;
+        case CMD_PAGE_ADDR:
+            d->page_start = args[0] & 0x07;
+            d->page_end = args[1] & 0x07;
+            d->page = d->page_start;
+            break;
+        case CMD_SEG_REMAP:
+        case CMD_SEG_REMAP_REV:
+            d->seg_remap = (cmd == CMD_SEG_REMAP_REV);
+            break;
+        case CMD_COM_SCAN_INC:
+        case CMD_COM_SCAN_DEC:
+            d->com_dec = (cmd == CMD_COM_SCAN_DEC);
+            break;
+        case CMD_ENTIRE_RESUME:
+        case CMD_ENTIRE_ON:
+            d->entire_on = (cmd == CMD_ENTIRE_ON);
+            break;
+        case CMD_NORMAL:
+        case CMD_INVERSE:
+            d->inverse = (cmd == CMD_INVERSE);
+            break;
+        case CMD_DISPLAY_OFF:
+        case CMD_DISPLAY_ON:
+            d->on = (cmd == CMD_DISPLAY_ON);
+            break;
+        default:
+            /* Timing, charge pump, scrolling: no effect on the image. */
+            break;
+    }
+}
+
+/** @brief Move the RAM pointer past a data byte, as the addressing mode
+    does. */
+static void
+advance(struct ssd1306ram_data *d)
+{
+    switch (d->mode)
+    {
+        case MODE_HORIZONTAL:
+            if (d->col == d->col_end)
+            {
+                d->col = d->col_start;
+                d->page = (d->page == d->page_end) ? d->page_start : d->page + 1;
+            }
+            else
+            {
+                d->col = (d->col + 1) & (RAM_COLS - 1);
+            }
+            break;
+        case MODE_VERTICAL:
+            if (d->page == d->page_end)
+            {
+                d->page = d->page_start;
+                d->col = (d->col == d->col_end) ? d->col_start : ((d->col + 1) & (RAM_COLS - 1));
+            }
+            else
+            {
+                d->page = (d->page + 1) & (RAM_PAGES - 1);
+            }
+            break;
+        default:
+            d->col = (d->col + 1) & (RAM_COLS - 1);
+            break;
+    }
+}
+
+/** @brief One I2C write to the controller: commands (control byte 0x00)
+    or display data (control byte 0x40). */
+static void
+bus_write(struct ssd1306ram_data *d, bool command, const uint8_t *buf, size_t len)
+{
+    size_t k;
+
+    d->stats.transfers++;
+    d->stats.bus_bytes += XFER_OVERHEAD + len;
+
+    if (!command)
+    {
+        for (k = 0; k < len; k++)
+        {
+            d->ram[d->page][d->col] = buf[k];
+            advance(d);
+        }
+        d->stats.data_bytes += len;
+        return;
+    }
+
+    for (k = 0; k < len; k++)
+    {
+        if (d->nargs < d->want)
+        {
+            d->args[d->nargs++] = buf[k];
+            if (d->nargs == d->want)
+            {
+                apply_cmd(d, d->cmd, d->args);
+                d->want = 0;
+            }
+            continue;
+        }
+
+        d->cmd = buf[k];
+        d->want = cmd_arg_count(d->cmd);
+        d->nargs = 0;
+        d->stats.commands++;
+        if (d->want == 0)
+        {
+            apply_cmd(d, d->cmd, NULL);
+        }
+    }
+}
+
+static void
+send_cmds(const struct device *dev, const uint8_t *cmds, size_t len)
+{
+    struct ssd1306ram_data *d = dev->data;
+
+    k_mutex_lock(&d->lock, K_FOREVER);
+    bus_write(d, true, cmds, len);
+    k_mutex_unlock(&d->lock);
+}
+
+static int
+pixel(const struct device *dev, uint16_t x, uint16_t y)
+{
+    const struct ssd1306ram_config *cfg = dev->config;
+    struct ssd1306ram_data *d = dev->data;
+    int bit;
+
+    if (!d->on)
+    {
+        return 0;
+    }
+    if (d->entire_on)
+    {
+        return 1;
+    }
+
+    bit = (d->ram[y / 8 + cfg->page_offset][x + cfg->segment_offset] >> (y & 7)) & 1;
+    return d->inverse ? !bit : bit;
+}
+
+static int
+ssd1306ram_blanking_on(const struct device *dev)
+{
+    static const uint8_t cmd[] = { CMD_DISPLAY_OFF };
+
+    send_cmds(dev, cmd, sizeof(cmd));
+    return 0;
+}
+
+static int
+ssd1306ram_blanking_off(const struct device *dev)
+{
+    static const uint8_t cmd[] = { CMD_DISPLAY_ON };
+
+    send_cmds(dev, cmd, sizeof(cmd));
+    return 0;
+}
+
+static int
+ssd1306ram_set_contrast(const struct device *dev, const uint8_t contrast)
+{
+    const uint8_t cmd[] = { CMD_SET_CONTRAST, contrast };
+
+    send_cmds(dev, cmd, sizeof(cmd));
+    return 0;
+}
+
+static int
+ssd1306ram_set_pixel_format(const struct device *dev, const enum display_pixel_format pf)
+{
+    struct ssd1306ram_data *d = dev->data;
+    uint8_t cmd;
+
+    if (pf == d->pf)
+    {
+        return 0;
+    }
+
+    /* As the SSD1306 driver: MONO10 is the inverse display. */
+    if (pf == PIXEL_FORMAT_MONO10)
+    {
+        cmd = CMD_INVERSE;
+    }
+    else if (pf == PIXEL_FORMAT_MONO01)
+    {
+        cmd = CMD_NORMAL;
+    }
+    else
+    {
+        return -ENOTSUP;
+    }
+
+    send_cmds(dev, &cmd, 1);
+    d->pf = pf;
+    return 0;
+}
+
+static int
+ssd1306ram_write(const struct device *dev, const uint16_t x, const uint16_t y,
+    const struct display_buffer_descriptor *desc, const void *buf)
+{
+    const struct ssd1306ram_config *cfg = dev->config;
+    struct ssd1306ram_data *d = dev->data;
+    size_t len = (size_t)desc->width * desc->height / 8;
+    uint8_t x0 = x + cfg->segment_offset;
+    uint8_t p0 = y / 8 + cfg->page_offset;
+
+    if (desc->pitch != desc->width || (y & 7) || (desc->height & 7) ||
+        x + desc->width > cfg->width || y + desc->height > cfg->height ||
+        desc->buf_size < len || len == 0)
+    {
+        LOG_ERR("Bad write: %ux%u at %u,%u", desc->width, desc->height, x, y);
+        return -EINVAL;
+    }
+
+    /* The SSD1306 driver's write: horizontal addressing over the window,
+       then the data. */
+    const uint8_t cmd[] = {
+        CMD_MEM_MODE, MODE_HORIZONTAL,
+        CMD_COLUMN_ADDR, x0, x0 + desc->width - 1,
+        CMD_PAGE_ADDR, p0, p0 + desc->height / 8 - 1,
+    };
+
+    k_mutex_lock(&d->lock, K_FOREVER);
+    bus_write(d, true, cmd, sizeof(cmd));
+    bus_write(d, false, buf, len);
+    k_mutex_unlock(&d->lock);
+    return 0;
+}
+
+static int
+ssd1306ram_read(const struct device *dev, const uint16_t x, const uint16_t y,
+    const struct display_buffer_descriptor *desc, void *buf)
+{
+    const struct ssd1306ram_config *cfg = dev->config;
+    struct ssd1306ram_data *d = dev->data;
+    uint8_t *out = buf;
+    uint16_t p, c;
+
+    if ((y & 7) || (desc->height & 7) || x + desc->width > cfg->width ||
+        y + desc->height > cfg->height || desc->buf_size < desc->pitch * desc->height / 8)
+    {
+        return -EINVAL;
+    }
+
+    /* Straight from the RAM: the SSD1306 cannot be read over I2C, so this
+       is not counted. */
+    k_mutex_lock(&d->lock, K_FOREVER);
+    for (p = 0; p < desc->height / 8; p++)
+    {
+        for (c = 0; c < desc->width; c++)
+        {
+            out[p * desc->pitch + c] =
+                d->ram[y / 8 + p + cfg->page_offset][x + c + cfg->segment_offset];
+        }
+    }
+    k_mutex_unlock(&d->lock);
+    return 0;
+}
+
+static void
+ssd1306ram_get_capabilities(const struct device *dev, struct display_capabilities *caps)
+{
+    const struct ssd1306ram_config *cfg = dev->config;
+    struct ssd1306ram_data *d = dev->data;
+
+    memset(caps, 0, sizeof(*caps));
+    caps->x_resolution = cfg->width;
+    caps->y_resolution = cfg->height;
+    caps->supported_pixel_formats = PIXEL_FORMAT_MONO10 | PIXEL_FORMAT_MONO01;
+    caps->current_pixel_format = d->pf;
+    caps->screen_info = SCREEN_INFO_MONO_VTILED;
+    caps->current_orientation = DISPLAY_ORIENTATION_NORMAL;
+}
+
+static const struct display_driver_api ssd1306ram_api = {
+    .blanking_on = ssd1306ram_blanking_on,
+    .blanking_off = ssd1306ram_blanking_off,
+    .write = ssd1306ram_write,
+    .read = ssd1306ram_read,
+    .set_contrast = ssd1306ram_set_contrast,
+    .get_capabilities = ssd1306ram_get_capabilities,
+    .set_pixel_format = ssd1306ram_set_pixel_format,
+};
+
+static int
+ssd1306ram_init(const struct device *dev)
+{
+    const struct ssd1306ram_config *cfg = dev->config;
+    struct ssd1306ram_data *d = dev->data;
+    /* The SSD1306 driver's init sequence. */
+    const uint8_t init_cmds[] = {
+        CMD_DISPLAY_OFF,
+        0xD5, 0x80,                 /* Clock divide. */
+        0xA8, cfg->height - 1,      /* Multiplex ratio. */
+        0xD3, 0x00,                 /* Display offset. */
+        0x40,                       /* Start line 0. */
+        0x8D, 0x14,                 /* Charge pump on. */
+        CMD_SEG_REMAP_REV,
+        CMD_COM_SCAN_DEC,
+        0xDA, 0x12,                 /* COM pins. */
+        CMD_SET_CONTRAST, 0x80,
+        0xD9, 0xF1,                 /* Precharge. */
+        0xDB, 0x40,                 /* VCOMH deselect. */
+        CMD_ENTIRE_RESUME,
+        CMD_NORMAL,
+    };
+
+    k_mutex_init(&d->lock);
+
+    /* Reset state. The real display RAM powers up random; this one is
+       clear. */
+    memset(d->ram, 0, sizeof(d->ram));
+    d->mode = MODE_PAGE;
+    d->col_start = 0;
+    d->col_end = RAM_COLS - 1;
+    d->page_start = 0;
+    d->page_end = RAM_PAGES - 1;
+    d->col = 0;
+    d->page = 0;
+    d->contrast = 0x7F;
+    d->pf = PIXEL_FORMAT_MONO01;
+
+    send_cmds(dev, init_cmds, sizeof(init_cmds));
+
+    /* Count from here: what the application sends. */
+    memset(&d->stats, 0, sizeof(d->stats));
+    memset(&d->mark, 0, sizeof(d->mark));
+
+#if CONFIG_SHELL
+    if (!shell_dev)
+    {
+        shell_dev = dev;
+    }
+#endif
+
+    LOG_INF("%s: %ux%u at column %u, page %u.", dev->name, cfg->width, cfg->height,
+        cfg->segment_offset, cfg->page_offset);
+    return 0;
+}
+
+void
+Ssd1306Ram_dump(const struct device *dev)
+{
+    const struct ssd1306ram_config *cfg = dev->config;
+    struct ssd1306ram_data *d = dev->data;
+    char line[RAM_COLS + 1];
+    uint16_t x, y;
+
+    k_mutex_lock(&d->lock, K_FOREVER);
+    printk("P1\n%u %u\n", cfg->width, cfg->height);
+    for (y = 0; y < cfg->height; y++)
+    {
+        for (x = 0; x < cfg->width; x++)
+        {
+            line[x] = pixel(dev, x, y) ? '1' : '0';
+        }
+        line[x] = '\0';
+        printk("%s\n", line);
+    }
+    k_mutex_unlock(&d->lock);
+}
+
+void
+Ssd1306Ram_endFrame(const struct device *dev)
+{
+    struct ssd1306ram_data *d = dev->data;
+    Ssd1306Ram_Stats st;
+
+    k_mutex_lock(&d->lock, K_FOREVER);
+    d->stats.frames++;
+    d->stats.frame_transfers = d->stats.transfers - d->mark.transfers;
+    d->stats.frame_bus_bytes = d->stats.bus_bytes - d->mark.bus_bytes;
+    d->stats.frame_commands = d->stats.commands - d->mark.commands;
+    d->mark = d->stats;
+    st = d->stats;
+    k_mutex_unlock(&d->lock);
+
+    LOG_DBG("Frame %u: %u transfers, %u bytes, %u commands.", st.frames,
+        st.frame_transfers, st.frame_bus_bytes, st.frame_commands);
+
+#if CONFIG_SSD1306RAM_DUMP_FRAMES
+    printk("PBM %u\n", st.frames);
+    Ssd1306Ram_dump(dev);
+    printk("PBM END\n");
+#endif
+}
+
+int
+Ssd1306Ram_getPixel(const struct device *dev, uint16_t x, uint16_t y)
+{
+    const struct ssd1306ram_config *cfg = dev->config;
+    struct ssd1306ram_data *d = dev->data;
+    int ret;
+
+    if (x >= cfg->width || y >= cfg->height)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&d->lock, K_FOREVER);
+    ret = pixel(dev, x, y);
+    k_mutex_unlock(&d->lock);
+    return ret;
+}
+
+void
+Ssd1306Ram_getStats(const struct device *dev, Ssd1306Ram_Stats *stats)
+{
+    struct ssd1306ram_data *d = dev->data;
+
+    k_mutex_lock(&d->lock, K_FOREVER);
+    *stats = d->stats;
+    k_mutex_unlock(&d->lock);
+}
+
+void
+Ssd1306Ram_resetStats(const struct device *dev)
+{
+    struct ssd1306ram_data *d = dev->data;
+
+    k_mutex_lock(&d->lock, K_FOREVER);
+    memset(&d->stats, 0, sizeof(d->stats));
+    memset(&d->mark, 0, sizeof(d->mark));
+    k_mutex_unlock(&d->lock);
+}
+
+#if CONFIG_SHELL
+static int
+cmd_show(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct ssd1306ram_config *cfg;
+    struct ssd1306ram_data *d;
+    Ssd1306Ram_Stats st;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    if (!shell_dev)
+    {
+        shell_print(sh, "No display.");
+        return 0;
+    }
+
+    cfg = shell_dev->config;
+    d = shell_dev->data;
+    Ssd1306Ram_getStats(shell_dev, &st);
+
+    shell_print(sh, "%s %ux%u, %s, %s, contrast %u", shell_dev->name, cfg->width, cfg->height,
+        d->on ? "on" : "off", d->inverse ? "inverse" : "normal", d->contrast);
+    shell_print(sh, "transfers %u, bus bytes %u (data %u), commands %u",
+        st.transfers, st.bus_bytes, st.data_bytes, st.commands);
+    shell_print(sh, "frames %u, last frame: %u transfers, %u bytes, %u commands",
+        st.frames, st.frame_transfers, st.frame_bus_bytes, st.frame_commands);
+    return 0;
+}
+
+static int
+cmd_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    if (shell_dev)
+    {
+        Ssd1306Ram_resetStats(shell_dev);
+    }
+    shell_print(sh, "Statistics cleared.");
+    return 0;
+}
+
+static int
+cmd_dump(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    if (!shell_dev)
+    {
+        shell_print(sh, "No display.");
+        return 0;
+    }
+
+    Ssd1306Ram_dump(shell_dev);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(ssd1306ram_cmds,
+    SHELL_CMD(show, NULL, "Show panel state and bus counters.", cmd_show),
+    SHELL_CMD(reset, NULL, "Clear the bus counters.", cmd_reset),
+    SHELL_CMD(dump, NULL, "Print the panel as a PBM image.", cmd_dump),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(ssd1306ram, &ssd1306ram_cmds, "SSD1306 RAM emulator", NULL);
+#endif
+
+#define SSD1306RAM_DEFINE(inst)                                                 \
+    BUILD_ASSERT(DT_INST_PROP(inst, segment_offset) + DT_INST_PROP(inst, width) \
+        <= RAM_COLS, "Window past the display RAM columns.");                   \
+    BUILD_ASSERT((DT_INST_PROP(inst, height) % 8) == 0 &&                       \
+        DT_INST_PROP(inst, page_offset) + DT_INST_PROP(inst, height) / 8        \
+        <= RAM_PAGES, "Window past the display RAM pages.");                    \
+                                                                                \
+    static const struct ssd1306ram_config ssd1306ram_config_##inst = {          \
+        .width = DT_INST_PROP(inst, width),                                     \
+        .height = DT_INST_PROP(inst, height),                                   \
+        .segment_offset = DT_INST_PROP(inst, segment_offset),                   \
+        .page_offset = DT_INST_PROP(inst, page_offset),                         \
+    };                                                                          \
+    static struct ssd1306ram_data ssd1306ram_data_##inst;                       \
+                                                                                \
+    DEVICE_DT_INST_DEFINE(inst, ssd1306ram_init, NULL,                          \
+        &ssd1306ram_data_##inst, &ssd1306ram_config_##inst,                     \
+        POST_KERNEL, CONFIG_DISPLAY_INIT_PRIORITY, &ssd1306ram_api);
+
+DT_INST_FOREACH_STATUS_OKAY(SSD1306RAM_DEFINE)
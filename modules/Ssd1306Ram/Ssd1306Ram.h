@@ -0,0 +1,63 @@
+/*******************************************************************************
+ *  @file: Ssd1306Ram.h
+ *
+ *  @brief: SSD1306 display emulated in RAM (vnd,ssd1306-ram).
+ *
+ *  A display driver for headless runs, e.g. on native_sim. Display API
+ *  calls become the transfers the SSD1306 driver sends over I2C: a command
+ *  transfer (control byte 0x00) setting the column and page window, then a
+ *  data transfer (control byte 0x40) with the pixels. A model of the
+ *  controller parses them and applies them to its 128x64 display RAM:
+ *  addressing modes and windows, display on/off, inverse, contrast.
+ *
+ *  Every transfer is counted as an I2C write: the address byte, the control
+ *  byte and the payload. So rendering code can be measured by what it
+ *  would cost on the bus. Ssd1306Ram_endFrame() marks the end of a frame
+ *  and keeps that frame's counts. With CONFIG_SSD1306RAM_DUMP_FRAMES, it
+ *  also prints the panel as a PBM image for golden-image comparisons.
+ *
+ *  The panel shows the RAM window from segment-offset and page-offset,
+ *  width x height. Segment remap and COM scan direction are parsed but
+ *  assumed to match the panel, as the SSD1306 driver sets them.
+*******************************************************************************/
+#ifndef SSD1306RAM_H
+#define SSD1306RAM_H
+
+#include <stdint.h>
+#include <zephyr/device.h>
+
+typedef struct Ssd1306Ram_Stats
+{
+    /** @brief I2C writes, command or data. */
+    uint32_t transfers;
+    /** @brief Bytes on the bus: address, control byte and payload. */
+    uint32_t bus_bytes;
+    uint32_t commands;
+    uint32_t data_bytes;
+    uint32_t frames;
+    /** @brief The last frame (between Ssd1306Ram_endFrame() calls). */
+    uint32_t frame_transfers;
+    uint32_t frame_bus_bytes;
+    uint32_t frame_commands;
+} Ssd1306Ram_Stats;
+
+/** @brief End the current frame: keep its counts and, with
+    CONFIG_SSD1306RAM_DUMP_FRAMES, print it. */
+void
+Ssd1306Ram_endFrame(const struct device *dev);
+
+/** @brief Print the panel as a plain PBM (P1) image, lit pixels as 1. */
+void
+Ssd1306Ram_dump(const struct device *dev);
+
+/** @brief Read the pixel at x, y of the panel as shown (1 is lit). */
+int
+Ssd1306Ram_getPixel(const struct device *dev, uint16_t x, uint16_t y);
+
+void
+Ssd1306Ram_getStats(const struct device *dev, Ssd1306Ram_Stats *stats);
+
+void
+Ssd1306Ram_resetStats(const struct device *dev);
+
+#endif
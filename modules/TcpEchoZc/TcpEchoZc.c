@@ -0,0 +1,406 @@
+/*******************************************************************************
+ *  @file: TcpEchoZc.c
+ *
+ *  @brief: Zero-copy TCP echo server on the net_context API.
+*******************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/net_ip.h>
+#include <zephyr/net/net_pkt.h>
+#include <zephyr/net/net_context.h>
+/* net_tcp_tx_sem_get(): the send window semaphore that socket poll waits on
+   for POLLOUT. */
+#include "tcp_internal.h"
+#include "TcpEchoZc.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(TcpEchoZc, CONFIG_TCPECHOZC_LOG_LEVEL);
+
+/** @brief Called from the net rx thread with each received segment. The
+    packet is ours until it is unref'd. */
+static void
+recv_cb(
+    struct net_context *ctx,
+    struct net_pkt *pkt,
+    union net_ip_header *ip_hdr,
+    union net_proto_header *proto_hdr,
+    int status,
+    void *user_data)
+{
+    TcpEchoZc_Conn *conn = (TcpEchoZc_Conn *)user_data;
+
+    ARG_UNUSED(ctx);
+    ARG_UNUSED(ip_hdr);
+    ARG_UNUSED(proto_hdr);
+
+    if (pkt && status == 0)
+    {
+        k_fifo_put(&conn->rxq, pkt);
+    }
+    else
+    {
+        /* A NULL packet is the peer's FIN. */
+        if (pkt)
+        {
+            net_pkt_unref(pkt);
+        }
+        atomic_set(&conn->closing, 1);
+    }
+
+    k_sem_give(&conn->server->work);
+}
+
+static void
+accept_cb(
+    struct net_context *new_ctx,
+    struct sockaddr *addr,
+    socklen_t addrlen,
+    int status,
+    void *user_data)
+{
+    TcpEchoZc *e = (TcpEchoZc *)user_data;
+    TcpEchoZc_Conn *conn = NULL;
+    uint32_t k;
+    int ret;
+
+    ARG_UNUSED(addr);
+    ARG_UNUSED(addrlen);
+
+    if (status < 0)
+    {
+        return;
+    }
+
+    for (k = 0; k < CONFIG_TCPECHOZC_MAX_CLIENTS; k++)
+    {
+        if (e->conns[k].ctx == NULL)
+        {
+            conn = &e->conns[k];
+            break;
+        }
+    }
+
+    if (!conn)
+    {
+        e->stats.rejects++;
+        net_context_put(new_ctx);
+        return;
+    }
+
+    atomic_clear(&conn->closing);
+    conn->ctx = new_ctx;
+
+    ret = net_context_recv(new_ctx, recv_cb, K_NO_WAIT, conn);
+    if (ret < 0)
+    {
+        LOG_ERR("[%s] recv setup error: %d", e->name, ret);
+        conn->ctx = NULL;
+        net_context_put(new_ctx);
+        return;
+    }
+
+    e->stats.accepts++;
+    LOG_DBG("[%s] client in slot %u", e->name, k);
+}
+
+/** @brief Point iov at the payload of the pending packet from pending_off on.
+    Returns the number of entries used. */
+static size_t
+pending_iov(TcpEchoZc_Conn *conn, struct iovec *iov, size_t max)
+{
+    struct net_buf *frag = conn->pending_frag;
+    size_t off = conn->pending_pos + conn->pending_off;
+    size_t remaining = conn->pending_len - conn->pending_off;
+    size_t cnt = 0;
+
+    /* Skip the fragments already echoed. */
+    while (frag && off >= frag->len)
+    {
+        off -= frag->len;
+        frag = frag->frags;
+    }
+
+    for (; frag && remaining > 0 && cnt < max; frag = frag->frags)
+    {
+        size_t len = MIN(frag->len - off, remaining);
+        if (len > 0)
+        {
+            iov[cnt].iov_base = frag->data + off;
+            iov[cnt].iov_len = len;
+            cnt++;
+            remaining -= len;
+        }
+        off = 0;
+    }
+
+    return cnt;
+}
+
+/** @brief Echo the rest of the pending packet straight from its buffer
+    fragments. Once all of it is queued, reopen the receive window by its
+    length and release it.
+    @return 0 when done, -EAGAIN if the peer's window is full (the packet
+    stays pending), or negative errno on error.
+*/
+static int
+echo_pending(TcpEchoZc *e, TcpEchoZc_Conn *conn)
+{
+    struct iovec iov[CONFIG_TCPECHOZC_MAX_IOV];
+    struct msghdr msg;
+    int ret;
+
+    while (conn->pending_off < conn->pending_len)
+    {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = pending_iov(conn, iov, ARRAY_SIZE(iov));
+
+        /* The stack may take less than all of it per call. */
+        ret = net_context_sendmsg(conn->ctx, &msg, 0, NULL, K_NO_WAIT, NULL);
+        if (ret == -EAGAIN)
+        {
+            e->stats.send_stalls++;
+            return ret;
+        }
+        if (ret < 0)
+        {
+            return ret;
+        }
+
+        e->stats.frags += msg.msg_iovlen;
+        e->stats.tx_bytes += ret;
+        conn->pending_off += ret;
+    }
+
+    net_context_update_recv_wnd(conn->ctx, conn->pending_len);
+    net_pkt_unref(conn->pending);
+    conn->pending = NULL;
+    return 0;
+}
+
+/** @brief Make a received packet the pending one and start echoing it. */
+static int
+echo_pkt(TcpEchoZc *e, TcpEchoZc_Conn *conn, struct net_pkt *pkt)
+{
+    conn->pending = pkt;
+    conn->pending_frag = pkt->cursor.buf;
+    conn->pending_pos = pkt->cursor.buf ? pkt->cursor.pos - pkt->cursor.buf->data : 0;
+    conn->pending_len = net_pkt_remaining_data(pkt);
+    conn->pending_off = 0;
+
+    e->stats.pkts++;
+    e->stats.rx_bytes += conn->pending_len;
+
+    return echo_pending(e, conn);
+}
+
+static void
+release_conn(TcpEchoZc *e, TcpEchoZc_Conn *conn)
+{
+    struct net_pkt *pkt;
+
+    if (conn->pending)
+    {
+        net_pkt_unref(conn->pending);
+        conn->pending = NULL;
+    }
+
+    while ((pkt = k_fifo_get(&conn->rxq, K_NO_WAIT)) != NULL)
+    {
+        net_pkt_unref(pkt);
+    }
+
+    net_context_put(conn->ctx);
+    conn->ctx = NULL;
+
+    LOG_DBG("[%s] client in slot %u closed", e->name, (uint32_t)(conn - e->conns));
+}
+
+/** @brief Wait for work: a stack callback, or the send window opening on a
+    connection whose echo is parked. */
+static void
+wait_work(TcpEchoZc *e, int parked)
+{
+    struct k_poll_event events[1 + CONFIG_TCPECHOZC_MAX_CLIENTS];
+    int num = 1;
+    uint32_t k;
+
+    k_poll_event_init(&events[0], K_POLL_TYPE_SEM_AVAILABLE,
+        K_POLL_MODE_NOTIFY_ONLY, &e->work);
+
+    for (k = 0; k < CONFIG_TCPECHOZC_MAX_CLIENTS; k++)
+    {
+        if (e->conns[k].ctx != NULL && e->conns[k].pending != NULL)
+        {
+            k_poll_event_init(&events[num++], K_POLL_TYPE_SEM_AVAILABLE,
+                K_POLL_MODE_NOTIFY_ONLY, net_tcp_tx_sem_get(e->conns[k].ctx));
+        }
+    }
+
+    /* The window semaphore is not given when a send fails for lack of
+       buffers, so parked sends are also retried after a short wait. */
+    k_poll(events, num,
+        parked ? K_MSEC(CONFIG_TCPECHOZC_RETRY_MS) : K_FOREVER);
+    k_sem_reset(&e->work);
+}
+
+static void
+worker_thread(void *p1, void *p2, void *p3)
+{
+    TcpEchoZc *e = (TcpEchoZc *)p1;
+    int parked = 0;
+    uint32_t k;
+
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    LOG_INF("[%s] zero-copy echo on port %u (%u clients)",
+        e->name, e->port, CONFIG_TCPECHOZC_MAX_CLIENTS);
+
+    while (1)
+    {
+        wait_work(e, parked);
+        parked = 0;
+
+        for (k = 0; k < CONFIG_TCPECHOZC_MAX_CLIENTS; k++)
+        {
+            TcpEchoZc_Conn *conn = &e->conns[k];
+            struct net_pkt *pkt;
+            bool closing;
+            int ret = 0;
+
+            if (conn->ctx == NULL)
+            {
+                continue;
+            }
+
+            /* Sample before draining: data queued ahead of the FIN is
+               always echoed. */
+            closing = atomic_get(&conn->closing);
+
+            /* A connection with a parked echo is not read from until the
+               echo completes, so its receive window stays closed and only
+               its own sender is throttled. */
+            if (conn->pending)
+            {
+                ret = echo_pending(e, conn);
+            }
+
+            while (ret == 0 && (pkt = k_fifo_get(&conn->rxq, K_NO_WAIT)) != NULL)
+            {
+                ret = echo_pkt(e, conn, pkt);
+            }
+
+            if (ret == -EAGAIN)
+            {
+                parked++;
+                continue;
+            }
+
+            if (ret < 0)
+            {
+                LOG_DBG("[%s] send error: %d", e->name, ret);
+                closing = true;
+            }
+
+            if (closing)
+            {
+                release_conn(e, conn);
+            }
+        }
+    }
+}
+
+/** @brief Start listening on the port and start the worker thread. */
+int
+TcpEchoZc_init(
+    TcpEchoZc *e,
+    uint16_t port,
+    k_thread_stack_t *stack,
+    size_t stack_size,
+    const char *name,
+    int prio)
+{
+    struct sockaddr_in addr;
+    uint32_t k;
+    int ret;
+
+    memset(e, 0, sizeof(*e));
+    e->name = name;
+    e->port = port;
+
+    k_sem_init(&e->work, 0, K_SEM_MAX_LIMIT);
+    for (k = 0; k < CONFIG_TCPECHOZC_MAX_CLIENTS; k++)
+    {
+        e->conns[k].server = e;
+        k_fifo_init(&e->conns[k].rxq);
+    }
+
+    ret = net_context_get(AF_INET, SOCK_STREAM, IPPROTO_TCP, &e->listen_ctx);
+    if (ret < 0)
+    {
+        LOG_ERR("[%s] context error: %d", name, ret);
+        return ret;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+
+    ret = net_context_bind(e->listen_ctx, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret < 0)
+    {
+        LOG_ERR("[%s] bind error: %d", name, ret);
+        goto error;
+    }
+
+    ret = net_context_listen(e->listen_ctx, CONFIG_TCPECHOZC_MAX_CLIENTS);
+    if (ret < 0)
+    {
+        LOG_ERR("[%s] listen error: %d", name, ret);
+        goto error;
+    }
+
+    ret = net_context_accept(e->listen_ctx, accept_cb, K_NO_WAIT, e);
+    if (ret < 0)
+    {
+        LOG_ERR("[%s] accept error: %d", name, ret);
+        goto error;
+    }
+
+    e->tid = k_thread_create(
+        &e->thread,
+        stack,
+        stack_size,
+        worker_thread,
+        e, NULL, NULL,
+        prio,
+        0,
+        K_NO_WAIT);
+    k_thread_name_set(e->tid, name);
+
+    return 0;
+
+error:
+    net_context_put(e->listen_ctx);
+    e->listen_ctx = NULL;
+    return ret;
+}
+
+/** @brief Copy the current statistics. */
+void
+TcpEchoZc_getStats(TcpEchoZc *e, TcpEchoZc_Stats *stats)
+{
+    uint32_t k;
+
+    *stats = e->stats;
+    stats->clients = 0;
+    for (k = 0; k < CONFIG_TCPECHOZC_MAX_CLIENTS; k++)
+    {
+        if (e->conns[k].ctx != NULL)
+        {
+            stats->clients++;
+        }
+    }
+}
@@ -0,0 +1,102 @@
+/*******************************************************************************
+ *  @file: TcpEchoZc.h
+ *
+ *  @brief: Zero-copy TCP echo server on the net_context API.
+ *
+ *  The socket API copies each received segment into a user buffer, and the
+ *  echo copies it back out again. This server skips the socket layer. The
+ *  stack hands received net_pkts to a callback, which queues them to a worker
+ *  thread. The worker points an iovec at the packet's own fragment chain and
+ *  passes it to net_context_sendmsg(). The payload is never copied into or
+ *  out of application memory.
+ *
+ *  The receive window is only reopened after a packet has been echoed and
+ *  released. A slow peer therefore throttles its own sender, and the server
+ *  holds no more than one window of rx buffers per client. When a peer's send
+ *  window is full, the rest of its packet is parked on the connection, which
+ *  is not read from until the stack signals that the window has opened. The
+ *  worker meanwhile serves the other connections.
+*******************************************************************************/
+#ifndef TCPECHOZC_H
+#define TCPECHOZC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/net_context.h>
+
+struct TcpEchoZc;
+
+/** @brief Per-client state. */
+typedef struct TcpEchoZc_Conn
+{
+    struct TcpEchoZc *server;
+    struct net_context *ctx;
+    /** @brief Received packets waiting to be echoed. */
+    struct k_fifo rxq;
+    /** @brief Set by the stack callback when the peer closes. */
+    atomic_t closing;
+    /** @brief Packet being echoed, parked while the peer's window is full:
+        its payload starts pending_pos bytes into pending_frag, and
+        pending_off of its pending_len bytes have been queued. */
+    struct net_pkt *pending;
+    struct net_buf *pending_frag;
+    size_t pending_pos;
+    size_t pending_len;
+    size_t pending_off;
+} TcpEchoZc_Conn;
+
+typedef struct TcpEchoZc_Stats
+{
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t pkts;
+    /** @brief Buffer fragments passed to the stack without a copy. */
+    uint32_t frags;
+    /** @brief Sends which found the peer's window full and were parked. */
+    uint32_t send_stalls;
+    uint32_t accepts;
+    uint32_t rejects;
+    uint32_t clients;
+} TcpEchoZc_Stats;
+
+typedef struct TcpEchoZc
+{
+    const char *name;
+    uint16_t port;
+
+    struct net_context *listen_ctx;
+    TcpEchoZc_Conn conns[CONFIG_TCPECHOZC_MAX_CLIENTS];
+
+    /** @brief Given by the stack callbacks whenever there is work. */
+    struct k_sem work;
+
+    struct k_thread thread;
+    k_tid_t tid;
+
+    TcpEchoZc_Stats stats;
+} TcpEchoZc;
+
+/** @brief Start listening on the port and start the worker thread.
+    @param e          Server object.
+    @param port       TCP port.
+    @param stack      Stack for the worker thread.
+    @param stack_size Size of stack.
+    @param name       Thread name.
+    @param prio       Thread priority.
+    @return 0 on success, negative errno on error.
+*/
+int
+TcpEchoZc_init(
+    TcpEchoZc *e,
+    uint16_t port,
+    k_thread_stack_t *stack,
+    size_t stack_size,
+    const char *name,
+    int prio);
+
+/** @brief Copy the current statistics. */
+void
+TcpEchoZc_getStats(TcpEchoZc *e, TcpEchoZc_Stats *stats);
+
+#endif
@@ -0,0 +1,68 @@
+/*******************************************************************************
+ *  @file: TempHumEmul.c
+ *
+ *  @brief: Temperature and humidity sensor emulated in software
+ *  (vnd,temphum-emul).
+*******************************************************************************/
+#define DT_DRV_COMPAT vnd_temphum_emul
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/sensor.h>
+
+struct temphumemul_config {
+    int32_t temp_milli;
+    int32_t hum_milli;
+    bool fail_fetch;
+};
+
+static int
+temphumemul_sample_fetch(const struct device *dev, enum sensor_channel chan)
+{
+    const struct temphumemul_config *cfg = dev->config;
+
+    if (chan != SENSOR_CHAN_ALL && chan != SENSOR_CHAN_AMBIENT_TEMP &&
+        chan != SENSOR_CHAN_HUMIDITY)
+    {
+        return -ENOTSUP;
+    }
+
+    return cfg->fail_fetch ? -EIO : 0;
+}
+
+static int
+temphumemul_channel_get(const struct device *dev, enum sensor_channel chan,
+    struct sensor_value *val)
+{
+    const struct temphumemul_config *cfg = dev->config;
+
+    switch (chan)
+    {
+    case SENSOR_CHAN_AMBIENT_TEMP:
+        return sensor_value_from_milli(val, cfg->temp_milli);
+    case SENSOR_CHAN_HUMIDITY:
+        return sensor_value_from_milli(val, cfg->hum_milli);
+    default:
+        return -ENOTSUP;
+    }
+}
+
+static const struct sensor_driver_api temphumemul_api = {
+    .sample_fetch = temphumemul_sample_fetch,
+    .channel_get = temphumemul_channel_get,
+};
+
+#define TEMPHUMEMUL_DEFINE(inst)                                                \
+    static const struct temphumemul_config temphumemul_config_##inst = {       \
+        .temp_milli = DT_INST_PROP(inst, temperature_milli),                    \
+        .hum_milli = DT_INST_PROP(inst, humidity_milli),                        \
+        .fail_fetch = DT_INST_PROP(inst, fail_fetch),                           \
+    };                                                                          \
+                                                                                \
+    SENSOR_DEVICE_DT_INST_DEFINE(inst, NULL, NULL, NULL,                        \
+        &temphumemul_config_##inst, POST_KERNEL,                                \
+        CONFIG_SENSOR_INIT_PRIORITY, &temphumemul_api);
+
+DT_INST_FOREACH_STATUS_OKAY(TEMPHUMEMUL_DEFINE)
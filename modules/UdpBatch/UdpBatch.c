@@ -0,0 +1,147 @@
+/*******************************************************************************
+ *  @file: UdpBatch.c
+ *
+ *  @brief: Batched receive and reply for UDP sockets.
+*******************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#include "UdpBatch.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(UdpBatch, CONFIG_UDPBATCH_LOG_LEVEL);
+
+/** @brief Attach a batch to a bound UDP socket. */
+void
+UdpBatch_init(UdpBatch *b, int fd)
+{
+    memset(&b->stats, 0, sizeof(b->stats));
+    b->fd = fd;
+}
+
+/** @brief Drain whatever is queued on the socket, without blocking.
+    Datagrams too long for a slot are dropped. */
+static int
+drain(UdpBatch *b)
+{
+    int n = 0;
+    int k;
+
+    for (k = 0; k < CONFIG_UDPBATCH_MAX_MSGS; k++)
+    {
+        UdpBatch_Msg *msg = &b->msgs[n];
+        ssize_t len;
+
+        /* Slots have a spare byte: a datagram which fills it did not fit,
+           and the rest of it has been discarded by the stack. */
+        msg->addr_len = sizeof(msg->addr);
+        len = zsock_recvfrom(b->fd, b->data[n], sizeof(b->data[n]),
+            ZSOCK_MSG_DONTWAIT, (struct sockaddr *)&msg->addr, &msg->addr_len);
+        if (len < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                break;
+            }
+            if (n == 0 && k == 0)
+            {
+                return -errno;
+            }
+            break;
+        }
+
+        if (len > CONFIG_UDPBATCH_MSG_SIZE)
+        {
+            b->stats.rx_truncated++;
+            continue;
+        }
+
+        msg->len = len;
+        b->stats.rx_bytes += len;
+        n++;
+    }
+
+    if (n > 0)
+    {
+        b->stats.rx_pkts += n;
+        b->stats.batches++;
+        if (k == CONFIG_UDPBATCH_MAX_MSGS)
+        {
+            b->stats.full_batches++;
+        }
+    }
+
+    return n;
+}
+
+/** @brief Wait for the socket to become readable, then drain a batch. */
+int
+UdpBatch_recv(UdpBatch *b, int timeout_ms)
+{
+    struct zsock_pollfd pfd = {
+        .fd = b->fd,
+        .events = ZSOCK_POLLIN
+    };
+    int ret;
+
+    if (timeout_ms != 0)
+    {
+        ret = zsock_poll(&pfd, 1, timeout_ms);
+        if (ret < 0)
+        {
+            return -errno;
+        }
+        if (ret == 0)
+        {
+            return 0;
+        }
+    }
+
+    return drain(b);
+}
+
+static int
+send_batch(
+    UdpBatch *b,
+    int n,
+    const struct sockaddr *dest,
+    socklen_t dest_len)
+{
+    int sent = 0;
+    int k;
+
+    for (k = 0; k < n; k++)
+    {
+        const UdpBatch_Msg *msg = &b->msgs[k];
+        const struct sockaddr *to = dest ? dest : (const struct sockaddr *)&msg->addr;
+        socklen_t to_len = dest ? dest_len : msg->addr_len;
+
+        if (zsock_sendto(b->fd, b->data[k], msg->len, 0, to, to_len) == msg->len)
+        {
+            b->stats.tx_bytes += msg->len;
+            sent++;
+        }
+        else
+        {
+            b->stats.tx_errors++;
+        }
+    }
+
+    b->stats.tx_pkts += sent;
+    return sent;
+}
+
+/** @brief Send msgs[0..n) back to their senders. */
+int
+UdpBatch_reply(UdpBatch *b, int n)
+{
+    return send_batch(b, n, NULL, 0);
+}
+
+/** @brief Send msgs[0..n) to one destination. */
+int
+UdpBatch_forward(UdpBatch *b, int n, const struct sockaddr *dest, socklen_t dest_len)
+{
+    return send_batch(b, n, dest, dest_len);
+}
@@ -0,0 +1,86 @@
+/*******************************************************************************
+ *  @file: UdpBatch.h
+ *
+ *  @brief: Batched receive and reply for UDP sockets.
+ *
+ *  Receiving one datagram per wakeup costs a poll or blocking-recv round trip
+ *  for every small packet. UdpBatch_recv() waits for the socket once, then
+ *  drains up to CONFIG_UDPBATCH_MAX_MSGS datagrams with non-blocking
+ *  recvfrom() into a preallocated array of slots. The whole batch is then
+ *  handled in one pass: UdpBatch_reply() echoes each datagram to its sender
+ *  and UdpBatch_forward() sends them all to a single destination.
+ *
+ *  Zephyr has no recvmmsg(), so each datagram is still one socket call. What
+ *  the batch saves is the wakeup and the poll per packet.
+*******************************************************************************/
+#ifndef UDPBATCH_H
+#define UDPBATCH_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+
+/** @brief One received datagram. */
+typedef struct UdpBatch_Msg
+{
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    uint16_t len;
+} UdpBatch_Msg;
+
+typedef struct UdpBatch_Stats
+{
+    uint32_t rx_pkts;
+    uint32_t rx_bytes;
+    uint32_t tx_pkts;
+    uint32_t tx_bytes;
+    uint32_t tx_errors;
+    /** @brief Datagrams longer than CONFIG_UDPBATCH_MSG_SIZE, dropped
+        rather than echoed short. */
+    uint32_t rx_truncated;
+    /** @brief Wakeups which returned at least one datagram. */
+    uint32_t batches;
+    /** @brief Batches which filled every slot (more data was likely
+        waiting). */
+    uint32_t full_batches;
+} UdpBatch_Stats;
+
+typedef struct UdpBatch
+{
+    int fd;
+    UdpBatch_Msg msgs[CONFIG_UDPBATCH_MAX_MSGS];
+    /** @brief One spare byte per slot detects datagrams that do not fit. */
+    uint8_t data[CONFIG_UDPBATCH_MAX_MSGS][CONFIG_UDPBATCH_MSG_SIZE + 1];
+    UdpBatch_Stats stats;
+} UdpBatch;
+
+/** @brief Attach a batch to a bound UDP socket. */
+void
+UdpBatch_init(UdpBatch *b, int fd);
+
+/** @brief Wait up to timeout_ms for the socket to become readable, then
+    drain as many datagrams as fit.
+    @param b           Batch object.
+    @param timeout_ms  Poll timeout (-1 to wait forever, 0 to not wait).
+    @return Number of datagrams received (0 on timeout), negative errno on
+            error.
+*/
+int
+UdpBatch_recv(UdpBatch *b, int timeout_ms);
+
+/** @brief Send msgs[0..n) back to their senders. Returns the number sent. */
+int
+UdpBatch_reply(UdpBatch *b, int n);
+
+/** @brief Send msgs[0..n) to one destination. Returns the number sent. */
+int
+UdpBatch_forward(UdpBatch *b, int n, const struct sockaddr *dest, socklen_t dest_len);
+
+/** @brief Payload of the k'th datagram in the current batch. */
+static inline uint8_t *
+UdpBatch_data(UdpBatch *b, int k)
+{
+    return b->data[k];
+}
+
+#endif
@@ -0,0 +1,183 @@
+/*******************************************************************************
+ *  @file: Ntb16.c
+ *
+ *  @brief: CDC-NCM NTB16 transfer blocks.
+*******************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include "Ntb16.h"
+
+#define ALIGN_UP(x)     (((x) + NDP_ALIGN - 1) & ~(size_t)(NDP_ALIGN - 1))
+
+static inline uint16_t
+get16(const uint8_t *p)
+{
+    return p[0] | ((uint16_t)p[1] << 8);
+}
+
+static inline uint32_t
+get32(const uint8_t *p)
+{
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void
+put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static inline void
+put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/** @brief Empty the NTB. */
+void
+Ntb16_clear(Ntb16_Tx *ntb)
+{
+    ntb->len = NTH16_LEN;
+    ntb->count = 0;
+}
+
+/** @brief Room for a datagram and its NDP entry? */
+bool
+Ntb16_fits(const Ntb16_Tx *ntb, size_t len, size_t max_size)
+{
+    size_t end = ALIGN_UP(ntb->len) + len;
+
+    return ntb->count < NTB16_TX_MAX_DATAGRAMS &&
+        ALIGN_UP(end) + NDP16_LEN(ntb->count + 1) <= max_size;
+}
+
+/** @brief Where the next datagram goes. */
+uint8_t *
+Ntb16_next(Ntb16_Tx *ntb)
+{
+    size_t off = ALIGN_UP(ntb->len);
+
+    memset(&ntb->buf[ntb->len], 0, off - ntb->len);
+    return &ntb->buf[off];
+}
+
+/** @brief Record the datagram written at Ntb16_next(). */
+void
+Ntb16_add(Ntb16_Tx *ntb, size_t len)
+{
+    uint16_t off = ALIGN_UP(ntb->len);
+
+    ntb->dg[ntb->count][0] = off;
+    ntb->dg[ntb->count][1] = len;
+    ntb->count++;
+    ntb->len = off + len;
+}
+
+/** @brief Write the NTH16 and NDP16. */
+size_t
+Ntb16_finish(Ntb16_Tx *ntb, uint16_t seq, size_t max_size, size_t mps)
+{
+    uint8_t *b = ntb->buf;
+    uint16_t ndp = ALIGN_UP(ntb->len);
+    uint16_t ndp_len = NDP16_LEN(ntb->count);
+    uint16_t total = ndp + ndp_len;
+    uint16_t k;
+
+    memset(&b[ntb->len], 0, ndp - ntb->len);
+    put32(&b[ndp], NDP16_SIG_NOCRC);
+    put16(&b[ndp + 4], ndp_len);
+    put16(&b[ndp + 6], 0);
+    for (k = 0; k < ntb->count; k++)
+    {
+        put16(&b[ndp + NDP16_HDR_LEN + k * NDP16_ENTRY_LEN], ntb->dg[k][0]);
+        put16(&b[ndp + NDP16_HDR_LEN + k * NDP16_ENTRY_LEN + 2], ntb->dg[k][1]);
+    }
+    put32(&b[ndp + NDP16_HDR_LEN + k * NDP16_ENTRY_LEN], 0);
+
+    if ((total % mps) == 0 && total < max_size)
+    {
+        b[total++] = 0;
+    }
+
+    put32(&b[0], NTH16_SIG);
+    put16(&b[4], NTH16_LEN);
+    put16(&b[6], seq);
+    put16(&b[8], total);
+    put16(&b[10], ndp);
+    return total;
+}
+
+/** @brief Validate an NTB16 and hand over its datagrams. */
+int
+Ntb16_parse(const uint8_t *b, size_t len, Ntb16_DatagramFn fn, void *arg, uint32_t *bad)
+{
+    int count = 0;
+    uint16_t block;
+    uint16_t ndp;
+    int k;
+
+    if (len < NTH16_LEN ||
+        get32(b) != NTH16_SIG ||
+        get16(&b[4]) != NTH16_LEN)
+    {
+        (*bad)++;
+        return -EINVAL;
+    }
+
+    block = get16(&b[8]);
+    if (block > len)
+    {
+        (*bad)++;
+        return -EINVAL;
+    }
+    ndp = get16(&b[10]);
+
+    /* NDPs may chain; bound the walk so a bad chain cannot loop. */
+    for (k = 0; ndp != 0 && k < NTB_MAX_NDPS; k++)
+    {
+        uint16_t ndp_len;
+        uint32_t pos;
+
+        if ((ndp % NDP_ALIGN) != 0 || ndp + NDP16_HDR_LEN > block ||
+            get32(&b[ndp]) != NDP16_SIG_NOCRC)
+        {
+            (*bad)++;
+            break;
+        }
+
+        ndp_len = get16(&b[ndp + 4]);
+        if (ndp_len < NDP16_LEN(1) || ndp + ndp_len > block)
+        {
+            (*bad)++;
+            break;
+        }
+
+        for (pos = ndp + NDP16_HDR_LEN; pos + NDP16_ENTRY_LEN <= (uint32_t)ndp + ndp_len;
+            pos += NDP16_ENTRY_LEN)
+        {
+            uint16_t idx = get16(&b[pos]);
+            uint16_t dlen = get16(&b[pos + 2]);
+
+            if (idx == 0 || dlen == 0)
+            {
+                break;
+            }
+            if ((uint32_t)idx + dlen > block)
+            {
+                (*bad)++;
+                continue;
+            }
+
+            fn(arg, &b[idx], dlen);
+            count++;
+        }
+
+        ndp = get16(&b[ndp + 6]);
+    }
+
+    return count;
+}
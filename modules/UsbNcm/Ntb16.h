@@ -0,0 +1,97 @@
+/*******************************************************************************
+ *  @file: Ntb16.h
+ *
+ *  @brief: CDC-NCM NTB16 transfer blocks: building the ones UsbNcm sends and
+ *  parsing the ones it receives.
+ *
+ *  An NTB16 is a 12 byte NTH16 header, the datagrams, and an NDP16 table of
+ *  (index, length) entries ending in a zero entry. Datagrams and the NDP
+ *  start on 4 byte boundaries. Only NTB16 without CRC is supported.
+ *
+ *  No Zephyr dependencies, so it can be tested on the host
+ *  (tools/ntb_test).
+*******************************************************************************/
+#ifndef NTB16_H
+#define NTB16_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef NTB16_TX_SIZE
+#define NTB16_TX_SIZE           CONFIG_USBNCM_NTB_IN_SIZE
+#endif
+#ifndef NTB16_TX_MAX_DATAGRAMS
+#define NTB16_TX_MAX_DATAGRAMS  CONFIG_USBNCM_TX_MAX_DATAGRAMS
+#endif
+
+#define NTH16_SIG           0x484D434EU     /* "NCMH" */
+#define NTH16_LEN           12
+#define NDP16_SIG_NOCRC     0x304D434EU     /* "NCM0" */
+#define NDP16_HDR_LEN       8
+#define NDP16_ENTRY_LEN     4
+#define NDP_ALIGN           4
+/** @brief Longest NDP chain followed in a received NTB. */
+#define NTB_MAX_NDPS        8
+
+/** @brief NDP16 length for n datagrams and the terminating entry. */
+#define NDP16_LEN(n)        (NDP16_HDR_LEN + NDP16_ENTRY_LEN * ((n) + 1))
+
+/** @brief An NTB being filled for sending. */
+typedef struct Ntb16_Tx
+{
+    uint8_t buf[NTB16_TX_SIZE];
+    /** @brief End of the last datagram. */
+    uint16_t len;
+    uint16_t count;
+    uint16_t dg[NTB16_TX_MAX_DATAGRAMS][2];
+} Ntb16_Tx;
+
+/** @brief Called for each datagram found by Ntb16_parse(). */
+typedef void (*Ntb16_DatagramFn)(void *arg, const uint8_t *data, size_t len);
+
+/** @brief Empty the NTB. */
+void
+Ntb16_clear(Ntb16_Tx *ntb);
+
+/** @brief Whether a datagram of len bytes, and its NDP entry, fit in an NTB
+    of at most max_size bytes. */
+bool
+Ntb16_fits(const Ntb16_Tx *ntb, size_t len, size_t max_size);
+
+/** @brief Where the next datagram goes. The padding before it is zeroed.
+    Only valid after Ntb16_fits() said it fits. */
+uint8_t *
+Ntb16_next(Ntb16_Tx *ntb);
+
+/** @brief Record the datagram of len bytes written at Ntb16_next(). */
+void
+Ntb16_add(Ntb16_Tx *ntb, size_t len);
+
+/** @brief Write the NTH16 and NDP16.
+    @param ntb       NTB with at least one datagram.
+    @param seq       NTH16 sequence number.
+    @param max_size  Largest NTB the host accepts.
+    @param mps       Bulk endpoint max packet size.
+    @return Bytes to send. A length that is a multiple of mps gets a pad
+            byte, so the transfer ends on a short packet rather than a zero
+            length one, unless it is exactly max_size (the host then knows
+            the transfer is complete).
+*/
+size_t
+Ntb16_finish(Ntb16_Tx *ntb, uint16_t seq, size_t max_size, size_t mps);
+
+/** @brief Validate a received NTB16 and hand over its datagrams.
+    @param b    The NTB.
+    @param len  Bytes received.
+    @param fn   Called for each datagram, in order.
+    @param arg  Passed to fn.
+    @param bad  Incremented for the NTB, each NDP and each entry that fails
+                validation.
+    @return Number of datagrams passed to fn, or -EINVAL if the NTH16 is
+            bad and nothing was parsed.
+*/
+int
+Ntb16_parse(const uint8_t *b, size_t len, Ntb16_DatagramFn fn, void *arg, uint32_t *bad);
+
+#endif
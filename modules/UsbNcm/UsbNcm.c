@@ -0,0 +1,886 @@
+/*******************************************************************************
+ *  @file: UsbNcm.c
+ *
+ *  @brief: USB CDC-NCM Ethernet function with NTB aggregation.
+*******************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/usb/usb_device.h>
+#include <zephyr/usb/class/usb_cdc.h>
+#include <zephyr/net/net_pkt.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/ethernet.h>
+#include <usb_descriptor.h>
+#include "UsbNcm.h"
+#include "Ntb16.h"
+
+#if CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(UsbNcm, CONFIG_USBNCM_LOG_LEVEL);
+
+BUILD_ASSERT(CONFIG_USBNCM_NTB_IN_SIZE <= UINT16_MAX &&
+    CONFIG_USBNCM_NTB_OUT_SIZE <= UINT16_MAX,
+    "NTB16 blocks are limited to 64 KiB");
+
+#if CONFIG_USB_DC_HAS_HS_SUPPORT
+#define BULK_EP_MPS         512
+#define LINK_SPEED          480000000U
+#else
+#define BULK_EP_MPS         USB_MAX_FS_BULK_MPS
+#define LINK_SPEED          12000000U
+#endif
+#define INT_EP_MPS          16
+#define INT_EP_INTERVAL     0x0A
+
+#define NCM_INT_EP_ADDR     0x83
+#define NCM_IN_EP_ADDR      0x82
+#define NCM_OUT_EP_ADDR     0x01
+#define NCM_INT_EP_IDX      0
+#define NCM_OUT_EP_IDX      1
+#define NCM_IN_EP_IDX       2
+
+/* CDC NCM 1.0 codes. */
+#define NCM_SUBCLASS_CODE   0x0D
+#define NCM_DATA_PROTOCOL   0x01
+#define NCM_FUNC_DESC       0x1A
+#define NCM_VERSION_1_00    0x0100
+/* SetEthernetPacketFilter is the only optional request handled. */
+#define NCM_CAPS            0x01
+
+#define REQ_SET_ETHERNET_PACKET_FILTER  0x43
+#define REQ_GET_NTB_PARAMETERS          0x80
+#define REQ_GET_NTB_FORMAT              0x83
+#define REQ_SET_NTB_FORMAT              0x84
+#define REQ_GET_NTB_INPUT_SIZE          0x85
+#define REQ_SET_NTB_INPUT_SIZE          0x86
+
+#define NOTIFY_NETWORK_CONNECTION       0x00
+#define NOTIFY_SPEED_CHANGE             0x2A
+
+#define FRAME_MAX           (NET_ETH_MTU + sizeof(struct net_eth_hdr))
+
+struct ncm_func_descriptor
+{
+    uint8_t bFunctionLength;
+    uint8_t bDescriptorType;
+    uint8_t bDescriptorSubtype;
+    uint16_t bcdNcmVersion;
+    uint8_t bmNetworkCapabilities;
+} __packed;
+
+struct ncm_ntb_params
+{
+    uint16_t wLength;
+    uint16_t bmNtbFormatsSupported;
+    uint32_t dwNtbInMaxSize;
+    uint16_t wNdpInDivisor;
+    uint16_t wNdpInPayloadRemainder;
+    uint16_t wNdpInAlignment;
+    uint16_t wReserved;
+    uint32_t dwNtbOutMaxSize;
+    uint16_t wNdpOutDivisor;
+    uint16_t wNdpOutPayloadRemainder;
+    uint16_t wNdpOutAlignment;
+    uint16_t wNtbOutMaxDatagrams;
+} __packed;
+
+struct ncm_notification
+{
+    uint8_t bmRequestType;
+    uint8_t bNotificationType;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+    uint32_t data[2];
+} __packed;
+
+struct usb_ncm_config
+{
+#if CONFIG_USB_COMPOSITE_DEVICE
+    struct usb_association_descriptor iad;
+#endif
+    struct usb_if_descriptor if0;
+    struct cdc_header_descriptor if0_header;
+    struct cdc_union_descriptor if0_union;
+    struct cdc_ecm_descriptor if0_netfun;
+    struct ncm_func_descriptor if0_ncm;
+    struct usb_ep_descriptor if0_int_ep;
+
+    struct usb_if_descriptor if1_0;
+
+    struct usb_if_descriptor if1_1;
+    struct usb_ep_descriptor if1_1_in_ep;
+    struct usb_ep_descriptor if1_1_out_ep;
+} __packed;
+
+USBD_CLASS_DESCR_DEFINE(primary, 0) struct usb_ncm_config ncm_cfg = {
+#if CONFIG_USB_COMPOSITE_DEVICE
+    .iad = {
+        .bLength = sizeof(struct usb_association_descriptor),
+        .bDescriptorType = USB_DESC_INTERFACE_ASSOC,
+        .bFirstInterface = 0,
+        .bInterfaceCount = 0x02,
+        .bFunctionClass = USB_BCC_CDC_CONTROL,
+        .bFunctionSubClass = NCM_SUBCLASS_CODE,
+        .bFunctionProtocol = 0,
+        .iFunction = 0,
+    },
+#endif
+    .if0 = {
+        .bLength = sizeof(struct usb_if_descriptor),
+        .bDescriptorType = USB_DESC_INTERFACE,
+        .bInterfaceNumber = 0,
+        .bAlternateSetting = 0,
+        .bNumEndpoints = 1,
+        .bInterfaceClass = USB_BCC_CDC_CONTROL,
+        .bInterfaceSubClass = NCM_SUBCLASS_CODE,
+        .bInterfaceProtocol = 0,
+        .iInterface = 0,
+    },
+    .if0_header = {
+        .bFunctionLength = sizeof(struct cdc_header_descriptor),
+        .bDescriptorType = USB_DESC_CS_INTERFACE,
+        .bDescriptorSubtype = HEADER_FUNC_DESC,
+        .bcdCDC = sys_cpu_to_le16(USB_SRN_1_1),
+    },
+    .if0_union = {
+        .bFunctionLength = sizeof(struct cdc_union_descriptor),
+        .bDescriptorType = USB_DESC_CS_INTERFACE,
+        .bDescriptorSubtype = UNION_FUNC_DESC,
+        .bControlInterface = 0,
+        .bSubordinateInterface0 = 1,
+    },
+    .if0_netfun = {
+        .bFunctionLength = sizeof(struct cdc_ecm_descriptor),
+        .bDescriptorType = USB_DESC_CS_INTERFACE,
+        .bDescriptorSubtype = ETHERNET_FUNC_DESC,
+        .iMACAddress = 4,
+        .bmEthernetStatistics = sys_cpu_to_le32(0),
+        .wMaxSegmentSize = sys_cpu_to_le16(FRAME_MAX),
+        .wNumberMCFilters = sys_cpu_to_le16(0),
+        .bNumberPowerFilters = 0,
+    },
+    .if0_ncm = {
+        .bFunctionLength = sizeof(struct ncm_func_descriptor),
+        .bDescriptorType = USB_DESC_CS_INTERFACE,
+        .bDescriptorSubtype = NCM_FUNC_DESC,
+        .bcdNcmVersion = sys_cpu_to_le16(NCM_VERSION_1_00),
+        .bmNetworkCapabilities = NCM_CAPS,
+    },
+    .if0_int_ep = {
+        .bLength = sizeof(struct usb_ep_descriptor),
+        .bDescriptorType = USB_DESC_ENDPOINT,
+        .bEndpointAddress = NCM_INT_EP_ADDR,
+        .bmAttributes = USB_DC_EP_INTERRUPT,
+        .wMaxPacketSize = sys_cpu_to_le16(INT_EP_MPS),
+        .bInterval = INT_EP_INTERVAL,
+    },
+    /* Alternate 0: no endpoints, the function is idle. */
+    .if1_0 = {
+        .bLength = sizeof(struct usb_if_descriptor),
+        .bDescriptorType = USB_DESC_INTERFACE,
+        .bInterfaceNumber = 1,
+        .bAlternateSetting = 0,
+        .bNumEndpoints = 0,
+        .bInterfaceClass = USB_BCC_CDC_DATA,
+        .bInterfaceSubClass = 0,
+        .bInterfaceProtocol = NCM_DATA_PROTOCOL,
+        .iInterface = 0,
+    },
+    .if1_1 = {
+        .bLength = sizeof(struct usb_if_descriptor),
+        .bDescriptorType = USB_DESC_INTERFACE,
+        .bInterfaceNumber = 1,
+        .bAlternateSetting = 1,
+        .bNumEndpoints = 2,
+        .bInterfaceClass = USB_BCC_CDC_DATA,
+        .bInterfaceSubClass = 0,
+        .bInterfaceProtocol = NCM_DATA_PROTOCOL,
+        .iInterface = 0,
+    },
+    .if1_1_in_ep = {
+        .bLength = sizeof(struct usb_ep_descriptor),
+        .bDescriptorType = USB_DESC_ENDPOINT,
+        .bEndpointAddress = NCM_IN_EP_ADDR,
+        .bmAttributes = USB_DC_EP_BULK,
+        .wMaxPacketSize = sys_cpu_to_le16(BULK_EP_MPS),
+        .bInterval = 0x00,
+    },
+    .if1_1_out_ep = {
+        .bLength = sizeof(struct usb_ep_descriptor),
+        .bDescriptorType = USB_DESC_ENDPOINT,
+        .bEndpointAddress = NCM_OUT_EP_ADDR,
+        .bmAttributes = USB_DC_EP_BULK,
+        .wMaxPacketSize = sys_cpu_to_le16(BULK_EP_MPS),
+        .bInterval = 0x00,
+    },
+};
+
+/* The host's MAC address, as 12 hex digits. */
+struct ncm_mac_descriptor
+{
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bString[USB_BSTRING_LENGTH(CONFIG_USBNCM_HOST_MAC)];
+} __packed;
+
+USBD_STRING_DESCR_USER_DEFINE(primary) struct ncm_mac_descriptor ncm_mac_str = {
+    .bLength = USB_STRING_DESCRIPTOR_LENGTH(CONFIG_USBNCM_HOST_MAC),
+    .bDescriptorType = USB_DESC_STRING,
+    .bString = CONFIG_USBNCM_HOST_MAC,
+};
+
+static struct usb_ep_cfg_data ncm_ep_data[] = {
+    [NCM_INT_EP_IDX] = { .ep_cb = usb_transfer_ep_callback, .ep_addr = NCM_INT_EP_ADDR },
+    [NCM_OUT_EP_IDX] = { .ep_cb = usb_transfer_ep_callback, .ep_addr = NCM_OUT_EP_ADDR },
+    [NCM_IN_EP_IDX] = { .ep_cb = usb_transfer_ep_callback, .ep_addr = NCM_IN_EP_ADDR },
+};
+
+typedef struct UsbNcm_Data
+{
+    struct net_if *iface;
+    uint8_t mac[6];
+    atomic_t up;
+    /** @brief Link state requested by the (possibly ISR) status callback,
+        applied by link_work. */
+    atomic_t link_req;
+    struct k_work link_work;
+
+    /** @brief TX double buffer: tx[tx_fill] collects frames while the
+        other may be on the bus (tx_busy). Both are guarded by tx_lock. */
+    Ntb16_Tx tx[2];
+    uint8_t tx_fill;
+    bool tx_busy;
+    uint16_t tx_seq;
+    /** @brief NTB input size set by the host (<= CONFIG_USBNCM_NTB_IN_SIZE).
+        The host sets it before it starts the function. */
+    uint32_t ntb_in_max;
+    struct k_mutex tx_lock;
+    struct k_sem tx_done;
+    struct k_work_delayable flush_work;
+
+    uint8_t rx_bufs[2][CONFIG_USBNCM_NTB_OUT_SIZE];
+    uint8_t rx_next;
+
+    struct ncm_notification notify[2];
+    struct ncm_ntb_params params;
+    uint8_t ctrl_buf[4];
+
+    UsbNcm_Stats stats;
+} UsbNcm_Data;
+
+static UsbNcm_Data ncm_data;
+
+static void
+rx_start(UsbNcm_Data *d);
+
+/** @brief Pass one received datagram to the stack. */
+static void
+rx_datagram(void *arg, const uint8_t *data, size_t len)
+{
+    UsbNcm_Data *d = (UsbNcm_Data *)arg;
+    struct net_pkt *pkt;
+
+    if (len > FRAME_MAX)
+    {
+        d->stats.rx_bad++;
+        return;
+    }
+
+    pkt = net_pkt_rx_alloc_with_buffer(d->iface, len, AF_UNSPEC, 0, K_NO_WAIT);
+    if (!pkt)
+    {
+        d->stats.rx_nobuf++;
+        return;
+    }
+
+    if (net_pkt_write(pkt, data, len) < 0)
+    {
+        net_pkt_unref(pkt);
+        d->stats.rx_nobuf++;
+        return;
+    }
+
+    net_pkt_cursor_init(pkt);
+    if (net_recv_data(d->iface, pkt) < 0)
+    {
+        net_pkt_unref(pkt);
+    }
+}
+
+/** @brief Validate an NTB16 and deliver its datagrams. */
+static void
+rx_ntb(UsbNcm_Data *d, const uint8_t *b, size_t len)
+{
+    int count;
+
+    count = Ntb16_parse(b, len, rx_datagram, d, &d->stats.rx_bad);
+    if (count < 0)
+    {
+        return;
+    }
+
+    d->stats.rx_ntbs++;
+    d->stats.rx_datagrams += count;
+    d->stats.rx_max_per_ntb = MAX(d->stats.rx_max_per_ntb, (uint32_t)count);
+}
+
+static void
+rx_done(uint8_t ep, int tsize, void *priv)
+{
+    UsbNcm_Data *d = (UsbNcm_Data *)priv;
+    const uint8_t *b = d->rx_bufs[d->rx_next];
+
+    ARG_UNUSED(ep);
+
+    if (tsize < 0 || !atomic_get(&d->up))
+    {
+        return;
+    }
+
+    /* Queue the next read into the other buffer before parsing this one. */
+    d->rx_next ^= 1;
+    rx_start(d);
+
+    rx_ntb(d, b, tsize);
+}
+
+static void
+rx_start(UsbNcm_Data *d)
+{
+    int ret;
+
+    ret = usb_transfer(ncm_ep_data[NCM_OUT_EP_IDX].ep_addr,
+        d->rx_bufs[d->rx_next], CONFIG_USBNCM_NTB_OUT_SIZE,
+        USB_TRANS_READ, rx_done, d);
+    if (ret < 0 && ret != -EBUSY)
+    {
+        LOG_ERR("Unable to start OUT transfer: %d", ret);
+    }
+}
+
+static void
+tx_done(uint8_t ep, int tsize, void *priv);
+
+/** @brief Write the NTH16 and NDP16 and send tx[tx_fill]. Called with
+    tx_lock held and the IN endpoint idle. */
+static void
+tx_submit_locked(UsbNcm_Data *d)
+{
+    Ntb16_Tx *ntb = &d->tx[d->tx_fill];
+    size_t total;
+    int ret;
+
+    total = Ntb16_finish(ntb, d->tx_seq++, d->ntb_in_max, BULK_EP_MPS);
+
+    d->stats.tx_ntbs++;
+    d->stats.tx_datagrams += ntb->count;
+    d->stats.tx_max_per_ntb = MAX(d->stats.tx_max_per_ntb, ntb->count);
+    d->stats.tx_bytes += total;
+
+    d->tx_busy = true;
+    d->tx_fill ^= 1;
+    Ntb16_clear(&d->tx[d->tx_fill]);
+
+    ret = usb_transfer(ncm_ep_data[NCM_IN_EP_IDX].ep_addr, ntb->buf, total,
+        USB_TRANS_WRITE | USB_TRANS_NO_ZLP, tx_done, d);
+    if (ret < 0)
+    {
+        LOG_ERR("Unable to start IN transfer: %d", ret);
+        d->tx_busy = false;
+        k_sem_give(&d->tx_done);
+    }
+}
+
+static void
+tx_done(uint8_t ep, int tsize, void *priv)
+{
+    UsbNcm_Data *d = (UsbNcm_Data *)priv;
+
+    ARG_UNUSED(ep);
+    ARG_UNUSED(tsize);
+
+    k_mutex_lock(&d->tx_lock, K_FOREVER);
+    d->tx_busy = false;
+
+    /* Whatever queued up while the bus was busy goes out now. */
+    if (atomic_get(&d->up) && d->tx[d->tx_fill].count > 0)
+    {
+        d->stats.tx_flush_done++;
+        tx_submit_locked(d);
+    }
+    k_mutex_unlock(&d->tx_lock);
+
+    k_sem_give(&d->tx_done);
+}
+
+static void
+flush_work_fn(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    UsbNcm_Data *d = CONTAINER_OF(dwork, UsbNcm_Data, flush_work);
+
+    k_mutex_lock(&d->tx_lock, K_FOREVER);
+    if (!d->tx_busy && d->tx[d->tx_fill].count > 0)
+    {
+        d->stats.tx_flush_timer++;
+        tx_submit_locked(d);
+    }
+    k_mutex_unlock(&d->tx_lock);
+}
+
+static int
+ncm_send(const struct device *dev, struct net_pkt *pkt)
+{
+    UsbNcm_Data *d = dev->data;
+    size_t len = net_pkt_get_len(pkt);
+    Ntb16_Tx *ntb;
+
+    if (!atomic_get(&d->up) || len > FRAME_MAX)
+    {
+        d->stats.tx_dropped++;
+        return -ENETDOWN;
+    }
+
+    k_mutex_lock(&d->tx_lock, K_FOREVER);
+
+    while (!Ntb16_fits(&d->tx[d->tx_fill], len, d->ntb_in_max))
+    {
+        if (!d->tx_busy)
+        {
+            d->stats.tx_flush_full++;
+            tx_submit_locked(d);
+            continue;
+        }
+
+        /* Both NTBs are taken: wait for the one on the bus. */
+        d->stats.tx_waits++;
+        k_sem_reset(&d->tx_done);
+        k_mutex_unlock(&d->tx_lock);
+        if (k_sem_take(&d->tx_done, K_MSEC(CONFIG_USBNCM_TX_WAIT_MS)) < 0 ||
+            !atomic_get(&d->up))
+        {
+            d->stats.tx_dropped++;
+            return -EIO;
+        }
+        k_mutex_lock(&d->tx_lock, K_FOREVER);
+    }
+
+    ntb = &d->tx[d->tx_fill];
+
+    net_pkt_cursor_init(pkt);
+    if (net_pkt_read(pkt, Ntb16_next(ntb), len) < 0)
+    {
+        k_mutex_unlock(&d->tx_lock);
+        d->stats.tx_dropped++;
+        return -EIO;
+    }
+    Ntb16_add(ntb, len);
+
+    if (!d->tx_busy)
+    {
+        if (ntb->count == CONFIG_USBNCM_TX_MAX_DATAGRAMS)
+        {
+            d->stats.tx_flush_full++;
+            tx_submit_locked(d);
+        }
+        else if (ntb->count == 1)
+        {
+            k_work_reschedule(&d->flush_work, K_USEC(CONFIG_USBNCM_TX_TIMEOUT_US));
+        }
+    }
+    /* Otherwise tx_done() sends it. */
+
+    k_mutex_unlock(&d->tx_lock);
+    return 0;
+}
+
+/** @brief Completion of the last notification. usb_transfer() frees its
+    transfer slot only when there is a callback to call, so one is always
+    given. */
+static void
+notify_sent(uint8_t ep, int tsize, void *priv)
+{
+    ARG_UNUSED(ep);
+    ARG_UNUSED(tsize);
+    ARG_UNUSED(priv);
+}
+
+/** @brief Speed change first, then the connection. */
+static void
+notify_done(uint8_t ep, int tsize, void *priv)
+{
+    UsbNcm_Data *d = (UsbNcm_Data *)priv;
+
+    if (atomic_get(&d->up) && tsize == sizeof(d->notify[0]))
+    {
+        usb_transfer(ep, (uint8_t *)&d->notify[1], 8, USB_TRANS_WRITE, notify_sent, NULL);
+    }
+}
+
+static void
+notify_link(UsbNcm_Data *d, bool connected)
+{
+    uint16_t iface = ncm_cfg.if0.bInterfaceNumber;
+
+    d->notify[0] = (struct ncm_notification) {
+        .bmRequestType = 0xA1,
+        .bNotificationType = NOTIFY_SPEED_CHANGE,
+        .wIndex = sys_cpu_to_le16(iface),
+        .wLength = sys_cpu_to_le16(8),
+        .data = { sys_cpu_to_le32(LINK_SPEED), sys_cpu_to_le32(LINK_SPEED) },
+    };
+    d->notify[1] = (struct ncm_notification) {
+        .bmRequestType = 0xA1,
+        .bNotificationType = NOTIFY_NETWORK_CONNECTION,
+        .wValue = sys_cpu_to_le16(connected ? 1 : 0),
+        .wIndex = sys_cpu_to_le16(iface),
+    };
+
+    if (connected)
+    {
+        usb_transfer(ncm_ep_data[NCM_INT_EP_IDX].ep_addr, (uint8_t *)&d->notify[0],
+            sizeof(d->notify[0]), USB_TRANS_WRITE, notify_done, d);
+    }
+    else
+    {
+        usb_transfer(ncm_ep_data[NCM_INT_EP_IDX].ep_addr, (uint8_t *)&d->notify[1],
+            8, USB_TRANS_WRITE, notify_sent, NULL);
+    }
+}
+
+static void
+ncm_link_up(UsbNcm_Data *d)
+{
+    if (atomic_set(&d->up, 1))
+    {
+        return;
+    }
+
+    k_mutex_lock(&d->tx_lock, K_FOREVER);
+    Ntb16_clear(&d->tx[0]);
+    Ntb16_clear(&d->tx[1]);
+    d->tx_fill = 0;
+    d->tx_busy = false;
+    k_mutex_unlock(&d->tx_lock);
+
+    d->rx_next = 0;
+    rx_start(d);
+    notify_link(d, true);
+    net_if_carrier_on(d->iface);
+    LOG_INF("Link up, NTB in %u out %u bytes.", d->ntb_in_max, CONFIG_USBNCM_NTB_OUT_SIZE);
+}
+
+static void
+ncm_link_down(UsbNcm_Data *d)
+{
+    if (!atomic_set(&d->up, 0))
+    {
+        return;
+    }
+
+    net_if_carrier_off(d->iface);
+    k_work_cancel_delayable(&d->flush_work);
+    usb_cancel_transfer(ncm_ep_data[NCM_OUT_EP_IDX].ep_addr);
+    usb_cancel_transfer(ncm_ep_data[NCM_IN_EP_IDX].ep_addr);
+    usb_cancel_transfer(ncm_ep_data[NCM_INT_EP_IDX].ep_addr);
+    k_sem_give(&d->tx_done);
+    LOG_INF("Link down.");
+}
+
+static void
+link_work_fn(struct k_work *work)
+{
+    UsbNcm_Data *d = CONTAINER_OF(work, UsbNcm_Data, link_work);
+
+    if (atomic_get(&d->link_req))
+    {
+        ncm_link_up(d);
+    }
+    else
+    {
+        ncm_link_down(d);
+    }
+}
+
+static void
+link_request(UsbNcm_Data *d, bool up)
+{
+    atomic_set(&d->link_req, up);
+    k_work_submit(&d->link_work);
+}
+
+static int
+ncm_class_handler(struct usb_setup_packet *setup, int32_t *len, uint8_t **data)
+{
+    UsbNcm_Data *d = &ncm_data;
+
+    if (setup->wIndex != ncm_cfg.if0.bInterfaceNumber)
+    {
+        return -ENOTSUP;
+    }
+
+    switch (setup->bRequest)
+    {
+    case REQ_SET_ETHERNET_PACKET_FILTER:
+        /* Everything is delivered; the stack filters. */
+        return 0;
+
+    case REQ_GET_NTB_PARAMETERS:
+        *data = (uint8_t *)&d->params;
+        *len = MIN(setup->wLength, sizeof(d->params));
+        return 0;
+
+    case REQ_GET_NTB_FORMAT:
+        /* Only NTB16. */
+        sys_put_le16(0, d->ctrl_buf);
+        *data = d->ctrl_buf;
+        *len = MIN(setup->wLength, 2);
+        return 0;
+
+    case REQ_SET_NTB_FORMAT:
+        return (setup->wValue == 0) ? 0 : -ENOTSUP;
+
+    case REQ_GET_NTB_INPUT_SIZE:
+        sys_put_le32(d->ntb_in_max, d->ctrl_buf);
+        *data = d->ctrl_buf;
+        *len = MIN(setup->wLength, 4);
+        return 0;
+
+    case REQ_SET_NTB_INPUT_SIZE:
+        if (*len < 4)
+        {
+            return -EINVAL;
+        }
+        /* The host's receive size; also the largest NTB we may send. */
+        d->ntb_in_max = CLAMP(sys_get_le32(*data),
+            NTH16_LEN + NDP16_LEN(1) + FRAME_MAX, CONFIG_USBNCM_NTB_IN_SIZE);
+        LOG_DBG("Host NTB input size %u.", sys_get_le32(*data));
+        return 0;
+
+    default:
+        LOG_DBG("Unsupported request 0x%02x.", setup->bRequest);
+        return -ENOTSUP;
+    }
+}
+
+/** @brief Called from the device controller's context, which may be an
+    ISR: link changes are deferred to link_work. */
+static void
+ncm_status_cb(struct usb_cfg_data *cfg, enum usb_dc_status_code status,
+    const uint8_t *param)
+{
+    UsbNcm_Data *d = &ncm_data;
+
+    ARG_UNUSED(cfg);
+
+    switch (status)
+    {
+    case USB_DC_INTERFACE:
+    {
+        const struct usb_if_descriptor *ifd = (const struct usb_if_descriptor *)param;
+
+        if (ifd->bInterfaceNumber != ncm_cfg.if1_0.bInterfaceNumber)
+        {
+            break;
+        }
+
+        /* The host selects alternate 1 to start the function. */
+        link_request(d, ifd->bAlternateSetting == 1);
+        break;
+    }
+    case USB_DC_DISCONNECTED:
+    case USB_DC_RESET:
+    case USB_DC_SUSPEND:
+        link_request(d, false);
+        break;
+    default:
+        break;
+    }
+}
+
+static void
+ncm_interface_config(struct usb_desc_header *head, uint8_t bInterfaceNumber)
+{
+    int idx = usb_get_str_descriptor_idx(&ncm_mac_str);
+
+    ARG_UNUSED(head);
+
+    if (idx)
+    {
+        ncm_cfg.if0_netfun.iMACAddress = idx;
+    }
+
+    ncm_cfg.if0.bInterfaceNumber = bInterfaceNumber;
+    ncm_cfg.if0_union.bControlInterface = bInterfaceNumber;
+    ncm_cfg.if0_union.bSubordinateInterface0 = bInterfaceNumber + 1;
+    ncm_cfg.if1_0.bInterfaceNumber = bInterfaceNumber + 1;
+    ncm_cfg.if1_1.bInterfaceNumber = bInterfaceNumber + 1;
+#if CONFIG_USB_COMPOSITE_DEVICE
+    ncm_cfg.iad.bFirstInterface = bInterfaceNumber;
+#endif
+}
+
+USBD_DEFINE_CFG_DATA(ncm_config) = {
+    .usb_device_description = NULL,
+    .interface_config = ncm_interface_config,
+    .interface_descriptor = &ncm_cfg.if0,
+    .cb_usb_status = ncm_status_cb,
+    .interface = {
+        .class_handler = ncm_class_handler,
+        .custom_handler = NULL,
+        .vendor_handler = NULL,
+    },
+    .num_endpoints = ARRAY_SIZE(ncm_ep_data),
+    .endpoint = ncm_ep_data,
+};
+
+static void
+ncm_iface_init(struct net_if *iface)
+{
+    const struct device *dev = net_if_get_device(iface);
+    UsbNcm_Data *d = dev->data;
+
+    d->iface = iface;
+    ethernet_init(iface);
+    net_if_set_link_addr(iface, d->mac, sizeof(d->mac), NET_LINK_ETHERNET);
+    net_if_carrier_off(iface);
+}
+
+static enum ethernet_hw_caps
+ncm_caps(const struct device *dev)
+{
+    ARG_UNUSED(dev);
+    return 0;
+}
+
+static const struct ethernet_api ncm_api = {
+    .iface_api.init = ncm_iface_init,
+    .get_capabilities = ncm_caps,
+    .send = ncm_send,
+};
+
+static int
+ncm_init(const struct device *dev)
+{
+    UsbNcm_Data *d = dev->data;
+
+    if (net_bytes_from_str(d->mac, sizeof(d->mac), CONFIG_USBNCM_MAC_ADDR) < 0)
+    {
+        LOG_ERR("Invalid MAC address: %s", CONFIG_USBNCM_MAC_ADDR);
+        return -EINVAL;
+    }
+
+    k_mutex_init(&d->tx_lock);
+    k_sem_init(&d->tx_done, 0, 1);
+    k_work_init_delayable(&d->flush_work, flush_work_fn);
+    k_work_init(&d->link_work, link_work_fn);
+    d->ntb_in_max = CONFIG_USBNCM_NTB_IN_SIZE;
+
+    d->params = (struct ncm_ntb_params) {
+        .wLength = sys_cpu_to_le16(sizeof(struct ncm_ntb_params)),
+        .bmNtbFormatsSupported = sys_cpu_to_le16(0x0001),
+        .dwNtbInMaxSize = sys_cpu_to_le32(CONFIG_USBNCM_NTB_IN_SIZE),
+        .wNdpInDivisor = sys_cpu_to_le16(NDP_ALIGN),
+        .wNdpInPayloadRemainder = 0,
+        .wNdpInAlignment = sys_cpu_to_le16(NDP_ALIGN),
+        .dwNtbOutMaxSize = sys_cpu_to_le32(CONFIG_USBNCM_NTB_OUT_SIZE),
+        .wNdpOutDivisor = sys_cpu_to_le16(NDP_ALIGN),
+        .wNdpOutPayloadRemainder = 0,
+        .wNdpOutAlignment = sys_cpu_to_le16(NDP_ALIGN),
+        .wNtbOutMaxDatagrams = sys_cpu_to_le16(CONFIG_USBNCM_RX_MAX_DATAGRAMS),
+    };
+
+    LOG_INF("NCM: NTB in %u out %u bytes, up to %u datagrams per NTB, %u us timeout",
+        CONFIG_USBNCM_NTB_IN_SIZE, CONFIG_USBNCM_NTB_OUT_SIZE,
+        CONFIG_USBNCM_TX_MAX_DATAGRAMS, CONFIG_USBNCM_TX_TIMEOUT_US);
+
+    return 0;
+}
+
+ETH_NET_DEVICE_INIT(
+    usb_ncm,
+    "usb_ncm",
+    ncm_init,
+    NULL,
+    &ncm_data,
+    NULL,
+    CONFIG_USBNCM_INIT_PRIORITY,
+    &ncm_api,
+    NET_ETH_MTU);
+
+/** @brief Copy the function statistics. */
+void
+UsbNcm_getStats(UsbNcm_Stats *stats)
+{
+    *stats = ncm_data.stats;
+}
+
+/** @brief Clear the statistics. */
+void
+UsbNcm_resetStats(void)
+{
+    memset(&ncm_data.stats, 0, sizeof(ncm_data.stats));
+}
+
+#if CONFIG_SHELL
+static uint32_t
+per_ntb_x10(uint32_t datagrams, uint32_t ntbs)
+{
+    return (ntbs > 0) ? (datagrams * 10 + ntbs / 2) / ntbs : 0;
+}
+
+static int
+cmd_show(const struct shell *sh, size_t argc, char **argv)
+{
+    UsbNcm_Stats st;
+    uint32_t rx_avg;
+    uint32_t tx_avg;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    UsbNcm_getStats(&st);
+    rx_avg = per_ntb_x10(st.rx_datagrams, st.rx_ntbs);
+    tx_avg = per_ntb_x10(st.tx_datagrams, st.tx_ntbs);
+
+    shell_print(sh, "link %s, NTB in %u out %u bytes",
+        atomic_get(&ncm_data.up) ? "up" : "down", ncm_data.ntb_in_max,
+        CONFIG_USBNCM_NTB_OUT_SIZE);
+    shell_print(sh, "rx: %u NTBs %u datagrams (%u.%u per NTB, max %u)",
+        st.rx_ntbs, st.rx_datagrams, rx_avg / 10, rx_avg % 10, st.rx_max_per_ntb);
+    shell_print(sh, "    bad %u nobuf %u", st.rx_bad, st.rx_nobuf);
+    shell_print(sh, "tx: %u NTBs %u datagrams %u bytes (%u.%u per NTB, max %u)",
+        st.tx_ntbs, st.tx_datagrams, st.tx_bytes, tx_avg / 10, tx_avg % 10,
+        st.tx_max_per_ntb);
+    shell_print(sh, "    sent when full %u, timer %u, after previous %u",
+        st.tx_flush_full, st.tx_flush_timer, st.tx_flush_done);
+    shell_print(sh, "    waits %u dropped %u", st.tx_waits, st.tx_dropped);
+    return 0;
+}
+
+static int
+cmd_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    UsbNcm_resetStats();
+    shell_print(sh, "Statistics cleared.");
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(usbncm_cmds,
+    SHELL_CMD(show, NULL, "Show NTB statistics.", cmd_show),
+    SHELL_CMD(reset, NULL, "Clear NTB statistics.", cmd_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(usbncm, &usbncm_cmds, "USB CDC-NCM statistics", NULL);
+#endif
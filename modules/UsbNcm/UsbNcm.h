@@ -0,0 +1,58 @@
+/*******************************************************************************
+ *  @file: UsbNcm.h
+ *
+ *  @brief: USB CDC-NCM Ethernet function for the USB device stack started by
+ *  usb_enable().
+ *
+ *  CDC-ECM moves one Ethernet frame per USB transfer, so small frames pay the
+ *  full per-transfer cost (scheduling, the short packet that ends the
+ *  transfer, a completion interrupt and callback). NCM packs several
+ *  datagrams into one NTB (NCM transfer block), in both directions.
+ *
+ *  Transmit: frames are copied into the NTB being filled. An NTB is sent
+ *  when it is full, when the previous NTB completes (frames queued behind a
+ *  busy endpoint go out together), or CONFIG_USBNCM_TX_TIMEOUT_US after its
+ *  first frame if the endpoint is idle. Two NTBs alternate, one filling while
+ *  the other is on the bus.
+ *
+ *  Receive: the host's NTBs are read into two alternating buffers. Every
+ *  datagram in an NTB is copied into its own net_pkt.
+*******************************************************************************/
+#ifndef USBNCM_H
+#define USBNCM_H
+
+#include <stdint.h>
+
+typedef struct UsbNcm_Stats
+{
+    uint32_t rx_ntbs;
+    uint32_t rx_datagrams;
+    /** @brief Most datagrams seen in one received NTB. */
+    uint32_t rx_max_per_ntb;
+    /** @brief NTBs (or NDPs) that failed validation. */
+    uint32_t rx_bad;
+    /** @brief Datagrams dropped because no net_pkt was available. */
+    uint32_t rx_nobuf;
+    uint32_t tx_ntbs;
+    uint32_t tx_datagrams;
+    uint32_t tx_max_per_ntb;
+    uint32_t tx_bytes;
+    /** @brief Why each NTB was sent: full, timer, or previous NTB done. */
+    uint32_t tx_flush_full;
+    uint32_t tx_flush_timer;
+    uint32_t tx_flush_done;
+    /** @brief Sends that waited for a free NTB. */
+    uint32_t tx_waits;
+    /** @brief Frames dropped (link down or too large). */
+    uint32_t tx_dropped;
+} UsbNcm_Stats;
+
+/** @brief Copy the function statistics. */
+void
+UsbNcm_getStats(UsbNcm_Stats *stats);
+
+/** @brief Clear the statistics. */
+void
+UsbNcm_resetStats(void);
+
+#endif
@@ -0,0 +1,929 @@
+/*******************************************************************************
+ *  @file: WifiFast.c
+ *
+ *  @brief: WiFi station connect that reuses the last AP and DHCP lease.
+*******************************************************************************/
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/net_mgmt.h>
+#include <zephyr/net/net_event.h>
+#include <zephyr/net/wifi_mgmt.h>
+#include <zephyr/net/dhcpv4.h>
+#include <zephyr/settings/settings.h>
+#include "WifiFast.h"
+
+#if CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(WifiFast, CONFIG_WIFIFAST_LOG_LEVEL);
+
+#define WIFI_EVENTS     (NET_EVENT_WIFI_CONNECT_RESULT | NET_EVENT_WIFI_DISCONNECT_RESULT)
+#define IPV4_EVENTS     (NET_EVENT_IPV4_DHCP_BOUND)
+
+#define CACHE_VERSION   1
+
+/** @brief Persisted as "wififast/ap". */
+typedef struct ApCache
+{
+    uint8_t version;
+    uint8_t ssid_len;
+    uint8_t channel;
+    uint8_t bssid[WIFI_MAC_ADDR_LEN];
+    char ssid[WIFI_SSID_MAX_LEN];
+} ApCache;
+
+/** @brief Persisted as "wififast/lease". Only used on the AP it came from. */
+typedef struct LeaseCache
+{
+    uint8_t version;
+    uint8_t pad[3];
+    struct in_addr addr;
+    struct in_addr mask;
+    struct in_addr gw;
+    uint32_t lease_time;
+} LeaseCache;
+
+K_THREAD_STACK_DEFINE(connect_stack, CONFIG_WIFIFAST_STACK_SIZE);
+static struct k_thread connect_thread;
+
+static struct net_if *iface;
+static struct net_mgmt_event_callback wifi_cb;
+static struct net_mgmt_event_callback ipv4_cb;
+
+static K_MUTEX_DEFINE(lock);
+static K_SEM_DEFINE(connect_sem, 0, 1);
+static K_SEM_DEFINE(result_sem, 0, 1);
+static int result_status;
+
+/* Protected by lock. */
+static char ssid[WIFI_SSID_MAX_LEN + 1];
+static char pass[WIFI_PSK_MAX_LEN + 1];
+static ApCache ap;
+static bool ap_valid;
+static LeaseCache lease;
+static bool lease_valid;
+static WifiFast_Stats stats;
+
+static atomic_t associated;
+/** @brief Set while WifiFast itself drops the link (directed timeout). */
+static atomic_t aborting;
+/** @brief Set while try_connect() waits for a connect result. A result that
+    comes after the attempt timed out is dropped. */
+static atomic_t awaiting_result;
+static bool dhcp_started;
+/** @brief The cached address is set and DHCP has not confirmed it yet. */
+static bool cached_addr_set;
+static int64_t connect_start;
+
+/** @brief Held while listeners are called, so they see the changes in
+    order and WifiFast_unsubscribe() can wait for a call in progress. */
+static K_MUTEX_DEFINE(notify_lock);
+static K_MUTEX_DEFINE(listener_lock);
+static sys_slist_t listeners = SYS_SLIST_STATIC_INIT(&listeners);
+static int listener_count;
+static WifiFast_Event last_event;
+static struct k_poll_signal state_signal = K_POLL_SIGNAL_INITIALIZER(state_signal);
+
+static K_MUTEX_DEFINE(profile_lock);
+static WifiFast_Profile base_profile =
+    IS_ENABLED(CONFIG_WIFIFAST_PROFILE_INTERACTIVE) ? WIFIFAST_PROFILE_INTERACTIVE :
+    IS_ENABLED(CONFIG_WIFIFAST_PROFILE_IDLE) ? WIFIFAST_PROFILE_IDLE :
+    WIFIFAST_PROFILE_BALANCED;
+static int interactive_holds;
+/** @brief Profile on the link, or -1 after (re)association. */
+static int applied_profile = -1;
+
+static const char *const profile_names[] = {
+    [WIFIFAST_PROFILE_INTERACTIVE] = "interactive",
+    [WIFIFAST_PROFILE_BALANCED] = "balanced",
+    [WIFIFAST_PROFILE_IDLE] = "idle",
+};
+
+static void lease_work_handler(struct k_work *work);
+static K_WORK_DEFINE(lease_work, lease_work_handler);
+
+static uint32_t
+elapsed_ms(void)
+{
+    return (uint32_t)(k_uptime_get() - connect_start);
+}
+
+static int8_t
+get_rssi(void)
+{
+    struct wifi_iface_status status = { 0 };
+
+    if (net_mgmt(NET_REQUEST_WIFI_IFACE_STATUS, iface, &status, sizeof(status)) < 0)
+    {
+        return 0;
+    }
+    return (int8_t)status.rssi;
+}
+
+/** @brief Enter a state and tell the listeners. Repeats are dropped. The
+    listeners are called from a copy of the list, without listener_lock. */
+static void
+set_state(WifiFast_State state)
+{
+    struct
+    {
+        WifiFast_Callback fn;
+        void *user_data;
+    } calls[CONFIG_WIFIFAST_MAX_LISTENERS];
+    WifiFast_Listener *l;
+    WifiFast_Event ev;
+    int8_t rssi = 0;
+    int n = 0;
+    int k;
+
+    if (state == WIFIFAST_STATE_ASSOCIATED || state == WIFIFAST_STATE_CONNECTED)
+    {
+        rssi = get_rssi();
+    }
+
+    k_mutex_lock(&notify_lock, K_FOREVER);
+    k_mutex_lock(&listener_lock, K_FOREVER);
+    if (state == last_event.state)
+    {
+        k_mutex_unlock(&listener_lock);
+        k_mutex_unlock(&notify_lock);
+        return;
+    }
+
+    last_event.prev = last_event.state;
+    last_event.state = state;
+    last_event.uptime_ms = k_uptime_get();
+    last_event.rssi = rssi;
+    ev = last_event;
+    LOG_DBG("State %d -> %d (rssi %d).", ev.prev, state, rssi);
+
+    SYS_SLIST_FOR_EACH_CONTAINER(&listeners, l, node)
+    {
+        calls[n].fn = l->fn;
+        calls[n].user_data = l->user_data;
+        n++;
+    }
+    k_poll_signal_raise(&state_signal, state);
+    k_mutex_unlock(&listener_lock);
+
+    for (k = 0; k < n; k++)
+    {
+        calls[k].fn(&ev, calls[k].user_data);
+    }
+    k_mutex_unlock(&notify_lock);
+}
+
+static int
+settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+    const char *next;
+    ssize_t rc;
+
+    if (settings_name_steq(name, "ap", &next) && !next)
+    {
+        if (len != sizeof(ap))
+        {
+            return -EINVAL;
+        }
+        rc = read_cb(cb_arg, &ap, sizeof(ap));
+        ap_valid = (rc == sizeof(ap) && ap.version == CACHE_VERSION);
+        return 0;
+    }
+
+    if (settings_name_steq(name, "lease", &next) && !next)
+    {
+        if (len != sizeof(lease))
+        {
+            return -EINVAL;
+        }
+        rc = read_cb(cb_arg, &lease, sizeof(lease));
+        lease_valid = (rc == sizeof(lease) && lease.version == CACHE_VERSION);
+        return 0;
+    }
+
+    return -ENOENT;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(wififast, "wififast", NULL, settings_set, NULL, NULL);
+
+static int
+ps_set(struct wifi_ps_params *params)
+{
+    int ret = net_mgmt(NET_REQUEST_WIFI_PS, iface, params, sizeof(*params));
+
+    if (ret < 0)
+    {
+        LOG_WRN("Power save parameter %d rejected: %d (reason %d)",
+            params->type, ret, params->fail_reason);
+    }
+    return ret;
+}
+
+/** @brief Program the driver for a profile. Only the power save state must
+    succeed; drivers may not support the wakeup mode or listen interval. */
+static int
+apply_profile(WifiFast_Profile profile)
+{
+    struct wifi_ps_params params = { 0 };
+
+    if (profile == WIFIFAST_PROFILE_INTERACTIVE)
+    {
+        params.type = WIFI_PS_PARAM_STATE;
+        params.enabled = WIFI_PS_DISABLED;
+        return ps_set(&params);
+    }
+
+    params.type = WIFI_PS_PARAM_WAKEUP_MODE;
+    params.wakeup_mode = (profile == WIFIFAST_PROFILE_IDLE) ?
+        WIFI_PS_WAKEUP_MODE_LISTEN_INTERVAL : WIFI_PS_WAKEUP_MODE_DTIM;
+    ps_set(&params);
+
+    if (profile == WIFIFAST_PROFILE_IDLE)
+    {
+        params.type = WIFI_PS_PARAM_LISTEN_INTERVAL;
+        params.listen_interval = CONFIG_WIFIFAST_IDLE_LISTEN_INTERVAL;
+        ps_set(&params);
+    }
+
+    params.type = WIFI_PS_PARAM_STATE;
+    params.enabled = WIFI_PS_ENABLED;
+    return ps_set(&params);
+}
+
+/** @brief Apply the profile in force (interactive while held, else the
+    base) if the link has a different one. */
+static int
+update_profile(void)
+{
+    WifiFast_Profile want;
+    int ret = 0;
+
+    k_mutex_lock(&profile_lock, K_FOREVER);
+    want = (interactive_holds > 0) ? WIFIFAST_PROFILE_INTERACTIVE : base_profile;
+    if (atomic_get(&associated) && applied_profile != (int)want)
+    {
+        ret = apply_profile(want);
+        if (ret == 0)
+        {
+            applied_profile = want;
+            LOG_INF("Power profile %s.", profile_names[want]);
+
+            k_mutex_lock(&lock, K_FOREVER);
+            stats.profile = want;
+            stats.profile_switches++;
+            k_mutex_unlock(&lock);
+        }
+    }
+    k_mutex_unlock(&profile_lock);
+
+    return ret;
+}
+
+/** @brief Ask for a connection and wait for the result. */
+static int
+try_connect(const uint8_t *bssid, uint8_t channel, uint32_t timeout_ms)
+{
+    struct wifi_connect_req_params params = { 0 };
+    int ret;
+
+    k_mutex_lock(&lock, K_FOREVER);
+    params.ssid = (const uint8_t *)ssid;
+    params.ssid_length = strlen(ssid);
+    params.psk = (const uint8_t *)pass;
+    params.psk_length = strlen(pass);
+    k_mutex_unlock(&lock);
+
+    params.security = (params.psk_length > 0) ?
+        WIFI_SECURITY_TYPE_PSK : WIFI_SECURITY_TYPE_NONE;
+    params.mfp = WIFI_MFP_OPTIONAL;
+    params.channel = channel;
+    params.band = WIFI_FREQ_BAND_UNKNOWN;
+    params.timeout = timeout_ms;
+    if (bssid)
+    {
+        memcpy(params.bssid, bssid, WIFI_MAC_ADDR_LEN);
+        params.band = (channel > 14) ? WIFI_FREQ_BAND_5_GHZ : WIFI_FREQ_BAND_2_4_GHZ;
+    }
+
+    k_sem_reset(&result_sem);
+    atomic_set(&awaiting_result, 1);
+    ret = net_mgmt(NET_REQUEST_WIFI_CONNECT, iface, &params, sizeof(params));
+    if (ret < 0)
+    {
+        atomic_set(&awaiting_result, 0);
+        LOG_ERR("Connect request failed: %d", ret);
+        return ret;
+    }
+
+    if (k_sem_take(&result_sem, K_MSEC(timeout_ms)) < 0)
+    {
+        if (atomic_cas(&awaiting_result, 1, 0))
+        {
+            atomic_set(&aborting, 1);
+            net_mgmt(NET_REQUEST_WIFI_DISCONNECT, iface, NULL, 0);
+            atomic_set(&aborting, 0);
+            return -ETIMEDOUT;
+        }
+        /* The result came in as the timeout expired. */
+        k_sem_take(&result_sem, K_FOREVER);
+    }
+
+    return (result_status == 0) ? 0 : -ECONNREFUSED;
+}
+
+/** @brief Apply the cached lease (if it belongs to this AP) and start DHCP
+    behind it. Within a boot, DHCP restarts from INIT-REBOOT instead. */
+static void
+start_addr(bool same_ap)
+{
+    if (dhcp_started)
+    {
+        net_dhcpv4_restart(iface);
+        return;
+    }
+
+    k_mutex_lock(&lock, K_FOREVER);
+    if (IS_ENABLED(CONFIG_WIFIFAST_CACHED_LEASE) && same_ap && lease_valid)
+    {
+        if (net_if_ipv4_addr_add(iface, &lease.addr, NET_ADDR_MANUAL, 0))
+        {
+            net_if_ipv4_set_netmask_by_addr(iface, &lease.addr, &lease.mask);
+            net_if_ipv4_set_gw(iface, &lease.gw);
+            cached_addr_set = true;
+            stats.last.addr = WIFIFAST_ADDR_CACHED;
+            stats.last.addr_ms = elapsed_ms();
+            stats.lease_reused++;
+        }
+    }
+    k_mutex_unlock(&lock);
+
+    if (cached_addr_set)
+    {
+        set_state(WIFIFAST_STATE_CONNECTED);
+    }
+
+    net_dhcpv4_start(iface);
+    dhcp_started = true;
+}
+
+/** @brief One connect: directed to the cached AP, then a full scan. */
+static int
+do_connect(void)
+{
+    struct wifi_iface_status status = { 0 };
+    WifiFast_Timing t = { 0 };
+    ApCache cached;
+    bool directed;
+    bool same_ap;
+    int ret = -ENOENT;
+
+    connect_start = k_uptime_get();
+    set_state(WIFIFAST_STATE_SCANNING);
+
+    k_mutex_lock(&lock, K_FOREVER);
+    stats.connects++;
+    cached = ap;
+    directed = ap_valid && cached.ssid_len == strlen(ssid) &&
+        memcmp(cached.ssid, ssid, cached.ssid_len) == 0;
+    k_mutex_unlock(&lock);
+
+    if (directed)
+    {
+        ret = try_connect(cached.bssid, cached.channel, CONFIG_WIFIFAST_DIRECTED_TIMEOUT_MS);
+        t.directed_ms = elapsed_ms();
+
+        k_mutex_lock(&lock, K_FOREVER);
+        if (ret == 0)
+        {
+            stats.directed_ok++;
+            t.path = WIFIFAST_PATH_DIRECTED;
+        }
+        else
+        {
+            stats.directed_fail++;
+        }
+        k_mutex_unlock(&lock);
+
+        if (ret < 0)
+        {
+            LOG_INF("Directed connect (channel %u) failed after %u ms (%d), scanning.",
+                cached.channel, t.directed_ms, ret);
+        }
+    }
+
+    if (ret < 0)
+    {
+        ret = try_connect(NULL, WIFI_CHANNEL_ANY, CONFIG_WIFIFAST_SCAN_TIMEOUT_MS);
+
+        k_mutex_lock(&lock, K_FOREVER);
+        if (ret == 0)
+        {
+            stats.scan_ok++;
+            t.path = WIFIFAST_PATH_SCAN;
+        }
+        else
+        {
+            stats.scan_fail++;
+        }
+        k_mutex_unlock(&lock);
+
+        if (ret < 0)
+        {
+            LOG_WRN("Connect failed after %u ms: %d", elapsed_ms(), ret);
+            return ret;
+        }
+    }
+    t.assoc_ms = elapsed_ms();
+    set_state(WIFIFAST_STATE_ASSOCIATED);
+
+    /* Power save settings do not survive a new association. */
+    k_mutex_lock(&profile_lock, K_FOREVER);
+    applied_profile = -1;
+    k_mutex_unlock(&profile_lock);
+    update_profile();
+
+    /* Which AP and channel did we end up on? */
+    ret = net_mgmt(NET_REQUEST_WIFI_IFACE_STATUS, iface, &status, sizeof(status));
+    same_ap = (ret == 0) && directed &&
+        memcmp(status.bssid, cached.bssid, WIFI_MAC_ADDR_LEN) == 0;
+
+    if (ret == 0 && (!same_ap || status.channel != cached.channel))
+    {
+        k_mutex_lock(&lock, K_FOREVER);
+        ap.version = CACHE_VERSION;
+        ap.ssid_len = strlen(ssid);
+        memcpy(ap.ssid, ssid, ap.ssid_len);
+        memcpy(ap.bssid, status.bssid, WIFI_MAC_ADDR_LEN);
+        ap.channel = status.channel;
+        ap_valid = true;
+        cached = ap;
+        k_mutex_unlock(&lock);
+
+        ret = settings_save_one("wififast/ap", &cached, sizeof(cached));
+        if (ret < 0)
+        {
+            LOG_ERR("Unable to save AP: %d", ret);
+        }
+    }
+
+    /* DHCP may bind as soon as it starts, so publish the timings first. */
+    k_mutex_lock(&lock, K_FOREVER);
+    stats.last = t;
+    k_mutex_unlock(&lock);
+
+    start_addr(same_ap);
+
+    LOG_INF("Associated (%s, channel %u) in %u ms.",
+        (t.path == WIFIFAST_PATH_DIRECTED) ? "directed" : "scan",
+        status.channel, t.assoc_ms);
+
+    return 0;
+}
+
+static void
+connect_thread_fn(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1)
+    {
+        k_sem_take(&connect_sem, K_FOREVER);
+
+        while (do_connect() < 0)
+        {
+            k_msleep(CONFIG_WIFIFAST_RETRY_MS);
+        }
+    }
+}
+
+/** @brief Record a newly bound lease. Drops the cached address if DHCP gave
+    a different one. Runs on the system workqueue (flash writes). */
+static void
+lease_work_handler(struct k_work *work)
+{
+    LeaseCache bound = { 0 };
+    bool changed;
+    int ret;
+
+    ARG_UNUSED(work);
+
+    bound.version = CACHE_VERSION;
+    bound.addr = iface->config.dhcpv4.requested_ip;
+    bound.mask = net_if_ipv4_get_netmask_by_addr(iface, &bound.addr);
+    bound.gw = iface->config.ip.ipv4->gw;
+    bound.lease_time = iface->config.dhcpv4.lease_time;
+
+    k_mutex_lock(&lock, K_FOREVER);
+    if (cached_addr_set && !net_ipv4_addr_cmp(&lease.addr, &bound.addr))
+    {
+        net_if_ipv4_addr_rm(iface, &lease.addr);
+        stats.lease_changed++;
+        LOG_INF("DHCP replaced the cached address.");
+    }
+    cached_addr_set = false;
+
+    changed = !lease_valid || memcmp(&lease, &bound, sizeof(bound)) != 0;
+    lease = bound;
+    lease_valid = true;
+    k_mutex_unlock(&lock);
+
+    if (changed)
+    {
+        ret = settings_save_one("wififast/lease", &bound, sizeof(bound));
+        if (ret < 0)
+        {
+            LOG_ERR("Unable to save lease: %d", ret);
+        }
+    }
+}
+
+static void
+wifi_event_handler(struct net_mgmt_event_callback *cb, uint32_t mgmt_event, struct net_if *ifc)
+{
+    const struct wifi_status *status = (const struct wifi_status *)cb->info;
+
+    ARG_UNUSED(ifc);
+
+    switch (mgmt_event)
+    {
+    case NET_EVENT_WIFI_CONNECT_RESULT:
+        if (!atomic_cas(&awaiting_result, 1, 0))
+        {
+            /* Late result of an attempt that already timed out. Marking it
+               associated would turn the disconnect that follows into a
+               spurious loss. */
+            LOG_DBG("Connect result %d after the timeout, ignored.",
+                status ? status->status : -EIO);
+            break;
+        }
+        result_status = status ? status->status : -EIO;
+        if (result_status == 0)
+        {
+            atomic_set(&associated, 1);
+        }
+        k_sem_give(&result_sem);
+        break;
+    case NET_EVENT_WIFI_DISCONNECT_RESULT:
+        if (atomic_cas(&associated, 1, 0) && !atomic_get(&aborting))
+        {
+            LOG_INF("Disconnected, reconnecting.");
+            set_state(WIFIFAST_STATE_LOST);
+            k_mutex_lock(&lock, K_FOREVER);
+            stats.reconnects++;
+            k_mutex_unlock(&lock);
+            k_sem_give(&connect_sem);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void
+ipv4_event_handler(struct net_mgmt_event_callback *cb, uint32_t mgmt_event, struct net_if *ifc)
+{
+    ARG_UNUSED(cb);
+    ARG_UNUSED(ifc);
+
+    if (mgmt_event != NET_EVENT_IPV4_DHCP_BOUND)
+    {
+        return;
+    }
+
+    /* Renewals are bound events too; time only the first after a connect. */
+    k_mutex_lock(&lock, K_FOREVER);
+    if (stats.last.dhcp_ms == 0)
+    {
+        stats.last.dhcp_ms = elapsed_ms();
+        if (stats.last.addr == WIFIFAST_ADDR_NONE)
+        {
+            stats.last.addr = WIFIFAST_ADDR_DHCP;
+            stats.last.addr_ms = stats.last.dhcp_ms;
+        }
+        LOG_INF("DHCP bound %u ms after connect start.", stats.last.dhcp_ms);
+    }
+    k_mutex_unlock(&lock);
+
+    if (atomic_get(&associated))
+    {
+        set_state(WIFIFAST_STATE_CONNECTED);
+    }
+    k_work_submit(&lease_work);
+}
+
+/** @brief Load the cache and start the connect thread. Settings must be
+    initialized (NvParms_init()). */
+int
+WifiFast_init(void)
+{
+    int ret;
+
+    iface = net_if_get_default();
+    if (!iface)
+    {
+        LOG_ERR("No network interface.");
+        return -ENODEV;
+    }
+
+    ret = settings_load_subtree("wififast");
+    if (ret < 0)
+    {
+        LOG_WRN("Unable to load cache: %d", ret);
+    }
+    LOG_INF("Cached AP %s, lease %s.", ap_valid ? "found" : "none",
+        lease_valid ? "found" : "none");
+
+    net_mgmt_init_event_callback(&wifi_cb, wifi_event_handler, WIFI_EVENTS);
+    net_mgmt_add_event_callback(&wifi_cb);
+    net_mgmt_init_event_callback(&ipv4_cb, ipv4_event_handler, IPV4_EVENTS);
+    net_mgmt_add_event_callback(&ipv4_cb);
+
+    k_thread_create(
+        &connect_thread,
+        connect_stack,
+        K_THREAD_STACK_SIZEOF(connect_stack),
+        connect_thread_fn,
+        NULL, NULL, NULL,
+        CONFIG_WIFIFAST_THREAD_PRIO,
+        0,
+        K_NO_WAIT);
+    k_thread_name_set(&connect_thread, "wififast");
+
+    return 0;
+}
+
+/** @brief Connect to ssid (pass may be empty for an open network). Returns
+    immediately; the connect and any later reconnects run on the WifiFast
+    thread. */
+int
+WifiFast_connect(const char *new_ssid, const char *new_pass)
+{
+    if (strlen(new_ssid) == 0 || strlen(new_ssid) > WIFI_SSID_MAX_LEN ||
+        strlen(new_pass) > WIFI_PSK_MAX_LEN)
+    {
+        LOG_ERR("Bad ssid or passphrase length.");
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&lock, K_FOREVER);
+    strcpy(ssid, new_ssid);
+    strcpy(pass, new_pass);
+    k_mutex_unlock(&lock);
+
+    k_sem_give(&connect_sem);
+    return 0;
+}
+
+/** @brief True when associated and an address is set. */
+bool
+WifiFast_isConnected(void)
+{
+    return WifiFast_getState(NULL) == WIFIFAST_STATE_CONNECTED;
+}
+
+/** @brief The current state and the event that entered it. */
+WifiFast_State
+WifiFast_getState(WifiFast_Event *ev)
+{
+    WifiFast_State state;
+
+    k_mutex_lock(&listener_lock, K_FOREVER);
+    state = last_event.state;
+    if (ev)
+    {
+        *ev = last_event;
+    }
+    k_mutex_unlock(&listener_lock);
+
+    return state;
+}
+
+/** @brief Add a listener (caller-owned, must stay valid until removed). It
+    is not called for the current state; use WifiFast_getState(). */
+int
+WifiFast_subscribe(WifiFast_Listener *listener, WifiFast_Callback fn, void *user_data)
+{
+    int ret = 0;
+
+    listener->fn = fn;
+    listener->user_data = user_data;
+
+    k_mutex_lock(&listener_lock, K_FOREVER);
+    if (listener_count < CONFIG_WIFIFAST_MAX_LISTENERS)
+    {
+        sys_slist_append(&listeners, &listener->node);
+        listener_count++;
+    }
+    else
+    {
+        LOG_ERR("Too many listeners (WIFIFAST_MAX_LISTENERS %d).",
+            CONFIG_WIFIFAST_MAX_LISTENERS);
+        ret = -ENOMEM;
+    }
+    k_mutex_unlock(&listener_lock);
+
+    return ret;
+}
+
+/** @brief Remove a listener. Waits for a call to it in progress on another
+    thread, so the listener can be freed on return. */
+void
+WifiFast_unsubscribe(WifiFast_Listener *listener)
+{
+    k_mutex_lock(&notify_lock, K_FOREVER);
+    k_mutex_lock(&listener_lock, K_FOREVER);
+    if (sys_slist_find_and_remove(&listeners, &listener->node))
+    {
+        listener_count--;
+    }
+    k_mutex_unlock(&listener_lock);
+    k_mutex_unlock(&notify_lock);
+}
+
+/** @brief Signal raised on every state change, with the new state as its
+    result. For k_poll() loops; reset it before polling again. */
+struct k_poll_signal *
+WifiFast_getSignal(void)
+{
+    return &state_signal;
+}
+
+/** @brief Set the base power profile. Applied now if associated, and on
+    every later association. */
+int
+WifiFast_setProfile(WifiFast_Profile profile)
+{
+    if (profile >= WIFIFAST_NUM_PROFILES)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&profile_lock, K_FOREVER);
+    base_profile = profile;
+    k_mutex_unlock(&profile_lock);
+
+    return update_profile();
+}
+
+/** @brief Use the interactive profile until the matching release, whatever
+    the base profile. Holds nest (e.g. one per connected client). */
+void
+WifiFast_holdInteractive(void)
+{
+    k_mutex_lock(&profile_lock, K_FOREVER);
+    interactive_holds++;
+    k_mutex_unlock(&profile_lock);
+
+    update_profile();
+}
+
+void
+WifiFast_releaseInteractive(void)
+{
+    k_mutex_lock(&profile_lock, K_FOREVER);
+    if (interactive_holds > 0)
+    {
+        interactive_holds--;
+    }
+    k_mutex_unlock(&profile_lock);
+
+    update_profile();
+}
+
+/** @brief Drop the cached AP and lease. The next connect scans. */
+int
+WifiFast_forget(void)
+{
+    k_mutex_lock(&lock, K_FOREVER);
+    ap_valid = false;
+    lease_valid = false;
+    k_mutex_unlock(&lock);
+
+    settings_delete("wififast/ap");
+    return settings_delete("wififast/lease");
+}
+
+void
+WifiFast_getStats(WifiFast_Stats *out)
+{
+    k_mutex_lock(&lock, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&lock);
+}
+
+#if CONFIG_SHELL
+static int
+cmd_show(const struct shell *sh, size_t argc, char **argv)
+{
+    static const char *const path_names[] = { "none", "directed", "scan" };
+    static const char *const addr_names[] = { "none", "cached", "dhcp" };
+    static const char *const state_names[] = {
+        "idle", "scanning", "associated", "connected", "lost"
+    };
+    WifiFast_Stats st;
+    WifiFast_Event ev;
+    WifiFast_Profile base;
+    int holds;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    WifiFast_getStats(&st);
+
+    k_mutex_lock(&lock, K_FOREVER);
+    if (ap_valid)
+    {
+        shell_print(sh, "cached AP %02x:%02x:%02x:%02x:%02x:%02x channel %u",
+            ap.bssid[0], ap.bssid[1], ap.bssid[2], ap.bssid[3], ap.bssid[4],
+            ap.bssid[5], ap.channel);
+    }
+    else
+    {
+        shell_print(sh, "no cached AP");
+    }
+    if (lease_valid)
+    {
+        shell_print(sh, "cached lease %u.%u.%u.%u (%u s)",
+            lease.addr.s4_addr[0], lease.addr.s4_addr[1], lease.addr.s4_addr[2],
+            lease.addr.s4_addr[3], lease.lease_time);
+    }
+    k_mutex_unlock(&lock);
+
+    WifiFast_getState(&ev);
+    shell_print(sh, "%s since %u ms (from %s), rssi %d", state_names[ev.state],
+        (uint32_t)ev.uptime_ms, state_names[ev.prev], ev.rssi);
+    shell_print(sh, "connects %u reconnects %u", st.connects, st.reconnects);
+    shell_print(sh, "directed ok %u fail %u, scan ok %u fail %u",
+        st.directed_ok, st.directed_fail, st.scan_ok, st.scan_fail);
+    shell_print(sh, "lease reused %u changed %u", st.lease_reused, st.lease_changed);
+    k_mutex_lock(&profile_lock, K_FOREVER);
+    base = base_profile;
+    holds = interactive_holds;
+    k_mutex_unlock(&profile_lock);
+    shell_print(sh, "profile %s (base %s, %d holds), %u switches",
+        profile_names[st.profile], profile_names[base], holds, st.profile_switches);
+    shell_print(sh, "last: %s, address %s", path_names[st.last.path], addr_names[st.last.addr]);
+    shell_print(sh, "      directed %u ms, assoc %u ms, address %u ms, dhcp %u ms",
+        st.last.directed_ms, st.last.assoc_ms, st.last.addr_ms, st.last.dhcp_ms);
+    return 0;
+}
+
+static int
+cmd_profile(const struct shell *sh, size_t argc, char **argv)
+{
+    int k;
+
+    if (argc < 2)
+    {
+        WifiFast_Profile base;
+
+        k_mutex_lock(&profile_lock, K_FOREVER);
+        base = base_profile;
+        k_mutex_unlock(&profile_lock);
+        shell_print(sh, "base profile %s", profile_names[base]);
+        return 0;
+    }
+
+    for (k = 0; k < WIFIFAST_NUM_PROFILES; k++)
+    {
+        if (strcmp(argv[1], profile_names[k]) == 0)
+        {
+            int ret = WifiFast_setProfile(k);
+
+            shell_print(sh, "base profile %s%s", profile_names[k],
+                (ret < 0) ? " (not applied, see log)" : "");
+            return 0;
+        }
+    }
+
+    shell_error(sh, "Unknown profile: %s", argv[1]);
+    return -EINVAL;
+}
+
+static int
+cmd_forget(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    WifiFast_forget();
+    shell_print(sh, "Cache cleared.");
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(wififast_cmds,
+    SHELL_CMD(show, NULL, "Show cache and connect timings.", cmd_show),
+    SHELL_CMD(forget, NULL, "Clear the cached AP and lease.", cmd_forget),
+    SHELL_CMD_ARG(profile, NULL, "Show or set the base power profile "
+        "(interactive, balanced, idle).", cmd_profile, 1, 1),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(wififast, &wififast_cmds, "WiFi fast connect", NULL);
+#endif
@@ -0,0 +1,191 @@
+/*******************************************************************************
+ *  @file: WifiFast.h
+ *
+ *  @brief: WiFi station connect that reuses the last AP and DHCP lease.
+ *
+ *  A plain connect scans every channel, associates, then runs DHCP from
+ *  DISCOVER. WifiFast keeps the BSSID and channel of the last AP, and the
+ *  last lease, in settings (the store NvParms uses). A connect then goes:
+ *
+ *    1. Directed: associate to the cached BSSID on its channel only, with a
+ *       short timeout (CONFIG_WIFIFAST_DIRECTED_TIMEOUT_MS).
+ *    2. Full scan: the usual connect, if there is no cache or the directed
+ *       attempt fails.
+ *
+ *  Address: on a reconnect within the same boot, DHCP restarts from
+ *  INIT-REBOOT with the lease it holds. On the first connect after boot,
+ *  if the AP is the cached one, the cached lease is applied at once and
+ *  DHCP runs behind it. If DHCP binds a different address, the cached one
+ *  is removed.
+ *
+ *  A dropped link reconnects the same way. The time taken by each phase of
+ *  the last connect is kept in WifiFast_Stats.
+ *
+ *  State changes (scanning, associated, connected, lost) are pushed to
+ *  subscribers as they happen, either by callback (WifiFast_subscribe()) or
+ *  through a k_poll signal (WifiFast_getSignal()), so apps need not poll.
+ *
+ *  Power profiles trade inbound latency for power. With power save on, the
+ *  AP buffers frames for the station until its next wakeup (DTIM or listen
+ *  interval), which adds up to that interval to every inbound request.
+ *    interactive   power save off: lowest latency, highest current.
+ *    balanced      power save on, wake for every DTIM beacon.
+ *    idle          power save on, wake every CONFIG_WIFIFAST_IDLE_LISTEN_INTERVAL
+ *                  beacons: lowest current.
+ *  The app picks a base profile. Code serving clients can hold the link in
+ *  interactive while it has any (WifiFast_holdInteractive()).
+*******************************************************************************/
+#ifndef WIFIFAST_H
+#define WIFIFAST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
+
+typedef enum WifiFast_State
+{
+    WIFIFAST_STATE_IDLE = 0,
+    /** @brief Connecting (directed or full scan). */
+    WIFIFAST_STATE_SCANNING,
+    /** @brief Associated, no address yet. */
+    WIFIFAST_STATE_ASSOCIATED,
+    /** @brief Associated with an address (cached lease or DHCP). */
+    WIFIFAST_STATE_CONNECTED,
+    /** @brief The link dropped. A reconnect follows. */
+    WIFIFAST_STATE_LOST
+} WifiFast_State;
+
+typedef struct WifiFast_Event
+{
+    WifiFast_State state;
+    WifiFast_State prev;
+    /** @brief k_uptime_get() at the transition. */
+    int64_t uptime_ms;
+    /** @brief Signal strength (dBm) when associated or connected, else 0. */
+    int8_t rssi;
+} WifiFast_Event;
+
+/** @brief Called on every state change, in order, from the WifiFast thread
+    or the network management thread. Must not block. */
+typedef void (*WifiFast_Callback)(const WifiFast_Event *ev, void *user_data);
+
+typedef struct WifiFast_Listener
+{
+    sys_snode_t node;
+    WifiFast_Callback fn;
+    void *user_data;
+} WifiFast_Listener;
+
+typedef enum WifiFast_Profile
+{
+    WIFIFAST_PROFILE_INTERACTIVE = 0,
+    WIFIFAST_PROFILE_BALANCED,
+    WIFIFAST_PROFILE_IDLE,
+    WIFIFAST_NUM_PROFILES
+} WifiFast_Profile;
+
+typedef enum WifiFast_Path
+{
+    WIFIFAST_PATH_NONE = 0,
+    WIFIFAST_PATH_DIRECTED,
+    WIFIFAST_PATH_SCAN
+} WifiFast_Path;
+
+typedef enum WifiFast_Addr
+{
+    WIFIFAST_ADDR_NONE = 0,
+    /** @brief Cached lease applied before DHCP completed. */
+    WIFIFAST_ADDR_CACHED,
+    /** @brief Address from DHCP (INIT-REBOOT or DISCOVER). */
+    WIFIFAST_ADDR_DHCP
+} WifiFast_Addr;
+
+typedef struct WifiFast_Timing
+{
+    WifiFast_Path path;
+    WifiFast_Addr addr;
+    /** @brief Milliseconds from the start of the connect. The directed
+        attempt, association (either path), first usable address, and
+        DHCP bound. 0 if the phase did not happen. */
+    uint32_t directed_ms;
+    uint32_t assoc_ms;
+    uint32_t addr_ms;
+    uint32_t dhcp_ms;
+} WifiFast_Timing;
+
+typedef struct WifiFast_Stats
+{
+    uint32_t connects;
+    uint32_t reconnects;
+    uint32_t directed_ok;
+    uint32_t directed_fail;
+    uint32_t scan_ok;
+    uint32_t scan_fail;
+    /** @brief Connects that used the cached lease, and those where DHCP
+        then bound a different address. */
+    uint32_t lease_reused;
+    uint32_t lease_changed;
+    /** @brief Profile applied to the link, and how often it changed. */
+    WifiFast_Profile profile;
+    uint32_t profile_switches;
+    /** @brief The last connect. */
+    WifiFast_Timing last;
+} WifiFast_Stats;
+
+/** @brief Load the cache and start the connect thread. Settings must be
+    initialized (NvParms_init()). */
+int
+WifiFast_init(void);
+
+/** @brief Connect to ssid (pass may be empty for an open network). Returns
+    immediately; the connect and any later reconnects run on the WifiFast
+    thread. */
+int
+WifiFast_connect(const char *ssid, const char *pass);
+
+/** @brief True when associated and an address is set. */
+bool
+WifiFast_isConnected(void);
+
+/** @brief The current state and the event that entered it. */
+WifiFast_State
+WifiFast_getState(WifiFast_Event *ev);
+
+/** @brief Add a listener (caller-owned, must stay valid until removed). It
+    is not called for the current state; use WifiFast_getState().
+    @return 0, or -ENOMEM with WIFIFAST_MAX_LISTENERS already subscribed. */
+int
+WifiFast_subscribe(WifiFast_Listener *listener, WifiFast_Callback fn, void *user_data);
+
+/** @brief Remove a listener. Once it returns the listener is not called
+    again and can be freed. */
+void
+WifiFast_unsubscribe(WifiFast_Listener *listener);
+
+/** @brief Signal raised on every state change, with the new state as its
+    result. For k_poll() loops; reset it before polling again. */
+struct k_poll_signal *
+WifiFast_getSignal(void);
+
+/** @brief Set the base power profile. Applied now if associated, and on
+    every later association. */
+int
+WifiFast_setProfile(WifiFast_Profile profile);
+
+/** @brief Use the interactive profile until the matching release, whatever
+    the base profile. Holds nest (e.g. one per connected client). */
+void
+WifiFast_holdInteractive(void);
+
+void
+WifiFast_releaseInteractive(void);
+
+/** @brief Drop the cached AP and lease. The next connect scans. */
+int
+WifiFast_forget(void);
+
+void
+WifiFast_getStats(WifiFast_Stats *stats);
+
+#endif
@@ -4,24 +4,70 @@
 #include <zephyr/devicetree.h>
 #include <zephyr/logging/log.h>
 
-#include "WS2812Led.h"
 #include "RtosUtils.h"
 #include "sensor.h"
+#include "sampler.h"
+#if CONFIG_APP_SENSOR_RTIO_CHECK
+#include "sensor_rtio.h"
+#endif
+#if CONFIG_WS2812LED
+#include "WS2812Led.h"
+#endif
+#if CONFIG_WIFICONNECT
 #include "WifiConnect.h"
 #include "NvParms.h"
+#endif
+#if CONFIG_MQTTQUEUE
+#include "MqttQueue.h"
+#if CONFIG_MQTTQUEUE_SPOOL
+#include <zephyr/fs/fs.h>
+#include <zephyr/fs/littlefs.h>
+#include <zephyr/storage/flash_map.h>
+#endif
+#elif CONFIG_MQTTCLIENT
 #include "MqttClient.h"
+#endif
 
 /** @brief Initialize the logging module. */
 LOG_MODULE_REGISTER(app, LOG_LEVEL_DBG);
 
 #define STRIP_NODE       DT_ALIAS(led_strip)
 
+#if CONFIG_APP_PAYLOAD_CBOR
+#define PAYLOAD_TOPIC    "room/temp_hum/cbor"
+#else
+#define PAYLOAD_TOPIC    "room/temp_hum"
+#endif
+
+#if CONFIG_WS2812LED
 static const struct device *const rgbled_dev = DEVICE_DT_GET(STRIP_NODE);
 
 static WS2812Led led;
+#endif
+
+#if CONFIG_MQTTQUEUE
+#define MQTT_STACK_SIZE   2048
+#define MQTT_THREAD_PRIO  10
+
+K_THREAD_STACK_DEFINE(mqtt_stack, MQTT_STACK_SIZE);
+static MqttQueue mqtt;
+static int mqtt_topic = -1;
+
+#if CONFIG_MQTTQUEUE_SPOOL
+FS_LITTLEFS_DECLARE_DEFAULT_CONFIG(spool);
+static struct fs_mount_t spool_mnt = {
+    .type = FS_LITTLEFS,
+    .fs_data = &spool,
+    .storage_dev = (void *)FIXED_PARTITION_ID(spool_partition),
+    .mnt_point = "/lfs",
+};
+#endif
+#elif CONFIG_MQTTCLIENT
 static MqttClient mqtt;
 static MqttClient_PubTopic mqtt_topic;
+#endif
 
+#if CONFIG_WIFICONNECT
 static int
 init_wifi(void)
 {
@@ -50,19 +96,35 @@ init_wifi(void)
     WifiConnect_connect(ssid, pass);
     return 0;
 }
+#endif
 
 
 int main(void)
 {
     int sensor_ready;
-    int ret;
-    struct sensor_value temp;
-    struct sensor_value hum;
-    WS2812Led_Segment *led_seg = &led.seg;
+    int ret __maybe_unused;
 
     sensor_ready = init_sensor();
     init_display();
 
+#if CONFIG_APP_DISPLAY_BOOT_FRAMES > 0
+    display_frames(CONFIG_APP_DISPLAY_BOOT_FRAMES);
+#endif
+
+#if CONFIG_APP_SENSOR_RTIO_CHECK
+    sensor_rtio_check();
+#endif
+
+    /* Sampling runs on its own timer from here on, whatever the network
+       is doing. */
+    if (sensor_ready == 0)
+    {
+        sampler_init();
+    }
+
+#if CONFIG_WS2812LED
+    WS2812Led_Segment *led_seg = &led.seg;
+
     WS2812LED_INIT_SIMPLE(rgbled_dev, &led, "led", 1);
 
     /* Start blend around the color wheel. */
@@ -70,7 +132,9 @@ int main(void)
     CHSV color2 = WS2812LED_HSV_COLOR(color1.h + 255, 255, 100);
     led_seg->show(led_seg);
     led_seg->blend(led_seg, true, &color1, &color2, GRAD_LONGEST, 200, 50);
+#endif
 
+#if CONFIG_WIFICONNECT
     ret = NvParms_init();
     if (ret < 0)
     {
@@ -84,32 +148,64 @@ int main(void)
         LOG_ERR("Error connecting to network.");
         return 0;
     }
+#endif
 
+#if CONFIG_MQTTQUEUE
+#if CONFIG_MQTTQUEUE_SPOOL
+    /* If this fails, MqttQueue runs without the spool. */
+    ret = fs_mount(&spool_mnt);
+    if (ret < 0)
+    {
+        LOG_ERR("Failed to mount %s: %d", spool_mnt.mnt_point, ret);
+    }
+#endif
+    /* The queue thread connects (and reconnects) on its own. Readings taken
+       before then are queued. */
+    ret = MqttQueue_init(&mqtt, "zephyr_test", mqtt_stack, MQTT_STACK_SIZE, MQTT_THREAD_PRIO);
+    if (ret == 0)
+    {
+        mqtt_topic = MqttQueue_addTopic(&mqtt, PAYLOAD_TOPIC, MQTT_QOS_1_AT_LEAST_ONCE);
+    }
+#elif CONFIG_MQTTCLIENT
     RTOS_TASK_SLEEP_ms(1000);
     ret = MqttClient_init(&mqtt, "zephyr_test");
     if (ret == 0)
     {
-        MqttClient_setTopic(&mqtt_topic, "room/temp_hum", MQTT_QOS_0_AT_MOST_ONCE);
+        MqttClient_setTopic(&mqtt_topic, PAYLOAD_TOPIC, MQTT_QOS_0_AT_MOST_ONCE);
     }
+#endif
+
+    /* Publish each summary as the sampler closes its window. */
+    struct k_poll_event summary_event = K_POLL_EVENT_INITIALIZER(
+        K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, sampler_get_signal());
 
     while (1)
     {
-        uint8_t pay[20];
-        char json_buffer[64];
+        sampler_summary sum;
+        uint8_t payload[160];
 
-        RTOS_TASK_SLEEP_ms(5000);
+        k_poll(&summary_event, 1, K_FOREVER);
+        k_poll_signal_reset(sampler_get_signal());
+        summary_event.state = K_POLL_STATE_NOT_READY;
 
-        if (sensor_ready == 0)
+        if (sampler_get_latest(&sum) < 0)
         {
-            get_temp_hum(&temp, &hum);
-            update_display(&temp, &hum);
+            continue;
+        }
 
-            int len = encode_json_result(
-                &temp, &hum, json_buffer, sizeof(json_buffer));
-            if (len > 0)
+        update_display(&sum);
+
+        int len = encode_summary(&sum, payload, sizeof(payload));
+        if (len > 0)
+        {
+#if CONFIG_MQTTQUEUE
+            if (mqtt_topic >= 0)
             {
-                MqttClient_publish(&mqtt, &mqtt_topic, json_buffer, len);
+                MqttQueue_publish(&mqtt, mqtt_topic, payload, len, K_NO_WAIT);
             }
+#elif CONFIG_MQTTCLIENT
+            MqttClient_publish(&mqtt, &mqtt_topic, (char *)payload, len);
+#endif
         }
     }
 }
@@ -0,0 +1,423 @@
+/*******************************************************************************
+ *  @file: sampler.c
+ *
+ *  @brief: Timer-driven sensor sampling with windowed aggregation.
+*******************************************************************************/
+#include <limits.h>
+#include <zephyr/kernel.h>
+#include "SwTimer.h"
+#include "FixedJson.h"
+#include "sensor.h"
+#include "sampler.h"
+#if CONFIG_APP_SENSOR_RTIO
+#include "sensor_rtio.h"
+#endif
+
+#if CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(app, LOG_LEVEL_INF);
+
+#define SAMPLER_STACK_SIZE   1024
+#define SAMPLER_THREAD_PRIO  5
+/* temphum0 to temphum3 (sensor_rtio.c). */
+#define SAMPLER_MAX_SENSORS  4
+
+/** @brief One reading, in thousandths (milli deg C, milli %RH). */
+typedef struct sample {
+    int32_t temp;
+    int32_t hum;
+} sample;
+
+/** @brief Running aggregate of one channel over the open window. */
+typedef struct channel_acc {
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    /** @brief EMA, in thousandths scaled by 2^8 for precision. */
+    int32_t ema_q8;
+    bool ema_valid;
+} channel_acc;
+
+static void timer_expired(struct k_timer *t);
+static void aggregate_handler(struct k_work *work);
+
+static SwTimer sample_timer = {
+    .expire_cb = timer_expired,
+    .stop_cb = NULL,
+    .type = SWTIMER_TYPE_PERIODIC
+};
+
+static K_SEM_DEFINE(sample_sem, 0, 1);
+/** @brief Timer ticks since the sampler thread last woke. sample_sem only
+    holds one, so more than one means reads were missed. */
+static atomic_t ticks;
+static K_WORK_DEFINE(aggregate_work, aggregate_handler);
+static K_THREAD_STACK_DEFINE(sampler_stack, SAMPLER_STACK_SIZE);
+static struct k_thread sampler_thread;
+
+/* Acquisition to aggregation ring, and the counters, guarded by
+   ring_lock. */
+static sample ring[CONFIG_APP_SAMPLE_RING];
+static uint32_t ring_head;
+static uint32_t ring_count;
+static struct k_spinlock ring_lock;
+
+/* Owned by the aggregation work item. */
+static channel_acc acc_temp;
+static channel_acc acc_hum;
+static uint32_t acc_count;
+
+/* Latest summary, guarded by latest_lock. */
+static sampler_summary latest;
+static struct k_spinlock latest_lock;
+static struct k_poll_signal summary_signal = K_POLL_SIGNAL_INITIALIZER(summary_signal);
+
+static sampler_counters counters;
+
+static inline int32_t
+to_milli(const struct sensor_value *val)
+{
+    return val->val1 * 1000 + val->val2 / 1000;
+}
+
+static inline void
+from_milli(int32_t milli, struct sensor_value *val)
+{
+    val->val1 = milli / 1000;
+    val->val2 = (milli % 1000) * 1000;
+}
+
+/** @brief Timer expiry, in ISR context: wake the sampler thread. */
+static void
+timer_expired(struct k_timer *t)
+{
+    ARG_UNUSED(t);
+    atomic_inc(&ticks);
+    k_sem_give(&sample_sem);
+}
+
+static void
+acc_reset(channel_acc *acc)
+{
+    acc->min = INT32_MAX;
+    acc->max = INT32_MIN;
+    acc->sum = 0;
+}
+
+static void
+acc_add(channel_acc *acc, int32_t v)
+{
+    acc->min = MIN(acc->min, v);
+    acc->max = MAX(acc->max, v);
+    acc->sum += v;
+
+    if (!acc->ema_valid)
+    {
+        acc->ema_q8 = v * 256;
+        acc->ema_valid = true;
+    }
+    else
+    {
+        acc->ema_q8 += (v * 256 - acc->ema_q8) >> CONFIG_APP_SAMPLE_EMA_SHIFT;
+    }
+}
+
+static void
+acc_close(const channel_acc *acc, uint32_t count, sampler_stats *stats)
+{
+    from_milli(acc->min, &stats->min);
+    from_milli(acc->max, &stats->max);
+    from_milli((int32_t)(acc->sum / (int64_t)count), &stats->mean);
+    from_milli(acc->ema_q8 / 256, &stats->ema);
+}
+
+/** @brief Aggregation stage: drain the ring into the open window, and close
+    the window into a summary when it is full. */
+static void
+aggregate_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    while (1)
+    {
+        k_spinlock_key_t key = k_spin_lock(&ring_lock);
+        sample s;
+
+        if (ring_count == 0)
+        {
+            k_spin_unlock(&ring_lock, key);
+            return;
+        }
+        s = ring[ring_head];
+        ring_head = (ring_head + 1) % CONFIG_APP_SAMPLE_RING;
+        ring_count--;
+        k_spin_unlock(&ring_lock, key);
+
+        if (acc_count == 0)
+        {
+            acc_reset(&acc_temp);
+            acc_reset(&acc_hum);
+        }
+        acc_add(&acc_temp, s.temp);
+        acc_add(&acc_hum, s.hum);
+        acc_count++;
+
+        if (acc_count == CONFIG_APP_SAMPLE_WINDOW)
+        {
+            sampler_summary sum;
+
+            acc_close(&acc_temp, acc_count, &sum.temp);
+            acc_close(&acc_hum, acc_count, &sum.hum);
+            sum.count = acc_count;
+            sum.end_ms = k_uptime_get_32();
+            acc_count = 0;
+
+            key = k_spin_lock(&latest_lock);
+            sum.seq = latest.seq + 1;
+            latest = sum;
+            k_spin_unlock(&latest_lock, key);
+
+            key = k_spin_lock(&ring_lock);
+            counters.summaries++;
+            k_spin_unlock(&ring_lock, key);
+
+            k_poll_signal_raise(&summary_signal, sum.seq);
+        }
+    }
+}
+
+#if CONFIG_APP_SENSOR_RTIO
+/** @brief Read every sensor in one RTIO submission, and average the ones
+    that succeeded. The thread sleeps while the reads are in progress. */
+static int
+read_sample(sample *s)
+{
+    sensor_rtio_reading readings[SAMPLER_MAX_SENSORS];
+    int64_t temp = 0, hum = 0;
+    int num, ok = 0, k;
+    int ret;
+
+    ret = sensor_rtio_submit();
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    num = sensor_rtio_complete(readings, ARRAY_SIZE(readings));
+    for (k = 0; k < MIN(num, (int)ARRAY_SIZE(readings)); k++)
+    {
+        if (readings[k].err < 0)
+        {
+            LOG_DBG("Sensor %d read failed: %d", k, readings[k].err);
+            continue;
+        }
+        temp += readings[k].temp;
+        hum += readings[k].hum;
+        ok++;
+    }
+
+    if (ok == 0)
+    {
+        return -EIO;
+    }
+
+    s->temp = (int32_t)(temp / ok);
+    s->hum = (int32_t)(hum / ok);
+    return 0;
+}
+#else
+static int
+read_sample(sample *s)
+{
+    struct sensor_value temp, hum;
+    int ret;
+
+    ret = get_temp_hum(&temp, &hum);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    s->temp = to_milli(&temp);
+    s->hum = to_milli(&hum);
+    return 0;
+}
+#endif
+
+/** @brief Acquisition stage: read the sensor on each timer tick. */
+static void
+sampler_task(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1)
+    {
+        k_spinlock_key_t key;
+        uint32_t start, read_us;
+        uint32_t tail;
+        sample s;
+        atomic_val_t n;
+        int ret;
+
+        k_sem_take(&sample_sem, K_FOREVER);
+        n = atomic_set(&ticks, 0);
+        if (n == 0)
+        {
+            /* A tick that came during the last wakeup, already counted. */
+            continue;
+        }
+        if (n > 1)
+        {
+            /* The last read took longer than the period. */
+            key = k_spin_lock(&ring_lock);
+            counters.overruns += n - 1;
+            k_spin_unlock(&ring_lock, key);
+        }
+
+        start = k_cycle_get_32();
+        ret = read_sample(&s);
+        read_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+        key = k_spin_lock(&ring_lock);
+        counters.read_us_last = read_us;
+        counters.read_us_max = MAX(counters.read_us_max, read_us);
+        k_spin_unlock(&ring_lock, key);
+
+        if (ret < 0)
+        {
+            key = k_spin_lock(&ring_lock);
+            counters.errors++;
+            k_spin_unlock(&ring_lock, key);
+            continue;
+        }
+
+        key = k_spin_lock(&ring_lock);
+        if (ring_count == CONFIG_APP_SAMPLE_RING)
+        {
+            /* Aggregation is behind: drop the oldest. */
+            ring_head = (ring_head + 1) % CONFIG_APP_SAMPLE_RING;
+            ring_count--;
+            counters.overruns++;
+        }
+        tail = (ring_head + ring_count) % CONFIG_APP_SAMPLE_RING;
+        ring[tail] = s;
+        ring_count++;
+        counters.samples++;
+        k_spin_unlock(&ring_lock, key);
+
+        k_work_submit(&aggregate_work);
+    }
+}
+
+int
+sampler_init(void)
+{
+#if CONFIG_APP_SENSOR_RTIO
+    int ret = sensor_rtio_init();
+
+    if (ret < 0)
+    {
+        return ret;
+    }
+#endif
+
+    k_thread_create(
+        &sampler_thread,
+        sampler_stack,
+        K_THREAD_STACK_SIZEOF(sampler_stack),
+        sampler_task,
+        NULL, NULL, NULL,
+        SAMPLER_THREAD_PRIO,
+        0,
+        K_NO_WAIT);
+    k_thread_name_set(&sampler_thread, "sampler");
+
+    SwTimer_create(&sample_timer);
+    SwTimer_start_ms(&sample_timer, CONFIG_APP_SAMPLE_PERIOD_MS);
+
+    LOG_INF("Sampling every %u ms, summary every %u samples.",
+        CONFIG_APP_SAMPLE_PERIOD_MS, CONFIG_APP_SAMPLE_WINDOW);
+    return 0;
+}
+
+int
+sampler_get_latest(sampler_summary *summary)
+{
+    k_spinlock_key_t key = k_spin_lock(&latest_lock);
+    int ret = (latest.seq == 0) ? -EAGAIN : 0;
+
+    *summary = latest;
+    k_spin_unlock(&latest_lock, key);
+    return ret;
+}
+
+struct k_poll_signal *
+sampler_get_signal(void)
+{
+    return &summary_signal;
+}
+
+void
+sampler_get_counters(sampler_counters *out)
+{
+    k_spinlock_key_t key = k_spin_lock(&ring_lock);
+
+    *out = counters;
+    k_spin_unlock(&ring_lock, key);
+}
+
+#if CONFIG_SHELL
+static void
+print_stats(const struct shell *sh, const char *name, const sampler_stats *st)
+{
+    char v[4][16];
+    int k;
+
+    for (k = 0; k < 4; k++)
+    {
+        const struct sensor_value *val = (k == 0) ? &st->min : (k == 1) ? &st->max :
+            (k == 2) ? &st->mean : &st->ema;
+        int len = FixedJson_putSensorValue(val, 3, v[k], sizeof(v[k]) - 1);
+
+        v[k][MAX(len, 0)] = '\0';
+    }
+
+    shell_print(sh, "%-5s min %s max %s mean %s ema %s", name, v[0], v[1], v[2], v[3]);
+}
+
+static int
+cmd_sampler(const struct shell *sh, size_t argc, char **argv)
+{
+    sampler_summary sum;
+    sampler_counters cnt;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    sampler_get_counters(&cnt);
+    shell_print(sh, "period %u ms, window %u, ring %u", CONFIG_APP_SAMPLE_PERIOD_MS,
+        CONFIG_APP_SAMPLE_WINDOW, CONFIG_APP_SAMPLE_RING);
+    shell_print(sh, "samples %u errors %u overruns %u summaries %u",
+        cnt.samples, cnt.errors, cnt.overruns, cnt.summaries);
+    shell_print(sh, "read %u us (max %u us)%s", cnt.read_us_last, cnt.read_us_max,
+        IS_ENABLED(CONFIG_APP_SENSOR_RTIO) ? ", rtio" : "");
+
+    if (sampler_get_latest(&sum) < 0)
+    {
+        shell_print(sh, "No summary yet.");
+        return 0;
+    }
+
+    shell_print(sh, "summary %u at %u ms, %u samples:", sum.seq, sum.end_ms, sum.count);
+    print_stats(sh, "temp", &sum.temp);
+    print_stats(sh, "hum", &sum.hum);
+    return 0;
+}
+
+SHELL_CMD_REGISTER(sampler, NULL, "Show sampler counters and the latest summary.", cmd_sampler);
+#endif
@@ -0,0 +1,76 @@
+/*******************************************************************************
+ *  @file: sampler.h
+ *
+ *  @brief: Timer-driven sensor sampling with windowed aggregation.
+ *
+ *  Three stages, each decoupled from the next:
+ *    acquisition   A SwTimer fires every CONFIG_APP_SAMPLE_PERIOD_MS and
+ *                  wakes the sampler thread, which reads the sensor and
+ *                  pushes the sample into a ring buffer. With
+ *                  CONFIG_APP_SENSOR_RTIO, the thread submits one RTIO read
+ *                  per sensor (sensor_rtio.h) in a single batch and sleeps
+ *                  until they complete; the sample is their average.
+ *    aggregation   A work item drains the ring into the current window:
+ *                  running min, max, sum and an EMA. Every
+ *                  CONFIG_APP_SAMPLE_WINDOW samples, the window is closed
+ *                  into a summary.
+ *    consumers     Read the latest summary (sampler_get_latest()), when
+ *                  they like or when the signal (sampler_get_signal()) is
+ *                  raised, e.g. the display and the MQTT publisher.
+ *  All math is integer, in thousandths.
+*******************************************************************************/
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/sensor.h>
+
+typedef struct sampler_stats {
+    struct sensor_value min;
+    struct sensor_value max;
+    struct sensor_value mean;
+    /** @brief Exponential moving average, alpha 1/2^CONFIG_APP_SAMPLE_EMA_SHIFT.
+        Runs across windows. */
+    struct sensor_value ema;
+} sampler_stats;
+
+typedef struct sampler_summary {
+    /** @brief deg C. */
+    sampler_stats temp;
+    /** @brief %RH. */
+    sampler_stats hum;
+    /** @brief Samples in the window. */
+    uint32_t count;
+    /** @brief Increments with each summary. */
+    uint32_t seq;
+    /** @brief k_uptime_get_32() at the end of the window. */
+    uint32_t end_ms;
+} sampler_summary;
+
+typedef struct sampler_counters {
+    uint32_t samples;
+    /** @brief Sensor reads that failed. */
+    uint32_t errors;
+    /** @brief Samples lost: ticks missed while a read overran the period,
+        or samples dropped because aggregation fell behind. */
+    uint32_t overruns;
+    uint32_t summaries;
+    /** @brief Time the sampler thread waited for a reading, in us. */
+    uint32_t read_us_last;
+    uint32_t read_us_max;
+} sampler_counters;
+
+/** @brief Start sampling. The sensor must be ready (init_sensor()). */
+int sampler_init(void);
+
+/** @brief Copy the latest summary. Returns -EAGAIN before the first one. */
+int sampler_get_latest(sampler_summary *summary);
+
+/** @brief Raised with each new summary, with its seq as the result. Reset
+    it before polling again. */
+struct k_poll_signal *sampler_get_signal(void);
+
+void sampler_get_counters(sampler_counters *counters);
+
+#endif
@@ -3,9 +3,32 @@
  *  
  *  @brief: Code for reading sensor data
 *******************************************************************************/
+#include "FixedJson.h"
+#include "sensor.h"
+
+#if CONFIG_ZCBOR
+#include <zcbor_encode.h>
+#endif
+
+#if CONFIG_SSD1306RAM
+#include "Ssd1306Ram.h"
+#endif
+
+#if CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#endif
+
+#if CONFIG_APP_DISPLAY_BENCH && CONFIG_BOARD_NATIVE_SIM
+#include "native_rtc.h"
+#endif
+
+#if CONFIG_APP_PAYLOAD_BENCH
+#if CONFIG_LWM2M
 #include <zephyr/data/json.h>
 #include "lwm2m_util.h"
-#include "sensor.h"
+#endif
+#endif
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(app, LOG_LEVEL_INF);
@@ -14,8 +37,12 @@ LOG_MODULE_DECLARE(app, LOG_LEVEL_INF);
 #define TEMP_HUM_SENSOR  DT_ALIAS(temphum0)
 
 static const struct device *const display_dev = DEVICE_DT_GET(DISPLAY_DRIVER);
-static const struct device *const temp_hum_dev = DEVICE_DT_GET(TEMP_HUM_SENSOR);
+/* NULL on boards without the sensor (native_sim). */
+static const struct device *const temp_hum_dev = DEVICE_DT_GET_OR_NULL(TEMP_HUM_SENSOR);
 
+#if CONFIG_DIRTYFB
+static DirtyFb oled_fb;
+#else
 static struct dparams {
     uint16_t rows;
     uint16_t cols;
@@ -27,36 +54,73 @@ static struct dparams {
 } dparams;
 
 #define FONT_INDEX  4
+#endif
 
 struct sensor_result {
-    struct json_obj_token temp;
-    struct json_obj_token hum;
+    struct sensor_value temp;
+    struct sensor_value hum;
 };
 
-static const struct json_obj_descr json_result[] = {
-    JSON_OBJ_DESCR_PRIM(struct sensor_result, temp, JSON_TOK_FLOAT),
-    JSON_OBJ_DESCR_PRIM(struct sensor_result, hum, JSON_TOK_FLOAT),
+static const FixedJson_Field json_result[] = {
+    FIXEDJSON_FIELD(struct sensor_result, temp, FIXEDJSON_SENSOR_VALUE, 2),
+    FIXEDJSON_FIELD(struct sensor_result, hum, FIXEDJSON_SENSOR_VALUE, 2),
 };
 
-static int
-float_to_string(double *value, char *out, uint32_t outlen, uint8_t num_precision)
+/** @brief A sampler summary as published: temp in deg F. temp and hum are
+    the window means, so readers of the single reading still work. */
+struct sensor_summary {
+    struct sensor_value temp;
+    struct sensor_value hum;
+    struct sensor_value temp_min;
+    struct sensor_value temp_max;
+    struct sensor_value temp_ema;
+    struct sensor_value hum_min;
+    struct sensor_value hum_max;
+    struct sensor_value hum_ema;
+    uint32_t n;
+};
+
+static const FixedJson_Field json_summary[] = {
+    FIXEDJSON_FIELD(struct sensor_summary, temp, FIXEDJSON_SENSOR_VALUE, 2),
+    FIXEDJSON_FIELD(struct sensor_summary, hum, FIXEDJSON_SENSOR_VALUE, 2),
+    FIXEDJSON_FIELD(struct sensor_summary, temp_min, FIXEDJSON_SENSOR_VALUE, 2),
+    FIXEDJSON_FIELD(struct sensor_summary, temp_max, FIXEDJSON_SENSOR_VALUE, 2),
+    FIXEDJSON_FIELD(struct sensor_summary, temp_ema, FIXEDJSON_SENSOR_VALUE, 2),
+    FIXEDJSON_FIELD(struct sensor_summary, hum_min, FIXEDJSON_SENSOR_VALUE, 2),
+    FIXEDJSON_FIELD(struct sensor_summary, hum_max, FIXEDJSON_SENSOR_VALUE, 2),
+    FIXEDJSON_FIELD(struct sensor_summary, hum_ema, FIXEDJSON_SENSOR_VALUE, 2),
+    FIXEDJSON_FIELD(struct sensor_summary, n, FIXEDJSON_UINT32, 0),
+};
+
+/** @brief deg C to deg F, in fixed point. */
+static void
+celsius_to_fahrenheit(const struct sensor_value *deg_c, struct sensor_value *deg_f)
 {
-    int len;
+    int64_t micro = (int64_t)deg_c->val1 * 1000000 + deg_c->val2;
 
-    len = lwm2m_ftoa(value, out, outlen, num_precision);
-    if (len < 0 || len >= outlen)
-    {
-        LOG_ERR("Failed to encode float value");
-        return -EINVAL;
-    }
+    micro = micro * 9 / 5 + 32000000;
+    deg_f->val1 = micro / 1000000;
+    deg_f->val2 = micro % 1000000;
+}
 
-    return len;
+static void
+summary_to_published(const sampler_summary *sum, struct sensor_summary *out)
+{
+    celsius_to_fahrenheit(&sum->temp.mean, &out->temp);
+    celsius_to_fahrenheit(&sum->temp.min, &out->temp_min);
+    celsius_to_fahrenheit(&sum->temp.max, &out->temp_max);
+    celsius_to_fahrenheit(&sum->temp.ema, &out->temp_ema);
+    out->hum = sum->hum.mean;
+    out->hum_min = sum->hum.min;
+    out->hum_max = sum->hum.max;
+    out->hum_ema = sum->hum.ema;
+    out->n = sum->count;
 }
 
 int
 init_sensor(void)
 {
-    if (!device_is_ready(temp_hum_dev))
+    if (!temp_hum_dev || !device_is_ready(temp_hum_dev))
     {
         LOG_ERR("Temp sensor is not ready.");
         return -1;
@@ -64,36 +128,83 @@ init_sensor(void)
     return 0;
 }
 
-void
+int
 get_temp_hum(struct sensor_value *temp, struct sensor_value *hum)
 {
     if (sensor_sample_fetch(temp_hum_dev))
     {
         LOG_ERR("Failed to fetch sensor data.");
-        return;
+        return -EIO;
     }
 
     sensor_channel_get(temp_hum_dev, SENSOR_CHAN_AMBIENT_TEMP, temp);
     sensor_channel_get(temp_hum_dev, SENSOR_CHAN_HUMIDITY, hum);
+    return 0;
 }
 
+/** @brief Show the smoothed (EMA) temperature and humidity. */
 void
-update_display(const struct sensor_value *temp, const struct sensor_value *hum)
+update_display(const sampler_summary *sum)
 {
-    double deg_c = temp->val1 + (double)(temp->val2)*0.000001;
-    double deg_f = deg_c*9/5 + 32.;
+    const struct sensor_value *hum = &sum->hum.ema;
+    struct sensor_value deg_f;
     char str[12];
 
-    LOG_DBG("Temperature: %d %d", temp->val1, temp->val2);
+    celsius_to_fahrenheit(&sum->temp.ema, &deg_f);
+
+    LOG_DBG("Temperature: %d %d", sum->temp.ema.val1, sum->temp.ema.val2);
     LOG_DBG("Humidity   : %d %d", hum->val1, hum->val2);
 
-    snprintf(str, sizeof(str), "Tmp: %d", (unsigned int)(deg_f + 0.5));
+#if CONFIG_DIRTYFB
+    int x;
+
+    /* Redraw the frame; the flush sends only the columns that changed. The
+       labels come from the text cache. */
+    DirtyFb_clear(&oled_fb);
+    x = DirtyFb_printCached(&oled_fb, &dirtyfb_font_8x8, "Tmp: ", 0, 0);
+    snprintf(str, sizeof(str), "%d", deg_f.val1 + (deg_f.val2 >= 500000) - (deg_f.val2 <= -500000));
+    DirtyFb_print(&oled_fb, &dirtyfb_font_8x8, str, x, 0);
+    x = DirtyFb_printCached(&oled_fb, &dirtyfb_font_8x8, "Hum: ", 0, 8);
+    snprintf(str, sizeof(str), "%u", hum->val1);
+    DirtyFb_print(&oled_fb, &dirtyfb_font_8x8, str, x, 8);
+    DirtyFb_flush(&oled_fb);
+#else
+    snprintf(str, sizeof(str), "Tmp: %d", deg_f.val1 + (deg_f.val2 >= 500000) - (deg_f.val2 <= -500000));
     cfb_print(display_dev, str, 0, 0);
     snprintf(str, sizeof(str), "Hum: %u", hum->val1);
     cfb_print(display_dev, str, 0, 8);
     cfb_framebuffer_finalize(display_dev);
+#endif
+
+#if CONFIG_SSD1306RAM
+    Ssd1306Ram_endFrame(display_dev);
+#endif
 }
 
+/** @brief Draw count frames from a fixed sequence of made-up readings:
+    the temperature steps by 0.37 deg C, and the humidity by 1 %RH. */
+void
+display_frames(uint32_t count)
+{
+    sampler_summary sum = { 0 };
+    uint32_t k;
+
+    for (k = 0; k < count; k++)
+    {
+        int32_t milli = 20000 + 370 * k;
+
+        sum.temp.ema.val1 = milli / 1000;
+        sum.temp.ema.val2 = (milli % 1000) * 1000;
+        sum.hum.ema.val1 = 40 + k % 20;
+        sum.seq = k + 1;
+        update_display(&sum);
+    }
+}
+
+/** @brief Encode the reading as {"temp":<deg F>,"hum":<%RH>}, two
+    decimals each, in one pass with no float math.
+    @return The length, or a negative errno.
+*/
 int
 encode_json_result(
     const struct sensor_value *temp,
@@ -101,59 +212,534 @@ encode_json_result(
     char *buffer,
     uint32_t max_size)
 {
-    int ret;
+    struct sensor_result rs;
+    int len;
+
+    celsius_to_fahrenheit(temp, &rs.temp);
+    rs.hum = *hum;
+
+    len = FixedJson_encode(json_result, ARRAY_SIZE(json_result), &rs, buffer, max_size);
+    if (len < 0)
+    {
+        LOG_ERR("Json encode error: %d", len);
+    }
+
+    return len;
+}
+
+#if CONFIG_ZCBOR
+/* Map keys, from schema/sensor_reading.cddl. */
+#define CBOR_KEY_TEMP       1
+#define CBOR_KEY_HUM        2
+#define CBOR_KEY_TEMP_MIN   3
+#define CBOR_KEY_TEMP_MAX   4
+#define CBOR_KEY_TEMP_EMA   5
+#define CBOR_KEY_HUM_MIN    6
+#define CBOR_KEY_HUM_MAX    7
+#define CBOR_KEY_HUM_EMA    8
+#define CBOR_KEY_N          9
+
+/** @brief val in hundredths, rounded half away from zero. */
+static int32_t
+sensor_value_to_centi(const struct sensor_value *val)
+{
+    int32_t frac = (val->val2 + ((val->val2 < 0) ? -5000 : 5000)) / 10000;
+
+    return val->val1 * 100 + frac;
+}
+
+/** @brief Encode the reading as the CBOR map in
+    schema/sensor_reading.cddl: {1: deg F x 100, 2: %RH x 100}.
+    @return The length, or a negative errno.
+*/
+int
+encode_cbor_result(
+    const struct sensor_value *temp,
+    const struct sensor_value *hum,
+    uint8_t *buffer,
+    uint32_t max_size)
+{
+    struct sensor_value deg_f;
+    bool ok;
+
+    /* Definite-length maps (CONFIG_ZCBOR_CANONICAL): the map header is
+       written at the end, from the backup taken at the start. */
+    ZCBOR_STATE_E(state, 1, buffer, max_size, 1);
+
+    celsius_to_fahrenheit(temp, &deg_f);
+
+    ok = zcbor_map_start_encode(state, 2) &&
+        zcbor_uint32_put(state, CBOR_KEY_TEMP) &&
+        zcbor_int32_put(state, sensor_value_to_centi(&deg_f)) &&
+        zcbor_uint32_put(state, CBOR_KEY_HUM) &&
+        zcbor_uint32_put(state, sensor_value_to_centi(hum)) &&
+        zcbor_map_end_encode(state, 2);
+    if (!ok)
+    {
+        LOG_ERR("CBOR encode error: %d", zcbor_peek_error(state));
+        return -ENOMEM;
+    }
+
+    return state->payload - buffer;
+}
+#endif
+
+/** @brief Encode a summary as JSON: the window means as temp and hum,
+    plus min, max and EMA of each, and the sample count n.
+    @return The length, or a negative errno.
+*/
+int
+encode_json_summary(const sampler_summary *sum, char *buffer, uint32_t max_size)
+{
+    struct sensor_summary ss;
+    int len;
+
+    summary_to_published(sum, &ss);
+
+    len = FixedJson_encode(json_summary, ARRAY_SIZE(json_summary), &ss, buffer, max_size);
+    if (len < 0)
+    {
+        LOG_ERR("Json encode error: %d", len);
+    }
+
+    return len;
+}
+
+#if CONFIG_ZCBOR
+/** @brief Encode a summary as the CBOR sensor-summary map in
+    schema/sensor_reading.cddl.
+    @return The length, or a negative errno.
+*/
+int
+encode_cbor_summary(const sampler_summary *sum, uint8_t *buffer, uint32_t max_size)
+{
+    struct sensor_summary ss;
+    bool ok;
+
+    ZCBOR_STATE_E(state, 1, buffer, max_size, 1);
+
+    summary_to_published(sum, &ss);
+
+    ok = zcbor_map_start_encode(state, 9) &&
+        zcbor_uint32_put(state, CBOR_KEY_TEMP) &&
+        zcbor_int32_put(state, sensor_value_to_centi(&ss.temp)) &&
+        zcbor_uint32_put(state, CBOR_KEY_HUM) &&
+        zcbor_uint32_put(state, sensor_value_to_centi(&ss.hum)) &&
+        zcbor_uint32_put(state, CBOR_KEY_TEMP_MIN) &&
+        zcbor_int32_put(state, sensor_value_to_centi(&ss.temp_min)) &&
+        zcbor_uint32_put(state, CBOR_KEY_TEMP_MAX) &&
+        zcbor_int32_put(state, sensor_value_to_centi(&ss.temp_max)) &&
+        zcbor_uint32_put(state, CBOR_KEY_TEMP_EMA) &&
+        zcbor_int32_put(state, sensor_value_to_centi(&ss.temp_ema)) &&
+        zcbor_uint32_put(state, CBOR_KEY_HUM_MIN) &&
+        zcbor_uint32_put(state, sensor_value_to_centi(&ss.hum_min)) &&
+        zcbor_uint32_put(state, CBOR_KEY_HUM_MAX) &&
+        zcbor_uint32_put(state, sensor_value_to_centi(&ss.hum_max)) &&
+        zcbor_uint32_put(state, CBOR_KEY_HUM_EMA) &&
+        zcbor_uint32_put(state, sensor_value_to_centi(&ss.hum_ema)) &&
+        zcbor_uint32_put(state, CBOR_KEY_N) &&
+        zcbor_uint32_put(state, ss.n) &&
+        zcbor_map_end_encode(state, 9);
+    if (!ok)
+    {
+        LOG_ERR("CBOR encode error: %d", zcbor_peek_error(state));
+        return -ENOMEM;
+    }
+
+    return state->payload - buffer;
+}
+#endif
+
+int
+encode_summary(const sampler_summary *sum, uint8_t *buffer, uint32_t max_size)
+{
+#if CONFIG_APP_PAYLOAD_CBOR
+    return encode_cbor_summary(sum, buffer, max_size);
+#else
+    return encode_json_summary(sum, (char *)buffer, max_size);
+#endif
+}
+
+#if CONFIG_APP_PAYLOAD_BENCH
+#if CONFIG_LWM2M
+/* The previous encoder (double math, lwm2m_ftoa, and the json library with
+   a length pass), kept to compare against. */
+struct sensor_result_tok {
+    struct json_obj_token temp;
+    struct json_obj_token hum;
+};
+
+static const struct json_obj_descr json_result_tok[] = {
+    JSON_OBJ_DESCR_PRIM(struct sensor_result_tok, temp, JSON_TOK_FLOAT),
+    JSON_OBJ_DESCR_PRIM(struct sensor_result_tok, hum, JSON_TOK_FLOAT),
+};
+
+static int
+encode_json_result_lwm2m(
+    const struct sensor_value *temp,
+    const struct sensor_value *hum,
+    char *buffer,
+    uint32_t max_size)
+{
     double deg_c = temp->val1 + (double)(temp->val2)*0.000001;
     double deg_f = deg_c*9/5 + 32.;
     double hum_pct = hum->val1 + (double)(hum->val2)*0.000001;
     char temp_fl[24];
     char hum_fl[24];
-    int fllen;
-
-    struct sensor_result rs;
+    struct sensor_result_tok rs;
+    int len;
 
-    fllen = float_to_string(&deg_f, temp_fl, sizeof(temp_fl), 2);
-    if (fllen < 0)
+    len = lwm2m_ftoa(&deg_f, temp_fl, sizeof(temp_fl), 2);
+    if (len < 0 || len >= sizeof(temp_fl))
     {
-        return -1;
+        return -EINVAL;
     }
     rs.temp.start = temp_fl;
-    rs.temp.length = fllen;
+    rs.temp.length = len;
 
-    fllen = float_to_string(&hum_pct, hum_fl, sizeof(hum_fl), 2);
-    if (fllen < 0)
+    len = lwm2m_ftoa(&hum_pct, hum_fl, sizeof(hum_fl), 2);
+    if (len < 0 || len >= sizeof(hum_fl))
     {
-        return -1;
+        return -EINVAL;
     }
     rs.hum.start = hum_fl;
-    rs.hum.length = fllen;
+    rs.hum.length = len;
+
+    len = json_calc_encoded_len(json_result_tok, ARRAY_SIZE(json_result_tok), &rs);
+    if (len < 0 || len > max_size)
+    {
+        return -EINVAL;
+    }
 
-    int len = json_calc_encoded_len(
-        json_result, ARRAY_SIZE(json_result), &rs);
+    return json_obj_encode_buf(json_result_tok, ARRAY_SIZE(json_result_tok),
+        &rs, buffer, max_size) < 0 ? -EINVAL : len;
+}
 
-    if (len < 0)
+#endif
+
+static int
+bench_fixedjson(const struct sensor_value *temp, const struct sensor_value *hum,
+    uint8_t *buf, uint32_t size)
+{
+    return encode_json_result(temp, hum, (char *)buf, size);
+}
+
+#if CONFIG_LWM2M
+static int
+bench_lwm2m(const struct sensor_value *temp, const struct sensor_value *hum,
+    uint8_t *buf, uint32_t size)
+{
+    return encode_json_result_lwm2m(temp, hum, (char *)buf, size);
+}
+#endif
+
+/** @brief A summary with every statistic set to the reading. */
+static void
+bench_summary(const struct sensor_value *temp, const struct sensor_value *hum,
+    sampler_summary *sum)
+{
+    sum->temp.min = sum->temp.max = sum->temp.mean = sum->temp.ema = *temp;
+    sum->hum.min = sum->hum.max = sum->hum.mean = sum->hum.ema = *hum;
+    sum->count = CONFIG_APP_SAMPLE_WINDOW;
+}
+
+static int
+bench_json_summary(const struct sensor_value *temp, const struct sensor_value *hum,
+    uint8_t *buf, uint32_t size)
+{
+    sampler_summary sum;
+
+    bench_summary(temp, hum, &sum);
+    return encode_json_summary(&sum, (char *)buf, size);
+}
+
+#if CONFIG_ZCBOR
+static int
+bench_cbor_summary(const struct sensor_value *temp, const struct sensor_value *hum,
+    uint8_t *buf, uint32_t size)
+{
+    sampler_summary sum;
+
+    bench_summary(temp, hum, &sum);
+    return encode_cbor_summary(&sum, buf, size);
+}
+#endif
+
+typedef struct bench_encoder {
+    const char *name;
+    int (*fn)(const struct sensor_value *, const struct sensor_value *, uint8_t *, uint32_t);
+} bench_encoder;
+
+static const bench_encoder bench_encoders[] = {
+#if CONFIG_LWM2M
+    { "lwm2m_ftoa + json", bench_lwm2m },
+#endif
+    { "FixedJson", bench_fixedjson },
+#if CONFIG_ZCBOR
+    { "zcbor", encode_cbor_result },
+#endif
+    { "FixedJson summary", bench_json_summary },
+#if CONFIG_ZCBOR
+    { "zcbor summary", bench_cbor_summary },
+#endif
+};
+
+/** @brief Encode count readings with fn. Returns the hardware cycles
+    (k_cycle_get_32()) taken, and the size of the last encode in len. */
+static uint32_t
+bench_one(const bench_encoder *enc, uint32_t count, uint8_t *buf, size_t size, int *len)
+{
+    struct sensor_value temp = { .val1 = 21, .val2 = 573000 };
+    struct sensor_value hum = { .val1 = 45, .val2 = 126000 };
+    uint32_t start = k_cycle_get_32();
+    uint32_t k;
+
+    for (k = 0; k < count; k++)
     {
-        LOG_ERR("Error json_calc_encoded_len: %d", len);
-        return (int)len;
+        /* Vary the reading so each pass formats different digits. */
+        temp.val2 = (temp.val2 + 7919) % 1000000;
+        *len = enc->fn(&temp, &hum, buf, size);
     }
 
-    if (len > max_size)
+    return k_cycle_get_32() - start;
+}
+
+/** @brief Size and encode time of each payload encoder built in. */
+static int
+cmd_payload_bench(const struct shell *sh, size_t argc, char **argv)
+{
+    uint32_t count = (argc > 1) ? strtoul(argv[1], NULL, 0) : 1000;
+    uint8_t buf[160];
+    size_t k;
+
+    if (count == 0)
     {
-        LOG_ERR("Buffer not large enough to encode json (%u > %u).",
-            len, max_size);
         return -EINVAL;
     }
 
-    ret = json_obj_encode_buf(json_result, ARRAY_SIZE(json_result),
-        &rs, buffer, max_size);
-    if (ret < 0)
+    shell_print(sh, "%u encodes each, %u Hz cycle counter.", count,
+        sys_clock_hw_cycles_per_sec());
+    shell_print(sh, "%-18s %5s %8s %8s", "encoder", "bytes", "cycles", "ns");
+
+    for (k = 0; k < ARRAY_SIZE(bench_encoders); k++)
     {
-        LOG_ERR("Json encode error: %d", ret);
-        return ret;
+        uint32_t cyc;
+        int len;
+
+        k_sched_lock();
+        cyc = bench_one(&bench_encoders[k], count, buf, sizeof(buf), &len);
+        k_sched_unlock();
+
+        shell_print(sh, "%-18s %5d %8u %8u", bench_encoders[k].name, len, cyc / count,
+            (uint32_t)(k_cyc_to_ns_floor64(cyc) / count));
     }
+    return 0;
+}
 
-    return len;
+SHELL_CMD_ARG_REGISTER(payload_bench, NULL,
+    "Compare payload encoders: payload_bench [count]",
+    cmd_payload_bench, 1, 1);
+#endif
+
+#if CONFIG_APP_DISPLAY_BENCH
+/* Drawn into its own buffer, so the display and its flushes are not
+   disturbed. */
+static DirtyFb bench_fb;
+static bool bench_cfb_ready;
+
+typedef enum bench_path {
+    BENCH_CFB,
+    BENCH_WORDS,
+    BENCH_CACHED,
+} bench_path;
+
+typedef struct bench_renderer {
+    const char *name;
+    const DirtyFb_Font *font;
+    bench_path path;
+} bench_renderer;
+
+static const bench_renderer bench_renderers[] = {
+    { "8x8 cfb", &dirtyfb_font_8x8, BENCH_CFB },
+    { "8x8 words", &dirtyfb_font_8x8, BENCH_WORDS },
+    { "8x8 cached", &dirtyfb_font_8x8, BENCH_CACHED },
+    { "5x7 cfb", &dirtyfb_font_5x7, BENCH_CFB },
+    { "5x7 words", &dirtyfb_font_5x7, BENCH_WORDS },
+    { "5x7 cached", &dirtyfb_font_5x7, BENCH_CACHED },
+};
+
+/** @brief A timestamp for bench_ns(). native_sim's cycle counter only
+    moves with simulated time, not while code runs, so there the host
+    clock is used. */
+static uint64_t
+bench_now(void)
+{
+#if CONFIG_BOARD_NATIVE_SIM
+    return native_rtc_gettime_us(RTC_CLOCK_PSEUDOHOSTREALTIME);
+#else
+    return k_cycle_get_32();
+#endif
+}
+
+/** @brief ns since start, a bench_now() timestamp. */
+static uint64_t
+bench_ns(uint64_t start)
+{
+#if CONFIG_BOARD_NATIVE_SIM
+    return (bench_now() - start) * 1000;
+#else
+    return k_cyc_to_ns_floor64((uint32_t)(k_cycle_get_32() - (uint32_t)start));
+#endif
+}
+
+/** @brief Select the cfb font of the same size as font, with the kerning
+    that gives it the same cell. cfb's buffer is set up the first time but
+    never sent to the display. */
+static int
+bench_cfb_font(const DirtyFb_Font *font)
+{
+    int num_fonts;
+    int idx;
+
+    if (!bench_cfb_ready)
+    {
+        if (cfb_framebuffer_init(display_dev))
+        {
+            return -ENOMEM;
+        }
+        bench_cfb_ready = true;
+    }
+
+    num_fonts = cfb_get_numof_fonts(display_dev);
+    for (idx = 0; idx < num_fonts; idx++)
+    {
+        uint8_t w, h;
+
+        cfb_get_font_size(display_dev, idx, &w, &h);
+        if (w == font->width && h == 8)
+        {
+            cfb_framebuffer_set_font(display_dev, idx);
+            cfb_set_kerning(display_dev, font->cell - font->width);
+            return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+/** @brief Draw str count times with r. Returns the ns taken. */
+static uint64_t
+bench_render(const bench_renderer *r, const char *str, uint32_t count)
+{
+    uint64_t start = bench_now();
+    uint32_t k;
+
+    for (k = 0; k < count; k++)
+    {
+        switch (r->path)
+        {
+        case BENCH_CFB:
+            cfb_print(display_dev, str, 0, 0);
+            break;
+        case BENCH_WORDS:
+            DirtyFb_print(&bench_fb, r->font, str, 0, 0);
+            break;
+        case BENCH_CACHED:
+            DirtyFb_printCached(&bench_fb, r->font, str, 0, 0);
+            break;
+        }
+    }
+
+    return bench_ns(start);
+}
+
+/** @brief ns per character of each way of drawing text. */
+static int
+cmd_display_bench(const struct shell *sh, size_t argc, char **argv)
+{
+    uint32_t count = (argc > 1) ? strtoul(argv[1], NULL, 0) : 1000;
+    const char *str = (argc > 2) ? argv[2] : "Tmp: ";
+    size_t len = strlen(str);
+    size_t k;
+
+    if (count == 0 || len == 0)
+    {
+        return -EINVAL;
+    }
+
+    if (!bench_fb.dev && DirtyFb_init(&bench_fb, display_dev) < 0)
+    {
+        return -ENODEV;
+    }
+
+    shell_print(sh, "\"%s\" %u times.", str, count);
+    shell_print(sh, "%-12s %8s", "renderer", "ns/char");
+
+    for (k = 0; k < ARRAY_SIZE(bench_renderers); k++)
+    {
+        const bench_renderer *r = &bench_renderers[k];
+        uint64_t ns;
+
+        if (r->path == BENCH_CFB && bench_cfb_font(r->font) < 0)
+        {
+            shell_print(sh, "%-12s %8s", r->name, "-");
+            continue;
+        }
+
+        k_sched_lock();
+        ns = bench_render(r, str, count);
+        k_sched_unlock();
+
+        shell_print(sh, "%-12s %8u", r->name, (uint32_t)(ns / (count * len)));
+    }
+    return 0;
+}
+
+SHELL_CMD_ARG_REGISTER(display_bench, NULL,
+    "Compare text renderers: display_bench [count] [string]",
+    cmd_display_bench, 1, 2);
+#endif
+
+#if CONFIG_SHELL && CONFIG_DIRTYFB
+/** @brief Bytes each update sends the display, over a fixed sequence of
+    frames. */
+static int
+cmd_display_frames(const struct shell *sh, size_t argc, char **argv)
+{
+    uint32_t count = (argc > 1) ? strtoul(argv[1], NULL, 0) : 100;
+    DirtyFb_Stats before, after;
+    uint32_t updates;
+
+    if (count == 0)
+    {
+        return -EINVAL;
+    }
+
+    DirtyFb_getStats(&oled_fb, &before);
+#if CONFIG_SSD1306RAM
+    Ssd1306Ram_resetStats(display_dev);
+#endif
+    display_frames(count);
+    DirtyFb_getStats(&oled_fb, &after);
+
+    updates = after.flushes - before.flushes;
+    shell_print(sh, "%u updates: %u pixel bytes (%u per update), %u writes", updates,
+        after.bytes - before.bytes, (after.bytes - before.bytes) / MAX(updates, 1),
+        after.writes - before.writes);
+#if CONFIG_SSD1306RAM
+    Ssd1306Ram_Stats st;
+
+    Ssd1306Ram_getStats(display_dev, &st);
+    shell_print(sh, "bus: %u bytes (%u per update), %u transfers, %u commands",
+        st.bus_bytes, st.bus_bytes / count, st.transfers, st.commands);
+#endif
+    return 0;
 }
 
+SHELL_CMD_ARG_REGISTER(display_frames, NULL,
+    "Draw a fixed sequence of frames and count the bytes: display_frames [count]",
+    cmd_display_frames, 1, 1);
+#endif
+
 int
 init_display(void)
 {
@@ -168,6 +754,17 @@ init_display(void)
         return -1;
     }
 
+#if CONFIG_DIRTYFB
+    if (DirtyFb_init(&oled_fb, display_dev))
+    {
+        LOG_ERR("Framebuffer initialization failed!");
+        return -1;
+    }
+
+    /* Send the cleared frame. */
+    DirtyFb_flush(&oled_fb);
+    display_blanking_off(display_dev);
+#else
     if (cfb_framebuffer_init(display_dev))
     {
         LOG_ERR("Framebuffer initialization failed!");
@@ -208,6 +805,7 @@ init_display(void)
         dparams.ppt,
         dparams.rows,
         dparams.cols);
+#endif
 
     return 0;
 }
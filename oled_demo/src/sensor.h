@@ -9,11 +9,20 @@
 #include <zephyr/device.h>
 #include <zephyr/display/cfb.h>
 #include <zephyr/drivers/sensor.h>
+#include "sampler.h"
+#if CONFIG_DIRTYFB
+#include "DirtyFb.h"
+
+/** @brief font8x8.c and font5x7.c, for DirtyFb_print(). */
+extern const DirtyFb_Font dirtyfb_font_8x8;
+extern const DirtyFb_Font dirtyfb_font_5x7;
+#endif
 
 int init_sensor(void);
-void get_temp_hum(struct sensor_value *temp, struct sensor_value *hum);
+int get_temp_hum(struct sensor_value *temp, struct sensor_value *hum);
 int init_display(void);
-void update_display(const struct sensor_value *temp, const struct sensor_value *hum);
+void update_display(const sampler_summary *sum);
+void display_frames(uint32_t count);
 
 int
 encode_json_result(
@@ -21,4 +30,26 @@ encode_json_result(
     const struct sensor_value *hum,
     char *buffer,
     uint32_t max_size);
+
+#if CONFIG_ZCBOR
+int
+encode_cbor_result(
+    const struct sensor_value *temp,
+    const struct sensor_value *hum,
+    uint8_t *buffer,
+    uint32_t max_size);
+#endif
+
+int
+encode_json_summary(const sampler_summary *sum, char *buffer, uint32_t max_size);
+
+#if CONFIG_ZCBOR
+int
+encode_cbor_summary(const sampler_summary *sum, uint8_t *buffer, uint32_t max_size);
+#endif
+
+/** @brief Encode a summary in the configured payload format
+    (CONFIG_APP_PAYLOAD_JSON or CONFIG_APP_PAYLOAD_CBOR). */
+int
+encode_summary(const sampler_summary *sum, uint8_t *buffer, uint32_t max_size);
 #endif
@@ -0,0 +1,298 @@
+/*******************************************************************************
+ *  @file: sensor_rtio.c
+ *
+ *  @brief: Asynchronous temp/humidity reads through the RTIO sensor API.
+*******************************************************************************/
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/rtio/rtio.h>
+#include "sensor_rtio.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(app, LOG_LEVEL_INF);
+
+#define TEMPHUM_NODE(n)     DT_ALIAS(temphum##n)
+#define TEMPHUM_OKAY(n)     DT_NODE_HAS_STATUS(TEMPHUM_NODE(n), okay)
+
+#define TEMPHUM_IODEV(n)                                                    \
+    IF_ENABLED(TEMPHUM_OKAY(n),                                             \
+        (SENSOR_DT_READ_IODEV(temphum_iodev_##n, TEMPHUM_NODE(n),           \
+            {SENSOR_CHAN_AMBIENT_TEMP, 0}, {SENSOR_CHAN_HUMIDITY, 0});))
+
+#define TEMPHUM_ENTRY(n)                                                    \
+    IF_ENABLED(TEMPHUM_OKAY(n),                                             \
+        ({ .dev = DEVICE_DT_GET(TEMPHUM_NODE(n)), .iodev = &temphum_iodev_##n },))
+
+TEMPHUM_IODEV(0)
+TEMPHUM_IODEV(1)
+TEMPHUM_IODEV(2)
+TEMPHUM_IODEV(3)
+
+typedef struct temphum_sensor {
+    const struct device *dev;
+    struct rtio_iodev *iodev;
+} temphum_sensor;
+
+static const temphum_sensor sensors[] = {
+    TEMPHUM_ENTRY(0)
+    TEMPHUM_ENTRY(1)
+    TEMPHUM_ENTRY(2)
+    TEMPHUM_ENTRY(3)
+};
+
+#define NUM_SENSORS     ARRAY_SIZE(sensors)
+
+BUILD_ASSERT(NUM_SENSORS > 0, "No temphum0 sensor alias.");
+
+/* One submission and one completion entry per sensor, and a pool block
+   per read for the encoded data. */
+RTIO_DEFINE_WITH_MEMPOOL(temphum_rtio, NUM_SENSORS, NUM_SENSORS, NUM_SENSORS, 64, 4);
+
+static bool in_flight;
+
+/** @brief A q31 reading in thousandths, rounded to the nearest (half away
+    from zero). A plain shift would truncate toward minus infinity, and the
+    q31 encoding of a whole number of thousandths can be a hair below it. */
+static inline int32_t
+q31_to_milli(int32_t value, int8_t shift)
+{
+    int64_t v = (int64_t)value * 1000;
+    int n = 31 - shift;
+
+    if (n <= 0)
+    {
+        return (int32_t)(v << -n);
+    }
+    if (v < 0)
+    {
+        return (int32_t)-((-v + ((int64_t)1 << (n - 1))) >> n);
+    }
+    return (int32_t)((v + ((int64_t)1 << (n - 1))) >> n);
+}
+
+static int
+decode_channel(const struct sensor_decoder_api *decoder, const uint8_t *buf,
+    enum sensor_channel chan, int32_t *milli)
+{
+    struct sensor_q31_data data = { 0 };
+    uint32_t fit = 0;
+    int ret;
+
+    ret = decoder->decode(buf, (struct sensor_chan_spec){ chan, 0 }, &fit, 1, &data);
+    if (ret <= 0)
+    {
+        return (ret < 0) ? ret : -ENODATA;
+    }
+
+    *milli = q31_to_milli(data.readings[0].value, data.shift);
+    return 0;
+}
+
+static int
+decode_reading(const temphum_sensor *s, const uint8_t *buf, sensor_rtio_reading *out)
+{
+    const struct sensor_decoder_api *decoder;
+    int ret;
+
+    ret = sensor_get_decoder(s->dev, &decoder);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    ret = decode_channel(decoder, buf, SENSOR_CHAN_AMBIENT_TEMP, &out->temp);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    return decode_channel(decoder, buf, SENSOR_CHAN_HUMIDITY, &out->hum);
+}
+
+int
+sensor_rtio_init(void)
+{
+    int ready = 0;
+    size_t k;
+
+    for (k = 0; k < NUM_SENSORS; k++)
+    {
+        if (device_is_ready(sensors[k].dev))
+        {
+            ready++;
+        }
+        else
+        {
+            LOG_ERR("Sensor %s is not ready.", sensors[k].dev->name);
+        }
+    }
+
+    LOG_INF("%d of %u temp/humidity sensors ready (RTIO).", ready, (unsigned int)NUM_SENSORS);
+    return ready ? ready : -ENODEV;
+}
+
+int
+sensor_rtio_submit(void)
+{
+    size_t k;
+
+    if (in_flight)
+    {
+        return -EBUSY;
+    }
+
+    for (k = 0; k < NUM_SENSORS; k++)
+    {
+        struct rtio_sqe *sqe = rtio_sqe_acquire(&temphum_rtio);
+
+        if (!sqe)
+        {
+            rtio_sqe_drop_all(&temphum_rtio);
+            return -ENOMEM;
+        }
+
+        /* The read gets a pool block for its data. userdata says which
+           sensor completed, since completions can come in any order. */
+        rtio_sqe_prep_read_with_pool(sqe, sensors[k].iodev, RTIO_PRIO_NORM,
+            (void *)(uintptr_t)k);
+    }
+
+    /* One submit for the whole batch; does not wait. */
+    rtio_submit(&temphum_rtio, 0);
+    in_flight = true;
+    return 0;
+}
+
+int
+sensor_rtio_complete(sensor_rtio_reading *readings, size_t num)
+{
+    size_t k;
+
+    if (!in_flight)
+    {
+        return -EINVAL;
+    }
+
+    for (k = 0; k < NUM_SENSORS; k++)
+    {
+        struct rtio_cqe *cqe = rtio_cqe_consume_block(&temphum_rtio);
+        uintptr_t idx = (uintptr_t)cqe->userdata;
+        int result = cqe->result;
+        uint8_t *buf = NULL;
+        uint32_t buf_len = 0;
+        int ret;
+
+        ret = rtio_cqe_get_mempool_buffer(&temphum_rtio, cqe, &buf, &buf_len);
+        rtio_cqe_release(&temphum_rtio, cqe);
+
+        if (idx >= num)
+        {
+            /* More sensors than the caller wants: just free the block. */
+        }
+        else if (result < 0 || ret < 0)
+        {
+            readings[idx].err = (result < 0) ? result : ret;
+        }
+        else
+        {
+            readings[idx].err = decode_reading(&sensors[idx], buf, &readings[idx]);
+        }
+
+        if (buf)
+        {
+            rtio_release_buffer(&temphum_rtio, buf, buf_len);
+        }
+    }
+
+    in_flight = false;
+    return NUM_SENSORS;
+}
+
+#if CONFIG_APP_SENSOR_RTIO_CHECK
+/* Batches read by the check: more than the pool has blocks, so a block
+   that is not given back shows up as a failed read. */
+#define CHECK_ROUNDS    8
+
+/* What each vnd,temphum-emul sensor returns, from the devicetree. */
+#define TEMPHUM_EXPECT(n)                                                   \
+    IF_ENABLED(TEMPHUM_OKAY(n),                                             \
+        ({ .temp = DT_PROP(TEMPHUM_NODE(n), temperature_milli),             \
+           .hum = DT_PROP(TEMPHUM_NODE(n), humidity_milli),                 \
+           .err = DT_PROP(TEMPHUM_NODE(n), fail_fetch) ? -EIO : 0 },))
+
+int
+sensor_rtio_check(void)
+{
+    static const sensor_rtio_reading expect[] = {
+        TEMPHUM_EXPECT(0)
+        TEMPHUM_EXPECT(1)
+        TEMPHUM_EXPECT(2)
+        TEMPHUM_EXPECT(3)
+    };
+    sensor_rtio_reading readings[NUM_SENSORS];
+    int failed = 0;
+    int round;
+    int ret;
+    size_t k;
+
+    ret = sensor_rtio_init();
+    if (ret != (int)NUM_SENSORS)
+    {
+        LOG_ERR("sensor_rtio check: %d of %u sensors ready.", ret, (unsigned int)NUM_SENSORS);
+        failed++;
+    }
+
+    for (round = 0; round < CHECK_ROUNDS && failed == 0; round++)
+    {
+        memset(readings, 0, sizeof(readings));
+
+        ret = sensor_rtio_submit();
+        if (ret < 0)
+        {
+            LOG_ERR("sensor_rtio check: submit failed: %d", ret);
+            failed++;
+            break;
+        }
+        ret = sensor_rtio_submit();
+        if (ret != -EBUSY)
+        {
+            LOG_ERR("sensor_rtio check: submit during a batch returned %d.", ret);
+            failed++;
+        }
+
+        ret = sensor_rtio_complete(readings, ARRAY_SIZE(readings));
+        if (ret != (int)NUM_SENSORS)
+        {
+            LOG_ERR("sensor_rtio check: %d readings, not %u.", ret, (unsigned int)NUM_SENSORS);
+            failed++;
+        }
+
+        for (k = 0; k < NUM_SENSORS; k++)
+        {
+            const sensor_rtio_reading *r = &readings[k];
+            const sensor_rtio_reading *e = &expect[k];
+
+            if (r->err != e->err || (e->err == 0 && (r->temp != e->temp || r->hum != e->hum)))
+            {
+                LOG_ERR("sensor_rtio check: sensor %u round %d: err %d temp %d hum %d, "
+                    "expected err %d temp %d hum %d", (unsigned int)k, round,
+                    r->err, r->temp, r->hum, e->err, e->temp, e->hum);
+                failed++;
+            }
+        }
+    }
+
+    if (failed)
+    {
+        LOG_ERR("sensor_rtio check: FAILED");
+        return -EIO;
+    }
+
+    LOG_INF("sensor_rtio check: ok, %u sensors, %d batches", (unsigned int)NUM_SENSORS,
+        CHECK_ROUNDS);
+    return 0;
+}
+#endif
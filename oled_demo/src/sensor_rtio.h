@@ -0,0 +1,47 @@
+/*******************************************************************************
+ *  @file: sensor_rtio.h
+ *
+ *  @brief: Asynchronous temp/humidity reads through the RTIO sensor API.
+ *
+ *  Every sensor aliased temphum0 to temphum3 in the devicetree gets a read
+ *  iodev for its temperature and humidity channels. sensor_rtio_submit()
+ *  queues one read per sensor and submits them together, without waiting.
+ *  The reads run in the driver (or, for drivers without native async
+ *  support, on the RTIO work queue) while the caller carries on.
+ *  sensor_rtio_complete() then takes the completions and decodes them.
+ *  Each read's data lives in a block of the RTIO context's memory pool
+ *  until it is decoded.
+*******************************************************************************/
+#ifndef SENSOR_RTIO_H
+#define SENSOR_RTIO_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+typedef struct sensor_rtio_reading {
+    /** @brief milli deg C and milli %RH. */
+    int32_t temp;
+    int32_t hum;
+    /** @brief 0, or the read or decode error. */
+    int err;
+} sensor_rtio_reading;
+
+/** @brief Check the sensors. Returns how many are ready, or -ENODEV. */
+int sensor_rtio_init(void);
+
+/** @brief Submit one read per sensor, in a single submission. Returns
+    -EBUSY if the previous batch has not been completed. */
+int sensor_rtio_submit(void);
+
+/** @brief Wait for the submitted batch, and decode it into readings, one
+    per sensor (in alias order). Returns the number of sensors. */
+int sensor_rtio_complete(sensor_rtio_reading *readings, size_t num);
+
+#if CONFIG_APP_SENSOR_RTIO_CHECK
+/** @brief Read every sensor several times and compare with what the
+    vnd,temphum-emul nodes in the devicetree return. Call before the
+    sampler starts. Returns 0, or -EIO if a reading or error differs. */
+int sensor_rtio_check(void);
+#endif
+
+#endif
@@ -7,6 +7,10 @@
 #include <zephyr/net/net_mgmt.h>
 #include <zephyr/net/net_event.h>
 #include <zephyr/net/conn_mgr_monitor.h>
+#if CONFIG_NETBUFSTATS
+#include "NetBufStats.h"
+#endif
+#include "BootSeq.h"
 
 /** @brief Initialize the logging module. */
 LOG_MODULE_REGISTER(app, LOG_LEVEL_DBG);
@@ -18,10 +22,40 @@ LOG_MODULE_REGISTER(app, LOG_LEVEL_DBG);
 static struct net_mgmt_event_callback mgmt_cb;
 static bool connected = false;
 
-static K_SEM_DEFINE(l4_connected, 0, 1);
+/** @brief Start-up phases. Address setup and net_config run while the link
+    comes up; nothing waits in main(). */
+enum
+{
+    PH_IP = 0,
+    PH_NET_CONFIG,
+    PH_L4_CONNECTED,
+    PH_NET_READY,
+    PH_FIRST_PING,
+    PH_REPORT,
+    NUM_PHASES
+};
+
+static int init_ip(void *arg);
+static int init_net_config(void *arg);
+static int net_ready(void *arg);
+static int boot_report(void *arg);
+
+static BootSeq boot;
+static BootSeq_Phase phases[NUM_PHASES] = {
+    [PH_IP] = { .name = "ip", .fn = init_ip },
+    [PH_NET_CONFIG] = { .name = "net_config", .fn = init_net_config, .deps = BIT(PH_IP) },
+    [PH_L4_CONNECTED] = { .name = "l4_connected" },
+    [PH_NET_READY] = {
+        .name = "net_ready",
+        .fn = net_ready,
+        .deps = BIT(PH_NET_CONFIG) | BIT(PH_L4_CONNECTED)
+    },
+    [PH_FIRST_PING] = { .name = "first_ping" },
+    [PH_REPORT] = { .name = "report", .fn = boot_report, .deps = BIT(PH_FIRST_PING) },
+};
 
-static void
-init_ip(void)
+static int
+init_ip(void *arg)
 {
     struct net_if *iface;
     struct net_if_addr *ifaddr;
@@ -29,6 +63,8 @@ init_ip(void)
     struct in_addr my_ipv4_mask;
     struct in_addr my_ipv4_gw;
 
+    ARG_UNUSED(arg);
+
     iface = net_if_get_default();
 
     LOG_INF("Setting IP address for iface:");
@@ -44,11 +80,46 @@ init_ip(void)
     if (!ifaddr)
     {
         LOG_ERR("Error setting IP address");
-        return;
+        return -EINVAL;
     }
 
     net_if_ipv4_set_netmask_by_addr(iface, &my_ipv4_addr, &my_ipv4_mask);
     net_if_ipv4_set_gw(iface, &my_ipv4_gw);
+    return 0;
+}
+
+static int
+init_net_config(void *arg)
+{
+    int ret;
+
+    ARG_UNUSED(arg);
+
+    ret = net_config_init_app(NULL, "Initializing network");
+    if (ret < 0)
+    {
+        LOG_ERR("Failed network init (%d)", ret);
+    }
+    return ret;
+}
+
+static int
+net_ready(void *arg)
+{
+    ARG_UNUSED(arg);
+
+    LOG_INF("Network connected.");
+    return 0;
+}
+
+/** @brief Log the start-up timeline once the first request has been served. */
+static int
+boot_report(void *arg)
+{
+    ARG_UNUSED(arg);
+
+    BootSeq_log(&boot);
+    return 0;
 }
 
 static void
@@ -68,7 +139,6 @@ l4_event_handler(
     case NET_EVENT_L4_CONNECTED:
         LOG_DBG("NET_EVENT_L4_CONNECTED");
         connected = true;
-        k_sem_give(&l4_connected);
         break;
     case NET_EVENT_L4_DISCONNECTED:
         LOG_DBG("NET_EVENT_L4_DISCONNECTED");
@@ -77,8 +147,6 @@ l4_event_handler(
             LOG_INF("Network disconnected event");
             connected = false;
         }
-        LOG_DBG("Resetting sem.");
-        k_sem_reset(&l4_connected);
         break;
     case NET_EVENT_L4_IPV4_CONNECTED:
         LOG_DBG("NET_EVENT_L4_IPV4_CONNECTED");
@@ -99,6 +167,7 @@ l4_event_handler(
 
 }
 
+/** @brief Start network bring-up. Returns without waiting for it. */
 static int
 network_init(void)
 {
@@ -112,25 +181,16 @@ network_init(void)
 
     net_mgmt_init_event_callback(&mgmt_cb, l4_event_handler, EVENT_MASK);
     net_mgmt_add_event_callback(&mgmt_cb);
-    conn_mgr_mon_resend_status();
-
-    init_ip();
 
-    ret = net_config_init_app(NULL, "Initializing network");
+    ret = BootSeq_init(&boot, phases, NUM_PHASES);
     if (ret < 0)
     {
-        LOG_ERR("Failed network init (%d)", ret);
         return ret;
     }
+    BootSeq_watchL4(&boot, PH_L4_CONNECTED);
+    BootSeq_watchPing(&boot, PH_FIRST_PING);
 
-    LOG_INF("Waiting for network connection...");
-
-    /* Wait for the connection. */
-    k_sem_take(&l4_connected, K_FOREVER);
-
-    LOG_INF("Network connected.");
-
-    return 0;
+    return BootSeq_start(&boot);
 }
 
 int main(void)
@@ -144,7 +204,12 @@ int main(void)
 
     while (1)
     {
+#if CONFIG_NETBUFSTATS && CONFIG_APP_NETBUF_LOG_PERIOD > 0
+        k_sleep(K_SECONDS(CONFIG_APP_NETBUF_LOG_PERIOD));
+        NetBufStats_log();
+#else
         k_msleep(1000);
+#endif
     }
 
     return 0;
@@ -8,16 +8,40 @@
 #include <zephyr/devicetree.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/gpio.h>
+#if CONFIG_WIFICONNECT
 #include "WifiConnect.h"
+#endif
 #include "TcpEcho.h"
+#if CONFIG_NVPARMS
 #include "NvParms.h"
+#endif
+#if CONFIG_APP_TCP_ECHO_ZEROCOPY
+#include "TcpEchoZc.h"
+#endif
 
 /** @brief Initialize the logging module. */
 LOG_MODULE_REGISTER(app, LOG_LEVEL_DBG);
 
+#define STATS_PERIOD_MS     10000
 
+#if CONFIG_APP_TCP_ECHO_ZEROCOPY
+K_THREAD_STACK_DEFINE(echo_zc_stack, CONFIG_APP_TCP_ECHO_ZEROCOPY_STACK_SIZE);
+static TcpEchoZc tcp_echo;
+
+static void
+log_echo_stats(void)
+{
+    TcpEchoZc_Stats st;
+
+    TcpEchoZc_getStats(&tcp_echo, &st);
+    LOG_INF("rx %u tx %u bytes, %u pkts in %u frags, %u send stalls, %u clients",
+        st.rx_bytes, st.tx_bytes, st.pkts, st.frags, st.send_stalls, st.clients);
+}
+#else
 static TcpEcho tcp_echo;
+#endif
 
+#if CONFIG_WIFICONNECT
 static int
 init_wifi(void)
 {
@@ -46,6 +70,7 @@ init_wifi(void)
     WifiConnect_connect(ssid, pass);
     return 0;
 }
+#endif
 
 int main(void)
 {
@@ -53,15 +78,29 @@ int main(void)
 
     LOG_INF("TCP Echo app.");
 
+#if CONFIG_NVPARMS
     ret = NvParms_init();
     if (ret < 0)
     {
         LOG_ERR("NvParms module init error : %d", ret);
         return 0;
     }
+#endif
 
+#if CONFIG_WIFICONNECT
     init_wifi();
+#endif
 
+#if CONFIG_APP_TCP_ECHO_ZEROCOPY
+    ret = TcpEchoZc_init(
+        &tcp_echo,
+        12001,
+        echo_zc_stack,
+        K_THREAD_STACK_SIZEOF(echo_zc_stack),
+        "TCP Echo ZC",
+        20);
+    if (ret < 0) LOG_ERR("Error initializing zero-copy Tcp Echo server: %d",  ret);
+#else
     ret = TcpEcho_init(
         &tcp_echo,
         12001,
@@ -71,10 +110,16 @@ int main(void)
         "TCP Echo",
         20);
     if (ret < 0) LOG_ERR("Error initializing Tcp Echo server: %d",  ret);
+#endif
 
     while (1)
     {
+#if CONFIG_APP_TCP_ECHO_ZEROCOPY
+        k_msleep(STATS_PERIOD_MS);
+        log_echo_stats();
+#else
         k_msleep(1000);
+#endif
     }
 
     return 0;
@@ -0,0 +1,475 @@
+#!/usr/bin/env python3
+"""Load generator for the echo servers (echo_server, tcp_echo) on port 12001.
+
+Closed loop (default): each connection sends a message, waits for the whole
+echo, records the round trip and then sends the next one. This measures the
+best-case latency at whatever rate the server can sustain.
+
+Open loop (--rate): messages are sent on a fixed schedule no matter how fast
+the echoes come back. Latency is measured from the time a message was
+*scheduled* to go out. When the server (or the link) falls behind, queueing
+delay shows up in the tail rather than being hidden by a slower send rate.
+
+Message sizes come from a distribution (--size):
+    64                      fixed
+    uniform:16-1024         uniform in [16, 1024]
+    exp:256[:1400]          exponential with mean 256, clipped to 1400
+    mix:64@7,512@2,1400@1   weighted choice
+
+Latencies are kept in an HDR-style log-linear histogram (about 1% value
+resolution from 1 us to minutes). --hgrm writes the percentile distribution
+in the HdrHistogram text format, which the HdrHistogram plotter can compare
+across runs. --json appends a one-line summary for scripting A/B runs.
+
+Examples (the targets run on qemu_x86 at 192.0.2.1 behind a host TAP or a
+socat/taptool serial link; see echo_server/README.md and serialnet/README.md):
+    ./echo_load.py --clients 32 --size 64 --duration 10
+    ./echo_load.py --clients 8 --size uniform:16-1024 --rate 2000 --hgrm tcp.hgrm
+    ./echo_load.py --clients 32 --size mix:32@9,512@1 --udp --rate 5000
+"""
+import argparse
+import asyncio
+import collections
+import json
+import math
+import os
+import random
+import socket
+import struct
+import sys
+import time
+
+# UDP messages carry a sequence number so that late or reordered echoes are
+# matched to the right send.
+UDP_HDR = struct.Struct("!Q")
+
+
+class SizeDist:
+    """Message size distribution parsed from a spec string."""
+
+    def __init__(self, spec):
+        self.spec = spec
+        kind, _, arg = spec.partition(":")
+        try:
+            if not arg:
+                n = int(kind)
+                self.max = n
+                self.sample = lambda: n
+            elif kind == "uniform":
+                lo, hi = (int(v) for v in arg.split("-"))
+                self.max = hi
+                self.sample = lambda: random.randint(lo, hi)
+            elif kind == "exp":
+                parts = arg.split(":")
+                mean = float(parts[0])
+                hi = int(parts[1]) if len(parts) > 1 else int(mean * 8)
+                self.max = hi
+                self.sample = lambda: max(1, min(hi, int(random.expovariate(1.0 / mean))))
+            elif kind == "mix":
+                sizes, weights = [], []
+                for item in arg.split(","):
+                    size, _, weight = item.partition("@")
+                    sizes.append(int(size))
+                    weights.append(float(weight or 1))
+                self.max = max(sizes)
+                self.sample = lambda: random.choices(sizes, weights)[0]
+            else:
+                raise ValueError(kind)
+        except ValueError:
+            raise argparse.ArgumentTypeError(f"bad size distribution '{spec}'")
+
+
+class Histogram:
+    """Log-linear latency histogram in integer microseconds.
+
+    Values below SUB are counted exactly. Above that, each power of two is
+    split into HALF linear sub-buckets, so a bucket is never wider than
+    1/HALF of its value (the HdrHistogram layout with 2 significant digits).
+    """
+
+    SUB_BITS = 8
+    SUB = 1 << SUB_BITS
+    HALF = SUB >> 1
+
+    def __init__(self):
+        self.counts = collections.Counter()
+        self.total = 0
+        self.min = None
+        self.max = 0
+        self.sum = 0
+        self.sum_sq = 0
+
+    def _index(self, v):
+        if v < self.SUB:
+            return v
+        shift = v.bit_length() - self.SUB_BITS
+        return shift * self.HALF + (v >> shift)
+
+    def _range(self, idx):
+        """Lowest and highest value counted in a bucket."""
+        if idx < self.SUB:
+            return idx, idx
+        shift = idx // self.HALF - 1
+        sub = idx - shift * self.HALF
+        return sub << shift, ((sub + 1) << shift) - 1
+
+    def record(self, seconds):
+        v = max(0, int(seconds * 1e6))
+        self.counts[self._index(v)] += 1
+        self.total += 1
+        self.min = v if self.min is None else min(self.min, v)
+        self.max = max(self.max, v)
+        self.sum += v
+        self.sum_sq += v * v
+
+    def merge(self, other):
+        self.counts.update(other.counts)
+        self.total += other.total
+        if other.min is not None:
+            self.min = other.min if self.min is None else min(self.min, other.min)
+        self.max = max(self.max, other.max)
+        self.sum += other.sum
+        self.sum_sq += other.sum_sq
+
+    def value_at(self, pct):
+        """Value (us) at or below which pct percent of samples fall."""
+        if self.total == 0:
+            return 0
+        target = max(1, math.ceil(pct / 100.0 * self.total))
+        seen = 0
+        for idx in sorted(self.counts):
+            seen += self.counts[idx]
+            if seen >= target:
+                return min(self._range(idx)[1], self.max)
+        return self.max
+
+    def mean(self):
+        return self.sum / self.total if self.total else 0.0
+
+    def stddev(self):
+        if self.total == 0:
+            return 0.0
+        m = self.mean()
+        return math.sqrt(max(0.0, self.sum_sq / self.total - m * m))
+
+    def write_hgrm(self, f, ticks_per_half=5):
+        """Percentile distribution in the HdrHistogram text format (ms)."""
+        f.write(f"{'Value':>12} {'Percentile':>14} {'TotalCount':>10} {'1/(1-Percentile)':>14}\n\n")
+        if self.total:
+            buckets = sorted(self.counts)
+            cum = []
+            seen = 0
+            for idx in buckets:
+                seen += self.counts[idx]
+                cum.append((min(self._range(idx)[1], self.max), seen))
+
+            k = 0
+            pos = 0
+            while True:
+                pct = 100.0 * (1.0 - 0.5 ** (k / ticks_per_half))
+                target = max(1, math.ceil(pct / 100.0 * self.total))
+                while cum[pos][1] < target:
+                    pos += 1
+                value, count = cum[pos]
+                frac = count / self.total
+                if count == self.total:
+                    f.write(f"{value / 1000:12.3f} {1.0:14.12f} {count:10d}\n")
+                    break
+                inv = 1.0 / (1.0 - frac)
+                f.write(f"{value / 1000:12.3f} {frac:14.12f} {count:10d} {inv:14.2f}\n")
+                k += 1
+
+        f.write(f"#[Mean    = {self.mean() / 1000:12.3f}, StdDeviation   = {self.stddev() / 1000:12.3f}]\n")
+        f.write(f"#[Max     = {self.max / 1000:12.3f}, Total count    = {self.total:12d}]\n")
+        f.write(f"#[Buckets = {len(self.counts):12d}, SubBuckets     = {self.SUB:12d}]\n")
+
+
+class Stats:
+    def __init__(self):
+        self.hist = Histogram()
+        self.msgs = 0
+        self.bytes = 0
+        self.errors = 0
+        self.lost = 0
+        self.late_sends = 0
+
+    def record(self, latency_s, nbytes):
+        self.hist.record(latency_s)
+        self.msgs += 1
+        self.bytes += nbytes
+
+
+def schedule(args, deadline):
+    """Yield the send times of one open-loop connection. Connections start at
+    a random phase so that their sends do not line up."""
+    period = args.clients / args.rate
+    t = time.monotonic() + random.uniform(0, period)
+    while t < deadline:
+        yield t
+        t += period
+
+
+async def sleep_until(t):
+    delay = t - time.monotonic()
+    if delay > 0:
+        await asyncio.sleep(delay)
+        return False
+    return True
+
+
+async def tcp_connect(args, stats):
+    try:
+        reader, writer = await asyncio.wait_for(
+            asyncio.open_connection(args.host, args.port), args.timeout)
+    except (OSError, asyncio.TimeoutError):
+        stats.errors += 1
+        return None, None
+
+    sock = writer.get_extra_info("socket")
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    return reader, writer
+
+
+async def tcp_closed(args, stats, deadline, payload):
+    reader, writer = await tcp_connect(args, stats)
+    if not writer:
+        return
+
+    try:
+        while time.monotonic() < deadline:
+            msg = payload[:args.sizes.sample()]
+            t0 = time.perf_counter()
+            writer.write(msg)
+            echoed = await asyncio.wait_for(reader.readexactly(len(msg)), args.timeout)
+            stats.record(time.perf_counter() - t0, len(msg))
+            if echoed != msg:
+                stats.errors += 1
+    except (OSError, asyncio.TimeoutError, asyncio.IncompleteReadError):
+        stats.errors += 1
+    finally:
+        writer.close()
+
+
+async def tcp_open(args, stats, deadline, payload):
+    reader, writer = await tcp_connect(args, stats)
+    if not writer:
+        return
+
+    # TCP echoes come back in order, so a FIFO of (scheduled time, message)
+    # matches them up.
+    inflight = collections.deque()
+    sent_all = asyncio.Event()
+    ready = asyncio.Event()
+
+    async def sender():
+        try:
+            for t in schedule(args, deadline):
+                if await sleep_until(t):
+                    stats.late_sends += 1
+                msg = payload[:args.sizes.sample()]
+                # perf_counter time equivalent of the scheduled send.
+                inflight.append((time.perf_counter() - (time.monotonic() - t), msg))
+                ready.set()
+                writer.write(msg)
+                await writer.drain()
+        finally:
+            sent_all.set()
+            ready.set()
+
+    async def receiver():
+        while True:
+            if not inflight:
+                if sent_all.is_set():
+                    return
+                ready.clear()
+                await ready.wait()
+                continue
+            t_sched, msg = inflight[0]
+            echoed = await asyncio.wait_for(reader.readexactly(len(msg)), args.timeout)
+            inflight.popleft()
+            stats.record(time.perf_counter() - t_sched, len(msg))
+            if echoed != msg:
+                stats.errors += 1
+
+    tx = asyncio.ensure_future(sender())
+    try:
+        await receiver()
+    except (OSError, asyncio.TimeoutError, asyncio.IncompleteReadError):
+        stats.errors += 1
+    finally:
+        tx.cancel()
+        stats.lost += len(inflight)
+        writer.close()
+
+
+class UdpEcho(asyncio.DatagramProtocol):
+    def __init__(self, stats):
+        self.stats = stats
+        self.pending = {}
+        self.idle = asyncio.Event()
+
+    def datagram_received(self, data, addr):
+        if len(data) < UDP_HDR.size:
+            self.stats.errors += 1
+            return
+        (seq,) = UDP_HDR.unpack_from(data)
+        entry = self.pending.pop(seq, None)
+        if entry is None:
+            # Late echo of a message that already timed out.
+            return
+        t0, msg, waiter = entry
+        self.stats.record(time.perf_counter() - t0, len(data))
+        if data != msg:
+            self.stats.errors += 1
+        if waiter and not waiter.done():
+            waiter.set_result(None)
+        if not self.pending:
+            self.idle.set()
+
+
+async def udp_client(args, stats, deadline, payload):
+    loop = asyncio.get_running_loop()
+    transport, proto = await loop.create_datagram_endpoint(
+        lambda: UdpEcho(stats), remote_addr=(args.host, args.port))
+
+    def make_msg(seq):
+        size = max(UDP_HDR.size, args.sizes.sample())
+        return UDP_HDR.pack(seq) + payload[UDP_HDR.size:size]
+
+    seq = 0
+    try:
+        if args.rate:
+            for t in schedule(args, deadline):
+                if await sleep_until(t):
+                    stats.late_sends += 1
+                msg = make_msg(seq)
+                proto.idle.clear()
+                proto.pending[seq] = (time.perf_counter() - (time.monotonic() - t), msg, None)
+                transport.sendto(msg)
+                seq += 1
+            if proto.pending:
+                try:
+                    await asyncio.wait_for(proto.idle.wait(), args.timeout)
+                except asyncio.TimeoutError:
+                    pass
+            stats.lost += len(proto.pending)
+        else:
+            while time.monotonic() < deadline:
+                msg = make_msg(seq)
+                waiter = loop.create_future()
+                proto.pending[seq] = (time.perf_counter(), msg, waiter)
+                transport.sendto(msg)
+                try:
+                    await asyncio.wait_for(waiter, args.timeout)
+                except asyncio.TimeoutError:
+                    proto.pending.pop(seq, None)
+                    stats.lost += 1
+                seq += 1
+    finally:
+        transport.close()
+
+
+async def ticker(args, stats):
+    last = 0
+    while True:
+        await asyncio.sleep(args.interval)
+        n = stats.msgs
+        print(f"  {(n - last) / args.interval:10.1f} msg/s  p99 {stats.hist.value_at(99) / 1000:.2f} ms",
+              file=sys.stderr)
+        last = n
+
+
+def summary(args, stats, elapsed):
+    h = stats.hist
+    return {
+        "label": args.label,
+        "proto": "udp" if args.udp else "tcp",
+        "host": args.host,
+        "port": args.port,
+        "clients": args.clients,
+        "size": args.sizes.spec,
+        "rate": args.rate,
+        "duration_s": round(elapsed, 3),
+        "msgs": stats.msgs,
+        "msg_per_s": round(stats.msgs / elapsed, 1),
+        "kbit_per_s": round(stats.bytes * 8 / elapsed / 1000, 1),
+        "errors": stats.errors,
+        "lost": stats.lost,
+        "late_sends": stats.late_sends,
+        "lat_us": {
+            "min": h.min or 0,
+            "p50": h.value_at(50),
+            "p90": h.value_at(90),
+            "p99": h.value_at(99),
+            "p99.9": h.value_at(99.9),
+            "max": h.max,
+            "mean": round(h.mean(), 1),
+        },
+    }
+
+
+def report(s):
+    mode = f"open loop {s['rate']} msg/s" if s["rate"] else "closed loop"
+    lat = s["lat_us"]
+    print(f"{s['proto']} {s['host']}:{s['port']} clients={s['clients']} size={s['size']} ({mode})")
+    print(f"  messages   : {s['msgs']} in {s['duration_s']:.2f} s ({s['msg_per_s']:.1f} msg/s)")
+    print(f"  throughput : {s['kbit_per_s']:.1f} Kbit/s each way")
+    print(f"  errors     : {s['errors']}  lost: {s['lost']}  late sends: {s['late_sends']}")
+    if s["msgs"]:
+        print("  latency ms : p50 {:.2f}  p90 {:.2f}  p99 {:.2f}  p99.9 {:.2f}  max {:.2f}".format(
+            *(lat[k] / 1000 for k in ("p50", "p90", "p99", "p99.9", "max"))))
+
+
+async def run(args):
+    stats = Stats()
+    payload = os.urandom(args.sizes.max + UDP_HDR.size)
+    if args.udp:
+        client = udp_client
+    else:
+        client = tcp_open if args.rate else tcp_closed
+
+    tick = asyncio.ensure_future(ticker(args, stats)) if args.interval else None
+    t0 = time.monotonic()
+    deadline = t0 + args.duration
+    await asyncio.gather(*(client(args, stats, deadline, payload) for _ in range(args.clients)))
+    elapsed = time.monotonic() - t0
+    if tick:
+        tick.cancel()
+
+    s = summary(args, stats, elapsed)
+    report(s)
+
+    if args.hgrm:
+        with open(args.hgrm, "w") as f:
+            stats.hist.write_hgrm(f)
+    if args.json:
+        with open(args.json, "a") as f:
+            f.write(json.dumps(s) + "\n")
+
+    return 1 if stats.errors or stats.msgs == 0 else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="192.0.2.1")
+    parser.add_argument("--port", type=int, default=12001)
+    parser.add_argument("--clients", type=int, default=32, help="concurrent connections")
+    parser.add_argument("--size", dest="sizes", type=SizeDist, default=SizeDist("64"),
+                        help="message size or distribution (default 64)")
+    parser.add_argument("--rate", type=float, default=0,
+                        help="open loop: total messages/s across all clients")
+    parser.add_argument("--duration", type=float, default=10.0, help="seconds")
+    parser.add_argument("--timeout", type=float, default=2.0, help="per-message timeout (s)")
+    parser.add_argument("--udp", action="store_true", help="use UDP instead of TCP")
+    parser.add_argument("--interval", type=float, default=0,
+                        help="print progress every N seconds")
+    parser.add_argument("--hgrm", help="write the latency distribution (HdrHistogram format)")
+    parser.add_argument("--json", help="append a one-line JSON summary to this file")
+    parser.add_argument("--label", default="", help="label stored in the JSON summary")
+    args = parser.parse_args()
+    raise SystemExit(asyncio.run(run(args)))
+
+
+if __name__ == "__main__":
+    main()
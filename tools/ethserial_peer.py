@@ -0,0 +1,302 @@
+#!/usr/bin/env python3
+"""Host peer for the EthSerial link protocol, over a pty with error injection.
+
+Creates a pseudo terminal, links its slave end to --link (the serial-port of
+serialnet/boards/native_sim.overlay), and plays the host side of the link
+control protocol: option negotiation, baud requests, probe echoes and
+BAUD_OK commits. Data frames are only counted (this is a test peer, not a
+replacement for taptool).
+
+The pty carries no real line, so the peer models one. The device's rate is
+read back from the pty (the native_tty UART applies uart_configure() with
+tcsetattr). While the device and the peer disagree on the rate, every byte
+in both directions is garbled. Above --clean-max, bytes are corrupted at
+--ber, so the device should settle on the fastest rate not above it.
+--burst-at/--burst-len corrupt the line heavily for a while to exercise the
+fallback.
+
+Example, with the serialnet app built for native_sim with autobaud.conf:
+    ./ethserial_peer.py --link /tmp/ethserial0 --clean-max 921600 --ber 0.001
+"""
+import argparse
+import os
+import random
+import select
+import struct
+import termios
+import time
+import tty
+
+MAGIC = b"ESLC"
+VERSION = 1
+REQ, ACK, BAUD_REQ, BAUD_ACK, PROBE, BAUD_OK = range(1, 7)
+OPT_HDRCOMP, OPT_CRC, OPT_AUTOBAUD = 0x01, 0x02, 0x04
+# Header compression is not implemented here.
+PEER_OPTS = OPT_CRC | OPT_AUTOBAUD
+
+# BAUD_REVERT_MS and IDLE_RESET_MS in modules/EthSerial/EthSerial.c.
+BAUD_REVERT_S = 1.5
+IDLE_RESET_S = 6.0
+
+SLIP_END, SLIP_ESC, SLIP_ESC_END, SLIP_ESC_ESC = 0xC0, 0xDB, 0xDC, 0xDD
+
+RATES = {getattr(termios, f"B{r}"): r for r in
+         (9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600,
+          1000000, 1500000, 2000000, 3000000) if hasattr(termios, f"B{r}")}
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT as computed by Zephyr's crc16_ccitt() (reflected, no
+    final xor). Over a frame followed by its CRC (little-endian) it is 0."""
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    return crc
+
+
+def slip_encode(data):
+    out = bytearray([SLIP_END])
+    for b in data:
+        if b == SLIP_END:
+            out += bytes([SLIP_ESC, SLIP_ESC_END])
+        elif b == SLIP_ESC:
+            out += bytes([SLIP_ESC, SLIP_ESC_ESC])
+        else:
+            out.append(b)
+    out.append(SLIP_END)
+    return bytes(out)
+
+
+def slip_decode(data):
+    out = bytearray()
+    it = iter(data)
+    for b in it:
+        if b == SLIP_ESC:
+            nxt = next(it, None)
+            if nxt == SLIP_ESC_END:
+                out.append(SLIP_END)
+            elif nxt == SLIP_ESC_ESC:
+                out.append(SLIP_ESC)
+            else:
+                return None
+        else:
+            out.append(b)
+    return bytes(out)
+
+
+def cobs_encode(data):
+    out = bytearray([0, 0])
+    code_pos, code = 1, 1
+    for b in data:
+        if b == 0:
+            out[code_pos] = code
+            code_pos, code = len(out), 1
+            out.append(0)
+        else:
+            out.append(b)
+            code += 1
+            if code == 0xFF:
+                out[code_pos] = code
+                code_pos, code = len(out), 1
+                out.append(0)
+    out[code_pos] = code
+    out.append(0)
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    k = 0
+    while k < len(data):
+        code = data[k]
+        if code == 0 or k + code > len(data):
+            return None
+        out += data[k + 1:k + code]
+        k += code
+        if code != 0xFF and k < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class Peer:
+    def __init__(self, args):
+        self.args = args
+        self.cobs = args.cobs
+        self.delim = 0 if self.cobs else SLIP_END
+        self.encode = cobs_encode if self.cobs else slip_encode
+        self.decode = cobs_decode if self.cobs else slip_decode
+
+        self.master, self.slave = os.openpty()
+        tty.setraw(self.slave)
+        self.set_pty_rate(args.base)
+        if os.path.lexists(args.link):
+            os.unlink(args.link)
+        os.symlink(os.ttyname(self.slave), args.link)
+
+        self.rate = args.base
+        self.revert = None
+        self.prev_rate = args.base
+        self.crc_on = False
+        self.last_good = time.monotonic()
+        self.rxbuf = bytearray()
+        self.start = time.monotonic()
+        self.stats = dict(frames=0, ctl=0, crc_err=0, bad=0, probes=0, garbled=0)
+
+    def set_pty_rate(self, rate):
+        attrs = termios.tcgetattr(self.slave)
+        code = next(c for c, r in RATES.items() if r == rate)
+        attrs[4] = attrs[5] = code
+        termios.tcsetattr(self.slave, termios.TCSANOW, attrs)
+
+    def device_rate(self):
+        return RATES.get(termios.tcgetattr(self.master)[5], 0)
+
+    def log(self, msg):
+        if self.args.verbose:
+            print(f"{time.monotonic() - self.start:8.3f} {msg}")
+
+    def line(self, data):
+        """Model the line between the two UARTs."""
+        now = time.monotonic() - self.start
+        if self.device_rate() != self.rate:
+            self.stats["garbled"] += len(data)
+            return bytes(random.getrandbits(8) for _ in data)
+
+        ber = 0.0
+        if self.rate > self.args.clean_max:
+            ber = self.args.ber
+        if self.args.burst_at is not None and \
+                self.args.burst_at <= now < self.args.burst_at + self.args.burst_len:
+            ber = max(ber, 0.02)
+        if ber == 0.0:
+            return data
+        out = bytearray(data)
+        for k in range(len(out)):
+            if random.random() < ber:
+                out[k] ^= 1 << random.randrange(8)
+                self.stats["garbled"] += 1
+        return bytes(out)
+
+    def send_frame(self, payload, crc):
+        if crc:
+            payload += struct.pack("<H", crc16(payload))
+        os.write(self.master, self.line(self.encode(payload)))
+
+    def send_ctl(self, op, payload=b""):
+        self.send_frame(MAGIC + bytes([op]) + payload, True)
+
+    def switch(self, rate):
+        # The device switches when it gets the ack, so let the ack leave first.
+        termios.tcdrain(self.master)
+        self.prev_rate, self.rate = self.rate, rate
+        self.log(f"host now at {rate} baud")
+
+    def on_ctl(self, f):
+        op, p = f[4], f[5:]
+        self.stats["ctl"] += 1
+        if op in (REQ, ACK) and len(p) >= 3 and p[0] == VERSION:
+            opts = p[1] & PEER_OPTS
+            if op == REQ:
+                self.send_ctl(ACK, bytes([VERSION, opts, 0]))
+            self.crc_on = bool(opts & OPT_CRC)
+            self.log(f"link options {opts:#x}")
+        elif op == BAUD_REQ and len(p) == 4:
+            (rate,) = struct.unpack("<I", p)
+            if rate > self.args.max_baud or rate not in RATES.values():
+                self.send_ctl(BAUD_ACK, struct.pack("<I", 0))
+                return
+            self.send_ctl(BAUD_ACK, p)
+            self.switch(rate)
+            self.revert = time.monotonic() + BAUD_REVERT_S
+        elif op == BAUD_OK and len(p) == 4:
+            self.revert = None
+            self.send_ctl(BAUD_OK, p)
+            self.log(f"committed {self.rate} baud")
+        elif op == PROBE:
+            self.stats["probes"] += 1
+            self.send_ctl(PROBE, p)
+
+    def on_frame(self, enc):
+        f = self.decode(bytes(enc))
+        if f is None:
+            self.stats["bad"] += 1
+            return
+        ctl = f[:4] == MAGIC
+        if (ctl or self.crc_on) and (len(f) < 3 or crc16(f) != 0):
+            self.stats["crc_err"] += 1
+            return
+        self.last_good = time.monotonic()
+        if ctl:
+            self.on_ctl(f[:-2])
+        else:
+            self.stats["frames"] += 1
+
+    def poll(self):
+        now = time.monotonic()
+        if self.revert is not None and now >= self.revert:
+            self.log(f"no BAUD_OK, back to {self.prev_rate} baud")
+            self.revert = None
+            self.rate = self.prev_rate
+        if self.rate != self.args.base and now - self.last_good > IDLE_RESET_S:
+            self.log(f"link idle, back to {self.args.base} baud")
+            self.rate = self.args.base
+            self.revert = None
+
+    def run(self):
+        print(f"{self.args.link} -> {os.ttyname(self.slave)}, "
+              f"{'COBS' if self.cobs else 'SLIP'}, {self.args.base} baud")
+        self.send_ctl(REQ, bytes([VERSION, PEER_OPTS, 0]))
+        next_report = time.monotonic() + self.args.report
+        while True:
+            r, _, _ = select.select([self.master], [], [], 0.05)
+            if r:
+                try:
+                    data = os.read(self.master, 4096)
+                except OSError:
+                    data = b""
+                for b in self.line(data):
+                    if b == self.delim:
+                        if self.rxbuf:
+                            self.on_frame(self.rxbuf)
+                        self.rxbuf = bytearray()
+                    else:
+                        self.rxbuf.append(b)
+            self.poll()
+            if time.monotonic() >= next_report:
+                next_report += self.args.report
+                s = self.stats
+                print(f"{self.rate:8d} baud (device {self.device_rate()}): "
+                      f"{s['frames']} frames, {s['ctl']} control, {s['probes']} probes, "
+                      f"{s['crc_err']} crc errors, {s['bad']} bad, {s['garbled']} bytes garbled")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--link", default="/tmp/ethserial0", help="symlink to the pty")
+    parser.add_argument("--cobs", action="store_true", help="COBS framing (default SLIP)")
+    parser.add_argument("--base", type=int, default=115200, help="starting rate")
+    parser.add_argument("--max-baud", type=int, default=3000000,
+                        help="decline baud requests above this")
+    parser.add_argument("--clean-max", type=int, default=3000000,
+                        help="fastest rate without injected errors")
+    parser.add_argument("--ber", type=float, default=0.001,
+                        help="byte error rate above --clean-max")
+    parser.add_argument("--burst-at", type=float, help="seconds from start to an error burst")
+    parser.add_argument("--burst-len", type=float, default=2.0, help="burst length in seconds")
+    parser.add_argument("--report", type=float, default=2.0, help="seconds between reports")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    peer = Peer(args)
+    try:
+        peer.run()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.unlink(args.link)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""Scripted-device check of ethserial_peer.py.
+
+Plays the device side of the EthSerial link protocol against the peer over
+its pty, without Zephyr: option negotiation, control frames with a bad
+CRC, a committed rate switch, probe echoes, a declined rate, a switch that
+is never committed (the peer must go back), the idle reset to the base
+rate, and CRC-checked data frames. The peer's timeouts are scaled down so
+the run takes a few seconds.
+
+Example:
+    ./ethserial_peer_test.py
+    ./ethserial_peer_test.py --cobs
+"""
+import argparse
+import os
+import select
+import struct
+import sys
+import tempfile
+import termios
+import threading
+import time
+import tty
+
+import ethserial_peer as ep
+
+BASE = 115200
+MAX_BAUD = 921600
+
+
+class Device:
+    def __init__(self, link, cobs):
+        self.fd = os.open(link, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        self.delim = 0 if cobs else ep.SLIP_END
+        self.encode = ep.cobs_encode if cobs else ep.slip_encode
+        self.decode = ep.cobs_decode if cobs else ep.slip_decode
+        self.rxbuf = bytearray()
+        self.set_rate(BASE)
+
+    def set_rate(self, rate):
+        attrs = termios.tcgetattr(self.fd)
+        attrs[4] = attrs[5] = next(c for c, r in ep.RATES.items() if r == rate)
+        termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+
+    def send(self, payload, bad_crc=False):
+        crc = ep.crc16(payload) ^ (0x0101 if bad_crc else 0)
+        os.write(self.fd, self.encode(payload + struct.pack("<H", crc)))
+
+    def send_ctl(self, op, payload=b"", bad_crc=False):
+        self.send(ep.MAGIC + bytes([op]) + payload, bad_crc)
+
+    def recv_ctl(self, timeout=1.0):
+        """Next control frame with a good CRC as (op, payload), or None."""
+        end = time.monotonic() + timeout
+        while True:
+            while self.delim in self.rxbuf:
+                k = self.rxbuf.index(self.delim)
+                enc, self.rxbuf = bytes(self.rxbuf[:k]), self.rxbuf[k + 1:]
+                f = self.decode(enc) if enc else None
+                if f and f[:4] == ep.MAGIC and len(f) >= 7 and ep.crc16(f) == 0:
+                    return f[4], f[5:-2]
+            left = end - time.monotonic()
+            if left <= 0:
+                return None
+            r, _, _ = select.select([self.fd], [], [], left)
+            if r:
+                self.rxbuf += os.read(self.fd, 4096)
+
+    def drain(self, secs):
+        time.sleep(secs)
+        termios.tcflush(self.fd, termios.TCIFLUSH)
+        self.rxbuf = bytearray()
+
+
+failures = 0
+
+
+def check(cond, what):
+    global failures
+    print("%-4s %s" % ("ok" if cond else "FAIL", what))
+    if not cond:
+        failures += 1
+
+
+def rate(r):
+    return struct.pack("<I", r)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--cobs", action="store_true", help="COBS framing (default SLIP)")
+    args = ap.parse_args()
+
+    # Scaled down from the device's BAUD_REVERT_MS and IDLE_RESET_MS.
+    ep.BAUD_REVERT_S = 0.3
+    ep.IDLE_RESET_S = 0.6
+
+    link = os.path.join(tempfile.mkdtemp(), "ethserial0")
+    peer = ep.Peer(argparse.Namespace(
+        link=link, cobs=args.cobs, base=BASE, max_baud=MAX_BAUD,
+        clean_max=3000000, ber=0.0, burst_at=None, burst_len=0.0,
+        report=1e9, verbose=False))
+    dev = Device(link, args.cobs)
+    threading.Thread(target=peer.run, daemon=True).start()
+
+    ctl = dev.recv_ctl()
+    check(ctl == (ep.REQ, bytes([ep.VERSION, ep.PEER_OPTS, 0])),
+          "peer requests its options at start-up")
+
+    dev.send_ctl(ep.REQ, bytes([ep.VERSION, ep.OPT_HDRCOMP | ep.OPT_CRC | ep.OPT_AUTOBAUD, 4]))
+    check(dev.recv_ctl() == (ep.ACK, bytes([ep.VERSION, ep.OPT_CRC | ep.OPT_AUTOBAUD, 0])),
+          "ack drops header compression, keeps CRC and auto-baud")
+
+    dev.send_ctl(ep.PROBE, bytes(64), bad_crc=True)
+    check(dev.recv_ctl(0.3) is None and peer.stats["crc_err"] == 1,
+          "control frame with a bad CRC is ignored and counted")
+    check(peer.crc_on, "CRC on data frames after the ack")
+
+    dev.send_ctl(ep.BAUD_REQ, rate(460800))
+    check(dev.recv_ctl() == (ep.BAUD_ACK, rate(460800)), "460800 baud acked")
+    dev.set_rate(460800)
+    dev.send_ctl(ep.BAUD_OK, rate(460800))
+    check(dev.recv_ctl() == (ep.BAUD_OK, rate(460800)), "BAUD_OK echoed")
+    time.sleep(0.4)
+    check(peer.rate == 460800, "460800 baud kept once committed")
+
+    probe = struct.pack("<H", 7) + bytes(range(62))
+    dev.send_ctl(ep.PROBE, probe)
+    check(dev.recv_ctl() == (ep.PROBE, probe), "probe echoed unchanged")
+
+    dev.send_ctl(ep.BAUD_REQ, rate(2000000))
+    check(dev.recv_ctl() == (ep.BAUD_ACK, rate(0)) and peer.rate == 460800,
+          "rate above --max-baud declined")
+
+    # The ack arrives but the device stays put: both sides garble until the
+    # peer gives up on BAUD_OK.
+    dev.send_ctl(ep.BAUD_REQ, rate(921600))
+    check(dev.recv_ctl() == (ep.BAUD_ACK, rate(921600)), "921600 baud acked")
+    dev.drain(0.5)
+    check(peer.rate == 460800, "no BAUD_OK, peer back to 460800 baud")
+    dev.send_ctl(ep.PROBE, probe)
+    check(dev.recv_ctl() == (ep.PROBE, probe), "probe echoed after the revert")
+
+    frames = peer.stats["frames"]
+    dev.send(bytes(60))
+    dev.send(bytes(60), bad_crc=True)
+    time.sleep(0.2)
+    check(peer.stats["frames"] == frames + 1 and peer.stats["crc_err"] == 2,
+          "data frames CRC-checked")
+
+    dev.drain(1.0)
+    check(peer.rate == BASE, "idle link back to the base rate")
+    dev.set_rate(BASE)
+    dev.send_ctl(ep.PROBE, probe)
+    check(dev.recv_ctl() == (ep.PROBE, probe), "probe echoed at the base rate")
+
+    os.unlink(link)
+    print("%d failed" % failures)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
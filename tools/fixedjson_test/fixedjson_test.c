@@ -0,0 +1,232 @@
+/*******************************************************************************
+ *  @file: fixedjson_test.c
+ *
+ *  @brief: Host check of the FixedJson encoder (FixedJson.c).
+ *
+ *  Fixed structs are encoded and compared with the expected JSON: rounding
+ *  of sensor values (half away from zero, and no "-0"), the integer
+ *  limits, booleans, and escaped and NULL strings. Each is encoded again
+ *  into every smaller buffer, which must fail with -ENOMEM without writing
+ *  past the buffer.
+ *
+ *  Then random sensor values are written with FixedJson_putSensorValue()
+ *  at every number of decimals and compared with a 64-bit reference.
+ *
+ *  Usage: fixedjson_test [values [seed]]
+*******************************************************************************/
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FixedJson.h"
+
+#define ARRAY_LEN(a)    (sizeof(a) / sizeof((a)[0]))
+#define CANARY          0x5a
+
+typedef struct Record
+{
+    struct sensor_value temp;
+    struct sensor_value hum;
+    uint32_t n;
+    int32_t delta;
+    bool ok;
+    const char *name;
+} Record;
+
+static const FixedJson_Field fields[] = {
+    FIXEDJSON_FIELD(Record, temp, FIXEDJSON_SENSOR_VALUE, 2),
+    FIXEDJSON_FIELD(Record, hum, FIXEDJSON_SENSOR_VALUE, 0),
+    FIXEDJSON_FIELD(Record, n, FIXEDJSON_UINT32, 0),
+    FIXEDJSON_FIELD(Record, delta, FIXEDJSON_INT32, 0),
+    FIXEDJSON_FIELD_NAMED(Record, ok, "is_ok", FIXEDJSON_BOOL, 0),
+    FIXEDJSON_FIELD(Record, name, FIXEDJSON_STRING, 0),
+};
+
+static const struct
+{
+    Record rec;
+    const char *json;
+} cases[] = {
+    { { { 21, 574999 }, { 45, 500000 }, 12, INT32_MIN, true, "a\"b\\\n" },
+      "{\"temp\":21.57,\"hum\":46,\"n\":12,\"delta\":-2147483648,\"is_ok\":true,"
+      "\"name\":\"a\\\"b\\\\\\u000a\"}" },
+    { { { 0, -4000 }, { -3, -999999 }, 0, 0, false, NULL },
+      "{\"temp\":0.00,\"hum\":-4,\"n\":0,\"delta\":0,\"is_ok\":false,\"name\":null}" },
+    { { { 0, -5000 }, { 99, 999999 }, UINT32_MAX, INT32_MAX, true, "" },
+      "{\"temp\":-0.01,\"hum\":100,\"n\":4294967295,\"delta\":2147483647,"
+      "\"is_ok\":true,\"name\":\"\"}" },
+    { { { 23, 995000 }, { 0, 0 }, 1, -1, false, "x" },
+      "{\"temp\":24.00,\"hum\":0,\"n\":1,\"delta\":-1,\"is_ok\":false,\"name\":\"x\"}" },
+    { { { -40, -125000 }, { 0, -499999 }, 7, -7, true, "\t" },
+      "{\"temp\":-40.13,\"hum\":0,\"n\":7,\"delta\":-7,\"is_ok\":true,\"name\":\"\\u0009\"}" },
+};
+
+static int
+check_cases(void)
+{
+    char buf[160];
+    size_t k, size;
+
+    for (k = 0; k < ARRAY_LEN(cases); k++)
+    {
+        int len = (int)strlen(cases[k].json);
+        int ret;
+
+        ret = FixedJson_encode(fields, ARRAY_LEN(fields), &cases[k].rec, buf, sizeof(buf));
+        if (ret != len || strcmp(buf, cases[k].json) != 0)
+        {
+            printf("FAIL: case %zu: %d %s\n  expected %d %s\n", k, ret,
+                ret < 0 ? "" : buf, len, cases[k].json);
+            return 1;
+        }
+
+        /* Every buffer too small by at least one byte must fail, and stay
+           inside the buffer. */
+        for (size = 0; size <= (size_t)len; size++)
+        {
+            memset(buf, CANARY, sizeof(buf));
+            ret = FixedJson_encode(fields, ARRAY_LEN(fields), &cases[k].rec, buf, size);
+            if (ret != -ENOMEM || buf[size] != CANARY)
+            {
+                printf("FAIL: case %zu: %d into %zu bytes\n", k, ret, size);
+                return 1;
+            }
+        }
+    }
+
+    printf("check: %zu objects, and every short buffer\n", ARRAY_LEN(cases));
+    return 0;
+}
+
+static int
+check_bad_fields(void)
+{
+    FixedJson_Field bad = fields[0];
+    struct sensor_value val = { 1, 0 };
+    char buf[32];
+
+    bad.decimals = 7;
+    if (FixedJson_encode(&bad, 1, &cases[0].rec, buf, sizeof(buf)) != -EINVAL ||
+        FixedJson_putSensorValue(&val, 7, buf, sizeof(buf)) != -EINVAL)
+    {
+        printf("FAIL: 7 decimals accepted\n");
+        return 1;
+    }
+
+    bad = fields[0];
+    bad.type = FIXEDJSON_STRING + 1;
+    if (FixedJson_encode(&bad, 1, &cases[0].rec, buf, sizeof(buf)) != -EINVAL)
+    {
+        printf("FAIL: unknown field type accepted\n");
+        return 1;
+    }
+
+    printf("check: bad fields rejected\n");
+    return 0;
+}
+
+/** @brief val with decimals digits, rounded half away from zero, from its
+    value in millionths. */
+static void
+reference(const struct sensor_value *val, uint8_t decimals, char *out, size_t size)
+{
+    int64_t micro = (int64_t)val->val1 * 1000000 + val->val2;
+    uint64_t mag = (micro < 0) ? (uint64_t)-micro : (uint64_t)micro;
+    uint64_t scale = 1;
+    uint64_t q, unit = 1;
+    uint8_t k;
+
+    for (k = decimals; k < 6; k++)
+    {
+        scale *= 10;
+    }
+    for (k = 0; k < decimals; k++)
+    {
+        unit *= 10;
+    }
+
+    q = (mag + scale / 2) / scale;
+    if (decimals)
+    {
+        snprintf(out, size, "%s%" PRIu64 ".%0*" PRIu64, (micro < 0 && q) ? "-" : "",
+            q / unit, (int)decimals, q % unit);
+    }
+    else
+    {
+        snprintf(out, size, "%s%" PRIu64, (micro < 0 && q) ? "-" : "", q);
+    }
+}
+
+static int32_t
+rnd32(void)
+{
+    return (int32_t)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+}
+
+static int
+check_values(long count)
+{
+    long t;
+
+    for (t = 0; t < count; t++)
+    {
+        struct sensor_value val;
+        uint8_t decimals;
+
+        /* Mostly sensor-sized values, some at the limits. val2 has the
+           sign of val1, or its own when val1 is 0. */
+        val.val1 = (t % 8) ? rnd32() % 1000 : rnd32();
+        if (t % 16 == 1)
+        {
+            val.val1 = (t & 32) ? INT32_MAX : INT32_MIN + 1;
+        }
+        val.val2 = abs(rnd32() % 1000000);
+        if (val.val1 < 0 || (val.val1 == 0 && (rand() & 1)))
+        {
+            val.val2 = -val.val2;
+        }
+
+        for (decimals = 0; decimals <= 6; decimals++)
+        {
+            char buf[48], ref[48];
+            int ret;
+
+            ret = FixedJson_putSensorValue(&val, decimals, buf, sizeof(buf));
+            reference(&val, decimals, ref, sizeof(ref));
+            if (ret < 0 || (size_t)ret != strlen(ref) || memcmp(buf, ref, ret) != 0)
+            {
+                printf("FAIL: {%" PRId32 ", %" PRId32 "} with %u decimals: %.*s, expected %s\n",
+                    val.val1, val.val2, decimals, ret < 0 ? 0 : ret, buf, ref);
+                return 1;
+            }
+            if (FixedJson_putSensorValue(&val, decimals, buf, ret - 1) != -ENOMEM)
+            {
+                printf("FAIL: {%" PRId32 ", %" PRId32 "} fits in %d bytes\n",
+                    val.val1, val.val2, ret - 1);
+                return 1;
+            }
+        }
+    }
+
+    printf("check: %ld sensor values at 0 to 6 decimals\n", count);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    long count = (argc > 1) ? atol(argv[1]) : 200000;
+    unsigned seed = (argc > 2) ? (unsigned)atoi(argv[2]) : 1;
+
+    srand(seed);
+
+    if (check_cases() != 0 || check_bad_fields() != 0 || check_values(count) != 0)
+    {
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
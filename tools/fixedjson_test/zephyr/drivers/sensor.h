@@ -0,0 +1,13 @@
+/* Host stand-in for Zephyr's sensor.h: only what FixedJson uses. */
+#ifndef ZEPHYR_INCLUDE_DRIVERS_SENSOR_H_
+#define ZEPHYR_INCLUDE_DRIVERS_SENSOR_H_
+
+#include <stdint.h>
+
+struct sensor_value
+{
+    int32_t val1;
+    int32_t val2;
+};
+
+#endif
@@ -0,0 +1,603 @@
+/*******************************************************************************
+ *  @file: hdrcomp_test.c
+ *
+ *  @brief: Host round trip of the EthSerial header compression (HdrComp)
+ *  over a clean and a lossy link.
+ *
+ *  A generator plays several TCP/IPv4 flows (more than there are slots, so
+ *  contexts get replaced) with bulk data, pure ACKs, window updates,
+ *  retransmissions, duplicate ACKs, IP ID jumps, SYN/FIN and non-TCP
+ *  frames, with and without the timestamp option. Every frame goes through
+ *  HdrComp_compress() and HdrComp_decompress() / HdrComp_rxEnd() as
+ *  EthSerial does, and:
+ *
+ *  - on a clean link every frame must arrive bit-exact;
+ *  - a damaged frame (caught by the link CRC) calls HdrComp_rxToss(), after
+ *    which compressed frames must be refused until their context is
+ *    reloaded by an uncompressed frame;
+ *  - after a silently lost frame, a delivered frame that differs from the
+ *    one sent (other than in the IP ID, as in RFC 1144) must fail its TCP
+ *    checksum, so TCP drops it.
+ *
+ *  Usage: hdrcomp_test [segments [seed]]
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "HdrComp.h"
+
+#define MAX_FRAME   1514
+#define NUM_FLOWS   6
+#define ETH_HLEN    14
+#define IP_ID_OFF   (ETH_HLEN + 4)
+#define IP_CSUM_OFF (ETH_HLEN + 10)
+
+/* Per mille of frames damaged (CRC error) or silently lost on the lossy
+   link. */
+#define DAMAGE_PM   5
+#define LOSS_PM     5
+
+typedef struct Flow
+{
+    uint8_t addr[8];
+    uint8_t ports[4];
+    uint32_t seq;
+    uint32_t ack;
+    uint16_t win;
+    uint16_t ip_id;
+    uint32_t tsval;
+    uint32_t tsecr;
+    bool ts;
+    uint16_t last_payload;
+} Flow;
+
+typedef struct Link
+{
+    HdrComp tx;
+    HdrComp rx;
+    uint32_t frames;
+    uint32_t raw_bytes;
+    uint32_t wire_bytes;
+    uint32_t exact;
+    uint32_t ip_id_only;
+    uint32_t refused;
+    uint32_t csum_caught;
+    uint32_t damaged;
+    uint32_t lost;
+} Link;
+
+static Flow flows[NUM_FLOWS];
+
+static uint32_t
+rnd(uint32_t n)
+{
+    return (uint32_t)rand() % n;
+}
+
+static void
+put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void
+put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t
+sum16(uint32_t sum, const uint8_t *p, size_t len)
+{
+    size_t k;
+
+    for (k = 0; k + 1 < len; k += 2)
+    {
+        sum += ((uint32_t)p[k] << 8) | p[k + 1];
+    }
+    if (len & 1)
+    {
+        sum += (uint32_t)p[len - 1] << 8;
+    }
+    return sum;
+}
+
+static uint16_t
+fold(uint32_t sum)
+{
+    while (sum >> 16)
+    {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+/** @brief TCP checksum over the pseudo header and segment; 0 when the
+    segment's checksum field is correct. */
+static uint16_t
+tcp_csum(const uint8_t *frame, size_t frame_len)
+{
+    const uint8_t *ip = &frame[ETH_HLEN];
+    size_t tcp_len = frame_len - ETH_HLEN - 20;
+    uint32_t sum;
+
+    sum = sum16(0, &ip[12], 8);
+    sum += 6 + tcp_len;
+    return fold(sum16(sum, &ip[20], tcp_len));
+}
+
+static uint16_t
+ip_csum(const uint8_t *frame)
+{
+    return fold(sum16(0, &frame[ETH_HLEN], 20));
+}
+
+static void
+flow_init(Flow *fl, int n)
+{
+    memset(fl, 0, sizeof(*fl));
+    put32(&fl->addr[0], 0xC0A80701);
+    put32(&fl->addr[4], 0xC0A80702 + n);
+    put16(&fl->ports[0], 4242);
+    put16(&fl->ports[2], 40000 + rnd(20000));
+    fl->seq = rand();
+    fl->ack = rand();
+    fl->win = 64240;
+    fl->ip_id = rand();
+    fl->tsval = rand();
+    fl->tsecr = rand();
+    fl->ts = (n % 3) != 2;
+}
+
+/** @brief Build an Ethernet + IPv4 + TCP frame from the flow's state. */
+static size_t
+tcp_frame(uint8_t *f, const Flow *fl, uint8_t flags, size_t payload)
+{
+    size_t opts = fl->ts ? 12 : 0;
+    size_t len = ETH_HLEN + 20 + 20 + opts + payload;
+    uint8_t *ip = &f[ETH_HLEN];
+    uint8_t *tcp = &ip[20];
+    size_t k;
+
+    memcpy(&f[0], "\x02\x00\x00\x00\x00\x01\x02\x00\x00\x00\x00\x02", 12);
+    put16(&f[12], 0x0800);
+
+    ip[0] = 0x45;
+    ip[1] = 0;
+    put16(&ip[2], len - ETH_HLEN);
+    put16(&ip[4], fl->ip_id);
+    put16(&ip[6], 0x4000);
+    ip[8] = 64;
+    ip[9] = 6;
+    put16(&ip[10], 0);
+    memcpy(&ip[12], fl->addr, 8);
+    put16(&ip[10], ip_csum(f));
+
+    memcpy(&tcp[0], fl->ports, 4);
+    put32(&tcp[4], fl->seq);
+    put32(&tcp[8], fl->ack);
+    tcp[12] = (5 + opts / 4) << 4;
+    tcp[13] = flags;
+    put16(&tcp[14], fl->win);
+    put16(&tcp[16], 0);
+    put16(&tcp[18], 0);
+    if (fl->ts)
+    {
+        memcpy(&tcp[20], "\x01\x01\x08\x0a", 4);
+        put32(&tcp[24], fl->tsval);
+        put32(&tcp[28], fl->tsecr);
+    }
+    for (k = 0; k < payload; k++)
+    {
+        tcp[20 + opts + k] = rand();
+    }
+    put16(&tcp[16], tcp_csum(f, len));
+    return len;
+}
+
+/** @brief A small UDP datagram, which is always sent raw. */
+static size_t
+udp_frame(uint8_t *f)
+{
+    size_t len = ETH_HLEN + 20 + 8 + 1 + rnd(200);
+    size_t k;
+
+    memset(f, 0, ETH_HLEN + 28);
+    put16(&f[12], 0x0800);
+    f[ETH_HLEN] = 0x45;
+    put16(&f[ETH_HLEN + 2], len - ETH_HLEN);
+    f[ETH_HLEN + 8] = 64;
+    f[ETH_HLEN + 9] = 17;
+    for (k = ETH_HLEN + 28; k < len; k++)
+    {
+        f[k] = rand();
+    }
+    put16(&f[IP_CSUM_OFF], ip_csum(f));
+    return len;
+}
+
+/** @brief Next frame of a random flow, with the flow's state advanced. */
+static size_t
+next_frame(uint8_t *f)
+{
+    /* Three busy flows, the rest now and then, to exercise replacement. */
+    int n = (rnd(10) < 8) ? rnd(3) : 3 + rnd(NUM_FLOWS - 3);
+    Flow *fl = &flows[n];
+    uint8_t flags = 0x10;
+    size_t payload = 0;
+    uint32_t r = rnd(100);
+    size_t len;
+
+    fl->ip_id++;
+    fl->tsval += rnd(3);
+
+    if (r < 50)
+    {
+        /* Bulk data, full-sized most of the time. */
+        payload = rnd(4) ? 1448 : 1 + rnd(1448);
+        if (rnd(4) == 0)
+        {
+            flags |= 0x08;
+            fl->ack += rnd(200);
+        }
+    }
+    else if (r < 72)
+    {
+        fl->ack += 1 + rnd(3000);
+        fl->tsecr += rnd(3);
+        if (rnd(4) == 0)
+        {
+            fl->win += rnd(2) ? 1448 : -1448;
+        }
+    }
+    else if (r < 77)
+    {
+        /* Duplicate ACK: only the IP ID and TSval move. */
+        payload = 0;
+    }
+    else if (r < 82 && fl->last_payload > 0)
+    {
+        /* Retransmission of the previous segment. */
+        fl->seq -= fl->last_payload;
+        payload = fl->last_payload;
+    }
+    else if (r < 86)
+    {
+        fl->win = 1024 + rnd(60000);
+    }
+    else if (r < 89)
+    {
+        fl->ip_id += rnd(1000);
+        payload = 1 + rnd(100);
+    }
+    else if (r < 92)
+    {
+        return udp_frame(f);
+    }
+    else if (r < 93)
+    {
+        /* Close and reopen, which also changes the ports. */
+        len = tcp_frame(f, fl, 0x11, 0);
+        flow_init(fl, n);
+        return len;
+    }
+    else if (r < 94)
+    {
+        fl->ack += 100000;
+    }
+    else if (r < 95)
+    {
+        fl->tsecr += 70000;
+    }
+    else
+    {
+        payload = 1 + rnd(536);
+    }
+
+    len = tcp_frame(f, fl, flags, payload);
+    fl->seq += payload;
+    if (payload > 0)
+    {
+        fl->last_payload = payload;
+    }
+    return len;
+}
+
+/** @brief Compress a frame into wire, as EthSerial's TX path does. */
+static size_t
+link_send(Link *l, const uint8_t *f, size_t len, uint8_t *wire)
+{
+    uint8_t prefix[HDRCOMP_MAX_PREFIX];
+    size_t plen, skip;
+
+    plen = HdrComp_compress(&l->tx, f, len, len, prefix, &skip);
+    memcpy(wire, prefix, plen);
+    memcpy(&wire[plen], &f[skip], len - skip);
+    l->frames++;
+    l->raw_bytes += len;
+    l->wire_bytes += plen + len - skip;
+    return plen + len - skip;
+}
+
+/** @brief Rebuild a frame from wire, as EthSerial's RX path does.
+    @return Frame length, or a negative errno if it was refused. */
+static int
+link_recv(Link *l, const uint8_t *wire, size_t wire_len, uint8_t *f)
+{
+    uint8_t hdr[HDRCOMP_MAX_HDR];
+    size_t head = (wire_len < HDRCOMP_MAX_HDR + 2) ? wire_len : HDRCOMP_MAX_HDR + 2;
+    size_t consumed;
+    size_t len;
+    int hlen;
+
+    hlen = HdrComp_decompress(&l->rx, wire, head, hdr, &consumed);
+    if (hlen < 0)
+    {
+        return hlen;
+    }
+    memcpy(f, hdr, hlen);
+    memcpy(&f[hlen], &wire[consumed], wire_len - consumed);
+    len = hlen + wire_len - consumed;
+    if (len >= ETH_HLEN + 20)
+    {
+        HdrComp_rxEnd(&l->rx, len, &f[ETH_HLEN]);
+    }
+    return len;
+}
+
+/** @brief Run segments frames through a link dropping or damaging the
+    given per mille of them. */
+static int
+run(Link *l, int segments, int damage_pm, int loss_pm)
+{
+    static uint8_t sent[MAX_FRAME];
+    static uint8_t wire[MAX_FRAME + HDRCOMP_MAX_PREFIX];
+    static uint8_t got[MAX_FRAME + HDRCOMP_MAX_HDR];
+    int k;
+
+    memset(l, 0, sizeof(*l));
+    HdrComp_reset(&l->tx, HDRCOMP_SLOTS);
+    HdrComp_reset(&l->rx, HDRCOMP_SLOTS);
+    for (k = 0; k < NUM_FLOWS; k++)
+    {
+        flow_init(&flows[k], k);
+    }
+
+    for (k = 0; k < segments; k++)
+    {
+        size_t len = next_frame(sent);
+        size_t wire_len = link_send(l, sent, len, wire);
+        int r = rnd(1000);
+        int got_len;
+
+        if (r < damage_pm)
+        {
+            l->damaged++;
+            HdrComp_rxToss(&l->rx);
+            continue;
+        }
+        if (r < damage_pm + loss_pm)
+        {
+            l->lost++;
+            continue;
+        }
+
+        got_len = link_recv(l, wire, wire_len, got);
+        if (got_len < 0)
+        {
+            if (damage_pm + loss_pm == 0)
+            {
+                printf("FAIL: frame %d refused on a clean link\n", k);
+                return 1;
+            }
+            l->refused++;
+            continue;
+        }
+
+        if ((size_t)got_len == len && memcmp(got, sent, len) == 0)
+        {
+            l->exact++;
+            continue;
+        }
+
+        if ((size_t)got_len >= ETH_HLEN + 20 && ip_csum(got) != 0)
+        {
+            printf("FAIL: frame %d delivered with a bad IP checksum\n", k);
+            return 1;
+        }
+
+        if ((size_t)got_len == len && len > IP_CSUM_OFF + 2 &&
+            memcmp(got, sent, IP_ID_OFF) == 0 &&
+            memcmp(&got[IP_ID_OFF + 2], &sent[IP_ID_OFF + 2],
+                IP_CSUM_OFF - IP_ID_OFF - 2) == 0 &&
+            memcmp(&got[IP_CSUM_OFF + 2], &sent[IP_CSUM_OFF + 2],
+                len - IP_CSUM_OFF - 2) == 0)
+        {
+            l->ip_id_only++;
+            continue;
+        }
+
+        if (damage_pm + loss_pm == 0)
+        {
+            printf("FAIL: frame %d differs on a clean link\n", k);
+            return 1;
+        }
+        if ((size_t)got_len < ETH_HLEN + 40 || got[ETH_HLEN + 9] != 6 ||
+            tcp_csum(got, got_len) == 0)
+        {
+            printf("FAIL: frame %d mangled and not caught by the TCP checksum\n", k);
+            return 1;
+        }
+        l->csum_caught++;
+    }
+
+    return 0;
+}
+
+static void
+report(const char *name, const Link *l)
+{
+    const HdrComp_Stats *s = &l->tx.stats;
+
+    printf("%s link: %u frames (%u raw, %u uncompressed, %u compressed)\n",
+        name, l->frames, s->tx_raw, s->tx_uncomp, s->tx_comp);
+    printf("  %u bytes on the wire for %u (%.1f%%), %u header bytes saved\n",
+        l->wire_bytes, l->raw_bytes, 100.0 * l->wire_bytes / l->raw_bytes, s->tx_saved);
+    printf("  %u damaged, %u lost, %u exact, %u differ in IP ID only,\n"
+        "  %u refused until reload, %u caught by the TCP checksum\n\n",
+        l->damaged, l->lost, l->exact, l->ip_id_only, l->refused, l->csum_caught);
+}
+
+/** @brief Two flows share the link; a damaged frame must stop both from
+    delivering compressed frames until each is reloaded on its own. */
+static int
+check_reload(void)
+{
+    static uint8_t sent[MAX_FRAME];
+    static uint8_t wire[MAX_FRAME + HDRCOMP_MAX_PREFIX];
+    static uint8_t got[MAX_FRAME + HDRCOMP_MAX_HDR];
+    Link l;
+    Flow *a = &flows[0];
+    Flow *b = &flows[1];
+    size_t len, wire_len;
+    int k;
+
+    memset(&l, 0, sizeof(l));
+    HdrComp_reset(&l.tx, HDRCOMP_SLOTS);
+    HdrComp_reset(&l.rx, HDRCOMP_SLOTS);
+    flow_init(a, 0);
+    flow_init(b, 1);
+
+#define SEND(fl, payload)                                       \
+    do {                                                        \
+        (fl)->ip_id++;                                          \
+        len = tcp_frame(sent, (fl), 0x10, (payload));           \
+        (fl)->seq += (payload);                                 \
+        (fl)->last_payload = (payload);                         \
+        wire_len = link_send(&l, sent, len, wire);              \
+    } while (0)
+
+#define EXPECT(type, delivered)                                              \
+    do {                                                                     \
+        int n = link_recv(&l, wire, wire_len, got);                          \
+        if (wire[0] != (type) ||                                             \
+            (delivered) != (n == (int)len && memcmp(got, sent, len) == 0))   \
+        {                                                                    \
+            printf("FAIL: reload check, line %d (type %u, got %d)\n",        \
+                __LINE__, wire[0], n);                                       \
+            return 1;                                                        \
+        }                                                                    \
+    } while (0)
+
+    SEND(a, 1000);
+    EXPECT(HDRCOMP_T_UNCOMP, true);
+    SEND(b, 100);
+    EXPECT(HDRCOMP_T_UNCOMP, true);
+    for (k = 0; k < 3; k++)
+    {
+        SEND(a, 1000);
+        EXPECT(HDRCOMP_T_COMP, true);
+        SEND(b, 100);
+        EXPECT(HDRCOMP_T_COMP, true);
+    }
+
+    /* A's next segment is damaged on the link. */
+    SEND(a, 1000);
+    HdrComp_rxToss(&l.rx);
+
+    SEND(a, 1000);
+    EXPECT(HDRCOMP_T_COMP, false);
+    SEND(b, 100);
+    EXPECT(HDRCOMP_T_COMP, false);
+
+    /* A retransmits, which goes uncompressed and reloads its context... */
+    a->seq -= 2000;
+    SEND(a, 1000);
+    EXPECT(HDRCOMP_T_UNCOMP, true);
+    SEND(a, 1000);
+    EXPECT(HDRCOMP_T_COMP, true);
+
+    /* ...but not B's. */
+    SEND(b, 100);
+    EXPECT(HDRCOMP_T_COMP, false);
+    b->seq -= 100;
+    SEND(b, 100);
+    EXPECT(HDRCOMP_T_UNCOMP, true);
+    SEND(b, 100);
+    EXPECT(HDRCOMP_T_COMP, true);
+
+#undef SEND
+#undef EXPECT
+
+    printf("check: damaged frame tosses every context, each reloads on its own\n\n");
+    return 0;
+}
+
+/** @brief Random prefixes must be refused or decoded without running off
+    the buffers (build with -fsanitize=address to check). */
+static void
+fuzz(int rounds)
+{
+    static uint8_t in[HDRCOMP_MAX_HDR + 2];
+    uint8_t hdr[HDRCOMP_MAX_HDR];
+    HdrComp rx;
+    size_t consumed;
+    int k;
+
+    HdrComp_reset(&rx, HDRCOMP_SLOTS);
+    for (k = 0; k < rounds; k++)
+    {
+        size_t len = 1 + rnd(sizeof(in));
+        size_t j;
+
+        for (j = 0; j < len; j++)
+        {
+            in[j] = rand();
+        }
+        in[0] = rnd(4);
+        if (HdrComp_decompress(&rx, in, len, hdr, &consumed) >= 0 && consumed > len)
+        {
+            printf("FAIL: consumed %zu of %zu bytes\n", consumed, len);
+            exit(1);
+        }
+        rx.rx_slot = -1;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    static Link l;
+    int segments = (argc > 1) ? atoi(argv[1]) : 200000;
+    unsigned seed = (argc > 2) ? (unsigned)atoi(argv[2]) : 1;
+
+    srand(seed);
+    printf("%d slots, %d flows, %d segments, seed %u\n\n",
+        HDRCOMP_SLOTS, NUM_FLOWS, segments, seed);
+
+    if (check_reload() != 0)
+    {
+        return 1;
+    }
+
+    if (run(&l, segments, 0, 0) != 0)
+    {
+        return 1;
+    }
+    report("clean", &l);
+
+    if (run(&l, segments, DAMAGE_PM, LOSS_PM) != 0)
+    {
+        return 1;
+    }
+    report("lossy", &l);
+
+    fuzz(segments);
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Replay throughput of the MqttQueue spool against a local broker.
+
+Runs the offline/replay cycle on a device with CONFIG_MQTTQUEUE_SPOOL:
+
+  1. With no broker running, the device is told ("mqttq flood <n>") to
+     publish n numbered messages. They go to the spool.
+  2. A local mosquitto is started, and a subscriber (mqtt_sink.py) counts
+     the messages as the device reconnects and replays the spool.
+  3. The replay rate, and any gaps, reordering or duplicates, are printed,
+     followed by "mqttq show" from the device.
+
+The device must be configured with this host as
+CONFIG_MQTTQUEUE_SERVER_ADDR, and nothing else may be listening on the
+port. The rate is taken from the first to the last message received, so
+the reconnect backoff does not count.
+
+Example (oled_demo on /dev/ttyUSB0):
+    ./mqtt_replay_test.py --console /dev/ttyUSB0 --count 10000
+"""
+import argparse
+import os
+import select
+import subprocess
+import sys
+import termios
+import time
+
+import mqtt_sink
+
+
+def open_console(path, baud):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    attrs = termios.tcgetattr(fd)
+    speed = getattr(termios, "B%d" % baud)
+    attrs[4] = attrs[5] = speed
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return fd
+
+
+def command(fd, cmd, until=None, timeout=2.0):
+    """Send a shell command and return its output, read until the text
+    until appears or timeout seconds pass."""
+    os.write(fd, b"\r%s\r" % cmd.encode())
+    out = b""
+    end = time.monotonic() + timeout
+    while time.monotonic() < end:
+        r, _, _ = select.select([fd], [], [], 0.1)
+        if r:
+            out += os.read(fd, 1024)
+            if until and until.encode() in out:
+                break
+    return out.decode(errors="replace")
+
+
+def start_broker(port, topic):
+    broker = subprocess.Popen(["mosquitto", "-p", str(port)],
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    for _ in range(50):
+        try:
+            return broker, mqtt_sink.connect("127.0.0.1", port, "replay_test", topic)
+        except OSError:
+            time.sleep(0.1)
+    broker.kill()
+    sys.exit("mosquitto did not start")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--console", required=True, help="device shell tty")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--topic", default="room/temp_hum")
+    ap.add_argument("--count", type=int, default=10000)
+    ap.add_argument("--idle", type=float, default=60.0,
+                    help="give up after this many seconds without a message")
+    args = ap.parse_args()
+
+    fd = open_console(args.console, args.baud)
+    try:
+        command(fd, "mqttq reset")
+        print("Spooling %d messages (no broker)..." % args.count)
+        out = command(fd, "mqttq flood %d" % args.count, until="queued in",
+                      timeout=args.count / 50.0 + 10)
+        print(out.strip().splitlines()[-1] if out.strip() else "(no reply)")
+        # Let the thread move the last ones to the spool.
+        time.sleep(1.0)
+
+        broker, sock = start_broker(args.port, args.topic)
+        try:
+            c = mqtt_sink.Counter()
+            first, last = mqtt_sink.receive(sock, c, args.count, args.idle, report=False)
+        finally:
+            sock.close()
+            broker.terminate()
+            broker.wait()
+
+        if first is None:
+            print("No messages received.")
+        else:
+            span = max(last - first, 1e-6)
+            print("%d of %d messages in %.2f s: %.0f msg/s" %
+                  (c.total, args.count, span, c.total / span))
+            print("gaps %d, reordered %d, dups %d" % (c.gaps, c.reordered, c.dups))
+        print(command(fd, "mqttq show", until="last replay"))
+    finally:
+        os.close(fd)
+
+
+if __name__ == "__main__":
+    main()
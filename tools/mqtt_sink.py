@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""Subscribe to an MQTT topic and report message rate and ordering.
+
+A minimal MQTT 3.1.1 subscriber (no dependencies). Counts the messages on
+a topic and prints the rate once a second. For payloads that are
+a sequence number (as sent by "mqttq flood" on the device), or JSON with a
+"seq" field, it also reports sequence gaps and messages out of order.
+
+Subscribes with QoS 1, so the broker forwards QoS 1 publishes as QoS 1.
+A repeated seq (a resend after a reconnect) is counted as a duplicate.
+
+Example (broker on this host, device publishing to room/temp_hum):
+    mosquitto -v &
+    ./mqtt_sink.py --topic room/temp_hum
+    (on the device shell) mqttq flood 1000
+"""
+import argparse
+import json
+import socket
+import struct
+import time
+
+
+def encode_len(n):
+    out = bytearray()
+    while True:
+        b = n % 128
+        n //= 128
+        out.append(b | 0x80 if n else b)
+        if not n:
+            return bytes(out)
+
+
+def utf8(s):
+    b = s.encode()
+    return struct.pack("!H", len(b)) + b
+
+
+def recv_exact(sock, n):
+    buf = b""
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise ConnectionError("broker closed the connection")
+        buf += chunk
+    return buf
+
+
+def recv_packet(sock):
+    hdr = recv_exact(sock, 1)[0]
+    n, mult = 0, 1
+    while True:
+        b = recv_exact(sock, 1)[0]
+        n += (b & 0x7F) * mult
+        mult *= 128
+        if not b & 0x80:
+            break
+    return hdr, recv_exact(sock, n)
+
+
+def connect(host, port, client_id, topic):
+    sock = socket.create_connection((host, port))
+    var = utf8("MQTT") + bytes([4, 0x02]) + struct.pack("!H", 60)
+    body = var + utf8(client_id)
+    sock.sendall(bytes([0x10]) + encode_len(len(body)) + body)
+    hdr, body = recv_packet(sock)
+    if hdr >> 4 != 2 or body[1] != 0:
+        raise ConnectionError("CONNACK refused: %r" % body)
+
+    body = struct.pack("!H", 1) + utf8(topic) + bytes([1])
+    sock.sendall(bytes([0x82]) + encode_len(len(body)) + body)
+    hdr, body = recv_packet(sock)
+    if hdr >> 4 != 9:
+        raise ConnectionError("no SUBACK")
+    return sock
+
+
+class Counter:
+    def __init__(self):
+        self.total = 0
+        self.window = 0
+        self.expected = None
+        self.seen = set()
+        self.gaps = 0
+        self.reordered = 0
+        self.dups = 0
+
+    def add(self, payload):
+        self.total += 1
+        self.window += 1
+        try:
+            seq = json.loads(payload)
+            if isinstance(seq, dict):
+                seq = seq["seq"]
+            if not isinstance(seq, int):
+                return
+        except (ValueError, KeyError, TypeError):
+            return
+        if seq in self.seen:
+            self.dups += 1
+            return
+        self.seen.add(seq)
+        if self.expected is not None:
+            if seq > self.expected:
+                self.gaps += seq - self.expected
+            elif seq < self.expected:
+                self.reordered += 1
+                self.gaps = max(0, self.gaps - 1)
+        if self.expected is None or seq >= self.expected:
+            self.expected = seq + 1
+
+
+def receive(sock, c, count=0, idle=None, report=True):
+    """Count messages until count arrive, idle seconds pass without one,
+    or ^C. Returns the times of the first and last message."""
+    sock.settimeout(1.0)
+    first = last = None
+    start = tick = time.monotonic()
+    try:
+        while not count or c.total < count:
+            try:
+                hdr, body = recv_packet(sock)
+            except socket.timeout:
+                hdr = None
+            now = time.monotonic()
+            if hdr is not None and hdr >> 4 == 3:
+                qos = (hdr >> 1) & 3
+                tlen = struct.unpack("!H", body[:2])[0]
+                pos = 2 + tlen
+                if qos:
+                    msg_id = body[pos:pos + 2]
+                    pos += 2
+                    sock.sendall(bytes([0x40, 2]) + msg_id)
+                c.add(body[pos:])
+                first = first or now
+                last = now
+            if idle and now - (last or start) >= idle:
+                break
+            if now - tick >= 1.0:
+                if report:
+                    print("%8.1f msg/s  total %d  gaps %d  reordered %d  dups %d" %
+                          (c.window / (now - tick), c.total, c.gaps, c.reordered, c.dups))
+                c.window = 0
+                tick = now
+    except KeyboardInterrupt:
+        pass
+    return first, last
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--host", default="127.0.0.1")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--topic", default="room/temp_hum")
+    ap.add_argument("--count", type=int, default=0,
+                    help="stop after this many messages (0: run until ^C)")
+    args = ap.parse_args()
+
+    sock = connect(args.host, args.port, "mqtt_sink", args.topic)
+    c = Counter()
+    start = time.monotonic()
+    receive(sock, c, args.count)
+    elapsed = time.monotonic() - start
+    print("%d messages in %.1f s, gaps %d, reordered %d, dups %d" %
+          (c.total, elapsed, c.gaps, c.reordered, c.dups))
+
+
+if __name__ == "__main__":
+    main()
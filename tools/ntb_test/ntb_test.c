@@ -0,0 +1,299 @@
+/*******************************************************************************
+ *  @file: ntb_test.c
+ *
+ *  @brief: Host check of the UsbNcm NTB16 builder and parser (Ntb16.c).
+ *
+ *  Random frames are packed into NTBs of random negotiated sizes the way
+ *  UsbNcm's send path does, and parsed back: every frame must come out
+ *  unchanged and in order, and the NTB must end on a short packet. Damaged
+ *  and random NTBs must be rejected or parsed without reading outside the
+ *  block (build with -fsanitize=address to check).
+ *
+ *  Then prints, for a stream of equal frames with the NTBs filled as they
+ *  are under load, the USB transfers and bulk packets per 1000 frames for
+ *  ECM (one transfer per frame) and NCM, at full and high speed.
+ *
+ *  Usage: ntb_test [ntbs [seed]]
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Ntb16.h"
+
+#define FRAME_MIN   14
+#define FRAME_MAX   1514
+
+typedef struct Expect
+{
+    const uint8_t *block;
+    size_t block_len;
+    const uint8_t (*frames)[FRAME_MAX];
+    const size_t *lens;
+    int count;
+    int seen;
+    int errors;
+} Expect;
+
+static Ntb16_Tx ntb;
+static uint8_t frames[NTB16_TX_MAX_DATAGRAMS][FRAME_MAX];
+static size_t lens[NTB16_TX_MAX_DATAGRAMS];
+
+static uint32_t
+rnd(uint32_t n)
+{
+    return (uint32_t)rand() % n;
+}
+
+static void
+check_datagram(void *arg, const uint8_t *data, size_t len)
+{
+    Expect *e = (Expect *)arg;
+
+    if (data < e->block || data + len > e->block + e->block_len)
+    {
+        printf("FAIL: datagram outside the NTB\n");
+        exit(1);
+    }
+    if (e->frames == NULL)
+    {
+        e->seen++;
+        return;
+    }
+    if (e->seen >= e->count || len != e->lens[e->seen] ||
+        memcmp(data, e->frames[e->seen], len) != 0)
+    {
+        e->errors++;
+    }
+    e->seen++;
+}
+
+/** @brief Pack random frames into one NTB, as UsbNcm's send path does.
+    @return Number of frames. */
+static int
+pack(size_t max_size)
+{
+    int n = 0;
+
+    Ntb16_clear(&ntb);
+    for (;;)
+    {
+        size_t len = rnd(4) ? FRAME_MIN + rnd(FRAME_MAX - FRAME_MIN + 1) : FRAME_MIN + rnd(100);
+        size_t k;
+
+        if (!Ntb16_fits(&ntb, len, max_size))
+        {
+            break;
+        }
+        for (k = 0; k < len; k++)
+        {
+            frames[n][k] = rand();
+        }
+        lens[n] = len;
+        memcpy(Ntb16_next(&ntb), frames[n], len);
+        Ntb16_add(&ntb, len);
+        n++;
+    }
+    return n;
+}
+
+static int
+check_round_trip(int ntbs)
+{
+    uint16_t seq = 0;
+    int t;
+
+    for (t = 0; t < ntbs; t++)
+    {
+        size_t max_size = 2048 + rnd(NTB16_TX_SIZE - 2048 + 1);
+        size_t mps = rnd(2) ? 64 : 512;
+        uint32_t bad = 0;
+        Expect e = { 0 };
+        size_t total;
+        int n, ret;
+
+        n = pack(max_size);
+        if (n == 0)
+        {
+            printf("FAIL: no frame fits in %zu bytes\n", max_size);
+            return 1;
+        }
+        total = Ntb16_finish(&ntb, seq++, max_size, mps);
+
+        if (total > max_size || ((total % mps) == 0 && total != max_size))
+        {
+            printf("FAIL: NTB of %zu bytes (max %zu, mps %zu)\n", total, max_size, mps);
+            return 1;
+        }
+
+        e.block = ntb.buf;
+        e.block_len = total;
+        e.frames = (const uint8_t (*)[FRAME_MAX])frames;
+        e.lens = lens;
+        e.count = n;
+        ret = Ntb16_parse(ntb.buf, total, check_datagram, &e, &bad);
+        if (ret != n || e.seen != n || e.errors != 0 || bad != 0)
+        {
+            printf("FAIL: NTB %d: %d of %d frames back, %d differ, %u bad\n",
+                t, ret, n, e.errors, bad);
+            return 1;
+        }
+    }
+
+    printf("check: %d NTBs round-trip\n", ntbs);
+    return 0;
+}
+
+/** @brief Damaged NTBs: flipped bytes, truncation and random data. */
+static void
+check_damage(int ntbs)
+{
+    static uint8_t buf[NTB16_TX_SIZE];
+    uint32_t bad = 0;
+    uint32_t rejected = 0;
+    int t;
+
+    for (t = 0; t < ntbs; t++)
+    {
+        Expect e = { 0 };
+        size_t total;
+        int k, ret;
+
+        pack(NTB16_TX_SIZE);
+        total = Ntb16_finish(&ntb, t, NTB16_TX_SIZE, 512);
+        memcpy(buf, ntb.buf, total);
+
+        switch (t % 3)
+        {
+        case 0:
+            for (k = 0; k < 4; k++)
+            {
+                buf[rnd(total)] ^= 1 << rnd(8);
+            }
+            break;
+        case 1:
+            total = rnd(total);
+            break;
+        default:
+            for (k = 0; k < (int)total; k++)
+            {
+                buf[k] = rand();
+            }
+            if (rnd(2))
+            {
+                /* A valid NTH16 in front of garbage. */
+                memcpy(buf, ntb.buf, NTH16_LEN);
+            }
+            break;
+        }
+
+        e.block = buf;
+        e.block_len = total;
+        ret = Ntb16_parse(buf, total, check_datagram, &e, &bad);
+        if (ret < 0)
+        {
+            rejected++;
+        }
+    }
+
+    printf("check: %d damaged NTBs parsed in bounds, %u rejected, %u errors counted\n\n",
+        ntbs, rejected, bad);
+}
+
+/** @brief Bulk packets for a transfer of len bytes. A multiple of mps
+    needs a zero length packet to end it. */
+static uint32_t
+packets(size_t len, size_t mps)
+{
+    return len / mps + 1;
+}
+
+/** @brief NCM transfers, packets and bytes for 1000 frames of len bytes,
+    each NTB filled before it is sent. */
+static void
+ncm_stream(size_t len, size_t mps, uint32_t *xfers, uint32_t *pkts, uint32_t *bytes)
+{
+    int k;
+
+    *xfers = *pkts = *bytes = 0;
+    Ntb16_clear(&ntb);
+    for (k = 0; k <= 1000; k++)
+    {
+        size_t total;
+
+        if (k < 1000 && Ntb16_fits(&ntb, len, NTB16_TX_SIZE))
+        {
+            memset(Ntb16_next(&ntb), 0, len);
+            Ntb16_add(&ntb, len);
+            continue;
+        }
+        if (ntb.count == 0)
+        {
+            break;
+        }
+
+        total = Ntb16_finish(&ntb, 0, NTB16_TX_SIZE, mps);
+        (*xfers)++;
+        *pkts += (total == NTB16_TX_SIZE) ? (total + mps - 1) / mps : packets(total, mps);
+        *bytes += total;
+        Ntb16_clear(&ntb);
+        k--;
+    }
+}
+
+static void
+report(void)
+{
+    static const struct
+    {
+        size_t len;
+        const char *what;
+    } sizes[] = {
+        { 66, "TCP ACK with timestamps" },
+        { 106, "UDP, 64 byte payload" },
+        { 590, "UDP, 548 byte payload" },
+        { 1066, "UDP, 1 KiB payload" },
+        { 1514, "full-size frame" },
+    };
+    size_t k;
+
+    printf("Per 1000 frames, NTB %d bytes, up to %d frames per NTB:\n\n",
+        NTB16_TX_SIZE, NTB16_TX_MAX_DATAGRAMS);
+    printf("| Frame (bytes)                  | ECM transfers | NCM transfers "
+        "| ECM packets FS / HS | NCM packets FS / HS | NCM overhead |\n");
+    printf("|--------------------------------|---------------|---------------"
+        "|---------------------|---------------------|--------------|\n");
+    for (k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++)
+    {
+        size_t len = sizes[k].len;
+        uint32_t fs_x, fs_p, fs_b, hs_x, hs_p, hs_b;
+        char name[40];
+
+        ncm_stream(len, 64, &fs_x, &fs_p, &fs_b);
+        ncm_stream(len, 512, &hs_x, &hs_p, &hs_b);
+        snprintf(name, sizeof(name), "%zu, %s", len, sizes[k].what);
+        printf("| %-30s | %13u | %13u | %9u / %7u | %9u / %7u | %11.1f%% |\n",
+            name, 1000, hs_x,
+            1000 * packets(len, 64), 1000 * packets(len, 512),
+            fs_p, hs_p, 100.0 * (hs_b - 1000.0 * len) / (1000.0 * len));
+    }
+    printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    int ntbs = (argc > 1) ? atoi(argv[1]) : 3000;
+    unsigned seed = (argc > 2) ? (unsigned)atoi(argv[2]) : 1;
+
+    srand(seed);
+
+    if (check_round_trip(ntbs) != 0)
+    {
+        return 1;
+    }
+    check_damage(ntbs * 10);
+    report();
+
+    printf("OK\n");
+    return 0;
+}
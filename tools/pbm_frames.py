@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""Extract display frames from an oled_demo native_sim run.
+
+With CONFIG_SSD1306RAM_DUMP_FRAMES, the SSD1306 RAM emulator prints each
+finished frame to the console as a plain PBM image between "PBM <n>" and
+"PBM END" lines. This reads that console output (stdin or a file) and
+writes each frame to frame_NNN.pbm.
+
+With --golden, the frames are compared with the images of the same name in
+a directory instead, and the exit status is 1 if any differ or are
+missing. --update writes the frames into the golden directory.
+
+Examples:
+    ./build/zephyr/zephyr.exe --stop_at=3 | ../tools/pbm_frames.py --out frames
+    ../tools/pbm_frames.py console.log --golden golden
+    ../tools/pbm_frames.py console.log --golden golden --update
+"""
+import argparse
+import os
+import re
+import sys
+
+
+def read_frames(lines):
+    """Returns a list of (number, width, height, rows) for every complete
+    frame. rows holds one string of '0'/'1' per row."""
+    frames = []
+    cur = None
+    for line in lines:
+        line = line.strip()
+        m = re.match(r"PBM (\d+)$", line)
+        if m:
+            cur = (int(m.group(1)), [])
+            continue
+        if cur is None:
+            continue
+        if line == "PBM END":
+            num, body = cur
+            cur = None
+            tokens = " ".join(body).split()
+            if len(tokens) < 3 or tokens[0] != "P1":
+                print("frame %d: not a P1 image, skipped" % num, file=sys.stderr)
+                continue
+            width, height = int(tokens[1]), int(tokens[2])
+            bits = "".join(tokens[3:])
+            if len(bits) != width * height:
+                print("frame %d: %d pixels, expected %d, skipped" %
+                      (num, len(bits), width * height), file=sys.stderr)
+                continue
+            rows = [bits[y * width:(y + 1) * width] for y in range(height)]
+            frames.append((num, width, height, rows))
+        elif re.match(r"(P1|[\d ]+)$", line):
+            # Skips log lines printed in the middle of a dump.
+            cur[1].append(line)
+    return frames
+
+
+def pbm_text(width, height, rows):
+    return "P1\n%d %d\n%s\n" % (width, height, "\n".join(" ".join(r) for r in rows))
+
+
+def write_frames(frames, out):
+    os.makedirs(out, exist_ok=True)
+    for num, width, height, rows in frames:
+        with open(os.path.join(out, "frame_%03d.pbm" % num), "w") as f:
+            f.write(pbm_text(width, height, rows))
+
+
+def compare(frames, golden):
+    """Returns the number of frames that differ from or are missing in
+    golden."""
+    bad = 0
+    for num, width, height, rows in frames:
+        name = "frame_%03d.pbm" % num
+        path = os.path.join(golden, name)
+        if not os.path.exists(path):
+            print("%s: no golden image" % name)
+            bad += 1
+            continue
+        with open(path) as f:
+            ref = read_frames(["PBM %d" % num] + f.read().splitlines() + ["PBM END"])
+        if not ref or ref[0][1:3] != (width, height):
+            print("%s: size differs" % name)
+            bad += 1
+            continue
+        diff = sum(a != b for r, g in zip(rows, ref[0][3]) for a, b in zip(r, g))
+        if diff:
+            print("%s: %d pixels differ" % (name, diff))
+            bad += 1
+    return bad
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("log", nargs="?", help="console output (default: stdin)")
+    ap.add_argument("--out", default="frames", help="directory for the frames")
+    ap.add_argument("--golden", help="compare with the frames in this directory")
+    ap.add_argument("--update", action="store_true",
+                    help="write the frames into the --golden directory")
+    args = ap.parse_args()
+
+    if args.log:
+        with open(args.log, errors="replace") as f:
+            frames = read_frames(f)
+    else:
+        frames = read_frames(sys.stdin)
+    print("%d frames" % len(frames))
+
+    if args.golden and not args.update:
+        bad = compare(frames, args.golden)
+        print("%d of %d frames differ" % (bad, len(frames)))
+        sys.exit(1 if bad or not frames else 0)
+
+    write_frames(frames, args.golden if args.golden else args.out)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Decode oled_demo CBOR sensor payloads using the shared CDDL schema.
+
+Reads the map keys and value scaling from oled_demo/schema/
+sensor_reading.cddl, so the decoder follows the schema the device encodes
+with. Decodes payloads given as hex on the command line, or subscribes to
+the broker and decodes each message as it arrives.
+
+For each message it also prints the size of the same reading as JSON
+(the JSON payload format), for comparison.
+
+Examples:
+    ./sensor_decode.py --hex a201191bbf021911a0
+    ./sensor_decode.py --host 127.0.0.1 --topic room/temp_hum/cbor
+"""
+import argparse
+import os
+import re
+import struct
+
+import mqtt_sink
+
+SCHEMA = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                      "..", "oled_demo", "schema", "sensor_reading.cddl")
+
+
+def load_schema(path):
+    """Returns {key: (name, scale)} for the keys of every map in the
+    schema (sensor-reading and sensor-summary share theirs)."""
+    with open(path) as f:
+        text = re.sub(r";.*", "", f.read())
+    consts = dict((n, int(v)) for n, v in re.findall(r"^([\w-]+)\s*=\s*(\d+)\s*$", text, re.M))
+    fields = {}
+    for body in re.findall(r"[\w-]+\s*=\s*\{(.*?)\}", text, re.S):
+        for name, typ in re.findall(r"([\w-]+)\s*=>\s*([\w-]+)", body):
+            scale = 100 if typ.startswith("centi-") else 1
+            fields[consts[name]] = (name, scale)
+    return fields
+
+
+def cbor_decode(data, pos=0):
+    """Minimal CBOR decoder: ints, strings, arrays, maps, simple values.
+    Returns (value, next position)."""
+    ib = data[pos]
+    pos += 1
+    major, info = ib >> 5, ib & 0x1F
+    if major == 7:
+        return {20: False, 21: True, 22: None}.get(info), pos
+    if info < 24:
+        arg = info
+    elif info in (24, 25, 26, 27):
+        n = 1 << (info - 24)
+        arg = int.from_bytes(data[pos:pos + n], "big")
+        pos += n
+    elif info == 31:
+        arg = None
+    else:
+        raise ValueError("bad CBOR header 0x%02x" % ib)
+
+    if major == 0:
+        return arg, pos
+    if major == 1:
+        return -1 - arg, pos
+    if major in (2, 3):
+        raw = data[pos:pos + arg]
+        return (raw if major == 2 else raw.decode()), pos + arg
+    if major == 4:
+        out = []
+        while (arg is None and data[pos] != 0xFF) or (arg is not None and len(out) < arg):
+            v, pos = cbor_decode(data, pos)
+            out.append(v)
+        return out, pos + (1 if arg is None else 0)
+    if major == 5:
+        out = {}
+        while (arg is None and data[pos] != 0xFF) or (arg is not None and len(out) < arg):
+            k, pos = cbor_decode(data, pos)
+            out[k], pos = cbor_decode(data, pos)
+        return out, pos + (1 if arg is None else 0)
+    raise ValueError("unsupported CBOR major type %d" % major)
+
+
+def decode(fields, payload):
+    raw, _ = cbor_decode(payload)
+    reading = {}
+    for key, value in raw.items():
+        name, scale = fields.get(key, (str(key), 1))
+        reading[name] = value / scale if scale != 1 else value
+    return reading
+
+
+def show(fields, payload):
+    reading = decode(fields, payload)
+    # As FixedJson writes it: two decimals for scaled values.
+    as_json = "{%s}" % ",".join(
+        '"%s":%s' % (k, ("%.2f" % v) if isinstance(v, float) else v)
+        for k, v in reading.items())
+    print("%-60s cbor %2d bytes, json %2d bytes" % (
+        " ".join("%s=%s" % kv for kv in reading.items()), len(payload), len(as_json)))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--schema", default=SCHEMA)
+    ap.add_argument("--hex", nargs="*", help="payloads to decode")
+    ap.add_argument("--host", default="127.0.0.1")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--topic", default="room/temp_hum/cbor")
+    args = ap.parse_args()
+
+    fields = load_schema(args.schema)
+
+    if args.hex:
+        for h in args.hex:
+            show(fields, bytes.fromhex(h))
+        return
+
+    sock = mqtt_sink.connect(args.host, args.port, "sensor_decode", args.topic)
+    try:
+        while True:
+            hdr, body = mqtt_sink.recv_packet(sock)
+            if hdr >> 4 != 3:
+                continue
+            qos = (hdr >> 1) & 3
+            pos = 2 + struct.unpack("!H", body[:2])[0]
+            if qos:
+                sock.sendall(bytes([0x40, 2]) + body[pos:pos + 2])
+                pos += 2
+            show(fields, body[pos:])
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
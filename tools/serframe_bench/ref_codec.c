@@ -0,0 +1,127 @@
+/*******************************************************************************
+ *  @file: ref_codec.c
+ *
+ *  @brief: Byte-at-a-time SLIP and COBS reference codecs (the classic
+ *  per-byte loops the driver used before), for correctness and speed
+ *  comparison.
+*******************************************************************************/
+#include "ref_codec.h"
+#include "SerFrame.h"
+
+size_t
+ref_slip_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t pos = 0;
+    size_t k;
+
+    out[pos++] = SLIP_END;
+    for (k = 0; k < len; k++)
+    {
+        switch (in[k])
+        {
+        case SLIP_END:
+            out[pos++] = SLIP_ESC;
+            out[pos++] = SLIP_ESC_END;
+            break;
+        case SLIP_ESC:
+            out[pos++] = SLIP_ESC;
+            out[pos++] = SLIP_ESC_ESC;
+            break;
+        default:
+            out[pos++] = in[k];
+            break;
+        }
+    }
+    out[pos++] = SLIP_END;
+    return pos;
+}
+
+size_t
+ref_slip_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t pos = 0;
+    int esc = 0;
+    size_t k;
+
+    for (k = 0; k < len; k++)
+    {
+        uint8_t b = in[k];
+
+        if (esc)
+        {
+            out[pos++] = (b == SLIP_ESC_END) ? SLIP_END : SLIP_ESC;
+            esc = 0;
+        }
+        else if (b == SLIP_ESC)
+        {
+            esc = 1;
+        }
+        else if (b != SLIP_END)
+        {
+            out[pos++] = b;
+        }
+    }
+    return pos;
+}
+
+size_t
+ref_cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t code_pos = 1;
+    size_t pos = 2;
+    uint8_t code = 1;
+    size_t k;
+
+    out[0] = COBS_DELIM;
+    for (k = 0; k < len; k++)
+    {
+        if (in[k] == 0)
+        {
+            out[code_pos] = code;
+            code_pos = pos++;
+            code = 1;
+        }
+        else
+        {
+            out[pos++] = in[k];
+            if (++code == 0xFF)
+            {
+                out[code_pos] = code;
+                code_pos = pos++;
+                code = 1;
+            }
+        }
+    }
+    out[code_pos] = code;
+    out[pos++] = COBS_DELIM;
+    return pos;
+}
+
+size_t
+ref_cobs_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t pos = 0;
+    size_t k = 0;
+
+    /* Skip leading delimiter. */
+    while (k < len && in[k] == COBS_DELIM)
+    {
+        k++;
+    }
+
+    while (k < len && in[k] != COBS_DELIM)
+    {
+        uint8_t code = in[k++];
+        uint8_t i;
+
+        for (i = 1; i < code && k < len; i++)
+        {
+            out[pos++] = in[k++];
+        }
+        if (code != 0xFF && k < len && in[k] != COBS_DELIM)
+        {
+            out[pos++] = 0;
+        }
+    }
+    return pos;
+}
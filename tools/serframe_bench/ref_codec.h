@@ -0,0 +1,12 @@
+#ifndef REF_CODEC_H
+#define REF_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+size_t ref_slip_encode(const uint8_t *in, size_t len, uint8_t *out);
+size_t ref_slip_decode(const uint8_t *in, size_t len, uint8_t *out);
+size_t ref_cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+size_t ref_cobs_decode(const uint8_t *in, size_t len, uint8_t *out);
+
+#endif
@@ -0,0 +1,311 @@
+/*******************************************************************************
+ *  @file: serframe_bench.c
+ *
+ *  @brief: Host check and benchmark of the EthSerial SerFrame codecs against
+ *  byte-at-a-time reference codecs.
+ *
+ *  First checks that SerFrame produces the reference wire format and
+ *  round-trips randomly chunked input. Then reports encode and decode
+ *  throughput (MB/s of frame payload) for random, worst-case (every byte
+ *  escaped or zero) and best-case (no special bytes) payloads.
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "SerFrame.h"
+#include "ref_codec.h"
+
+#define MAX_FRAME   1514
+#define ENC_SIZE    SERFRAME_MAX_ENCODED(MAX_FRAME)
+#define MIN_SECS    0.25
+
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+
+typedef enum Payload
+{
+    PAYLOAD_RANDOM = 0,
+    PAYLOAD_WORST,
+    PAYLOAD_BEST,
+    NUM_PAYLOADS
+} Payload;
+
+static const char *payload_names[] = { "random", "worst", "best" };
+
+static uint8_t out_buf[ENC_SIZE];
+static size_t out_len;
+
+static void
+sink(void *arg, const uint8_t *data, size_t len)
+{
+    (void)arg;
+    memcpy(&out_buf[out_len], data, len);
+    out_len += len;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+fill(uint8_t *buf, size_t len, SerFrame_Type type, Payload payload)
+{
+    size_t k;
+
+    for (k = 0; k < len; k++)
+    {
+        uint8_t b = rand();
+
+        if (payload == PAYLOAD_WORST)
+        {
+            b = (type == SERFRAME_SLIP) ? ((b & 1) ? SLIP_END : SLIP_ESC) : 0;
+        }
+        else if (payload == PAYLOAD_BEST)
+        {
+            b = (b % 0x7F) + 1;
+        }
+        buf[k] = b;
+    }
+}
+
+static size_t
+new_encode(SerFrame_Type type, const uint8_t *in, size_t len, uint8_t *out)
+{
+    SerFrame_Encoder enc;
+
+    SerFrame_encodeBegin(&enc, type, out);
+    SerFrame_encodeFeed(&enc, in, len);
+    return SerFrame_encodeEnd(&enc);
+}
+
+static size_t
+new_decode(SerFrame_Type type, const uint8_t *in, size_t len)
+{
+    SerFrame_Decoder dec;
+    size_t k = 0;
+
+    SerFrame_decodeInit(&dec, type);
+    out_len = 0;
+    while (k < len)
+    {
+        bool frame_end;
+        k += SerFrame_decode(&dec, &in[k], len - k, sink, NULL, &frame_end);
+        if (frame_end && dec.len > 0)
+        {
+            break;
+        }
+        if (frame_end)
+        {
+            SerFrame_decodeNext(&dec);
+        }
+    }
+    return out_len;
+}
+
+static size_t
+ref_encode(SerFrame_Type type, const uint8_t *in, size_t len, uint8_t *out)
+{
+    return (type == SERFRAME_SLIP) ?
+        ref_slip_encode(in, len, out) : ref_cobs_encode(in, len, out);
+}
+
+static size_t
+ref_decode(SerFrame_Type type, const uint8_t *in, size_t len)
+{
+    return (type == SERFRAME_SLIP) ?
+        ref_slip_decode(in, len, out_buf) : ref_cobs_decode(in, len, out_buf);
+}
+
+/** @brief Randomized check against the reference, with the input split at
+    random points on both sides. */
+static int
+check(void)
+{
+    static uint8_t in[MAX_FRAME];
+    static uint8_t enc_new[ENC_SIZE];
+    static uint8_t enc_ref[ENC_SIZE];
+    int type, t;
+
+    for (type = 0; type < 2; type++)
+    {
+        for (t = 0; t < 20000; t++)
+        {
+            size_t len = rand() % (MAX_FRAME + 1);
+            Payload payload = rand() % NUM_PAYLOADS;
+            SerFrame_Encoder enc;
+            SerFrame_Decoder dec;
+            size_t n_ref, n_new, pos;
+            int frames = 0;
+
+            fill(in, len, type, payload);
+            if (payload == PAYLOAD_RANDOM && (t & 1))
+            {
+                /* Sprinkle zeros and SLIP specials into random data. */
+                size_t k;
+                for (k = 0; k < len / 8; k++)
+                {
+                    in[rand() % len] = (uint8_t[]){ 0, SLIP_END, SLIP_ESC }[rand() % 3];
+                }
+            }
+
+            n_ref = ref_encode(type, in, len, enc_ref);
+
+            SerFrame_encodeBegin(&enc, type, enc_new);
+            for (pos = 0; pos < len;)
+            {
+                size_t n = rand() % 200;
+                n = MIN(len - pos, n);
+                SerFrame_encodeFeed(&enc, &in[pos], n);
+                pos += n;
+            }
+            n_new = SerFrame_encodeEnd(&enc);
+
+            if (n_new != n_ref || memcmp(enc_new, enc_ref, n_ref) != 0)
+            {
+                printf("FAIL: %s encode differs from reference (len %zu, %s)\n",
+                    type == SERFRAME_SLIP ? "slip" : "cobs", len, payload_names[payload]);
+                return 1;
+            }
+
+            SerFrame_decodeInit(&dec, type);
+            out_len = 0;
+            for (pos = 0; pos < n_new;)
+            {
+                size_t n = 1 + rand() % 64;
+                n = MIN(n_new - pos, n);
+                size_t off = 0;
+                while (off < n)
+                {
+                    bool frame_end;
+                    off += SerFrame_decode(&dec, &enc_new[pos + off], n - off,
+                        sink, NULL, &frame_end);
+                    if (frame_end)
+                    {
+                        if (dec.len > 0)
+                        {
+                            frames++;
+                            if (dec.bad || out_len != len || memcmp(out_buf, in, len) != 0)
+                            {
+                                printf("FAIL: %s decode mismatch (len %zu, %s)\n",
+                                    type == SERFRAME_SLIP ? "slip" : "cobs",
+                                    len, payload_names[payload]);
+                                return 1;
+                            }
+                        }
+                        SerFrame_decodeNext(&dec);
+                    }
+                }
+                pos += n;
+            }
+
+            if (frames != (len > 0))
+            {
+                printf("FAIL: %s got %d frames for len %zu\n",
+                    type == SERFRAME_SLIP ? "slip" : "cobs", frames, len);
+                return 1;
+            }
+        }
+    }
+
+    printf("check: SerFrame matches reference wire format and round-trips\n\n");
+    return 0;
+}
+
+static double
+rate(double bytes, double secs)
+{
+    return bytes / secs / 1e6;
+}
+
+static void
+bench(SerFrame_Type type, Payload payload, size_t len)
+{
+    static uint8_t in[MAX_FRAME];
+    static uint8_t enc[ENC_SIZE];
+    double t0, el;
+    size_t enc_len = 0;
+    long iters, k;
+    double r[4];
+    int impl;
+
+    fill(in, len, type, payload);
+
+    for (impl = 0; impl < 2; impl++)
+    {
+        /* Encode */
+        iters = 0;
+        t0 = now();
+        do
+        {
+            for (k = 0; k < 1000; k++)
+            {
+                enc_len = impl ? new_encode(type, in, len, enc) : ref_encode(type, in, len, enc);
+            }
+            iters += 1000;
+            el = now() - t0;
+        } while (el < MIN_SECS);
+        r[impl * 2] = rate((double)iters * len, el);
+
+        /* Decode */
+        iters = 0;
+        t0 = now();
+        do
+        {
+            for (k = 0; k < 1000; k++)
+            {
+                if (impl)
+                {
+                    new_decode(type, enc, enc_len);
+                }
+                else
+                {
+                    ref_decode(type, enc, enc_len);
+                }
+            }
+            iters += 1000;
+            el = now() - t0;
+        } while (el < MIN_SECS);
+        r[impl * 2 + 1] = rate((double)iters * len, el);
+    }
+
+    printf("%-5s %-7s %5zu  %8.1f %8.1f %5.1fx  %8.1f %8.1f %5.1fx\n",
+        type == SERFRAME_SLIP ? "slip" : "cobs",
+        payload_names[payload],
+        len,
+        r[0], r[2], r[2] / r[0],
+        r[1], r[3], r[3] / r[1]);
+}
+
+int
+main(void)
+{
+    static const size_t sizes[] = { 64, 1500 };
+    int type, payload;
+    size_t s;
+
+    srand(1);
+
+    if (check())
+    {
+        return 1;
+    }
+
+    printf("MB/s of payload       %8s %8s %6s  %8s %8s %6s\n",
+        "enc ref", "enc new", "", "dec ref", "dec new", "");
+    for (type = 0; type < 2; type++)
+    {
+        for (payload = 0; payload < NUM_PAYLOADS; payload++)
+        {
+            for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            {
+                bench(type, payload, sizes[s]);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""UDP packets-per-second benchmark for the echo servers on port 12001.
+
+Small datagrams are sent at a fixed rate (or as fast as possible with
+--rate 0) from one socket, and a second thread counts the echoes. For each
+offered rate the tool prints the transmitted and echoed packets per second
+and the loss. The highest rate echoed with little or no loss is the server's
+capacity.
+
+Example, comparing echo_server with and without CONFIG_ECHOREACTOR_UDP_BATCH
+on qemu_x86 (see echo_server/README.md):
+    ./udp_pps.py --host 192.0.2.1 --size 32 --rates 1000,2000,5000,10000,20000
+"""
+import argparse
+import socket
+import struct
+import threading
+import time
+
+SEQ = struct.Struct("!Q")
+
+
+def receiver(sock, result, stop):
+    count = 0
+    seen = set()
+    dups = 0
+    sock.settimeout(0.1)
+    while not stop.is_set():
+        try:
+            data = sock.recv(65536)
+        except socket.timeout:
+            continue
+        except OSError:
+            break
+        if len(data) >= SEQ.size:
+            (seq,) = SEQ.unpack_from(data)
+            if seq in seen:
+                dups += 1
+                continue
+            seen.add(seq)
+        count += 1
+    result["rx"] = count
+    result["dups"] = dups
+
+
+def run_rate(args, rate):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 * 1024 * 1024)
+    sock.connect((args.host, args.port))
+
+    result = {}
+    stop = threading.Event()
+    rx = threading.Thread(target=receiver, args=(sock, result, stop))
+    rx.start()
+
+    pad = bytes(max(0, args.size - SEQ.size))
+    sent = 0
+    t0 = time.perf_counter()
+    end = t0 + args.duration
+    while True:
+        now = time.perf_counter()
+        if now >= end:
+            break
+        if rate:
+            # Send whatever is due, then sleep briefly.
+            due = int((now - t0) * rate)
+            while sent < due:
+                try:
+                    sock.send(SEQ.pack(sent) + pad)
+                except OSError:
+                    pass
+                sent += 1
+            time.sleep(0.0005)
+        else:
+            try:
+                sock.send(SEQ.pack(sent) + pad)
+            except OSError:
+                pass
+            sent += 1
+    elapsed = time.perf_counter() - t0
+
+    # Let the last echoes arrive.
+    time.sleep(args.drain)
+    stop.set()
+    rx.join()
+    sock.close()
+
+    received = result.get("rx", 0)
+    loss = 100.0 * (sent - received) / sent if sent else 0.0
+    return sent / elapsed, received / elapsed, loss, result.get("dups", 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="192.0.2.1")
+    parser.add_argument("--port", type=int, default=12001)
+    parser.add_argument("--size", type=int, default=32, help="datagram size in bytes")
+    parser.add_argument("--rates", default="0",
+                        help="comma separated offered rates in pkt/s (0 = as fast as possible)")
+    parser.add_argument("--duration", type=float, default=5.0, help="seconds per rate")
+    parser.add_argument("--drain", type=float, default=1.0,
+                        help="seconds to wait for echoes after sending stops")
+    args = parser.parse_args()
+
+    print(f"udp {args.host}:{args.port} size={args.size}")
+    print(f"{'offered':>10} {'tx pkt/s':>10} {'rx pkt/s':>10} {'loss %':>8}")
+    for rate in (int(r) for r in args.rates.split(",")):
+        tx, rx, loss, dups = run_rate(args, rate)
+        offered = str(rate) if rate else "max"
+        line = f"{offered:>10} {tx:10.0f} {rx:10.0f} {loss:8.2f}"
+        if dups:
+            line += f"  ({dups} duplicates)"
+        print(line)
+
+
+if __name__ == "__main__":
+    main()
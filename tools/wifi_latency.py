@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Inbound latency of a WiFi station under each WifiFast power profile.
+
+Pings the device at a slow rate (by default one request every 1.5 s, so
+the station has time to doze between requests, as it would between
+sporadic RPC calls) and reports the round trip percentiles. With
+--console, the tool first switches the profile on the device shell
+("wififast profile <name>") and then measures each profile in turn.
+Without it, it measures whatever profile is set.
+
+Power save delays a request until the station next wakes. The spread
+between p50 and max shows this: with "balanced", it is about one DTIM
+period; with "idle", about the listen interval.
+
+Uses the system ping, so no root access is needed.
+
+Example (wifi_sta on /dev/ttyUSB0, device at 192.168.1.188):
+    ./wifi_latency.py --host 192.168.1.188 --console /dev/ttyUSB0 --count 40
+"""
+import argparse
+import os
+import re
+import subprocess
+import termios
+import time
+
+PROFILES = ("interactive", "balanced", "idle")
+RTT = re.compile(r"time=([\d.]+) ms")
+
+
+def set_profile(console, baud, profile):
+    fd = os.open(console, os.O_RDWR | os.O_NOCTTY)
+    try:
+        attrs = termios.tcgetattr(fd)
+        speed = getattr(termios, "B%d" % baud)
+        attrs[4] = attrs[5] = speed
+        termios.tcsetattr(fd, termios.TCSANOW, attrs)
+        os.write(fd, b"\rwififast profile %s\r" % profile.encode())
+        termios.tcdrain(fd)
+    finally:
+        os.close(fd)
+    # Let the driver apply it before timing.
+    time.sleep(1.0)
+
+
+def measure(host, count, interval, timeout):
+    cmd = ["ping", "-n", "-c", str(count), "-i", str(interval), "-W", str(timeout), host]
+    out = subprocess.run(cmd, capture_output=True, text=True).stdout
+    return [float(m) for m in RTT.findall(out)]
+
+
+def pct(values, p):
+    if not values:
+        return float("nan")
+    k = min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))
+    return values[k]
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--host", required=True)
+    ap.add_argument("--console", help="device shell tty, to switch profiles")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--profiles", default=",".join(PROFILES),
+                    help="profiles to measure (with --console)")
+    ap.add_argument("--count", type=int, default=40)
+    ap.add_argument("--interval", type=float, default=1.5,
+                    help="seconds between requests")
+    ap.add_argument("--timeout", type=int, default=2, help="per reply, seconds")
+    args = ap.parse_args()
+
+    profiles = args.profiles.split(",") if args.console else ["(current)"]
+
+    print("%-12s %5s %5s %8s %8s %8s %8s" %
+          ("profile", "sent", "lost", "min ms", "p50 ms", "p90 ms", "max ms"))
+    for profile in profiles:
+        if args.console:
+            set_profile(args.console, args.baud, profile)
+        rtts = sorted(measure(args.host, args.count, args.interval, args.timeout))
+        print("%-12s %5d %5d %8.1f %8.1f %8.1f %8.1f" % (
+            profile, args.count, args.count - len(rtts),
+            rtts[0] if rtts else float("nan"),
+            pct(rtts, 50), pct(rtts, 90),
+            rtts[-1] if rtts else float("nan")))
+
+
+if __name__ == "__main__":
+    main()
@@ -15,6 +15,8 @@
 #include <zephyr/net/net_event.h>
 #include <zephyr/net/conn_mgr_monitor.h>
 
+#include "BootSeq.h"
+
 /** @brief Initialize the logging module. */
 LOG_MODULE_REGISTER(app, LOG_LEVEL_DBG);
 
@@ -25,7 +27,40 @@ LOG_MODULE_REGISTER(app, LOG_LEVEL_DBG);
 static struct net_mgmt_event_callback mgmt_cb;
 static bool connected = false;
 
-static K_SEM_DEFINE(run_app, 0, 1);
+/** @brief Start-up phases. USB enumeration and the address setup run in
+    parallel; nothing waits in main(). */
+enum
+{
+    PH_USB = 0,
+    PH_IP,
+    PH_NET_CONFIG,
+    PH_L4_CONNECTED,
+    PH_NET_READY,
+    PH_FIRST_PING,
+    PH_REPORT,
+    NUM_PHASES
+};
+
+static int init_usb(void *arg);
+static int init_ip(void *arg);
+static int init_net_config(void *arg);
+static int net_ready(void *arg);
+static int boot_report(void *arg);
+
+static BootSeq boot;
+static BootSeq_Phase phases[NUM_PHASES] = {
+    [PH_USB] = { .name = "usb", .fn = init_usb },
+    [PH_IP] = { .name = "ip", .fn = init_ip },
+    [PH_NET_CONFIG] = { .name = "net_config", .fn = init_net_config, .deps = BIT(PH_IP) },
+    [PH_L4_CONNECTED] = { .name = "l4_connected" },
+    [PH_NET_READY] = {
+        .name = "net_ready",
+        .fn = net_ready,
+        .deps = BIT(PH_USB) | BIT(PH_NET_CONFIG) | BIT(PH_L4_CONNECTED)
+    },
+    [PH_FIRST_PING] = { .name = "first_ping" },
+    [PH_REPORT] = { .name = "report", .fn = boot_report, .deps = BIT(PH_FIRST_PING) },
+};
 
 #define IPADDR(o1,o2,o3,o4)   { { { (o1), (o2), (o3), (o4) } } };
 
@@ -34,10 +69,12 @@ static struct in_addr my_netmask = IPADDR(255, 255, 255, 0);
 static struct in_addr my_gw = IPADDR(192, 0, 2, 2);
 
 static int
-init_usb(void)
+init_usb(void *arg)
 {
     int ret;
 
+    ARG_UNUSED(arg);
+
     LOG_DBG("Initializing usb.");
 
     ret = usb_enable(NULL);
@@ -50,22 +87,59 @@ init_usb(void)
     return 0;
 }
 
-static void
-init_ip(void)
+static int
+init_ip(void *arg)
 {
     struct net_if *iface = net_if_get_default();
     struct net_if_addr *ifaddr;
 
+    ARG_UNUSED(arg);
+
     LOG_DBG("Setting IP address.");
     ifaddr = net_if_ipv4_addr_add(iface, &my_ipv4_addr, NET_ADDR_MANUAL, 0);
     if (!ifaddr)
     {
         LOG_ERR("Error setting IP address");
-        return;
+        return -EINVAL;
     }
 
     net_if_ipv4_set_netmask(iface, &my_netmask);
     net_if_ipv4_set_gw(iface, &my_gw);
+    return 0;
+}
+
+static int
+init_net_config(void *arg)
+{
+    int ret;
+
+    ARG_UNUSED(arg);
+
+    ret = net_config_init_app(NULL, "Initializing network");
+    if (ret < 0)
+    {
+        LOG_ERR("Failed network init (%d)", ret);
+    }
+    return ret;
+}
+
+static int
+net_ready(void *arg)
+{
+    ARG_UNUSED(arg);
+
+    LOG_INF("Network connected.");
+    return 0;
+}
+
+/** @brief Log the start-up timeline once the first request has been served. */
+static int
+boot_report(void *arg)
+{
+    ARG_UNUSED(arg);
+
+    BootSeq_log(&boot);
+    return 0;
 }
 
 static void
@@ -85,7 +159,6 @@ event_handler(
     case NET_EVENT_L4_CONNECTED:
         LOG_DBG("NET_EVENT_L4_CONNECTED");
         connected = true;
-        k_sem_give(&run_app);
         break;
     case NET_EVENT_L4_DISCONNECTED:
         LOG_DBG("NET_EVENT_L4_DISCONNECTED");
@@ -94,8 +167,6 @@ event_handler(
             LOG_INF("Network disconnected event");
             connected = false;
         }
-        LOG_DBG("Resetting sem.");
-        k_sem_reset(&run_app);
         break;
     case NET_EVENT_L4_IPV4_CONNECTED:
         LOG_DBG("NET_EVENT_L4_IPV4_CONNECTED");
@@ -116,6 +187,7 @@ event_handler(
 
 }
 
+/** @brief Start the bring-up. Returns without waiting for it. */
 static int
 init_app(void)
 {
@@ -129,21 +201,16 @@ init_app(void)
 
     net_mgmt_init_event_callback(&mgmt_cb, event_handler, EVENT_MASK);
     net_mgmt_add_event_callback(&mgmt_cb);
-    conn_mgr_mon_resend_status();
-
-    init_usb();
-
-    init_ip();
 
-    ret = net_config_init_app(NULL, "Initializing network");
+    ret = BootSeq_init(&boot, phases, NUM_PHASES);
     if (ret < 0)
     {
-        LOG_ERR("Failed network init (%d)", ret);
         return ret;
     }
+    BootSeq_watchL4(&boot, PH_L4_CONNECTED);
+    BootSeq_watchPing(&boot, PH_FIRST_PING);
 
-
-    return ret;
+    return BootSeq_start(&boot);
 }
 
 int main(void)
@@ -152,13 +219,6 @@ int main(void)
 
     init_app();
 
-    LOG_DBG("Waiting on connection sem.");
-
-    /* Wait for the connection. */
-    k_sem_take(&run_app, K_FOREVER);
-    LOG_DBG("Got connection sem.");
-
-
     while (1)
     {
         k_msleep(1000);
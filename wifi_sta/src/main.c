@@ -9,7 +9,11 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/gpio.h>
 
+#if CONFIG_WIFIFAST
+#include "WifiFast.h"
+#else
 #include "WifiConnect.h"
+#endif
 #include "NvParms.h"
 
 /** @brief Initialize the logging module. */
@@ -91,6 +95,24 @@ static void thread_entry(void *arg0, void *arg1, void *arg2)
 #define LED_UP_PERIOD_MS    200
 #define LED_DN_PERIOD_MS    1000
 
+#if CONFIG_WIFIFAST
+static WifiFast_Listener wifi_listener;
+
+/** @brief Log link changes as they happen. */
+static void
+on_wifi_state(const WifiFast_Event *ev, void *user_data)
+{
+    static const char *const names[] = {
+        "idle", "scanning", "associated", "connected", "lost"
+    };
+
+    ARG_UNUSED(user_data);
+
+    LOG_INF("wifi %s -> %s at %u ms (rssi %d)", names[ev->prev], names[ev->state],
+        (uint32_t)ev->uptime_ms, ev->rssi);
+}
+#endif
+
 static int
 init_wifi(void)
 {
@@ -115,9 +137,18 @@ init_wifi(void)
     LOG_DBG("ssid=%s", ssid);
     LOG_DBG("password length=%d", pass_len);
 
+#if CONFIG_WIFIFAST
+    ret = WifiFast_init();
+    if (ret < 0)
+    {
+        return ret;
+    }
+    return WifiFast_connect(ssid, pass);
+#else
     WifiConnect_init();
     WifiConnect_connect(ssid, pass);
     return 0;
+#endif
 }
 
 int main(void)
@@ -145,8 +176,32 @@ int main(void)
         return 0;
     }
 
+#if CONFIG_WIFIFAST
+    WifiFast_subscribe(&wifi_listener, on_wifi_state, NULL);
+#endif
+
     init_wifi();
 
+#if CONFIG_WIFIFAST
+    struct k_poll_event link_event = K_POLL_EVENT_INITIALIZER(
+        K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, WifiFast_getSignal());
+
+    while (1)
+    {
+        int state = WifiFast_isConnected();
+
+        k_event_set(&event_flags, FLAG_LED_TOGGLE);
+
+        /* Blink at the rate for the current state. A link change cuts the
+           period short, so the LED follows it at once. */
+        if (k_poll(&link_event, 1,
+                K_MSEC(state ? LED_UP_PERIOD_MS : LED_DN_PERIOD_MS)) == 0)
+        {
+            k_poll_signal_reset(link_event.signal);
+            link_event.state = K_POLL_STATE_NOT_READY;
+        }
+    }
+#else
     while (1)
     {
         int state;
@@ -158,6 +213,7 @@ int main(void)
         sleep = (state) ? LED_UP_PERIOD_MS : LED_DN_PERIOD_MS;
         k_msleep(sleep);
     }
+#endif
 
     return 0;
 }